@@ -17,6 +17,7 @@ import collections,datetime,math,multiprocessing,os,random,sys,traceback
 import numpy,pandas
 import _fasttrips
 
+from .Coordinator import Coordinator
 from .Logger      import FastTripsLogger, setupLogging
 from .Passenger   import Passenger
 from .Path        import Path
@@ -97,9 +98,52 @@ class Assignment:
     #: (not necessarily unique) to define a path choice set?  Int.
     STOCH_PATHSET_SIZE              = None
 
+    #: Route choice configuration: How many threads should generate the stochastic paths
+    #: for a single path finding query?  The paths are the same for any number of threads.
+    #: Tracing uses one thread.  Int.
+    STOCH_PATHSET_THREADS           = None
+
     #: Route choice configuration: Use vehicle capacity constraints. Boolean.
     CAPACITY_CONSTRAINT             = None
 
+    #: Deterministic path finding configuration: Goal direction.  Labeling is ordered
+    #: by cost plus a lower bound on the remaining cost to the end TAZ, precomputed
+    #: when the network supply is loaded.  One of
+    #: :py:attr:`Assignment.GOAL_DIRECTION_NONE`, :py:attr:`Assignment.GOAL_DIRECTION_TAZ`
+    #: (bounds to/from every TAZ; memory grows with TAZs times stops) or
+    #: :py:attr:`Assignment.GOAL_DIRECTION_LANDMARKS` (bounds via a few landmark stops;
+    #: use this for large networks).  String.
+    GOAL_DIRECTION                  = None
+    GOAL_DIRECTION_NONE             = 'none'
+    GOAL_DIRECTION_TAZ              = 'taz'
+    GOAL_DIRECTION_LANDMARKS        = 'landmarks'
+
+    #: Deterministic path finding configuration: Number of landmarks to use for
+    #: :py:attr:`Assignment.GOAL_DIRECTION_LANDMARKS`.  Memory grows with landmarks times stops.  Int.
+    GOAL_DIRECTION_LANDMARKS_NUM    = None
+
+    #: Debug configuration: Write every path specification sent to the C++ extension, along with
+    #: the parameters and stop times, to ft_capture_* files in the output directory so the
+    #: path finding can be replayed with the ft_replay benchmark (see ``setup.py build_replay``).
+    #: Boolean.
+    CAPTURE_PATH_SPECIFICATIONS     = None
+
+    #: Performance configuration: Keep the network supply the C++ extension builds in
+    #: :py:attr:`Assignment.SUPPLY_SNAPSHOT_FILE` in the output directory, and have later runs
+    #: and worker processes read it from there rather than building it again.  The snapshot is
+    #: rebuilt when the ft_intermediate files, stop times or goal direction change.  Boolean.
+    SUPPLY_SNAPSHOT                 = None
+
+    #: Performance configuration: Keep the transit vehicle schedules in the C++ extension as
+    #: whole seconds, 16-bit offsets from each trip's first arrival, rather than as doubles.
+    #: This takes about a quarter of the memory per stop time, for feeds with many stop times,
+    #: and gives the same paths.  If a stop time isn't a whole second or a trip's times are out
+    #: of order or span more than 18 hours, the usual layout is used.  Boolean.
+    COMPACT_SCHEDULE                = None
+
+    #: See :py:attr:`Assignment.SUPPLY_SNAPSHOT`
+    SUPPLY_SNAPSHOT_FILE            = "ft_supply_snapshot.bin"
+
     #: Use this as the date
     TODAY                           = datetime.date.today()
 
@@ -119,6 +163,45 @@ class Assignment:
     #: Set to positive integer greater than 1 to set a fixed number of processes
     NUMBER_OF_PROCESSES             = None
 
+    #: Number of threads the C++ extension uses to find the paths when path finding runs
+    #: in this process (:py:attr:`Assignment.NUMBER_OF_PROCESSES` is 1).  The paths are found
+    #: in one call for the whole trip list rather than one call per path.
+    #: Set to less than 1 to use the result of :py:func:`multiprocessing.cpu_count`
+    NUMBER_OF_THREADS               = None
+
+    #: When finding the paths in this process, find the ones that start labeling from the same TAZ,
+    #: in the same direction, time window and user class one after another so the network data they
+    #: use stays in cache.  The paths don't depend on the order.  Boolean.
+    GROUP_PATHS_BY_LOCALITY         = None
+
+    #: When finding the paths in this process, the extension finds them on a background thread
+    #: and hands them back this many at a time, so the paths found so far are put into the
+    #: passengers' paths while it finds the rest.  Set to less than 1 to get them all at once.  Int.
+    PATH_CHUNK_SIZE                 = None
+
+    #: Find the paths with workers that connect to this address, on this machine or others,
+    #: rather than in this process.  ``host:port`` for TCP (``0.0.0.0:port`` to take workers from
+    #: other machines), or a Unix socket path.  Workers on other machines are started with
+    #: ``scripts/run_worker.py``.  See :py:class:`Coordinator`.  None to not use workers.
+    COORDINATOR_ADDRESS             = None
+
+    #: Coordinator configuration: Authentication key the workers have to know.  String.
+    COORDINATOR_AUTHKEY             = None
+
+    #: Coordinator configuration: Number of workers the coordinator starts on this machine.  Int.
+    COORDINATOR_LOCAL_WORKERS       = None
+
+    #: Coordinator configuration: Number of paths handed to a worker at a time.  Int.
+    COORDINATOR_BATCH_SIZE          = None
+
+    #: Coordinator configuration: Seconds a worker has to return a batch before it's given up on
+    #: and the batch is handed to another worker.  Int.
+    COORDINATOR_BATCH_TIMEOUT       = None
+
+    #: The :py:class:`Coordinator`, once path finding has started, if there's a
+    #: :py:attr:`Assignment.COORDINATOR_ADDRESS`
+    coordinator                     = None
+
     #: Extra time so passengers don't get bumped (?). A :py:class:`datetime.timedelta` instance.
     BUMP_BUFFER                     = None
 
@@ -149,6 +232,9 @@ class Assignment:
     #: assignment results - Passenger table
     PASSENGERS_CSV                  = r"passengers_df_iter%d.csv"
 
+    #: TAZ to TAZ skims from :py:meth:`Assignment.generate_skims`
+    SKIMS_FILE                      = r"ft_skims.npz"
+
     #: Column names for simulation
     SIM_COL_PAX_BOARD_TIME              = 'board_time'
     SIM_COL_PAX_ALIGHT_TIME             = 'alight_time'
@@ -189,13 +275,27 @@ class Assignment:
                       'stochastic_dispersion'           :1.0,
                       'stochastic_max_stop_process_count':-1,
                       'stochastic_pathset_size'         :1000,
+                      'stochastic_pathset_threads'      :1,
                       'capacity_constraint'             :False,
                       'trace_person_ids'                :'None',
                       'debug_trace_only'                :'False',
                       'prepend_route_id_to_trip_id'     :'False',
                       'number_of_processes'             :0,
+                      'number_of_threads'               :1,
+                      'group_paths_by_locality'         :False,
+                      'path_chunk_size'                 :1000,
+                      'coordinator_address'             :'None',
+                      'coordinator_authkey'             :'fasttrips',
+                      'coordinator_local_workers'       :0,
+                      'coordinator_batch_size'          :1000,
+                      'coordinator_batch_timeout'       :600,
                       'bump_buffer'                     :5,
                       'bump_one_at_a_time'              :True,
+                      'goal_direction'                  :Assignment.GOAL_DIRECTION_NONE,
+                      'goal_direction_landmarks'        :16,
+                      'capture_path_specifications'     :False,
+                      'supply_snapshot'                 :False,
+                      'compact_schedule'                :False,
                       # pathfinding
                       'user_class_function'             :'generic_user_class'
                      })
@@ -219,15 +319,33 @@ class Assignment:
                                                    parser.get       ('fasttrips','skim_end_time'),'%H:%M')
         Assignment.STOCH_DISPERSION              = parser.getfloat  ('fasttrips','stochastic_dispersion')
         Assignment.STOCH_PATHSET_SIZE            = parser.getint    ('fasttrips','stochastic_pathset_size')
+        Assignment.STOCH_PATHSET_THREADS         = parser.getint    ('fasttrips','stochastic_pathset_threads')
         Assignment.STOCH_MAX_STOP_PROCESS_COUNT  = parser.getint    ('fasttrips','stochastic_max_stop_process_count')
         Assignment.CAPACITY_CONSTRAINT           = parser.getboolean('fasttrips','capacity_constraint')
         Assignment.TRACE_PERSON_IDS         = eval(parser.get       ('fasttrips','trace_person_ids'))
         Assignment.DEBUG_TRACE_ONLY              = parser.getboolean('fasttrips','debug_trace_only')
         Assignment.PREPEND_ROUTE_ID_TO_TRIP_ID   = parser.getboolean('fasttrips','prepend_route_id_to_trip_id')
         Assignment.NUMBER_OF_PROCESSES           = parser.getint    ('fasttrips','number_of_processes')
+        Assignment.NUMBER_OF_THREADS             = parser.getint    ('fasttrips','number_of_threads')
+        Assignment.GROUP_PATHS_BY_LOCALITY       = parser.getboolean('fasttrips','group_paths_by_locality')
+        Assignment.PATH_CHUNK_SIZE               = parser.getint    ('fasttrips','path_chunk_size')
+        Assignment.COORDINATOR_ADDRESS           = parser.get       ('fasttrips','coordinator_address')
+        if Assignment.COORDINATOR_ADDRESS == 'None': Assignment.COORDINATOR_ADDRESS = None
+        Assignment.COORDINATOR_AUTHKEY           = parser.get       ('fasttrips','coordinator_authkey')
+        Assignment.COORDINATOR_LOCAL_WORKERS     = parser.getint    ('fasttrips','coordinator_local_workers')
+        Assignment.COORDINATOR_BATCH_SIZE        = parser.getint    ('fasttrips','coordinator_batch_size')
+        Assignment.COORDINATOR_BATCH_TIMEOUT     = parser.getint    ('fasttrips','coordinator_batch_timeout')
         Assignment.BUMP_BUFFER = datetime.timedelta(
                                          minutes = parser.getfloat  ('fasttrips','bump_buffer'))
         Assignment.BUMP_ONE_AT_A_TIME            = parser.getboolean('fasttrips','bump_one_at_a_time')
+        Assignment.GOAL_DIRECTION                = parser.get       ('fasttrips','goal_direction')
+        assert(Assignment.GOAL_DIRECTION in [Assignment.GOAL_DIRECTION_NONE, \
+                                             Assignment.GOAL_DIRECTION_TAZ, \
+                                             Assignment.GOAL_DIRECTION_LANDMARKS])
+        Assignment.GOAL_DIRECTION_LANDMARKS_NUM  = parser.getint    ('fasttrips','goal_direction_landmarks')
+        Assignment.CAPTURE_PATH_SPECIFICATIONS   = parser.getboolean('fasttrips','capture_path_specifications')
+        Assignment.SUPPLY_SNAPSHOT               = parser.getboolean('fasttrips','supply_snapshot')
+        Assignment.COMPACT_SCHEDULE              = parser.getboolean('fasttrips','compact_schedule')
 
         # pathfinding
         Path.USER_CLASS_FUNCTION                 = parser.get     ('pathfinding','user_class_function')
@@ -262,13 +380,26 @@ class Assignment:
         parser.set('fasttrips','stochastic_dispersion',         '%f' % Assignment.STOCH_DISPERSION)
         parser.set('fasttrips','stochastic_max_stop_process_count', '%d' % Assignment.STOCH_MAX_STOP_PROCESS_COUNT)
         parser.set('fasttrips','stochastic_pathset_size',       '%d' % Assignment.STOCH_PATHSET_SIZE)
+        parser.set('fasttrips','stochastic_pathset_threads',    '%d' % Assignment.STOCH_PATHSET_THREADS)
         parser.set('fasttrips','capacity_constraint',           'True' if Assignment.CAPACITY_CONSTRAINT else 'False')
         parser.set('fasttrips','trace_person_ids',              '%s' % str(Assignment.TRACE_PERSON_IDS))
         parser.set('fasttrips','debug_trace_only',              'True' if Assignment.DEBUG_TRACE_ONLY else 'False')
         parser.set('fasttrips','prepend_route_id_to_trip_id',   'True' if Assignment.PREPEND_ROUTE_ID_TO_TRIP_ID else 'False')
         parser.set('fasttrips','number_of_processes',           '%d' % Assignment.NUMBER_OF_PROCESSES)
+        parser.set('fasttrips','number_of_threads',             '%d' % Assignment.NUMBER_OF_THREADS)
+        parser.set('fasttrips','group_paths_by_locality',       'True' if Assignment.GROUP_PATHS_BY_LOCALITY else 'False')
+        parser.set('fasttrips','path_chunk_size',               '%d' % Assignment.PATH_CHUNK_SIZE)
+        parser.set('fasttrips','coordinator_address',           '%s' % str(Assignment.COORDINATOR_ADDRESS))
+        parser.set('fasttrips','coordinator_local_workers',     '%d' % Assignment.COORDINATOR_LOCAL_WORKERS)
+        parser.set('fasttrips','coordinator_batch_size',        '%d' % Assignment.COORDINATOR_BATCH_SIZE)
+        parser.set('fasttrips','coordinator_batch_timeout',     '%d' % Assignment.COORDINATOR_BATCH_TIMEOUT)
         parser.set('fasttrips','bump_buffer',                   '%f' % (Assignment.BUMP_BUFFER.total_seconds()/60.0))
         parser.set('fasttrips','bump_one_at_a_time',            'True' if Assignment.BUMP_ONE_AT_A_TIME else 'False')
+        parser.set('fasttrips','goal_direction',                Assignment.GOAL_DIRECTION)
+        parser.set('fasttrips','goal_direction_landmarks',      '%d' % Assignment.GOAL_DIRECTION_LANDMARKS_NUM)
+        parser.set('fasttrips','capture_path_specifications',   'True' if Assignment.CAPTURE_PATH_SPECIFICATIONS else 'False')
+        parser.set('fasttrips','supply_snapshot',               'True' if Assignment.SUPPLY_SNAPSHOT else 'False')
+        parser.set('fasttrips','compact_schedule',              'True' if Assignment.COMPACT_SCHEDULE else 'False')
 
         #pathfinding
         parser.add_section('pathfinding')
@@ -285,28 +416,103 @@ class Assignment:
         """
         FastTripsLogger.debug("Initializing fasttrips extension for process number %d" % process_number)
 
-        _fasttrips.initialize_supply(output_dir, process_number,
-                                     FT.trips.stop_times_df[[Trip.STOPTIMES_COLUMN_TRIP_ID_NUM,
-                                                             Trip.STOPTIMES_COLUMN_STOP_SEQUENCE,
-                                                             Trip.STOPTIMES_COLUMN_STOP_ID_NUM]].as_matrix().astype('int32'),
-                                     FT.trips.stop_times_df[[Trip.STOPTIMES_COLUMN_ARRIVAL_TIME_MIN,
-                                                             Trip.STOPTIMES_COLUMN_DEPARTURE_TIME_MIN]].as_matrix().astype('float64'))
-
+        # parameters first since the goal direction bounds are built with the supply
         _fasttrips.initialize_parameters(Assignment.TIME_WINDOW.total_seconds()/60.0,
                                          Assignment.BUMP_BUFFER.total_seconds()/60.0,
                                          Assignment.STOCH_PATHSET_SIZE,
+                                         Assignment.STOCH_PATHSET_THREADS,
                                          Assignment.STOCH_DISPERSION,
-                                         Assignment.STOCH_MAX_STOP_PROCESS_COUNT)
+                                         Assignment.STOCH_MAX_STOP_PROCESS_COUNT,
+                                         Assignment.GOAL_DIRECTION,
+                                         Assignment.GOAL_DIRECTION_LANDMARKS_NUM,
+                                         1 if Assignment.CAPTURE_PATH_SPECIFICATIONS else 0,
+                                         1 if Assignment.COMPACT_SCHEDULE else 0)
+
+        stoptime_index = FT.trips.stop_times_df[[Trip.STOPTIMES_COLUMN_TRIP_ID_NUM,
+                                                 Trip.STOPTIMES_COLUMN_STOP_SEQUENCE,
+                                                 Trip.STOPTIMES_COLUMN_STOP_ID_NUM]].as_matrix().astype('int32')
+        stoptime_times = FT.trips.stop_times_df[[Trip.STOPTIMES_COLUMN_ARRIVAL_TIME_MIN,
+                                                 Trip.STOPTIMES_COLUMN_DEPARTURE_TIME_MIN]].as_matrix().astype('float64')
+
+        if Assignment.SUPPLY_SNAPSHOT:
+            snapshot_file = os.path.join(output_dir, Assignment.SUPPLY_SNAPSHOT_FILE)
+            if _fasttrips.load_snapshot(snapshot_file, output_dir, process_number, stoptime_index, stoptime_times):
+                FastTripsLogger.debug("Read network supply snapshot %s" % snapshot_file)
+                return
+
+        _fasttrips.initialize_supply(output_dir, process_number, stoptime_index, stoptime_times)
+
+        # the first process to build it keeps it for the others
+        if Assignment.SUPPLY_SNAPSHOT and process_number <= 1:
+            _fasttrips.save_snapshot(snapshot_file)
+            FastTripsLogger.info("Wrote network supply snapshot %s" % snapshot_file)
+
+    @staticmethod
+    def generate_skims(FT, output_dir, origin_taz_ids, destination_taz_ids, preferred_time_min,
+                       user_class, access_mode, transit_mode, egress_mode):
+        """
+        Finds TAZ to TAZ skims in the C++ extension, which labels the network once from each origin
+        (on :py:meth:`Assignment.number_of_threads` threads) and reads the deterministic path to every
+        destination from those labels, rather than finding a path per origin and destination.
+
+        Returns a dictionary of origin by destination :py:class:`numpy.ndarray` matrices: ``cost``,
+        ``in_vehicle_time_min`` and ``wait_time_min`` (nan if there's no path) and ``transfers``
+        (-1 if there's no path), along with the ``origin`` and ``destination`` TAZ IDs.  These are
+        also written to :py:attr:`Assignment.SKIMS_FILE` in *output_dir*.
+
+        :param FT:                  fasttrips data
+        :type  FT:                  a :py:class:`FastTrips` instance
+        :param output_dir:          the directory with the intermediate files, for the skims file
+        :type  output_dir:          string
+        :param origin_taz_ids:      the origin TAZ IDs
+        :type  origin_taz_ids:      list of string
+        :param destination_taz_ids: the destination TAZ IDs
+        :type  destination_taz_ids: list of string
+        :param preferred_time_min:  the departure time from the origins, minutes after midnight
+        :type  preferred_time_min:  float
+        """
+        Assignment.initialize_fasttrips_extension(0, output_dir, FT)
+
+        taz_nums = {}
+        for (name, taz_ids) in [("origin", origin_taz_ids), ("destination", destination_taz_ids)]:
+            taz_df = FT.stops.add_numeric_stop_id(pandas.DataFrame({TAZ.WALK_ACCESS_COLUMN_TAZ:list(taz_ids)}),
+                                                  id_colname=TAZ.WALK_ACCESS_COLUMN_TAZ,
+                                                  numeric_newcolname=Stop.STOPS_COLUMN_STOP_ID_NUM)
+            taz_nums[name] = taz_df[Stop.STOPS_COLUMN_STOP_ID_NUM].values.astype('int32')
+
+        FastTripsLogger.info("Finding skims for %d origins and %d destinations" % (len(origin_taz_ids), len(destination_taz_ids)))
+        (cost, ivt, wait, transfers) = _fasttrips.find_skims(user_class, access_mode, transit_mode, egress_mode,
+                                                              preferred_time_min, taz_nums["origin"], taz_nums["destination"],
+                                                              Assignment.number_of_threads())
+        skims = { "origin"              : numpy.array(origin_taz_ids),
+                  "destination"         : numpy.array(destination_taz_ids),
+                  "cost"                : cost,
+                  "in_vehicle_time_min" : ivt,
+                  "wait_time_min"       : wait,
+                  "transfers"           : transfers }
+        skims_file = os.path.join(output_dir, Assignment.SKIMS_FILE)
+        numpy.savez(skims_file, **skims)
+        FastTripsLogger.info("Wrote %s" % skims_file)
+        return skims
+
+    @staticmethod
+    def bump_wait_arrays(bump_wait_df):
+        """
+        Returns the (index, times) arrays of the bump wait information for the fasttrips extension.
+        """
+        return (bump_wait_df[[Trip.STOPTIMES_COLUMN_TRIP_ID_NUM,
+                              Trip.STOPTIMES_COLUMN_STOP_SEQUENCE,
+                              Trip.STOPTIMES_COLUMN_STOP_ID_NUM]].as_matrix().astype('int32'),
+                bump_wait_df[Assignment.SIM_COL_PAX_ARRIVE_TIME_MIN].values.astype('float64'))
 
     @staticmethod
     def set_fasttrips_bump_wait(bump_wait_df):
         """
-        Sends the bump wait information to the fasttrips extension
+        Sends the bump wait information to the fasttrips extension.  This only adds to (or updates)
+        the bump waits the extension already has, so it's fine to send just the new ones.
         """
-        _fasttrips.set_bump_wait(bump_wait_df[[Trip.STOPTIMES_COLUMN_TRIP_ID_NUM,
-                                               Trip.STOPTIMES_COLUMN_STOP_SEQUENCE,
-                                               Trip.STOPTIMES_COLUMN_STOP_ID_NUM]].as_matrix().astype('int32'),
-                                 bump_wait_df[Assignment.SIM_COL_PAX_ARRIVE_TIME_MIN].values.astype('float64'))
+        (bw_index, bw_times) = Assignment.bump_wait_arrays(bump_wait_df)
+        _fasttrips.set_bump_wait(bw_index, bw_times)
 
 
     @staticmethod
@@ -316,47 +522,54 @@ class Assignment:
         """
         Assignment.write_configuration(output_dir)
 
-        Assignment.bump_wait = {}
-        for iteration in range(1,Assignment.ITERATION_FLAG+1):
-            FastTripsLogger.info("***************************** ITERATION %d **************************************" % iteration)
+        try:
+            Assignment.bump_wait = {}
+            for iteration in range(1,Assignment.ITERATION_FLAG+1):
+                FastTripsLogger.info("***************************** ITERATION %d **************************************" % iteration)
 
-            if Assignment.ASSIGNMENT_TYPE == Assignment.ASSIGNMENT_TYPE_SIM_ONLY and \
-               os.path.exists(os.path.join(output_dir, Assignment.PASSENGERS_CSV % iteration)):
-                FastTripsLogger.info("Simulation only")
-                (num_paths_found, passengers_df) = Assignment.read_assignment_results(output_dir, iteration)
+                if Assignment.ASSIGNMENT_TYPE == Assignment.ASSIGNMENT_TYPE_SIM_ONLY and \
+                   os.path.exists(os.path.join(output_dir, Assignment.PASSENGERS_CSV % iteration)):
+                    FastTripsLogger.info("Simulation only")
+                    (num_paths_found, passengers_df) = Assignment.read_assignment_results(output_dir, iteration)
 
-            else:
-                num_paths_found    = Assignment.generate_paths(FT, output_dir, iteration)
-                passengers_df      = Assignment.setup_passengers(FT, output_dir, iteration)
+                else:
+                    num_paths_found    = Assignment.generate_paths(FT, output_dir, iteration)
+                    passengers_df      = Assignment.setup_passengers(FT, output_dir, iteration)
+
+                veh_trips_df       = Assignment.setup_trips(FT)
 
-            veh_trips_df       = Assignment.setup_trips(FT)
+                if Assignment.OUTPUT_PASSENGER_TRAJECTORIES:
+                    Path.write_paths(passengers_df, output_dir)
 
-            if Assignment.OUTPUT_PASSENGER_TRAJECTORIES:
-                Path.write_paths(passengers_df, output_dir)
+                if Assignment.SIMULATION_FLAG == True:
+                    FastTripsLogger.info("****************************** SIMULATING *****************************")
+                    (num_passengers_arrived,veh_trips_df,pax_exp_df) = Assignment.simulate(FT, passengers_df, veh_trips_df)
 
-            if Assignment.SIMULATION_FLAG == True:
-                FastTripsLogger.info("****************************** SIMULATING *****************************")
-                (num_passengers_arrived,veh_trips_df,pax_exp_df) = Assignment.simulate(FT, passengers_df, veh_trips_df)
+                if Assignment.OUTPUT_PASSENGER_TRAJECTORIES:
+                    Path.write_path_times(pax_exp_df, output_dir)
 
-            if Assignment.OUTPUT_PASSENGER_TRAJECTORIES:
-                Path.write_path_times(pax_exp_df, output_dir)
+                # capacity gap stuff
+                num_bumped_passengers = num_paths_found - num_passengers_arrived
+                capacity_gap = 100.0*num_bumped_passengers/num_paths_found
 
-            # capacity gap stuff
-            num_bumped_passengers = num_paths_found - num_passengers_arrived
-            capacity_gap = 100.0*num_bumped_passengers/num_paths_found
+                FastTripsLogger.info("")
+                FastTripsLogger.info("  TOTAL ASSIGNED PASSENGERS: %10d" % num_paths_found)
+                FastTripsLogger.info("  ARRIVED PASSENGERS:        %10d" % num_passengers_arrived)
+                FastTripsLogger.info("  MISSED PASSENGERS:         %10d" % num_bumped_passengers)
+                FastTripsLogger.info("  CAPACITY GAP:              %10.5f" % capacity_gap)
 
-            FastTripsLogger.info("")
-            FastTripsLogger.info("  TOTAL ASSIGNED PASSENGERS: %10d" % num_paths_found)
-            FastTripsLogger.info("  ARRIVED PASSENGERS:        %10d" % num_passengers_arrived)
-            FastTripsLogger.info("  MISSED PASSENGERS:         %10d" % num_bumped_passengers)
-            FastTripsLogger.info("  CAPACITY GAP:              %10.5f" % capacity_gap)
+                if capacity_gap < 0.001 or Assignment.ASSIGNMENT_TYPE == Assignment.ASSIGNMENT_TYPE_STO_ASGN:
+                    break
 
-            if capacity_gap < 0.001 or Assignment.ASSIGNMENT_TYPE == Assignment.ASSIGNMENT_TYPE_STO_ASGN:
-                break
+            # end for loop
+            FastTripsLogger.info("**************************** WRITING OUTPUTS ****************************")
+            Assignment.print_load_profile(FT, veh_trips_df, output_dir)
 
-        # end for loop
-        FastTripsLogger.info("**************************** WRITING OUTPUTS ****************************")
-        Assignment.print_load_profile(FT, veh_trips_df, output_dir)
+        finally:
+            # the workers wait for it, so close it even if something went wrong
+            if Assignment.coordinator:
+                Assignment.coordinator.close()
+                Assignment.coordinator = None
 
     @staticmethod
     def generate_paths(FT, output_dir, iteration):
@@ -388,6 +601,9 @@ class Assignment:
             num_processes   = multiprocessing.cpu_count()
         if num_processes > est_paths_to_find:
             num_processes = est_paths_to_find
+        # the coordinator's workers do the path finding
+        if Assignment.COORDINATOR_ADDRESS:
+            num_processes = 1
 
         # this is probalby time consuming... put in a try block
         try:
@@ -403,60 +619,83 @@ class Assignment:
                                                                       Assignment.ASSIGNMENT_TYPE==Assignment.ASSIGNMENT_TYPE_STO_ASGN,
                                                                       Assignment.bump_wait_df)))
                     process_list[-1].start()
-            else:
+            elif not Assignment.COORDINATOR_ADDRESS:
                 Assignment.initialize_fasttrips_extension(0, output_dir, FT)
+                if type(Assignment.bump_wait_df) == pandas.DataFrame and len(Assignment.bump_wait_df) > 0:
+                    Assignment.set_fasttrips_bump_wait(Assignment.bump_wait_df)
 
             # process tasks or send tasks to workers for processing
             num_paths_found_prev  = 0
             num_paths_found_now   = 0
-            path_cols             = list(FT.passengers.trip_list_df.columns.values)
-            for path_tuple in FT.passengers.trip_list_df.itertuples(index=False):
-                path_dict         = dict(zip(path_cols, path_tuple))
-                trip_list_id      = path_dict[Passenger.TRIP_LIST_COLUMN_TRIP_LIST_ID_NUM]
-                person_id         = path_dict[Passenger.TRIP_LIST_COLUMN_PERSON_ID]
-                trace_person      = person_id in Assignment.TRACE_PERSON_IDS
-
-                if Assignment.DEBUG_TRACE_ONLY and not trace_person: continue
-
-                # first iteration -- create path objects
-                if iteration==1:
-                    trip_path = Path(path_dict)
-                    FT.passengers.add_path(trip_list_id, trip_path)
-                else:
-                    trip_path = FT.passengers.get_path(trip_list_id)
+            trip_list_df          = FT.passengers.trip_list_df
+            if Assignment.DEBUG_TRACE_ONLY:
+                trip_list_df      = trip_list_df.loc[trip_list_df[Passenger.TRIP_LIST_COLUMN_PERSON_ID].isin(Assignment.TRACE_PERSON_IDS)]
+
+            # first iteration -- create path objects.  A Path takes its whole trip list row, so this is per row.
+            if iteration==1:
+                path_cols         = list(trip_list_df.columns.values)
+                for path_tuple in trip_list_df.itertuples(index=False):
+                    path_dict     = dict(zip(path_cols, path_tuple))
+                    FT.passengers.add_path(path_dict[Passenger.TRIP_LIST_COLUMN_TRIP_LIST_ID_NUM], Path(path_dict))
+
+            # the ones that go somewhere (see Path.goes_somewhere), and after the first iteration, were bumped
+            trip_list_df          = trip_list_df.loc[trip_list_df[Passenger.TRIP_LIST_COLUMN_ORIGIN_TAZ_ID] !=
+                                                     trip_list_df[Passenger.TRIP_LIST_COLUMN_DESTINATION_TAZ_ID]]
+            if iteration > 1:
+                bumped            = trip_list_df[Passenger.TRIP_LIST_COLUMN_TRIP_LIST_ID_NUM].isin(list(Assignment.bumped_trip_list_nums))
+                num_paths_found_prev = int((~bumped).sum())
+                trip_list_df      = trip_list_df.loc[bumped]
 
-                if not trip_path.goes_somewhere(): continue
+            if num_processes <= 1:
+                for person_id in trip_list_df.loc[trip_list_df[Passenger.TRIP_LIST_COLUMN_PERSON_ID].isin(Assignment.TRACE_PERSON_IDS),
+                                                  Passenger.TRIP_LIST_COLUMN_PERSON_ID]:
+                    FastTripsLogger.debug("Tracing assignment of person_id %s" % str(person_id))
+            batch_trip_list_ids   = trip_list_df[Passenger.TRIP_LIST_COLUMN_TRIP_LIST_ID_NUM].tolist()
 
-                if iteration > 1 and trip_list_id not in Assignment.bumped_trip_list_nums:
-                    num_paths_found_prev += 1
-                    continue
+            # how long each took last time (or -1), so the longest can go first
+            cost_estimates = FT.performance.cost_estimates(batch_trip_list_ids)
 
-                if num_processes > 1:
-                    todo_queue.put( trip_path )
+            if num_processes > 1:
+                # stable, so the ones without estimates stay in trip list order, at the end
+                for index in numpy.argsort(-cost_estimates, kind='mergesort'):
+                    todo_queue.put( FT.passengers.get_path(batch_trip_list_ids[index]) )
+
+            # single process: find them all in one go, putting each chunk into the paths as it comes
+            if num_processes <= 1 and len(batch_trip_list_ids) > 0:
+                if Assignment.COORDINATOR_ADDRESS:
+                    FastTripsLogger.info("Finding %d passenger paths with workers" % len(batch_trip_list_ids))
+                    path_chunks = [Assignment.find_trip_based_paths_with_workers(iteration, FT, output_dir, batch_trip_list_ids, cost_estimates,
+                                                                                 Assignment.ASSIGNMENT_TYPE==Assignment.ASSIGNMENT_TYPE_STO_ASGN)]
                 else:
-                    if trace_person:
-                        FastTripsLogger.debug("Tracing assignment of person_id %s" % str(person_id))
-
-                    # do the work
-                    (cost, return_states, perf_dict) = \
-                        Assignment.find_trip_based_path(iteration, FT, trip_path,
-                                                        Assignment.ASSIGNMENT_TYPE==Assignment.ASSIGNMENT_TYPE_STO_ASGN,
-                                                        trace=trace_person)
-                    trip_path.states = return_states
-                    trip_path.cost   = cost
-                    FT.performance.add_info(iteration, trip_list_id, perf_dict)
-
-                    if trip_path.path_found():
-                        num_paths_found_now += 1
-
-                    if num_paths_found_now % info_freq == 0:
+                    num_threads = Assignment.number_of_threads()
+                    FastTripsLogger.info("Finding %d passenger paths on %d thread%s" %
+                                         (len(batch_trip_list_ids), num_threads, "" if num_threads == 1 else "s"))
+                    path_chunks = Assignment.find_trip_based_paths_in_chunks(iteration, FT, batch_trip_list_ids, cost_estimates,
+                                                                             Assignment.ASSIGNMENT_TYPE==Assignment.ASSIGNMENT_TYPE_STO_ASGN,
+                                                                             num_threads, Assignment.PATH_CHUNK_SIZE)
+
+                num_paths_done = 0
+                for path_results in path_chunks:
+                    for (trip_list_id, cost, return_states) in path_results:
+                        trip_path        = FT.passengers.get_path(trip_list_id)
+                        trip_path.states = return_states
+                        trip_path.cost   = cost
+
+                        if trip_path.path_found():
+                            num_paths_found_now += 1
+
+                    num_paths_done += len(path_results)
+                    if num_paths_done < len(batch_trip_list_ids):
                         time_elapsed = datetime.datetime.now() - start_time
-                        FastTripsLogger.info(" %6d / %6d passenger paths found.  Time elapsed: %2dh:%2dm:%2ds" % (
-                                             num_paths_found_now, est_paths_to_find,
+                        FastTripsLogger.info(" %6d / %6d passenger paths done.  Time elapsed: %2dh:%2dm:%2ds" % (
+                                             num_paths_done, len(batch_trip_list_ids),
                                              int( time_elapsed.total_seconds() / 3600),
                                              int( (time_elapsed.total_seconds() % 3600) / 60),
                                              time_elapsed.total_seconds() % 60))
 
+                if not Assignment.COORDINATOR_ADDRESS:
+                    Assignment.fetch_fasttrips_performance(FT)
+
             # multiprocessing follow-up
             if num_processes > 1:
                 # we're done, let each process know
@@ -472,14 +711,14 @@ class Assignment:
                         FastTripsLogger.debug("Received done")
                         done_procs += 1
 
+                    elif result[0] == 'performance':
+                        FT.performance.add_arrays(*result[1])
+
                     else:
                         trip_list_id    = result[0]
                         path            = FT.passengers.get_path(trip_list_id)
                         path.cost       = result[1]
                         path.states     = result[2]
-                        perf_dict       = result[3]
-
-                        FT.performance.add_info(iteration, trip_list_id, perf_dict)
 
                         if path.path_found():
                             num_paths_found_now += 1
@@ -531,15 +770,8 @@ class Assignment:
         Will do so either backwards (destination to origin) if :py:attr:`Path.direction` is :py:attr:`Path.DIR_OUTBOUND`
         or forwards (origin to destination) if :py:attr:`Path.direction` is :py:attr:`Path.DIR_INBOUND`.
 
-        Returns (path cost,
-                 return_states,
-                 performance_dict)
-
-        Where performance_dict includes:
-                 number of label iterations,
-                 max number of times a stop was processed,
-                 seconds spent in labeling,
-                 seconds spend in enumeration
+        Returns (path cost, return_states).  The extension records the performance info;
+        see :py:meth:`Assignment.fetch_fasttrips_performance`.
 
         :param iteration: The pathfinding iteration we're on
         :type  iteration: int
@@ -556,9 +788,7 @@ class Assignment:
         """
         # FastTripsLogger.debug("C++ extension start")
         # send it to the C++ extension
-        (ret_ints, ret_doubles, path_cost,
-         label_iterations, max_label_process_count,
-         seconds_labeling, seconds_enumerating) = \
+        find_results = \
             _fasttrips.find_path(iteration, path.person_id_num, path.trip_list_id_num, hyperpath,
                                  path.user_class, path.access_mode, path.transit_mode, path.egress_mode,
                                  path.o_taz_num, path.d_taz_num,
@@ -567,6 +797,237 @@ class Assignment:
         # FastTripsLogger.debug("C++ extension complete")
         # FastTripsLogger.debug("Finished finding path for person %s trip list id num %d" % (path.person_id, path.trip_list_id_num))
 
+        # the rest is the performance info, which the extension has recorded
+        (ret_ints, ret_doubles, path_cost) = find_results[:3]
+        return_states = Assignment.convert_states(ret_ints, ret_doubles, hyperpath)
+        return (path_cost, return_states)
+
+    @staticmethod
+    def find_trip_based_paths(iteration, FT, trip_list_id_nums, cost_estimates, hyperpath, num_threads):
+        """
+        Perform trip-based path search for a batch of paths in one call to the C++ extension,
+        which finds them on *num_threads* threads.  The path specifications are sent as columns
+        of the trip list rather than one call per path.  The extension starts with the most
+        expensive paths, per *cost_estimates* (or its own guess, where those are negative).
+
+        Returns a list of (trip list ID num, path cost, return_states), as :py:meth:`Assignment.find_trip_based_path`
+        does for each path.  The performance info goes to *FT*.performance.
+
+        :param iteration:         The pathfinding iteration we're on
+        :type  iteration:         int
+        :param FT:                fasttrips data
+        :type  FT:                a :py:class:`FastTrips` instance
+        :param trip_list_id_nums: the trip list ID nums of the paths to find
+        :type  trip_list_id_nums: list of int
+        :param cost_estimates:    per trip list ID num, how expensive the path is expected to be, or -1 if unknown.
+                                  See :py:meth:`Performance.cost_estimates`.
+        :type  cost_estimates:    :py:class:`numpy.ndarray` of float
+        :param hyperpath:         pass True to use a stochastic hyperpath-finding algorithm, otherwise a deterministic shortest path
+                                  search algorithm will be use.
+        :type  hyperpath:         boolean
+        :param num_threads:       the number of threads to find the paths on
+        :type  num_threads:       int
+
+        """
+        spec_columns = Assignment.path_spec_columns(FT, trip_list_id_nums, cost_estimates)
+        find_results = Assignment.find_paths_for_columns(iteration, hyperpath, spec_columns, num_threads)
+        FT.performance.add_arrays(*Assignment.performance_arrays(iteration, spec_columns, find_results))
+        return Assignment.convert_path_results(spec_columns, find_results, hyperpath)
+
+    @staticmethod
+    def find_trip_based_paths_in_chunks(iteration, FT, trip_list_id_nums, cost_estimates, hyperpath, num_threads, chunk_size):
+        """
+        Like :py:meth:`Assignment.find_trip_based_paths`, but the C++ extension finds the paths on a
+        background thread, without holding the GIL, and this is a generator of the results for
+        *chunk_size* paths at a time (all of them at once if *chunk_size* is less than 1).  Each chunk
+        is yielded as soon as it's found, so the caller's work on it overlaps the search for the rest.
+        The paths are submitted most expensive first, per *cost_estimates*.
+
+        The extension records the performance info; see :py:meth:`Assignment.fetch_fasttrips_performance`.
+        Its supply and bump waits can't be changed until the generator is exhausted or closed.
+        """
+        spec_columns = Assignment.path_spec_columns(FT, trip_list_id_nums, cost_estimates)
+        # stable, so the ones without estimates stay in trip list order, at the end
+        spec_columns = Assignment.slice_path_spec_columns(spec_columns,
+                                                          numpy.argsort(-spec_columns["cost_estimates"], kind='mergesort'))
+        mode_strings = spec_columns["mode_strings"]
+        handle = _fasttrips.submit_paths(iteration, 1 if hyperpath else 0,
+                                         spec_columns["path_specs"], spec_columns["pref_time"], spec_columns["cost_estimates"],
+                                         mode_strings[0], mode_strings[1], mode_strings[2], mode_strings[3], num_threads,
+                                         1 if Assignment.GROUP_PATHS_BY_LOCALITY else 0, chunk_size)
+        done = False
+        try:
+            while not done:
+                (done, found_chunks) = _fasttrips.wait_paths(handle)
+                for (first, find_results) in found_chunks:
+                    num_found     = len(find_results[3])
+                    batch_columns = Assignment.slice_path_spec_columns(spec_columns, slice(first, first+num_found))
+                    yield Assignment.convert_path_results(batch_columns, find_results, hyperpath)
+        finally:
+            # closed early, or an exception
+            if not done:
+                _fasttrips.cancel_paths(handle)
+
+    @staticmethod
+    def find_trip_based_paths_with_workers(iteration, FT, output_dir, trip_list_id_nums, cost_estimates, hyperpath):
+        """
+        Like :py:meth:`Assignment.find_trip_based_paths`, but the paths are found by the workers of the
+        :py:class:`Coordinator` at :py:attr:`Assignment.COORDINATOR_ADDRESS`, which is started on first use.
+        If the workers all drop out, the rest of the paths are found in this process.
+        """
+        if Assignment.coordinator is None:
+            Assignment.coordinator = Coordinator(Assignment.COORDINATOR_ADDRESS, Assignment.COORDINATOR_AUTHKEY,
+                                                 Assignment.COORDINATOR_LOCAL_WORKERS,
+                                                 FT.input_network_dir, FT.input_demand_dir, FT.output_dir,
+                                                 Assignment.COORDINATOR_BATCH_TIMEOUT)
+
+        bump_wait = None
+        if type(Assignment.bump_wait_df) == pandas.DataFrame and len(Assignment.bump_wait_df) > 0:
+            bump_wait = Assignment.bump_wait_arrays(Assignment.bump_wait_df)
+
+        spec_columns     = Assignment.path_spec_columns(FT, trip_list_id_nums, cost_estimates)
+        (found, unfound) = Assignment.coordinator.find_paths(iteration, hyperpath, bump_wait, spec_columns,
+                                                             Assignment.COORDINATOR_BATCH_SIZE)
+        results = []
+        for (batch_columns, find_results) in found:
+            FT.performance.add_arrays(*Assignment.performance_arrays(iteration, batch_columns, find_results))
+            results.extend(Assignment.convert_path_results(batch_columns, find_results, hyperpath))
+
+        if len(unfound) > 0:
+            FastTripsLogger.warning("Finding the paths for %d batches in this process" % len(unfound))
+            Assignment.initialize_fasttrips_extension(0, output_dir, FT)
+            if bump_wait is not None:
+                _fasttrips.set_bump_wait(bump_wait[0], bump_wait[1])
+            for batch_columns in unfound:
+                find_results = Assignment.find_paths_for_columns(iteration, hyperpath, batch_columns, Assignment.number_of_threads())
+                FT.performance.add_arrays(*Assignment.performance_arrays(iteration, batch_columns, find_results))
+                results.extend(Assignment.convert_path_results(batch_columns, find_results, hyperpath))
+        return results
+
+    @staticmethod
+    def number_of_threads():
+        """
+        Returns :py:attr:`Assignment.NUMBER_OF_THREADS`, or the number of CPUs if that's less than 1.
+        """
+        if Assignment.NUMBER_OF_THREADS < 1:
+            return multiprocessing.cpu_count()
+        return Assignment.NUMBER_OF_THREADS
+
+    @staticmethod
+    def path_spec_columns(FT, trip_list_id_nums, cost_estimates):
+        """
+        Puts the path specifications for the given trip list ID nums into the columns the C++ extension's
+        find_paths takes.  Returns a dictionary with
+
+        * ``path_specs``: int32 array with a row per path: person ID num, trip list ID num, user class code,
+          access mode code, transit mode code, egress mode code, origin TAZ num, destination TAZ num,
+          outbound, trace
+        * ``pref_time``: the preferred times, minutes after midnight
+        * ``cost_estimates``: see :py:meth:`Performance.cost_estimates`
+        * ``mode_strings``: lists of the user classes, access modes, transit modes and egress modes the codes stand for
+
+        These are all picklable, so they can be sent to other processes.
+        """
+        trip_list_df = FT.passengers.trip_list_df
+        batch_df     = trip_list_df.loc[trip_list_df[Passenger.TRIP_LIST_COLUMN_TRIP_LIST_ID_NUM].isin(trip_list_id_nums)]
+        batch_costs  = pandas.Series(cost_estimates, index=trip_list_id_nums).reindex(
+                           batch_df[Passenger.TRIP_LIST_COLUMN_TRIP_LIST_ID_NUM].values).fillna(-1.0).values
+
+        outbound     = (batch_df[Passenger.TRIP_LIST_COLUMN_TIME_TARGET] == "arrival").values
+        pref_time    = numpy.where(outbound, batch_df[Passenger.TRIP_LIST_COLUMN_ARRIVAL_TIME_MIN].values,
+                                             batch_df[Passenger.TRIP_LIST_COLUMN_DEPARTURE_TIME_MIN].values)
+        if Assignment.TRACE_PERSON_IDS:
+            trace    = batch_df[Passenger.TRIP_LIST_COLUMN_PERSON_ID].isin(Assignment.TRACE_PERSON_IDS).values
+        else:
+            trace    = numpy.zeros(len(batch_df), dtype=bool)
+
+        # the extension gets codes for the user class and modes, and the strings they stand for
+        mode_codes   = []
+        mode_strings = []
+        for col in [Passenger.TRIP_LIST_COLUMN_USER_CLASS,  Passenger.TRIP_LIST_COLUMN_ACCESS_MODE,
+                    Passenger.TRIP_LIST_COLUMN_TRANSIT_MODE, Passenger.TRIP_LIST_COLUMN_EGRESS_MODE]:
+            (codes, strings) = pandas.factorize(batch_df[col])
+            mode_codes.append(codes)
+            mode_strings.append([str(string) for string in strings])
+
+        path_specs = numpy.column_stack([batch_df[Passenger.PERSONS_COLUMN_PERSON_ID_NUM].values,
+                                         batch_df[Passenger.TRIP_LIST_COLUMN_TRIP_LIST_ID_NUM].values] +
+                                        mode_codes +
+                                        [batch_df[Passenger.TRIP_LIST_COLUMN_ORIGIN_TAZ_ID_NUM].values,
+                                         batch_df[Passenger.TRIP_LIST_COLUMN_DESTINATION_TAZ_ID_NUM].values,
+                                         outbound, trace]).astype('int32')
+
+        return { "path_specs"     : path_specs,
+                 "pref_time"      : pref_time.astype('float64'),
+                 "cost_estimates" : batch_costs.astype('float64'),
+                 "mode_strings"   : mode_strings }
+
+    @staticmethod
+    def slice_path_spec_columns(spec_columns, rows):
+        """
+        Returns the *rows* (a slice or an index array) of the given :py:meth:`Assignment.path_spec_columns`.
+        """
+        return { "path_specs"     : spec_columns["path_specs"][rows],
+                 "pref_time"      : spec_columns["pref_time"][rows],
+                 "cost_estimates" : spec_columns["cost_estimates"][rows],
+                 "mode_strings"   : spec_columns["mode_strings"] }
+
+    @staticmethod
+    def find_paths_for_columns(iteration, hyperpath, spec_columns, num_threads):
+        """
+        Sends the :py:meth:`Assignment.path_spec_columns` to the C++ extension to find the paths.
+
+        Returns (path start, state ints, state doubles, path costs, performance ints, performance milliseconds),
+        as the extension's find_paths does.
+        """
+        mode_strings = spec_columns["mode_strings"]
+        return _fasttrips.find_paths(iteration, 1 if hyperpath else 0,
+                                     spec_columns["path_specs"], spec_columns["pref_time"], spec_columns["cost_estimates"],
+                                     mode_strings[0], mode_strings[1], mode_strings[2], mode_strings[3], num_threads,
+                                     1 if Assignment.GROUP_PATHS_BY_LOCALITY else 0)
+
+    @staticmethod
+    def convert_path_results(spec_columns, find_results, hyperpath):
+        """
+        Converts the results of :py:meth:`Assignment.find_paths_for_columns` into a list of
+        (trip list ID num, path cost, return_states).  See :py:meth:`Assignment.performance_arrays`
+        for the performance info.
+        """
+        (path_start, ret_ints, ret_doubles, path_costs, perf_ints, perf_ms) = find_results
+        path_specs = spec_columns["path_specs"]
+
+        results = []
+        for index in range(path_specs.shape[0]):
+            start, end    = path_start[index], path_start[index+1]
+            return_states = Assignment.convert_states(ret_ints[start:end], ret_doubles[start:end], hyperpath)
+            results.append( (path_specs[index,1], path_costs[index], return_states) )
+        return results
+
+    @staticmethod
+    def performance_arrays(iteration, spec_columns, find_results):
+        """
+        Returns the arguments for :py:meth:`Performance.add_arrays` for the results of
+        :py:meth:`Assignment.find_paths_for_columns`.
+        """
+        path_specs = spec_columns["path_specs"]
+        return (numpy.repeat(iteration, path_specs.shape[0]), path_specs[:,1], path_specs[:,9],
+                find_results[4], find_results[5])
+
+    @staticmethod
+    def fetch_fasttrips_performance(FT):
+        """
+        Moves the performance info the C++ extension recorded for the paths found by
+        :py:meth:`Assignment.find_trip_based_path` and :py:meth:`Assignment.find_trip_based_paths_in_chunks`
+        since the last call into *FT*.performance, all at once.
+        """
+        FT.performance.add_arrays(*_fasttrips.fetch_performance())
+
+    @staticmethod
+    def convert_states(ret_ints, ret_doubles, hyperpath):
+        """
+        Converts the path states returned by the C++ extension into a list of (stop_id, state array).
+        See :py:attr:`Path.states`.
+        """
         # Put the results into an list of (stop_id, state array)
         return_states = []
         midnight = datetime.datetime.combine(Assignment.TODAY, datetime.time())
@@ -609,14 +1070,7 @@ class Assignment:
                               datetime.timedelta(minutes=ret_doubles[index,3]),             # cost
                               midnight + datetime.timedelta(minutes=ret_doubles[index,4])   # arrival/departure time
                               ] ) )
-        perf_dict = { \
-            Performance.PERFORMANCE_COLUMN_LABEL_ITERATIONS      : label_iterations,
-            Performance.PERFORMANCE_COLUMN_MAX_STOP_PROCESS_COUNT: max_label_process_count,
-            Performance.PERFORMANCE_COLUMN_TIME_LABELING_MS      : seconds_labeling,
-            Performance.PERFORMANCE_COLUMN_TIME_ENUMERATING_MS   : seconds_enumerating,
-            Performance.PERFORMANCE_COLUMN_TRACED                : trace,
-        }
-        return (path_cost, return_states, perf_dict)
+        return return_states
 
     @staticmethod
     def read_assignment_results(output_dir, iteration):
@@ -908,246 +1362,101 @@ class Assignment:
         passenger_trips_len = len(passenger_trips)
 
         ######################################################################################################
-        bump_iter = 0
+        FastTripsLogger.info("Step 2. Put passenger paths on transit vehicles to get vehicle boards/alights/load")
         Assignment.bumped_person_ids.clear()
         Assignment.bumped_trip_list_nums.clear()
-        while True: # loop for capacity constraint
-            FastTripsLogger.info("Step 2. Put passenger paths on transit vehicles to get vehicle boards/alights/load")
-
-            # Group to boards by counting trip_list_id_nums for a (trip_id, A_id as stop_id)
-            passenger_trips_boards = passenger_trips[[Passenger.TRIP_LIST_COLUMN_TRIP_LIST_ID_NUM,
-                                                      Trip.STOPTIMES_COLUMN_TRIP_ID_NUM,'A_id','A_seq']].groupby([Trip.STOPTIMES_COLUMN_TRIP_ID_NUM,'A_id','A_seq']).count()
-            passenger_trips_boards.index.names = [Trip.STOPTIMES_COLUMN_TRIP_ID_NUM,
-                                                  Trip.STOPTIMES_COLUMN_STOP_ID_NUM,
-                                                  Trip.STOPTIMES_COLUMN_STOP_SEQUENCE]
-
-            # And alights by counting path_ids for a (trip_id, B_id as stop_id)
-            passenger_trips_alights = passenger_trips[[Passenger.TRIP_LIST_COLUMN_TRIP_LIST_ID_NUM,
-                                                       Trip.TRIPS_COLUMN_TRIP_ID_NUM,'B_id','B_seq']].groupby([Trip.TRIPS_COLUMN_TRIP_ID_NUM,'B_id','B_seq']).count()
-            passenger_trips_alights.index.names = [Trip.STOPTIMES_COLUMN_TRIP_ID_NUM,
-                                                   Trip.STOPTIMES_COLUMN_STOP_ID_NUM,
-                                                   Trip.STOPTIMES_COLUMN_STOP_SEQUENCE]
-
-            # Join them to the transit vehicle trips so we can put people on vehicles
-            veh_loaded_df = pandas.merge(left        = veh_trips_df,
-                                         right       = passenger_trips_boards,
-                                         left_on     = [Trip.STOPTIMES_COLUMN_TRIP_ID_NUM,
-                                                        Trip.STOPTIMES_COLUMN_STOP_ID_NUM,
-                                                        Trip.STOPTIMES_COLUMN_STOP_SEQUENCE],
-                                         right_index = True,
-                                         how         = 'left')
-            veh_loaded_df.rename(columns={Passenger.TRIP_LIST_COLUMN_TRIP_LIST_ID_NUM:'boards'}, inplace=True)
-
-            veh_loaded_df = pandas.merge(left        = veh_loaded_df,
-                                         right       = passenger_trips_alights,
-                                        left_on      = [Trip.TRIPS_COLUMN_TRIP_ID_NUM,
-                                                        Trip.STOPTIMES_COLUMN_STOP_ID_NUM,
-                                                        Trip.STOPTIMES_COLUMN_STOP_SEQUENCE],
-                                        right_index  = True,
-                                        how          ='left')
-            veh_loaded_df.rename(columns={Passenger.TRIP_LIST_COLUMN_TRIP_LIST_ID_NUM:'alights'}, inplace=True)
-            veh_loaded_df.fillna(value=0, inplace=True)
-            assert(len(veh_loaded_df)==veh_trips_df_len)
-
-            # these are ints, not floats
-            veh_loaded_df[['boards','alights']] = veh_loaded_df[['boards','alights']].astype(int)
-
-            veh_loaded_df.set_index([Trip.TRIPS_COLUMN_TRIP_ID_NUM,Trip.STOPTIMES_COLUMN_STOP_SEQUENCE],inplace=True)
-            veh_loaded_df['onboard'] = veh_loaded_df.boards - veh_loaded_df.alights
-
-            # on board is the cumulative sum of boards - alights
-            trips_cumsum = veh_loaded_df[['onboard']].groupby(level=[0]).cumsum()
-            veh_loaded_df.drop('onboard', axis=1, inplace=True) # replace with cumsum
-            veh_loaded_df = pandas.merge(left        = veh_loaded_df,
-                                         right       = trips_cumsum,
-                                         left_index  = True,
-                                         right_index = True,
-                                         how         = 'left')
-            assert(len(veh_loaded_df)==veh_trips_df_len)
-            # print veh_trips_df.loc[5123368]
-            veh_loaded_df.reset_index(inplace=True)
-
-            FastTripsLogger.debug("veh_trips_loaded with onboard>0: (showing head)\n" + \
-                                  veh_loaded_df.loc[veh_loaded_df.onboard>0].head().to_string(formatters=\
-                   {Trip.STOPTIMES_COLUMN_ARRIVAL_TIME   :Util.datetime64_formatter,
-                    Trip.STOPTIMES_COLUMN_DEPARTURE_TIME :Util.datetime64_formatter}))
-
-            if not Assignment.CAPACITY_CONSTRAINT or not FT.trips.has_capacity_configured():
-                # No need to loop
-                break
 
-            else:
-                ######################################################################################################
-                FastTripsLogger.info("Step 3. Capacity constraints on transit vehicles.")
-                if bump_iter == 0:
-                    FastTripsLogger.info("        Bumping one at a time? %s" % ("true" if Assignment.BUMP_ONE_AT_A_TIME else "false"))
-                # This needs to run at this point because the arrival times for the passengers are accurate here
-
-                # Who gets bumped?
-                # overcap = how many people are problematic
-                veh_loaded_df['overcap'] = veh_loaded_df.onboard - veh_loaded_df.capacity
-                overcap_df     = veh_loaded_df.loc[veh_loaded_df.overcap > 0]
-
-                FastTripsLogger.debug("%d vehicle trip/stops over capacity: (showing head)\n%s" % \
-                                      (len(overcap_df),
-                                      overcap_df.head().to_string(formatters=\
-                   {Trip.STOPTIMES_COLUMN_ARRIVAL_TIME   :Util.datetime64_formatter,
-                    Trip.STOPTIMES_COLUMN_DEPARTURE_TIME :Util.datetime64_formatter})))
-
-                # If none, we're done
-                if len(overcap_df) == 0:
-                    FastTripsLogger.info("        No overcapacity vehicles")
-                    break
+        capacity_constraint = Assignment.CAPACITY_CONSTRAINT and FT.trips.has_capacity_configured()
+        if capacity_constraint:
+            FastTripsLogger.info("Step 3. Capacity constraints on transit vehicles.")
+            FastTripsLogger.info("        Bumping one at a time? %s" % ("true" if Assignment.BUMP_ONE_AT_A_TIME else "false"))
 
-                # start by bumping the first ones who board after at capacity - which stops are they?
-                bump_stops_df  = overcap_df.groupby([Trip.STOPTIMES_COLUMN_TRIP_ID]).aggregate('first')
-                FastTripsLogger.debug("Bump stops (%d rows, showing head):\n%s" %
-                                      (len(bump_stops_df),
-                                      bump_stops_df.head().to_string(formatters=\
-                   {Trip.STOPTIMES_COLUMN_ARRIVAL_TIME   :Util.datetime64_formatter,
-                    Trip.STOPTIMES_COLUMN_DEPARTURE_TIME :Util.datetime64_formatter})))
-
-                # One stop at a time -- slower but more accurate
-                if Assignment.BUMP_ONE_AT_A_TIME:
-                    bump_stops_df.sort([Trip.STOPTIMES_COLUMN_ARRIVAL_TIME], inplace=True)
-                    bump_stops_df = bump_stops_df.iloc[:1]
-
-                FastTripsLogger.info("        Need to bump %d passengers from %d stops" % (bump_stops_df.overcap.sum(), len(bump_stops_df)))
-
-                # FastTripsLogger.debug("passenger_trips\n%s" % \
-                #                (passenger_trips.to_string(formatters=\
-                #                {Assignment.SIM_COL_PAX_BOARD_TIME   :Util.datetime64_min_formatter,
-                #                 Assignment.SIM_COL_PAX_ARRIVE_TIME  :Util.datetime64_min_formatter,
-                #                 Assignment.SIM_COL_PAX_ALIGHT_TIME  :Util.datetime64_min_formatter,
-                #                 'B_time'                            :Util.datetime64_min_formatter,
-                #                 Assignment.SIM_COL_PAX_LINK_TIME    :Util.timedelta_formatter})))
-
-                # who boards at those stops?
-                bumped_pax_boards = pandas.merge(left    =passenger_trips[[ \
-                                                            Trip.STOPTIMES_COLUMN_TRIP_ID_NUM,'A_id',
-                                                            Passenger.TRIP_LIST_COLUMN_PERSON_ID,
-                                                            Passenger.TRIP_LIST_COLUMN_TRIP_LIST_ID_NUM,'A_seq',
-                                                            Assignment.SIM_COL_PAX_ARRIVE_TIME]],
-                                                 left_on =[Trip.STOPTIMES_COLUMN_TRIP_ID_NUM,'A_id','A_seq'],
-                                                 right   =bump_stops_df.reset_index()[[ \
-                                                            Trip.STOPTIMES_COLUMN_TRIP_ID,
-                                                            Trip.STOPTIMES_COLUMN_TRIP_ID_NUM,
-                                                            Trip.STOPTIMES_COLUMN_STOP_ID,
-                                                            Trip.STOPTIMES_COLUMN_STOP_ID_NUM,
-                                                            Trip.STOPTIMES_COLUMN_STOP_SEQUENCE,
-                                                            Trip.STOPTIMES_COLUMN_ARRIVAL_TIME,
-                                                            Trip.STOPTIMES_COLUMN_DEPARTURE_TIME,'overcap']],
-                                                 right_on=[Trip.STOPTIMES_COLUMN_TRIP_ID_NUM,
-                                                           Trip.STOPTIMES_COLUMN_STOP_ID_NUM,
-                                                           Trip.STOPTIMES_COLUMN_STOP_SEQUENCE],
-                                                 how     ='inner')
-                # bump off later arrivals, later trip_list_num
-                bumped_pax_boards.sort([Trip.STOPTIMES_COLUMN_ARRIVAL_TIME,
-                                        Trip.STOPTIMES_COLUMN_TRIP_ID_NUM,
-                                        Trip.STOPTIMES_COLUMN_STOP_SEQUENCE,
-                                        Trip.STOPTIMES_COLUMN_STOP_ID_NUM,
-                                        Assignment.SIM_COL_PAX_ARRIVE_TIME,
-                                        Passenger.TRIP_LIST_COLUMN_TRIP_LIST_ID_NUM],
-                                       ascending=[True, True, True, True, False, False], inplace=True)
-                bumped_pax_boards.reset_index(drop=True, inplace=True)
-
-                # For each trip_id, stop_seq, stop_id, we want the first *overcap* rows
-                # group to trip_id, stop_seq, stop_id and count off
-                bpb_count = bumped_pax_boards.groupby([Trip.STOPTIMES_COLUMN_TRIP_ID_NUM,
+        # The vehicle trips are the stop times in the same order as given to the extension's initialize_supply(),
+        # so the loads come back one per row
+        _fasttrips.initialize_simulation(veh_trips_df[[Trip.STOPTIMES_COLUMN_TRIP_ID_NUM,
                                                        Trip.STOPTIMES_COLUMN_STOP_SEQUENCE,
-                                                       Trip.STOPTIMES_COLUMN_STOP_ID_NUM]).cumcount()
-                bpb_count.name = 'bump_index'
-
-                # Add the bump index to our passenger-paths/stops
-                bumped_pax_boards = pandas.concat([bumped_pax_boards, bpb_count], axis=1)
-
-                FastTripsLogger.debug("bumped_pax_boards (%d rows, showing head):\n%s" % (len(bumped_pax_boards),
-                    bumped_pax_boards.head().to_string(formatters=\
-                   {Assignment.SIM_COL_PAX_ARRIVE_TIME   :Util.datetime64_formatter,
-                    Trip.STOPTIMES_COLUMN_ARRIVAL_TIME   :Util.datetime64_formatter,
-                    Trip.STOPTIMES_COLUMN_DEPARTURE_TIME :Util.datetime64_formatter})))
-
-                # use it to filter to those we bump
-                bumped_pax_boards = bumped_pax_boards.loc[bumped_pax_boards.bump_index < bumped_pax_boards.overcap]
-
-                FastTripsLogger.debug("filtered bumped_pax_boards (%d rows, showing head):\n%s" % (len(bumped_pax_boards),
-                    bumped_pax_boards.head().to_string(formatters=\
-                   {Assignment.SIM_COL_PAX_ARRIVE_TIME   :Util.datetime64_formatter,
-                    Trip.STOPTIMES_COLUMN_ARRIVAL_TIME   :Util.datetime64_formatter,
-                    Trip.STOPTIMES_COLUMN_DEPARTURE_TIME :Util.datetime64_formatter})))
-
-                # filter to unique passengers/paths
-                bumped_pax_boards.drop_duplicates(subset=[Passenger.TRIP_LIST_COLUMN_PERSON_ID,
-                                                          Passenger.TRIP_LIST_COLUMN_TRIP_LIST_ID_NUM],inplace=True)
-                bumped_pax_boards['bump'] = True
-
-                # keep track of these
-                Assignment.bumped_person_ids.update(bumped_pax_boards[Passenger.TRIP_LIST_COLUMN_PERSON_ID].tolist())
-                Assignment.bumped_trip_list_nums.update(bumped_pax_boards[Passenger.TRIP_LIST_COLUMN_TRIP_LIST_ID_NUM].tolist())
-
-                FastTripsLogger.debug("bumped_pax_boards without duplicate passengers (%d rows, showing head):\n%s" % \
-                    (len(bumped_pax_boards),
-                     bumped_pax_boards.head().to_string(formatters=\
-                   {Assignment.SIM_COL_PAX_ARRIVE_TIME   :Util.datetime64_formatter,
-                    Trip.STOPTIMES_COLUMN_ARRIVAL_TIME   :Util.datetime64_formatter,
-                    Trip.STOPTIMES_COLUMN_DEPARTURE_TIME :Util.datetime64_formatter})))
-
-                # Kick out the bumped passengers
-                passengers_df = pandas.merge(left     =passengers_df,
-                                             right    =bumped_pax_boards[[Passenger.TRIP_LIST_COLUMN_PERSON_ID,
-                                                                          Passenger.TRIP_LIST_COLUMN_TRIP_LIST_ID_NUM,
-                                                                          'bump']],
-                                             on       =[Passenger.TRIP_LIST_COLUMN_PERSON_ID,
-                                                        Passenger.TRIP_LIST_COLUMN_TRIP_LIST_ID_NUM],
-                                             how      ='left')
-                assert(passengers_df_len == len(passengers_df))
-                passengers_df = passengers_df[passengers_df.bump != True]
-                FastTripsLogger.info("        Bumped %d passengers; passenger_df length %d -> %d" %
-                                     (len(bumped_pax_boards), passengers_df_len, len(passengers_df)))
-                passengers_df.drop('bump', axis=1, inplace=True)
-                passengers_df_len = len(passengers_df)
-
-                # recreate
-                passenger_trips     = Assignment.get_passenger_trips(passengers_df, veh_trips_df)
-                passenger_trips_len = len(passenger_trips)
-
-                new_bump_wait = bumped_pax_boards[[Trip.STOPTIMES_COLUMN_TRIP_ID,
-                                                   Trip.STOPTIMES_COLUMN_TRIP_ID_NUM,
-                                                   Trip.STOPTIMES_COLUMN_STOP_ID,
-                                                   'A_id','A_seq',
-                                                   Assignment.SIM_COL_PAX_ARRIVE_TIME]].groupby([\
-                                                     Trip.STOPTIMES_COLUMN_TRIP_ID_NUM,'A_id','A_seq']).first()
-                new_bump_wait.reset_index(drop=False, inplace=True)
-                new_bump_wait.rename(columns={'A_id' :Trip.STOPTIMES_COLUMN_STOP_ID_NUM,
-                                              'A_seq':Trip.STOPTIMES_COLUMN_STOP_SEQUENCE}, inplace=True)
-
-                FastTripsLogger.debug("new_bump_wait (%d rows, showing head):\n%s" %
-                    (len(new_bump_wait), new_bump_wait.head().to_string(formatters=\
-                   {Assignment.SIM_COL_PAX_ARRIVE_TIME:Util.datetime64_formatter})))
-
-                # incorporate it into the bump wait df
-                if type(Assignment.bump_wait_df) == type(None):
-                    Assignment.bump_wait_df = new_bump_wait
-                else:
-                    Assignment.bump_wait_df = Assignment.bump_wait_df.append(new_bump_wait)
-                    Assignment.bump_wait_df.drop_duplicates([Trip.STOPTIMES_COLUMN_TRIP_ID_NUM,
-                                                             Trip.STOPTIMES_COLUMN_STOP_SEQUENCE], inplace=True)
-
-                # incorporate it into the bump wait
-                # This is (trip_id, stop_id) -> Timestamp
-                bump_wait_dict  = Assignment.bump_wait_df.set_index([Trip.STOPTIMES_COLUMN_TRIP_ID_NUM,
-                                                                     Trip.STOPTIMES_COLUMN_STOP_ID_NUM,
-                                                                     Trip.STOPTIMES_COLUMN_STOP_SEQUENCE]).to_dict()[Assignment.SIM_COL_PAX_ARRIVE_TIME]
-                bump_wait_dict2 = {k: v.to_datetime() for k, v in bump_wait_dict.iteritems()}
-                Assignment.bump_wait.update(bump_wait_dict2)
-
-                # FastTripsLogger.debug("Bump wait ---------")
-                # for key,val in Assignment.bump_wait.iteritems():
-                #     FastTripsLogger.debug("(%10s, %10s, %10s) -> %s" %
-                #                           (str(key[0]), str(key[1]), str(key[2]), val.strftime("%H:%M:%S")))
-
-                bump_iter += 1
-                FastTripsLogger.info("        -> complete loop iter %d" % bump_iter)
+                                                       Trip.STOPTIMES_COLUMN_STOP_ID_NUM]].as_matrix().astype('int32'),
+                                         veh_trips_df[[Trip.STOPTIMES_COLUMN_ARRIVAL_TIME_MIN,
+                                                       Trip.STOPTIMES_COLUMN_DEPARTURE_TIME_MIN]].as_matrix().astype('float64'),
+                                         veh_trips_df[Trip.VEHICLES_COLUMN_TOTAL_CAPACITY].fillna(-1).values.astype('int32') \
+                                            if capacity_constraint else None)
+
+        # Put the passenger trips on the vehicles and bump passengers off of full ones until none are over capacity.
+        # This returns the loads and the indices into passenger_trips of the bumped passengers and of the first
+        # passenger bumped at each stop (who sets the bump wait time there).
+        midnight = datetime.datetime.combine(Assignment.TODAY, datetime.time())
+        (boards, alights, onboard, bumped_legs, bump_wait_legs, bump_iter) = \
+            _fasttrips.simulate(passenger_trips[[Passenger.TRIP_LIST_COLUMN_TRIP_LIST_ID_NUM,
+                                                 Trip.STOPTIMES_COLUMN_TRIP_ID_NUM,
+                                                 'A_seq','B_seq']].as_matrix().astype('int32').reshape(-1,4),
+                                ((passenger_trips[Assignment.SIM_COL_PAX_ARRIVE_TIME] - midnight)/numpy.timedelta64(1,'m')).values.astype('float64'),
+                                1 if capacity_constraint else 0,
+                                1 if Assignment.BUMP_ONE_AT_A_TIME else 0)
+
+        veh_loaded_df = veh_trips_df.copy()
+        veh_loaded_df['boards' ] = boards
+        veh_loaded_df['alights'] = alights
+        veh_loaded_df['onboard'] = onboard
+        if capacity_constraint:
+            veh_loaded_df['overcap'] = veh_loaded_df.onboard - veh_loaded_df.capacity
+
+        FastTripsLogger.debug("veh_trips_loaded with onboard>0: (showing head)\n" + \
+                              veh_loaded_df.loc[veh_loaded_df.onboard>0].head().to_string(formatters=\
+               {Trip.STOPTIMES_COLUMN_ARRIVAL_TIME   :Util.datetime64_formatter,
+                Trip.STOPTIMES_COLUMN_DEPARTURE_TIME :Util.datetime64_formatter}))
+
+        if len(bumped_legs) == 0:
+            if capacity_constraint:
+                FastTripsLogger.info("        No overcapacity vehicles")
+        else:
+            bumped_pax_boards = passenger_trips.iloc[bumped_legs]
+
+            # keep track of these
+            Assignment.bumped_person_ids.update(bumped_pax_boards[Passenger.TRIP_LIST_COLUMN_PERSON_ID].tolist())
+            Assignment.bumped_trip_list_nums.update(bumped_pax_boards[Passenger.TRIP_LIST_COLUMN_TRIP_LIST_ID_NUM].tolist())
+
+            FastTripsLogger.debug("bumped_pax_boards (%d rows, showing head):\n%s" % (len(bumped_pax_boards),
+                bumped_pax_boards.head().to_string(formatters=\
+               {Assignment.SIM_COL_PAX_ARRIVE_TIME   :Util.datetime64_formatter,
+                Assignment.SIM_COL_PAX_BOARD_TIME    :Util.datetime64_formatter,
+                Assignment.SIM_COL_PAX_ALIGHT_TIME   :Util.datetime64_formatter})))
+
+            new_bump_wait = passenger_trips.iloc[bump_wait_legs][[Trip.STOPTIMES_COLUMN_TRIP_ID,
+                                                                  Trip.STOPTIMES_COLUMN_TRIP_ID_NUM,
+                                                                  'A_id','A_id_num','A_seq',
+                                                                  Assignment.SIM_COL_PAX_ARRIVE_TIME]].reset_index(drop=True)
+            new_bump_wait.rename(columns={'A_id'     :Trip.STOPTIMES_COLUMN_STOP_ID,
+                                          'A_id_num' :Trip.STOPTIMES_COLUMN_STOP_ID_NUM,
+                                          'A_seq'    :Trip.STOPTIMES_COLUMN_STOP_SEQUENCE}, inplace=True)
+
+            FastTripsLogger.debug("new_bump_wait (%d rows, showing head):\n%s" %
+                (len(new_bump_wait), new_bump_wait.head().to_string(formatters=\
+               {Assignment.SIM_COL_PAX_ARRIVE_TIME:Util.datetime64_formatter})))
+
+            # Kick out the bumped passengers
+            bumped_trip_list_nums = list(Assignment.bumped_trip_list_nums)
+            passengers_df   = passengers_df.loc[~passengers_df[Passenger.TRIP_LIST_COLUMN_TRIP_LIST_ID_NUM].isin(bumped_trip_list_nums)]
+            passenger_trips = passenger_trips.loc[~passenger_trips[Passenger.TRIP_LIST_COLUMN_TRIP_LIST_ID_NUM].isin(bumped_trip_list_nums)]
+            FastTripsLogger.info("        Bumped %d passengers in %d iterations; passenger_df length %d -> %d" %
+                                 (len(bumped_pax_boards), bump_iter, passengers_df_len, len(passengers_df)))
+            passengers_df_len   = len(passengers_df)
+            passenger_trips_len = len(passenger_trips)
+
+            # incorporate it into the bump wait df
+            if type(Assignment.bump_wait_df) == type(None):
+                Assignment.bump_wait_df = new_bump_wait
+            else:
+                Assignment.bump_wait_df = Assignment.bump_wait_df.append(new_bump_wait)
+                Assignment.bump_wait_df.drop_duplicates([Trip.STOPTIMES_COLUMN_TRIP_ID_NUM,
+                                                         Trip.STOPTIMES_COLUMN_STOP_SEQUENCE], inplace=True)
+
+            # incorporate it into the bump wait
+            # This is (trip_id, stop_id) -> Timestamp
+            bump_wait_dict  = Assignment.bump_wait_df.set_index([Trip.STOPTIMES_COLUMN_TRIP_ID_NUM,
+                                                                 Trip.STOPTIMES_COLUMN_STOP_ID_NUM,
+                                                                 Trip.STOPTIMES_COLUMN_STOP_SEQUENCE]).to_dict()[Assignment.SIM_COL_PAX_ARRIVE_TIME]
+            bump_wait_dict2 = {k: v.to_datetime() for k, v in bump_wait_dict.iteritems()}
+            Assignment.bump_wait.update(bump_wait_dict2)
 
         if type(Assignment.bump_wait_df) == pandas.DataFrame and len(Assignment.bump_wait_df) > 0:
             Assignment.bump_wait_df[Assignment.SIM_COL_PAX_ARRIVE_TIME_MIN] = \
@@ -1291,6 +1600,7 @@ def find_trip_based_paths_process_worker(iteration, worker_num, input_network_di
         # go through my queue -- check if we're done
         todo = todo_path_queue.get()
         if todo == 'DONE':
+            done_queue.put( ('performance', _fasttrips.fetch_performance()) )
             done_queue.put('DONE')
             FastTripsLogger.debug("Received DONE from the todo_path_queue")
             return
@@ -1306,10 +1616,11 @@ def find_trip_based_paths_process_worker(iteration, worker_num, input_network_di
             trace_person = True
 
         try:
-            (cost, return_states, perf_dict) = Assignment.find_trip_based_path(iteration, worker_FT, path, hyperpath, trace=trace_person)
-            done_queue.put( (path.trip_list_id_num, cost, return_states, perf_dict) )
+            (cost, return_states) = Assignment.find_trip_based_path(iteration, worker_FT, path, hyperpath, trace=trace_person)
+            done_queue.put( (path.trip_list_id_num, cost, return_states) )
         except:
             FastTripsLogger.exception('Exception')
             # call it a day
+            done_queue.put( ('performance', _fasttrips.fetch_performance()) )
             done_queue.put('DONE')
             return
@@ -0,0 +1,306 @@
+__copyright__ = "Copyright 2016 Contributing Entities"
+__license__   = """
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+"""
+import collections,multiprocessing,os,socket,threading,time
+from multiprocessing.connection import Listener, Client
+
+import numpy
+
+from .Logger import FastTripsLogger
+
+class Coordinator:
+    """
+    Spreads path finding over worker processes, on this machine or on others, which connect to the
+    coordinator over a socket (see :py:func:`run_worker`).  Each worker loads the network supply into
+    the C++ extension once and then finds the paths for batches of path specifications (see
+    :py:meth:`Assignment.path_spec_columns`) as they're handed out, for as many iterations as needed.
+
+    If a worker drops out, or doesn't return its batch within the batch timeout, the batch it was
+    working on is handed to another worker and the worker's connection is closed.
+
+    The messages are pickled tuples over a :py:class:`multiprocessing.connection.Connection`:
+
+    * worker -> coordinator: ``("hello", hostname, pid)``
+    * coordinator -> worker: ``("welcome", worker_num)``
+    * worker -> coordinator: ``("ready",)`` once the network supply is loaded
+    * coordinator -> worker: ``("iteration", iteration, hyperpath, bump_wait)`` before the first batch of an iteration
+    * coordinator -> worker: ``("batch", batch_id, spec_columns)``
+    * worker -> coordinator: ``("result", batch_id, find_results)``, see :py:meth:`Assignment.find_paths_for_columns`
+    * coordinator -> worker: ``("exit",)``
+    """
+
+    #: If no workers are connected for this many seconds, :py:meth:`Coordinator.find_paths` gives
+    #: back the batches that aren't done.
+    NO_WORKER_TIMEOUT_SECS = 120
+
+    #: How long :py:meth:`Coordinator.close` waits for each local worker to exit before terminating it
+    LOCAL_WORKER_EXIT_SECS = 30
+
+    @staticmethod
+    def parse_address(address, connect=False):
+        """
+        Returns the address as :py:mod:`multiprocessing.connection` wants it: a (host, port) tuple
+        for ``host:port`` and the string otherwise (a Unix socket, or a named pipe on Windows).
+        With *connect*, a wildcard host is replaced with localhost.
+        """
+        if ":" in address and not address.startswith("\\\\"):
+            (host, port) = address.rsplit(":", 1)
+            if connect and host in ["", "0.0.0.0"]:
+                host = "localhost"
+            return (host, int(port))
+        return address
+
+    def __init__(self, address, authkey, num_local_workers, input_network_dir, input_demand_dir, output_dir,
+                 batch_timeout_secs):
+        """
+        Starts listening at *address* (see :py:meth:`Coordinator.parse_address`) for workers,
+        and starts *num_local_workers* workers on this machine.  A worker that hasn't returned a batch
+        after *batch_timeout_secs* is given up on.
+        """
+        self.address            = address
+        self.batch_timeout_secs = batch_timeout_secs
+        self.listener           = Listener(Coordinator.parse_address(address), authkey=authkey)
+        FastTripsLogger.info("Coordinator listening at %s" % address)
+
+        #: Guards everything below, and is notified when any of it changes
+        self.lock               = threading.Condition()
+        self.closing            = False
+        self.next_worker_num    = 1
+        #: worker num -> connection, for the workers that have loaded the supply
+        self.workers            = {}
+        #: the current :py:class:`CoordinatorJob`, or None
+        self.job                = None
+
+        accept_thread = threading.Thread(target=self.accept_workers, name="coordinator")
+        accept_thread.daemon = True
+        accept_thread.start()
+
+        self.local_workers      = []
+        for worker_idx in range(num_local_workers):
+            self.local_workers.append(multiprocessing.Process(target=run_worker,
+                                                              args=(address, authkey, input_network_dir,
+                                                                    input_demand_dir, output_dir)))
+            # so they don't keep this process from exiting if it doesn't get to close()
+            self.local_workers[-1].daemon = True
+            self.local_workers[-1].start()
+
+    def accept_workers(self):
+        """
+        Accepts worker connections and starts a thread to serve each one.
+        """
+        while True:
+            try:
+                conn = self.listener.accept()
+            except Exception as e:
+                # the listener closed, or a worker with the wrong authkey
+                with self.lock:
+                    if self.closing: return
+                FastTripsLogger.warning("Coordinator couldn't accept a worker: %s" % str(e))
+                continue
+
+            with self.lock:
+                worker_num = self.next_worker_num
+                self.next_worker_num += 1
+            worker_thread = threading.Thread(target=self.serve_worker, args=(conn, worker_num),
+                                             name="coordinator_worker%02d" % worker_num)
+            worker_thread.daemon = True
+            worker_thread.start()
+
+    def serve_worker(self, conn, worker_num):
+        """
+        Hands batches of the current job to the worker on *conn* until it drops out, takes longer than
+        the batch timeout, or the coordinator closes.
+        """
+        job      = None
+        batch_id = None
+        try:
+            hello = conn.recv()
+            conn.send(("welcome", worker_num))
+            conn.recv()  # ready
+            FastTripsLogger.info("Worker %2d on %s (pid %s) is ready" % (worker_num, hello[1], str(hello[2])))
+            with self.lock:
+                self.workers[worker_num] = conn
+                self.lock.notify_all()
+
+            iteration_sent = None
+            while True:
+                with self.lock:
+                    while not self.closing and (self.job is None or len(self.job.todo) == 0):
+                        self.lock.wait(1.0)
+                    if self.closing:
+                        break
+                    job      = self.job
+                    batch_id = job.todo.popleft()
+
+                if iteration_sent is not job:
+                    conn.send(("iteration", job.iteration, job.hyperpath, job.bump_wait))
+                    iteration_sent = job
+                conn.send(("batch", batch_id, job.batches[batch_id]))
+                if not conn.poll(self.batch_timeout_secs):
+                    raise IOError("no result for batch %d in %d seconds" % (batch_id, self.batch_timeout_secs))
+                result = conn.recv()
+
+                with self.lock:
+                    job.results[batch_id] = result[2]
+                    batch_id = None
+                    self.lock.notify_all()
+
+            conn.send(("exit",))
+
+        except Exception as e:
+            FastTripsLogger.warning("Worker %2d dropped out: %s" % (worker_num, str(e)))
+
+        try:
+            conn.close()
+        except Exception:
+            pass
+
+        with self.lock:
+            # someone else can do it
+            if batch_id is not None:
+                job.todo.appendleft(batch_id)
+            if worker_num in self.workers:
+                del self.workers[worker_num]
+            self.lock.notify_all()
+
+    def find_paths(self, iteration, hyperpath, bump_wait, spec_columns, batch_size):
+        """
+        Splits the :py:meth:`Assignment.path_spec_columns` into batches of *batch_size* paths, most
+        expensive first, and has the workers find them.  *bump_wait* is None or the (index, times)
+        arrays for the extension's set_bump_wait.
+
+        Returns a list of (batch spec columns, find results) for the batches that were found, and a list
+        of the batch spec columns that weren't because no workers were connected for
+        :py:attr:`Coordinator.NO_WORKER_TIMEOUT_SECS`.
+        """
+        # local import since Assignment imports us
+        from .Assignment import Assignment
+
+        num_paths = spec_columns["path_specs"].shape[0]
+        order     = numpy.argsort(-spec_columns["cost_estimates"], kind='mergesort')
+        batches   = [Assignment.slice_path_spec_columns(spec_columns, order[start:start+batch_size])
+                     for start in range(0, num_paths, batch_size)]
+        job       = CoordinatorJob(iteration, hyperpath, bump_wait, batches)
+
+        num_done        = 0
+        no_worker_since = None
+        with self.lock:
+            self.job = job
+            self.lock.notify_all()
+
+            while len(job.results) < len(batches):
+                self.lock.wait(5.0)
+
+                if len(job.results) != num_done:
+                    num_done = len(job.results)
+                    FastTripsLogger.info(" %6d / %6d batches of passenger paths found by %d workers" %
+                                         (num_done, len(batches), len(self.workers)))
+
+                if len(self.workers) > 0:
+                    no_worker_since = None
+                elif no_worker_since is None:
+                    no_worker_since = time.time()
+                elif time.time() - no_worker_since > Coordinator.NO_WORKER_TIMEOUT_SECS:
+                    FastTripsLogger.warning("No workers for %d seconds" % Coordinator.NO_WORKER_TIMEOUT_SECS)
+                    break
+
+            self.job = None
+            found    = [(batches[batch_id], job.results[batch_id]) for batch_id in sorted(job.results.keys())]
+            unfound  = [batches[batch_id] for batch_id in range(len(batches)) if batch_id not in job.results]
+        return (found, unfound)
+
+    def close(self):
+        """
+        Tells the workers to exit and stops listening.
+        """
+        with self.lock:
+            self.closing = True
+            self.lock.notify_all()
+        # wait for the workers to be told
+        with self.lock:
+            while len(self.workers) > 0:
+                self.lock.wait(1.0)
+        self.listener.close()
+        for proc in self.local_workers:
+            proc.join(Coordinator.LOCAL_WORKER_EXIT_SECS)
+            if proc.is_alive():
+                FastTripsLogger.warning("Terminating local worker pid %d" % proc.pid)
+                proc.terminate()
+        FastTripsLogger.info("Coordinator closed")
+
+
+class CoordinatorJob:
+    """
+    The batches of path specifications for one :py:meth:`Coordinator.find_paths`.
+    """
+    def __init__(self, iteration, hyperpath, bump_wait, batches):
+        self.iteration  = iteration
+        self.hyperpath  = hyperpath
+        self.bump_wait  = bump_wait
+        self.batches    = batches
+        #: batch ids not handed out yet
+        self.todo       = collections.deque(range(len(batches)))
+        #: batch id -> find results
+        self.results    = {}
+
+
+def run_worker(address, authkey, input_network_dir, input_demand_dir, output_dir):
+    """
+    Connects to the :py:class:`Coordinator` at *address*, loads the network supply and then finds
+    paths for the batches the coordinator hands out until it says to exit.
+
+    The ft_intermediate files the coordinator wrote must be in *output_dir*, via a shared file system
+    or a copy, since that's where the supply is read from.
+    """
+    # local imports since Assignment imports us
+    from .Assignment import Assignment
+    from .FastTrips  import FastTrips
+    import _fasttrips
+
+    conn = Client(Coordinator.parse_address(address, connect=True), authkey=authkey)
+    conn.send(("hello", socket.gethostname(), os.getpid()))
+    (welcome, worker_num) = conn.recv()
+    worker_str = "_worker%02d" % worker_num
+
+    worker_FT = FastTrips(input_network_dir=input_network_dir, input_demand_dir=input_demand_dir, output_dir=output_dir,
+                          is_child_process=True, logname_append=worker_str, appendLog=False)
+    FastTripsLogger.info("Worker %2d starting" % worker_num)
+    Assignment.initialize_fasttrips_extension(worker_num, output_dir, worker_FT)
+
+    num_threads = Assignment.number_of_threads()
+
+    conn.send(("ready",))
+    iteration = 0
+    hyperpath = False
+    while True:
+        message = conn.recv()
+        if message[0] == "exit":
+            break
+
+        elif message[0] == "iteration":
+            (iteration, hyperpath, bump_wait) = message[1:]
+            FastTripsLogger.info("Worker %2d iteration %d" % (worker_num, iteration))
+            _fasttrips.clear_bump_wait(None)
+            if bump_wait is not None:
+                _fasttrips.set_bump_wait(bump_wait[0], bump_wait[1])
+
+        elif message[0] == "batch":
+            spec_columns = message[2]
+            FastTripsLogger.debug("Worker %2d finding %d paths for batch %d" %
+                                  (worker_num, spec_columns["path_specs"].shape[0], message[1]))
+            conn.send(("result", message[1],
+                       Assignment.find_paths_for_columns(iteration, hyperpath, spec_columns, num_threads)))
+
+    conn.close()
+    FastTripsLogger.info("Worker %2d exiting" % worker_num)
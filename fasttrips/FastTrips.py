@@ -208,3 +208,13 @@ class FastTrips:
         self.combine_pathset_files()
         self.performance.write(output_dir)
 
+    def run_skims(self, output_dir, origin_taz_ids, destination_taz_ids, preferred_time_min,
+                  user_class, access_mode, transit_mode, egress_mode):
+        """
+        Finds TAZ to TAZ skims.  See :py:meth:`Assignment.generate_skims`.
+        """
+        return Assignment.generate_skims(output_dir=output_dir, FT=self,
+                                         origin_taz_ids=origin_taz_ids, destination_taz_ids=destination_taz_ids,
+                                         preferred_time_min=preferred_time_min, user_class=user_class,
+                                         access_mode=access_mode, transit_mode=transit_mode, egress_mode=egress_mode)
+
@@ -12,8 +12,8 @@ __license__   = """
     See the License for the specific language governing permissions and
     limitations under the License.
 """
-import datetime, os
-import pandas
+import os
+import numpy, pandas
 
 from .Logger    import FastTripsLogger
 from .Passenger import Passenger
@@ -42,39 +42,142 @@ class Performance:
     PERFORMANCE_COLUMN_TIME_ENUMERATING_MS    = "time enumerating milliseconds"
     #: Performance column: Traced, since this affects performance
     PERFORMANCE_COLUMN_TRACED                 = "traced"
+    #: Performance column: Number of labels pushed onto the label stop queue
+    PERFORMANCE_COLUMN_QUEUE_PUSHES           = "queue pushes"
+    #: Performance column: Number of labels popped from the label stop queue
+    PERFORMANCE_COLUMN_QUEUE_POPS             = "queue pops"
+    #: Performance column: Number of superseded labels skipped in the label stop queue
+    PERFORMANCE_COLUMN_QUEUE_STALE_POPS       = "queue stale pops"
+    #: Performance column: Number of trips found departing/arriving within the time window of labeled stops
+    PERFORMANCE_COLUMN_TRIPS_WITHIN_TIME      = "trips within time"
+    #: Performance column: Number of transfer links and trip stops considered from labeled stops
+    PERFORMANCE_COLUMN_STOP_RELAXATIONS       = "stop relaxations"
+    #: Performance column: Number of stop states added
+    PERFORMANCE_COLUMN_STATES_ADDED           = "stop states added"
+    #: Performance column: Number of stop states replaced with a different cost
+    PERFORMANCE_COLUMN_STATES_UPDATED         = "stop states updated"
+    #: Performance column: Number of stop states rejected
+    PERFORMANCE_COLUMN_STATES_REJECTED        = "stop states rejected"
+    #: Performance column: Number of hyperpath stop states pruned for falling outside the time window
+    PERFORMANCE_COLUMN_STATES_PRUNED          = "stop states pruned"
+    #: Performance column: Number of paths generated for the stochastic path set
+    PERFORMANCE_COLUMN_PATHS_DRAWN            = "paths drawn"
+    #: Performance column: Number of distinct paths in the stochastic path set
+    PERFORMANCE_COLUMN_DISTINCT_PATHS         = "distinct paths"
 
     #: File with to write performance results
     OUTPUT_PERFORMANCE_FILE                   = 'ft_output_performance.txt'
 
+    #: The columns of the performance table, in order
+    PERFORMANCE_COLUMNS = [PERFORMANCE_COLUMN_ITERATION,
+                           PERFORMANCE_COLUMN_TRIP_LIST_ID_NUM,
+                           PERFORMANCE_COLUMN_LABEL_ITERATIONS,
+                           PERFORMANCE_COLUMN_MAX_STOP_PROCESS_COUNT,
+                           PERFORMANCE_COLUMN_TIME_LABELING,
+                           PERFORMANCE_COLUMN_TIME_ENUMERATING,
+                           PERFORMANCE_COLUMN_QUEUE_PUSHES,
+                           PERFORMANCE_COLUMN_QUEUE_POPS,
+                           PERFORMANCE_COLUMN_QUEUE_STALE_POPS,
+                           PERFORMANCE_COLUMN_TRIPS_WITHIN_TIME,
+                           PERFORMANCE_COLUMN_STOP_RELAXATIONS,
+                           PERFORMANCE_COLUMN_STATES_ADDED,
+                           PERFORMANCE_COLUMN_STATES_UPDATED,
+                           PERFORMANCE_COLUMN_STATES_REJECTED,
+                           PERFORMANCE_COLUMN_STATES_PRUNED,
+                           PERFORMANCE_COLUMN_PATHS_DRAWN,
+                           PERFORMANCE_COLUMN_DISTINCT_PATHS,
+                           PERFORMANCE_COLUMN_TIME_ENUMERATING_MS,
+                           PERFORMANCE_COLUMN_TIME_LABELING_MS,
+                           PERFORMANCE_COLUMN_TRACED]
+
+    #: The performance columns of the counts the C++ extension returns, in its order
+    PERFORMANCE_COUNT_COLUMNS = [PERFORMANCE_COLUMN_LABEL_ITERATIONS,
+                                 PERFORMANCE_COLUMN_MAX_STOP_PROCESS_COUNT,
+                                 PERFORMANCE_COLUMN_QUEUE_PUSHES,
+                                 PERFORMANCE_COLUMN_QUEUE_POPS,
+                                 PERFORMANCE_COLUMN_QUEUE_STALE_POPS,
+                                 PERFORMANCE_COLUMN_TRIPS_WITHIN_TIME,
+                                 PERFORMANCE_COLUMN_STOP_RELAXATIONS,
+                                 PERFORMANCE_COLUMN_STATES_ADDED,
+                                 PERFORMANCE_COLUMN_STATES_UPDATED,
+                                 PERFORMANCE_COLUMN_STATES_REJECTED,
+                                 PERFORMANCE_COLUMN_STATES_PRUNED,
+                                 PERFORMANCE_COLUMN_PATHS_DRAWN,
+                                 PERFORMANCE_COLUMN_DISTINCT_PATHS]
+
     def __init__(self):
         """
         Constructor.  Initialize empty dataframe for performance info.
         """
-        self.performance_df = pandas.DataFrame(columns=[Performance.PERFORMANCE_COLUMN_ITERATION,
-                                                        Performance.PERFORMANCE_COLUMN_TRIP_LIST_ID_NUM,
-                                                        Performance.PERFORMANCE_COLUMN_LABEL_ITERATIONS,
-                                                        Performance.PERFORMANCE_COLUMN_MAX_STOP_PROCESS_COUNT,
-                                                        Performance.PERFORMANCE_COLUMN_TIME_LABELING,
-                                                        Performance.PERFORMANCE_COLUMN_TIME_ENUMERATING])
-
-    def add_info(self, iteration, trip_list_id_num, perf_dict):
+        self.performance_df = pandas.DataFrame(columns=Performance.PERFORMANCE_COLUMNS)
+
+        #: Dataframes of the performance info added since :py:attr:`Performance.performance_df` was
+        #: built, in the order it was added.  Appending to the dataframe a path at a time would copy it
+        #: each time.
+        self.pending_frames = []
+
+    def add_arrays(self, iterations, trip_list_id_nums, traced, perf_ints, perf_ms):
+        """
+        Add the performance info for a number of paths, in the arrays the C++ extension returns it in.
+
+        :param iterations:        the iteration of each path
+        :param trip_list_id_nums: the trip list ID num of each path
+        :param traced:            was each path traced?
+        :param perf_ints:         a row per path with the :py:attr:`Performance.PERFORMANCE_COUNT_COLUMNS`
+        :param perf_ms:           a row per path with the milliseconds labeling and enumerating
+        """
+        perf_df = pandas.DataFrame(perf_ints, columns=Performance.PERFORMANCE_COUNT_COLUMNS)
+        perf_df[Performance.PERFORMANCE_COLUMN_ITERATION         ] = iterations
+        perf_df[Performance.PERFORMANCE_COLUMN_TRIP_LIST_ID_NUM  ] = trip_list_id_nums
+        perf_df[Performance.PERFORMANCE_COLUMN_TRACED            ] = numpy.asarray(traced).astype(bool)
+        perf_df[Performance.PERFORMANCE_COLUMN_TIME_LABELING_MS  ] = perf_ms[:,0]
+        perf_df[Performance.PERFORMANCE_COLUMN_TIME_ENUMERATING_MS] = perf_ms[:,1]
+        self.pending_frames.append(perf_df)
+
+    def dataframe(self):
         """
-        Add this row to the performance dataframe.
-        Assumes time values are in milliseconds.
+        Returns the performance info as a :py:class:`pandas.DataFrame` with the :py:attr:`Performance.PERFORMANCE_COLUMNS`,
+        adding what's been added since the last call to :py:attr:`Performance.performance_df` in one go.
         """
-        perf_dict[Performance.PERFORMANCE_COLUMN_ITERATION       ] = iteration
-        perf_dict[Performance.PERFORMANCE_COLUMN_TRIP_LIST_ID_NUM] = trip_list_id_num
+        if len(self.pending_frames) == 0:
+            return self.performance_df
+
+        new_df = pandas.concat(self.pending_frames, ignore_index=True)
+        self.pending_frames = []
 
         # convert milliseconds time to timedeltas
-        perf_dict[Performance.PERFORMANCE_COLUMN_TIME_LABELING   ] = datetime.timedelta(milliseconds=perf_dict[Performance.PERFORMANCE_COLUMN_TIME_LABELING_MS   ])
-        perf_dict[Performance.PERFORMANCE_COLUMN_TIME_ENUMERATING] = datetime.timedelta(milliseconds=perf_dict[Performance.PERFORMANCE_COLUMN_TIME_ENUMERATING_MS])
+        new_df[Performance.PERFORMANCE_COLUMN_TIME_LABELING   ] = pandas.to_timedelta(new_df[Performance.PERFORMANCE_COLUMN_TIME_LABELING_MS   ], unit='ms')
+        new_df[Performance.PERFORMANCE_COLUMN_TIME_ENUMERATING] = pandas.to_timedelta(new_df[Performance.PERFORMANCE_COLUMN_TIME_ENUMERATING_MS], unit='ms')
+        new_df = new_df[Performance.PERFORMANCE_COLUMNS]
+
+        if len(self.performance_df) == 0:
+            self.performance_df = new_df
+        else:
+            self.performance_df = pandas.concat([self.performance_df, new_df], ignore_index=True)
+        return self.performance_df
+
+    def cost_estimates(self, trip_list_id_nums):
+        """
+        Estimates how expensive finding each of the given paths will be from the last time it was
+        found: the milliseconds spent labeling plus enumerating.
+
+        Returns a :py:class:`numpy.ndarray` of those, in the order of *trip_list_id_nums*, with -1 for
+        paths that haven't been found yet.
+        """
+        performance_df = self.dataframe()
+        if len(performance_df) == 0:
+            return numpy.repeat(-1.0, len(trip_list_id_nums))
 
-        self.performance_df = self.performance_df.append(perf_dict, ignore_index=True)
+        # the latest iteration for each
+        last_df = performance_df.groupby(Performance.PERFORMANCE_COLUMN_TRIP_LIST_ID_NUM).last()
+        milliseconds = last_df[Performance.PERFORMANCE_COLUMN_TIME_LABELING_MS] + \
+                       last_df[Performance.PERFORMANCE_COLUMN_TIME_ENUMERATING_MS]
+        return milliseconds.reindex(trip_list_id_nums).fillna(-1.0).values.astype('float64')
 
     def write(self, output_dir):
         """
         Writes the results to OUTPUT_PERFORMANCE_FILE to a tab-delimited file.
         """
         output_filename = os.path.join(output_dir, Performance.OUTPUT_PERFORMANCE_FILE)
-        self.performance_df.to_csv(output_filename, sep="\t", index=False, date_format="")
+        self.dataframe().to_csv(output_filename, sep="\t", index=False, date_format="")
         FastTripsLogger.info("Wrote performance info to %s" % output_filename)
\ No newline at end of file
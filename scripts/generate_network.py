@@ -0,0 +1,315 @@
+import argparse, math, os, random, sys
+
+USAGE = r"""
+
+  python generate_network.py [options] output_dir
+
+  Generates a synthetic transit network and demand for pathfinder benchmarks, written in the formats the
+  C++ extension reads: the ft_intermediate_* supply files (as written by fasttrips.Stop, fasttrips.Route,
+  fasttrips.Trip etc. for PathFinder::initializeSupply) and the ft_capture_* files (the stop times, the
+  pathfinding parameters and the path specifications, as written with capture_path_specifications = True).
+
+  Replay the result with build/ft_replay output_dir, e.g.
+
+  python scripts\generate_network.py --topology radial --stops 10000 --paths 500 --hyperpath C:\temp\radial_10k
+  build\ft_replay C:\temp\radial_10k
+
+  Topologies:
+    grid    stops on a square grid; local routes run along the rows and columns, rapid routes along every
+            fourth row and column with a stop at every third grid point
+    radial  stops on rings around a center; local routes run along the spokes (through the center) and
+            around the rings, rapid routes along every fourth spoke with a stop on every third ring
+
+  Stops are STOP_SPACING miles apart along routes.  Routes longer than --route_length stops are split into
+  overlapping routes.  Walk transfers connect stops within --transfer_distance miles of each other, keeping
+  each with probability --transfer_density.  TAZs cover squares of about --stops_per_taz stops, with walk
+  access and egress links to the stops within --access_distance miles of their centers.
+"""
+
+STOP_SPACING        = 0.25      # miles
+WALK_SPEED          = 3.0       # miles per hour
+LOCAL_SPEED         = 12.0      # miles per hour
+RAPID_SPEED         = 20.0      # miles per hour
+DWELL_TIME          = 0.25      # minutes
+
+SUPPLY_MODES        = [(1, "local_bus"), (2, "rapid_bus"), (3, "walk_access"), (4, "walk_egress"), (5, "transfer")]
+MODE_LOCAL          = 1
+MODE_RAPID          = 2
+MODE_WALK_ACCESS    = 3
+MODE_WALK_EGRESS    = 4
+MODE_TRANSFER       = 5
+
+def minutes_to_walk(miles):
+    return 60.0*miles/WALK_SPEED
+
+class SyntheticNetwork:
+    """
+    A synthetic network: stops with coordinates, routes as lists of stops, and their trips.
+    """
+
+    def __init__(self, args):
+        self.args     = args
+        self.random   = random.Random(args.seed)
+        self.stops    = []   # (x, y) in miles, stop_id_num = index + 1
+        self.routes   = []   # (mode_num, [stop_id_num])
+        if args.topology == "grid":
+            self.build_grid()
+        else:
+            self.build_radial()
+
+    def add_routes(self, mode, line):
+        """
+        Adds the routes along the given line of stop indices in both directions, split into overlapping
+        routes of at most args.route_length stops.
+        """
+        if len(line) < 2: return
+        length = max(2, self.args.route_length)
+        step   = max(1, length - length/4)
+        start  = 0
+        while True:
+            piece = line[start:start+length]
+            self.routes.append((mode, [stop+1 for stop in piece]))
+            self.routes.append((mode, [stop+1 for stop in reversed(piece)]))
+            if start + length >= len(line): break
+            start += step
+
+    def build_grid(self):
+        side = int(math.ceil(math.sqrt(self.args.stops)))
+        for row in range(side):
+            for col in range(side):
+                self.stops.append((col*STOP_SPACING, row*STOP_SPACING))
+
+        for row in range(side):
+            self.add_routes(MODE_LOCAL, [row*side + col for col in range(side)])
+            if row % 4 == 2:
+                self.add_routes(MODE_RAPID, [row*side + col for col in range(0, side, 3)])
+        for col in range(side):
+            self.add_routes(MODE_LOCAL, [row*side + col for row in range(side)])
+            if col % 4 == 2:
+                self.add_routes(MODE_RAPID, [row*side + col for row in range(0, side, 3)])
+
+    def build_radial(self):
+        # rings r = 1..R with 6r stops each, so stops ~ 3R^2, plus the center
+        rings  = max(1, int(math.ceil(math.sqrt(self.args.stops/3.0))))
+        spokes = 6
+        self.stops.append((0.0, 0.0))
+        ring_start = [0]
+        for ring in range(1, rings+1):
+            ring_start.append(len(self.stops))
+            for ind in range(6*ring):
+                angle = 2.0*math.pi*ind/(6*ring)
+                self.stops.append((ring*STOP_SPACING*math.cos(angle), ring*STOP_SPACING*math.sin(angle)))
+
+        def nearest_on_ring(ring, angle):
+            return ring_start[ring] + int(round(angle/(2.0*math.pi)*6*ring)) % (6*ring)
+
+        # spokes through the center, at every stop of the first ring and then more often farther out
+        num_lines = spokes*max(1, rings/8)
+        for line in range(num_lines):
+            angle    = math.pi*line/num_lines
+            opposite = angle + math.pi
+            stops    = [nearest_on_ring(ring, opposite) for ring in range(rings, 0, -1)] + [0] + \
+                       [nearest_on_ring(ring, angle)    for ring in range(1, rings+1)]
+            self.add_routes(MODE_LOCAL, stops)
+            if line % 4 == 0:
+                self.add_routes(MODE_RAPID, stops[::3])
+        # every other ring
+        for ring in range(1, rings+1, 2):
+            stops = range(ring_start[ring], ring_start[ring] + 6*ring)
+            self.add_routes(MODE_LOCAL, stops + stops[:1])
+
+    def write(self, output_dir):
+        args = self.args
+        if not os.path.exists(output_dir):
+            os.makedirs(output_dir)
+
+        # TAZs on a square grid over the stops
+        xs = [x for (x, y) in self.stops]
+        ys = [y for (x, y) in self.stops]
+        taz_size = STOP_SPACING*math.sqrt(max(1.0, args.stops_per_taz))
+        taz_cols = max(1, int(math.ceil((max(xs) - min(xs))/taz_size)))
+        taz_rows = max(1, int(math.ceil((max(ys) - min(ys))/taz_size)))
+        tazs     = []   # (taz_num, x, y)
+        for row in range(taz_rows):
+            for col in range(taz_cols):
+                tazs.append((len(self.stops) + 1 + len(tazs),
+                             min(xs) + (col + 0.5)*taz_size, min(ys) + (row + 0.5)*taz_size))
+
+        # stops by grid cell, for neighbor searches
+        cell_size = max(args.transfer_distance, args.access_distance, STOP_SPACING)
+        cells     = {}
+        for ind, (x, y) in enumerate(self.stops):
+            cells.setdefault((int(math.floor(x/cell_size)), int(math.floor(y/cell_size))), []).append(ind)
+
+        def stops_near(x, y, distance):
+            cx, cy = int(math.floor(x/cell_size)), int(math.floor(y/cell_size))
+            for dx in (-1, 0, 1):
+                for dy in (-1, 0, 1):
+                    for ind in cells.get((cx+dx, cy+dy), []):
+                        dist = math.hypot(self.stops[ind][0] - x, self.stops[ind][1] - y)
+                        if dist <= distance:
+                            yield ind, dist
+
+        # ids
+        f = open(os.path.join(output_dir, "ft_intermediate_stop_id.txt"), "w")
+        f.write("stop_id_num stop_id\n")
+        for ind in range(len(self.stops)):
+            f.write("%d S%d\n" % (ind+1, ind+1))
+        for (taz_num, x, y) in tazs:
+            f.write("%d Z%d\n" % (taz_num, taz_num - len(self.stops)))
+        f.close()
+
+        f = open(os.path.join(output_dir, "ft_intermediate_supply_mode_id.txt"), "w")
+        f.write("mode_num mode\n")
+        for (mode_num, mode) in SUPPLY_MODES:
+            f.write("%d %s\n" % (mode_num, mode))
+        f.close()
+
+        # routes, trips and stop times
+        num_trips      = 0
+        num_stop_times = 0
+        f_route  = open(os.path.join(output_dir, "ft_intermediate_route_id.txt"),  "w")
+        f_trip   = open(os.path.join(output_dir, "ft_intermediate_trip_id.txt"),   "w")
+        f_info   = open(os.path.join(output_dir, "ft_intermediate_trip_info.txt"), "w")
+        f_times  = open(os.path.join(output_dir, "ft_capture_stop_times.txt"),     "w")
+        f_route.write("route_id_num route_id\n")
+        f_trip.write ("trip_id_num trip_id\n")
+        f_info.write ("trip_id_num attr_name attr_value\n")
+        f_times.write("trip_id_num sequence stop_id_num arrive_time depart_time\n")
+        for route_ind, (mode, stops) in enumerate(self.routes):
+            f_route.write("%d R%d\n" % (route_ind+1, route_ind+1))
+            speed   = RAPID_SPEED if mode == MODE_RAPID else LOCAL_SPEED
+            headway = args.rapid_headway if mode == MODE_RAPID else args.headway
+            hops    = [60.0*math.hypot(self.stops[stops[ind+1]-1][0] - self.stops[stops[ind]-1][0],
+                                       self.stops[stops[ind+1]-1][1] - self.stops[stops[ind]-1][1])/speed
+                       for ind in range(len(stops)-1)]
+            depart  = args.start_time + self.random.random()*headway
+            while depart < args.end_time:
+                num_trips += 1
+                f_trip.write("%d T%d\n" % (num_trips, num_trips))
+                f_info.write("%d mode_num %d\n%d route_id_num %d\n" % (num_trips, mode, num_trips, route_ind+1))
+                arrive = depart
+                for seq, stop in enumerate(stops):
+                    stop_depart = arrive + (DWELL_TIME if seq > 0 and seq < len(stops)-1 else 0.0)
+                    f_times.write("%d %d %d %.4f %.4f\n" % (num_trips, seq+1, stop, arrive, stop_depart))
+                    num_stop_times += 1
+                    if seq < len(hops):
+                        arrive = stop_depart + hops[seq]
+                depart += headway
+        f_route.close()
+        f_trip.close()
+        f_info.close()
+        f_times.close()
+
+        # walk transfers
+        num_transfers = 0
+        f = open(os.path.join(output_dir, "ft_intermediate_transfers.txt"), "w")
+        f.write("from_stop_id_num to_stop_id_num attr_name attr_value\n")
+        for ind, (x, y) in enumerate(self.stops):
+            for (other, dist) in stops_near(x, y, args.transfer_distance):
+                if other == ind or self.random.random() >= args.transfer_density: continue
+                walk_time = minutes_to_walk(dist)
+                f.write("%d %d time_min %.2f\n%d %d walk_time_min %.2f\n%d %d dist %.3f\n" %
+                        (ind+1, other+1, walk_time, ind+1, other+1, walk_time, ind+1, other+1, dist))
+                num_transfers += 1
+        f.close()
+
+        # walk access and egress
+        num_access = 0
+        f = open(os.path.join(output_dir, "ft_intermediate_access_egress.txt"), "w")
+        f.write("taz_num supply_mode_num stop_id_num attr_name attr_value\n")
+        for (taz_num, x, y) in tazs:
+            for (stop, dist) in stops_near(x, y, args.access_distance):
+                walk_time = minutes_to_walk(dist)
+                for mode in (MODE_WALK_ACCESS, MODE_WALK_EGRESS):
+                    f.write("%d %d %d time_min %.2f\n%d %d %d dist %.3f\n" %
+                            (taz_num, mode, stop+1, walk_time, taz_num, mode, stop+1, dist))
+                num_access += 1
+        f.close()
+
+        # the default weights, as in the test network's pathweight_ft.txt
+        f = open(os.path.join(output_dir, "ft_intermediate_weights.txt"), "w")
+        f.write("user_class demand_mode_type demand_mode supply_mode_num weight_name weight_value\n")
+        f.write("all access walk %d time_min 3.93\n"        % MODE_WALK_ACCESS)
+        f.write("all egress walk %d time_min 3.93\n"        % MODE_WALK_EGRESS)
+        f.write("all transfer transfer %d walk_time_min 3.93\n" % MODE_TRANSFER)
+        for mode in (MODE_LOCAL, MODE_RAPID):
+            f.write("all transit transit %d in_vehicle_time_min 1.0\n"   % mode)
+            f.write("all transit transit %d wait_time_min 1.77\n"        % mode)
+            f.write("all transit transit %d transfer_penalty 47.73\n"    % mode)
+        f.close()
+
+        # the pathfinding parameters, as the Assignment defaults
+        f = open(os.path.join(output_dir, "ft_capture_parameters.txt"), "w")
+        f.write("parameter value\n")
+        f.write("time_window %f\n"                  % args.time_window)
+        f.write("bump_buffer 5\n")
+        f.write("stoch_pathset_size %d\n"           % args.pathset_size)
+        f.write("stoch_pathset_threads 1\n")
+        f.write("stoch_dispersion %f\n"             % args.dispersion)
+        f.write("stoch_max_stop_process_count %d\n" % args.max_stop_process_count)
+        f.write("goal_direction %d\n"               % args.goal_direction)
+        f.write("goal_direction_landmarks 16\n")
+        f.close()
+
+        # the trip list: random origins and destinations with an access link, half of them outbound
+        served = [taz for taz in tazs if any(True for s in stops_near(taz[1], taz[2], args.access_distance))]
+        f = open(os.path.join(output_dir, "ft_capture_path_specs.txt"), "w")
+        f.write("iteration passenger_id path_id hyperpath user_class access_mode transit_mode egress_mode "
+                "origin_taz_id destination_taz_id outbound preferred_time trace\n")
+        path_id = 0
+        while path_id < args.paths and len(served) > 1:
+            origin      = self.random.choice(served)[0]
+            destination = self.random.choice(served)[0]
+            if origin == destination: continue
+            path_id += 1
+            f.write("1 %d %d %d all walk transit walk %d %d %d %.2f 0\n" %
+                    (path_id, path_id, 1 if args.hyperpath else 0, origin, destination,
+                     1 if self.random.random() < 0.5 else 0,
+                     args.start_time + 45 + self.random.random()*max(0.0, args.end_time - args.start_time - 90)))
+        f.close()
+
+        return { "stops"      : len(self.stops),
+                 "routes"     : len(self.routes),
+                 "trips"      : num_trips,
+                 "stop_times" : num_stop_times,
+                 "transfers"  : num_transfers,
+                 "tazs"       : len(tazs),
+                 "access"     : num_access,
+                 "paths"      : path_id }
+
+def add_arguments(parser):
+    """
+    Adds the network and demand options to the given argparse.ArgumentParser.
+    """
+    parser.add_argument("--topology",               choices=['grid','radial'], default='grid')
+    parser.add_argument("--stops",                  type=int,   default=1000,   help="Approximate number of stops")
+    parser.add_argument("--route_length",           type=int,   default=40,     help="Maximum stops per route")
+    parser.add_argument("--headway",                type=float, default=10.0,   help="Local route headway, in minutes")
+    parser.add_argument("--rapid_headway",          type=float, default=6.0,    help="Rapid route headway, in minutes")
+    parser.add_argument("--start_time",             type=float, default=15*60,  help="Start of service, minutes after midnight")
+    parser.add_argument("--end_time",               type=float, default=18*60,  help="End of service, minutes after midnight")
+    parser.add_argument("--transfer_distance",      type=float, default=0.3,    help="Maximum walk transfer distance, in miles")
+    parser.add_argument("--transfer_density",       type=float, default=0.5,    help="Fraction of stop pairs within transfer distance with a transfer")
+    parser.add_argument("--stops_per_taz",          type=float, default=16,     help="Approximate number of stops per TAZ")
+    parser.add_argument("--access_distance",        type=float, default=0.5,    help="Maximum walk access distance, in miles")
+    parser.add_argument("--paths",                  type=int,   default=200,    help="Number of path specifications")
+    parser.add_argument("--hyperpath",              action='store_true',        help="Find stochastic (hyperpath) paths")
+    parser.add_argument("--time_window",            type=float, default=30)
+    parser.add_argument("--pathset_size",           type=int,   default=1000)
+    parser.add_argument("--dispersion",             type=float, default=1.0)
+    parser.add_argument("--max_stop_process_count", type=int,   default=-1)
+    parser.add_argument("--goal_direction",         type=int,   default=0,      choices=[0,1,2],
+                        help="0 for none, 1 for TAZ, 2 for landmarks; see Assignment.GOAL_DIRECTION")
+    parser.add_argument("--seed",                   type=int,   default=1)
+
+if __name__ == "__main__":
+
+    parser = argparse.ArgumentParser(usage=USAGE)
+    add_arguments(parser)
+    parser.add_argument("output_dir", type=str)
+    args = parser.parse_args(sys.argv[1:])
+
+    counts = SyntheticNetwork(args).write(args.output_dir)
+    print "Wrote %s: %s" % (args.output_dir, ", ".join(["%d %s" % (counts[key], key) for key in
+                                                       ["stops","routes","trips","stop_times","transfers","tazs","access","paths"]]))
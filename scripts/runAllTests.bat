@@ -19,4 +19,8 @@ python scripts\runTest.py deterministic 2 True Examples\test_network\input Examp
 python scripts\runTest.py stochastic 1 False Examples\test_network\input Examples\test_network\demand_reg Examples\test_network\output
 
 :: stochatic, 2 iterations, capacity constraint on
-python scripts\runTest.py stochastic 2 True Examples\test_network\input Examples\test_network\demand_reg Examples\test_network\output
\ No newline at end of file
+python scripts\runTest.py stochastic 2 True Examples\test_network\input Examples\test_network\demand_reg Examples\test_network\output
+
+
+:: coordinator with local workers, and with a worker that dies and one that hangs
+python scripts\testCoordinator.py Examples\test_network\input Examples\test_network\demand_reg Examples\test_network\output
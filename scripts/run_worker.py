@@ -0,0 +1,30 @@
+from fasttrips.Coordinator import run_worker
+import argparse, sys
+
+USAGE = r"""
+
+  python run_worker.py [--authkey key] address input_network_dir input_demand_dir output_dir
+
+  Connects to the fast-trips coordinator at address (host:port, or a Unix socket path) and finds
+  passenger paths for it until it's done.  See the coordinator_address configuration option.
+
+  The coordinator's output_dir (with its ft_intermediate files) must be readable here as output_dir,
+  and the input directories must be the same network and demand.
+
+  e.g.
+
+  python scripts\run_worker.py modelhost:6100 "C:\fasttrips\network" "C:\fasttrips\demand" \\modelhost\fasttrips\output
+"""
+
+if __name__ == "__main__":
+
+    parser = argparse.ArgumentParser(usage=USAGE)
+    parser.add_argument("--authkey",         type=str, default="fasttrips")
+    parser.add_argument("address",           type=str)
+    parser.add_argument("input_network_dir", type=str)
+    parser.add_argument("input_demand_dir",  type=str)
+    parser.add_argument("output_dir",        type=str)
+    args = parser.parse_args(sys.argv[1:])
+
+    run_worker(args.address, args.authkey,
+               args.input_network_dir, args.input_demand_dir, args.output_dir)
@@ -0,0 +1,72 @@
+import argparse, os, re, subprocess, sys
+
+import generate_network
+
+USAGE = r"""
+
+  python scaling_benchmark.py [options] work_dir
+
+  Sweeps synthetic networks (see generate_network.py) from 1k to 100k stops, replays deterministic and
+  hyperpath path specifications on each with ft_replay (build it with python setup.py build_replay) and
+  reports how label iterations, memory and latency scale.
+
+  e.g.
+
+  python scripts\scaling_benchmark.py --topology radial --sizes 1000,10000 C:\temp\scaling
+"""
+
+if __name__ == "__main__":
+
+    parser = argparse.ArgumentParser(usage=USAGE)
+    generate_network.add_arguments(parser)
+    parser.add_argument("--sizes",   type=str, default="1000,3000,10000,30000,100000", help="Comma-separated numbers of stops")
+    parser.add_argument("--threads", type=int, default=1)
+    parser.add_argument("--replay",  type=str, default=os.path.join("build", "ft_replay.exe" if sys.platform == 'win32' else "ft_replay"))
+    parser.add_argument("work_dir",  type=str)
+    args = parser.parse_args(sys.argv[1:])
+
+    if not os.path.exists(args.replay):
+        print "Couldn't find %s; build it with python setup.py build_replay" % args.replay
+        sys.exit(2)
+
+    results = []
+    for stops in [int(size) for size in args.sizes.split(",")]:
+        args.stops     = stops
+        args.hyperpath = False
+        output_dir     = os.path.join(args.work_dir, "%s_%d" % (args.topology, stops))
+        counts         = generate_network.SyntheticNetwork(args).write(output_dir)
+
+        # the same trip list, stochastic
+        det_specs_file = os.path.join(output_dir, "ft_capture_path_specs.txt")
+        hyp_specs_file = os.path.join(output_dir, "ft_capture_path_specs_hyperpath.txt")
+        det_specs      = open(det_specs_file, "r")
+        hyp_specs      = open(hyp_specs_file, "w")
+        hyp_specs.write(det_specs.readline())
+        for line in det_specs:
+            fields    = line.split()
+            fields[3] = "1"
+            hyp_specs.write(" ".join(fields) + "\n")
+        det_specs.close()
+        hyp_specs.close()
+
+        for (path_type, specs_file) in [("det", det_specs_file), ("hyp", hyp_specs_file)]:
+            replay = subprocess.Popen([args.replay, output_dir, specs_file, str(args.threads)],
+                                      stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+            output = replay.communicate()[0]
+            if replay.returncode != 0:
+                print output
+                sys.exit(replay.returncode)
+
+            run = re.search(r"([\d.]+) seconds; ([\d.]+) paths per second; (\d+) label iterations; ([\d.]+) MB peak memory", output)
+            pct = dict((match.group(1), [float(value) for value in match.groups()[1:]])
+                       for match in re.finditer(r"^(labeling|enumerating|total)\s+([\d.]+)\s+([\d.]+)\s+([\d.]+)\s+([\d.]+)", output, re.M))
+            results.append((counts["stops"], counts["stop_times"], path_type, counts["paths"],
+                            float(run.group(2)), int(run.group(3))/max(1, counts["paths"]), float(run.group(4)),
+                            pct["total"][0], pct["total"][1], pct["total"][3]))
+            print "%s %s: %s" % (output_dir, path_type, run.group(0))
+
+    print
+    print "%8s %10s %4s %6s %10s %12s %9s %9s %9s %9s" % ("stops", "stop_times", "type", "paths", "paths/s",
+                                                        "labels/path", "peak_MB", "p50_ms", "p95_ms", "max_ms")
+    for result in results:
+        print "%8d %10d %4s %6d %10.1f %12d %9.1f %9.2f %9.2f %9.2f" % result
@@ -0,0 +1,176 @@
+import fasttrips
+from fasttrips.Assignment  import Assignment
+from fasttrips.Coordinator import Coordinator, run_worker
+from fasttrips.Passenger   import Passenger
+from multiprocessing.connection import Client
+import argparse, multiprocessing, os, socket, sys, threading, time
+import numpy
+
+USAGE = r"""
+
+  python testCoordinator.py input_network_dir input_demand_dir output_dir
+
+  Finds the deterministic paths for the demand in this process, and then through a Coordinator
+  with local worker processes on this machine, and checks they're the same:
+
+  1. with two local workers
+  2. with a local worker, a worker that dies when it gets its batch and one that hangs
+     with its batch, whose batches have to be handed to the local worker
+
+  Exits with status 1 if a check fails.
+
+  e.g.
+
+  python scripts\testCoordinator.py Examples\test_network\input Examples\test_network\demand_reg Examples\test_network\output
+"""
+
+#: Paths per batch, small so each worker gets several
+BATCH_SIZE          = 5
+
+#: Seconds before the hanging worker's batch is given up on
+BATCH_TIMEOUT_SECS  = 20
+
+#: Seconds before the test is called hung
+TEST_TIMEOUT_SECS   = 600
+
+AUTHKEY             = "fasttrips-test"
+
+def free_address():
+    """
+    Returns a localhost:port address with a port nothing's listening on.
+    """
+    sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    sock.bind(("localhost", 0))
+    port = sock.getsockname()[1]
+    sock.close()
+    return "localhost:%d" % port
+
+def faulty_worker(address, got_batch, hang):
+    """
+    Connects to the coordinator as a worker would and takes a batch, and then dies (or hangs,
+    keeping its connection open) instead of finding it.
+    """
+    conn = Client(Coordinator.parse_address(address, connect=True), authkey=AUTHKEY)
+    conn.send(("hello", socket.gethostname(), os.getpid()))
+    conn.recv()
+    conn.send(("ready",))
+    while True:
+        message = conn.recv()
+        if message[0] == "batch":
+            got_batch.set()
+            if hang:
+                time.sleep(TEST_TIMEOUT_SECS)
+            os._exit(1)
+
+def test_timed_out():
+    print "Timed out"
+    os._exit(1)
+
+def paths_by_trip_list_id(found):
+    """
+    Returns trip list ID num -> (path cost, state ints, state doubles) for the (spec columns, find results) found.
+    """
+    paths = {}
+    for (spec_columns, find_results) in found:
+        (path_start, ret_ints, ret_doubles, path_costs, perf_ints, perf_ms) = find_results
+        path_specs = spec_columns["path_specs"]
+        for index in range(path_specs.shape[0]):
+            start, end = path_start[index], path_start[index+1]
+            paths[path_specs[index,1]] = (path_costs[index], ret_ints[start:end], ret_doubles[start:end])
+    return paths
+
+def check_paths(test_name, expected, found, unfound):
+    """
+    Returns True if the paths found through the coordinator are the ones found in this process.
+    """
+    paths = paths_by_trip_list_id(found)
+    ok    = True
+    if len(unfound) > 0:
+        print "%s: %d batches weren't found" % (test_name, len(unfound))
+        ok = False
+    for (trip_list_id_num, (cost, ret_ints, ret_doubles)) in expected.iteritems():
+        if trip_list_id_num not in paths:
+            print "%s: no path for trip list ID num %d" % (test_name, trip_list_id_num)
+            ok = False
+            continue
+        (found_cost, found_ints, found_doubles) = paths[trip_list_id_num]
+        if found_cost != cost or not numpy.array_equal(found_ints, ret_ints) or not numpy.array_equal(found_doubles, ret_doubles):
+            print "%s: the path for trip list ID num %d differs" % (test_name, trip_list_id_num)
+            ok = False
+    print "%s: %s (%d paths)" % (test_name, "OK" if ok else "FAILED", len(expected))
+    return ok
+
+if __name__ == "__main__":
+
+    parser = argparse.ArgumentParser(usage=USAGE)
+    parser.add_argument("input_network_dir", type=str)
+    parser.add_argument("input_demand_dir",  type=str)
+    parser.add_argument("output_dir",        type=str)
+
+    args = parser.parse_args(sys.argv[1:])
+
+    full_output_dir = os.path.join(args.output_dir, "coordinator")
+    if not os.path.exists(full_output_dir):
+        print "Creating full output dir [%s]" % full_output_dir
+        os.makedirs(full_output_dir)
+
+    # don't wait forever if the coordinator doesn't requeue a batch
+    watchdog = threading.Timer(TEST_TIMEOUT_SECS, test_timed_out)
+    watchdog.daemon = True
+    watchdog.start()
+
+    ft = fasttrips.FastTrips(args.input_network_dir, args.input_demand_dir, full_output_dir)
+    Assignment.ASSIGNMENT_TYPE = Assignment.ASSIGNMENT_TYPE_DET_ASGN
+
+    trip_list_id_nums = ft.passengers.trip_list_df[Passenger.TRIP_LIST_COLUMN_TRIP_LIST_ID_NUM].values
+    spec_columns      = Assignment.path_spec_columns(ft, trip_list_id_nums, numpy.repeat(-1.0, len(trip_list_id_nums)))
+
+    # in this process
+    Assignment.initialize_fasttrips_extension(0, full_output_dir, ft)
+    expected = paths_by_trip_list_id([(spec_columns, Assignment.find_paths_for_columns(1, False, spec_columns, 1))])
+
+    all_ok = True
+
+    # 1. two local workers
+    coordinator = Coordinator(free_address(), AUTHKEY, 2, args.input_network_dir, args.input_demand_dir,
+                              full_output_dir, BATCH_TIMEOUT_SECS)
+    try:
+        (found, unfound) = coordinator.find_paths(1, False, None, spec_columns, BATCH_SIZE)
+    finally:
+        coordinator.close()
+    all_ok = check_paths("two local workers", expected, found, unfound) and all_ok
+
+    # 2. the faulty workers connect first, so they get batches before the local worker is ready
+    address     = free_address()
+    coordinator = Coordinator(address, AUTHKEY, 0, args.input_network_dir, args.input_demand_dir,
+                              full_output_dir, BATCH_TIMEOUT_SECS)
+    faulty_procs = []
+    got_batches  = []
+    try:
+        for hang in [False, True]:
+            got_batches.append(multiprocessing.Event())
+            faulty_procs.append(multiprocessing.Process(target=faulty_worker, args=(address, got_batches[-1], hang)))
+            faulty_procs[-1].daemon = True
+            faulty_procs[-1].start()
+        while len(coordinator.workers) < 2:
+            time.sleep(0.1)
+
+        local_proc = multiprocessing.Process(target=run_worker,
+                                             args=(address, AUTHKEY, args.input_network_dir,
+                                                   args.input_demand_dir, full_output_dir))
+        local_proc.daemon = True
+        local_proc.start()
+        coordinator.local_workers.append(local_proc)
+
+        (found, unfound) = coordinator.find_paths(1, False, None, spec_columns, BATCH_SIZE)
+    finally:
+        coordinator.close()
+        for proc in faulty_procs:
+            proc.terminate()
+
+    requeued = all([got_batch.is_set() for got_batch in got_batches])
+    if not requeued:
+        print "killed and hung workers: the faulty workers didn't get batches"
+    all_ok = check_paths("killed and hung workers", expected, found, unfound) and requeued and all_ok
+
+    sys.exit(0 if all_ok else 1)
@@ -1,5 +1,33 @@
 from setuptools import setup, Extension
+from distutils.core import Command
+from distutils.ccompiler import new_compiler
+from distutils.sysconfig import customize_compiler
 import numpy
+import sys
+
+class build_replay(Command):
+    """
+    Builds ft_replay, the standalone path finding benchmark in src/replay.cpp, into build/.
+    """
+    description  = "build the ft_replay path finding benchmark"
+    user_options = []
+
+    def initialize_options(self):
+        pass
+
+    def finalize_options(self):
+        pass
+
+    def run(self):
+        compiler = new_compiler()
+        customize_compiler(compiler)
+        objects  = compiler.compile(['src/replay.cpp', 'src/pathfinder.cpp'],
+                                    output_dir='build',
+                                    macros=[('NDEBUG', None)])
+        compiler.link_executable(objects, 'ft_replay',
+                                 output_dir='build',
+                                 libraries=[] if sys.platform == 'win32' else ['pthread'],
+                                 target_lang='c++')
 
 setup(name          = 'fasttrips',
       version       = '1.0',
@@ -9,8 +37,11 @@ setup(name          = 'fasttrips',
       url           = 'http://fast-trips.mtc.ca.gov/',
       ext_modules   = [Extension('_fasttrips',
                                  sources=['src/fasttrips.cpp',
-                                          'src/pathfinder.cpp'],
+                                          'src/pathfinder.cpp',
+                                          'src/simulation.cpp'],
                                  include_dirs=[numpy.get_include()],
+                                 libraries=[] if sys.platform == 'win32' else ['pthread'],
                                  )
                       ],
-      )
\ No newline at end of file
+      cmdclass      = {'build_replay': build_replay},
+      )
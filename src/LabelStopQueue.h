@@ -56,14 +56,19 @@ namespace fasttrips {
 
         int valid_count_;
 
+        /** For performance reporting: labels pushed onto and popped from labelstop_priority_queue_,
+         *  and popped labels that were skipped because they were superseded. */
+        long push_count_, pop_count_, stale_pop_count_;
+
     public:
-        LabelStopQueue() : valid_count_(0) {}
+        LabelStopQueue() : valid_count_(0), push_count_(0), pop_count_(0), stale_pop_count_(0) {}
         ~LabelStopQueue() {}
 
         void push(const LabelStop& val) {
             // if the stop is not in here, no problem!
             if (labelstop_map_.find(val.stop_id_) == labelstop_map_.end()) {
                 labelstop_priority_queue_.push(val);
+                push_count_++;
                 LabelCount lc = { val.label_, true, 1 };
                 labelstop_map_[val.stop_id_] = lc;
                 valid_count_++;
@@ -73,6 +78,7 @@ namespace fasttrips {
             // if not valid in the queue, then we've popped out all valid instances from the priority queue so it's like it's not here
             if (!labelstop_map_[val.stop_id_].valid_) {
                 labelstop_priority_queue_.push(val);
+                push_count_++;
                 labelstop_map_[val.stop_id_].label_     = val.label_;
                 labelstop_map_[val.stop_id_].valid_     = true;
                 labelstop_map_[val.stop_id_].count_    += 1;
@@ -84,6 +90,7 @@ namespace fasttrips {
             // If the label is smaller, add this one and invalidate the other
             if (val.label_ < labelstop_map_[val.stop_id_].label_) {
                 labelstop_priority_queue_.push(val);
+                push_count_++;
                 labelstop_map_[val.stop_id_].label_ = val.label_;
                 labelstop_map_[val.stop_id_].count_ += 1;
                 // no additional valid counts
@@ -95,7 +102,7 @@ namespace fasttrips {
         }
 
         /** Pop the top *valid* LabelStop */
-        LabelStop pop_top(const std::map<int, std::string>& stop_num_to_str, bool trace, std::ofstream& trace_file) {
+        LabelStop pop_top(const StringPool& stop_names, bool trace, std::ofstream& trace_file) {
             // this will crash if labelstop_priority_queue_ is empty.  I'm terrible.
 
             while (true) {
@@ -118,7 +125,7 @@ namespace fasttrips {
                 // if it's not valid then continue
                 if (!ls_iter->second.valid_) {
                     if (trace) {
-                        trace_file << "Skipping stop A " << stop_num_to_str.find(ls.stop_id_)->second;
+                        trace_file << "Skipping stop A " << stop_names.get(ls.stop_id_);
                         trace_file << "; valid " << ls_iter->second.valid_;
                         trace_file << "; count " << ls_iter->second.count_;
                         trace_file << "; map label " << ls_iter->second.label_;
@@ -127,6 +134,7 @@ namespace fasttrips {
                     }
                     ls_iter->second.count_ -= 1;
                     labelstop_priority_queue_.pop();
+                    stale_pop_count_++;
                     continue;
                 }
 
@@ -134,7 +142,7 @@ namespace fasttrips {
                 // but only the matching label is valid
                 if (ls_iter->second.label_ != ls.label_) {
                     if (trace) {
-                        trace_file << "Skipping stop B " << stop_num_to_str.find(ls.stop_id_)->second;
+                        trace_file << "Skipping stop B " << stop_names.get(ls.stop_id_);
                         trace_file << "; valid " << ls_iter->second.valid_;
                         trace_file << "; count " << ls_iter->second.count_;
                         trace_file << "; map label " << ls_iter->second.label_;
@@ -143,11 +151,12 @@ namespace fasttrips {
                     }
                     ls_iter->second.count_ -= 1;
                     labelstop_priority_queue_.pop();
+                    stale_pop_count_++;
                     continue;
                 }
 
                 if (trace) {
-                    trace_file << "LabelStopQueue returning " << stop_num_to_str.find(ls.stop_id_)->second;
+                    trace_file << "LabelStopQueue returning " << stop_names.get(ls.stop_id_);
                     trace_file << "; valid " << ls_iter->second.valid_;
                     trace_file << "; count " << ls_iter->second.count_;
                     trace_file << "; map label " << ls_iter->second.label_;
@@ -161,6 +170,7 @@ namespace fasttrips {
                 ls_iter->second.valid_  = false; // not valid any longer
                 ls_iter->second.count_ -= 1;     // decrement count
                 valid_count_ -= 1;
+                pop_count_++;
                 return to_ret;
 
             }
@@ -173,6 +183,10 @@ namespace fasttrips {
         bool empty() const {
             return (valid_count_ == 0);
         }
+
+        long push_count()      const { return push_count_;      }
+        long pop_count()       const { return pop_count_;       }
+        long stale_pop_count() const { return stale_pop_count_; }
     };
 
 };
@@ -0,0 +1,251 @@
+/**
+ * \file LogitKernels.h
+ *
+ * Batch kernels for the logit math used by hyperpath labeling and path choice: the logsum
+ * (-1/dispersion * log(sum of exp(-dispersion*cost))) and the choice probabilities over a
+ * contiguous array of costs.
+ *
+ * The exponentials are vectorized with AVX-512 if compiled with __AVX512F__ or AVX2 if compiled
+ * with __AVX2__ (e.g. -march=native or /arch:AVX2); otherwise, and for the remainder of an array
+ * that doesn't fill a vector, the C library exp() is used.
+ *
+ * Accuracy: the vector exp() is the Cephes rational approximation with a two-part ln(2) range
+ * reduction; its relative error is below 4e-16 (a couple of ulp; 3.1e-16 measured) for arguments
+ * in [-708.39, 709], which is the same order as the C library.  In the vector path, arguments below
+ * -708.39 return 0 and arguments above 709 are clamped to 709.  Costs are shifted by their minimum
+ * (or by a reference cost at most the minimum) before exponentiating, so the
+ * logsum and probabilities don't underflow for large costs (unlike exp(-dispersion*cost) alone)
+ * and the sum is at least 1; the results are within a few ulp of the exact values times the
+ * number of costs summed.
+ */
+
+#include <math.h>
+#include <stddef.h>
+#include <vector>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace fasttrips {
+
+    /// Cephes exp() coefficients
+    namespace logit_kernel_constants {
+        const double LOG2E    =  1.4426950408889634073599;
+        const double LN2_HI   =  6.93145751953125E-1;
+        const double LN2_LO   =  1.42860682030941723212E-6;
+        const double P0       =  1.26177193074810590878E-4;
+        const double P1       =  3.02994407707441961300E-2;
+        const double P2       =  9.99999999999999999910E-1;
+        const double Q0       =  3.00198505138664455042E-6;
+        const double Q1       =  2.52448340349684104192E-3;
+        const double Q2       =  2.27265548208155028766E-1;
+        const double Q3       =  2.00000000000000000009E0;
+        const double EXP_MIN  = -708.39;
+        const double EXP_MAX  =  709.0;
+    }
+
+#if defined(__AVX512F__)
+    /// exp() of 8 doubles.  See the file documentation for accuracy.
+    inline __m512d logitExp8(__m512d x)
+    {
+        using namespace logit_kernel_constants;
+        __mmask8 underflow = _mm512_cmp_pd_mask(x, _mm512_set1_pd(EXP_MIN), _CMP_LT_OQ);
+        x = _mm512_min_pd(_mm512_max_pd(x, _mm512_set1_pd(EXP_MIN)), _mm512_set1_pd(EXP_MAX));
+
+        // x = n*ln(2) + r
+        __m512d n  = _mm512_roundscale_pd(_mm512_mul_pd(x, _mm512_set1_pd(LOG2E)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        x          = _mm512_fnmadd_pd(n, _mm512_set1_pd(LN2_HI), x);
+        x          = _mm512_fnmadd_pd(n, _mm512_set1_pd(LN2_LO), x);
+
+        // exp(r) = 1 + 2*P(r)/(Q(r) - P(r))
+        __m512d xx = _mm512_mul_pd(x, x);
+        __m512d px = _mm512_fmadd_pd(_mm512_fmadd_pd(_mm512_set1_pd(P0), xx, _mm512_set1_pd(P1)), xx, _mm512_set1_pd(P2));
+        px         = _mm512_mul_pd(px, x);
+        __m512d qx = _mm512_fmadd_pd(_mm512_fmadd_pd(_mm512_fmadd_pd(_mm512_set1_pd(Q0), xx, _mm512_set1_pd(Q1)), xx, _mm512_set1_pd(Q2)), xx, _mm512_set1_pd(Q3));
+        __m512d r  = _mm512_div_pd(px, _mm512_sub_pd(qx, px));
+        r          = _mm512_fmadd_pd(_mm512_set1_pd(2.0), r, _mm512_set1_pd(1.0));
+
+        // times 2^n
+        r = _mm512_scalef_pd(r, n);
+        return _mm512_maskz_mov_pd(static_cast<__mmask8>(~underflow), r);
+    }
+#elif defined(__AVX2__)
+    /// exp() of 4 doubles.  See the file documentation for accuracy.
+    inline __m256d logitExp4(__m256d x)
+    {
+        using namespace logit_kernel_constants;
+        __m256d underflow = _mm256_cmp_pd(x, _mm256_set1_pd(EXP_MIN), _CMP_LT_OQ);
+        x = _mm256_min_pd(_mm256_max_pd(x, _mm256_set1_pd(EXP_MIN)), _mm256_set1_pd(EXP_MAX));
+
+        // x = n*ln(2) + r
+        __m256d n  = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(LOG2E)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        x          = _mm256_sub_pd(x, _mm256_mul_pd(n, _mm256_set1_pd(LN2_HI)));
+        x          = _mm256_sub_pd(x, _mm256_mul_pd(n, _mm256_set1_pd(LN2_LO)));
+
+        // exp(r) = 1 + 2*P(r)/(Q(r) - P(r))
+        __m256d xx = _mm256_mul_pd(x, x);
+        __m256d px = _mm256_add_pd(_mm256_mul_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_set1_pd(P0), xx), _mm256_set1_pd(P1)), xx), _mm256_set1_pd(P2));
+        px         = _mm256_mul_pd(px, x);
+        __m256d qx = _mm256_add_pd(_mm256_mul_pd(_mm256_set1_pd(Q0), xx), _mm256_set1_pd(Q1));
+        qx         = _mm256_add_pd(_mm256_mul_pd(qx, xx), _mm256_set1_pd(Q2));
+        qx         = _mm256_add_pd(_mm256_mul_pd(qx, xx), _mm256_set1_pd(Q3));
+        __m256d r  = _mm256_div_pd(px, _mm256_sub_pd(qx, px));
+        r          = _mm256_add_pd(_mm256_mul_pd(_mm256_set1_pd(2.0), r), _mm256_set1_pd(1.0));
+
+        // times 2^n, built in the exponent bits; n is in [-1022, 1023] after the clamp
+        __m256i e = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(n));
+        e         = _mm256_slli_epi64(_mm256_add_epi64(e, _mm256_set1_epi64x(1023)), 52);
+        r         = _mm256_mul_pd(r, _mm256_castsi256_pd(e));
+        return _mm256_andnot_pd(underflow, r);
+    }
+#endif
+
+    /**
+     * Sets weights[i] = exp(-dispersion*(costs[i] - ref_cost)).
+     *
+     * @return the sum of the weights.
+     */
+    inline double logitWeights(const double* costs, size_t num_costs, double dispersion, double ref_cost, double* weights)
+    {
+        double sum = 0.0;
+        size_t i   = 0;
+#if defined(__AVX512F__)
+        __m512d neg_disp = _mm512_set1_pd(-1.0*dispersion);
+        __m512d ref      = _mm512_set1_pd(ref_cost);
+        __m512d vsum     = _mm512_setzero_pd();
+        for (; i + 8 <= num_costs; i += 8) {
+            __m512d w = logitExp8(_mm512_mul_pd(neg_disp, _mm512_sub_pd(_mm512_loadu_pd(costs + i), ref)));
+            _mm512_storeu_pd(weights + i, w);
+            vsum = _mm512_add_pd(vsum, w);
+        }
+        sum = _mm512_reduce_add_pd(vsum);
+#elif defined(__AVX2__)
+        __m256d neg_disp = _mm256_set1_pd(-1.0*dispersion);
+        __m256d ref      = _mm256_set1_pd(ref_cost);
+        __m256d vsum     = _mm256_setzero_pd();
+        for (; i + 4 <= num_costs; i += 4) {
+            __m256d w = logitExp4(_mm256_mul_pd(neg_disp, _mm256_sub_pd(_mm256_loadu_pd(costs + i), ref)));
+            _mm256_storeu_pd(weights + i, w);
+            vsum = _mm256_add_pd(vsum, w);
+        }
+        double lanes[4];
+        _mm256_storeu_pd(lanes, vsum);
+        sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+        for (; i < num_costs; ++i) {
+            weights[i] = exp(-1.0*dispersion*(costs[i] - ref_cost));
+            sum       += weights[i];
+        }
+        return sum;
+    }
+
+    /// @return the smallest of the costs.  There must be at least one.
+    inline double logitMinCost(const double* costs, size_t num_costs)
+    {
+        double min_cost = costs[0];
+        size_t i        = 0;
+#if defined(__AVX512F__)
+        if (num_costs >= 8) {
+            __m512d vmin = _mm512_loadu_pd(costs);
+            for (i = 8; i + 8 <= num_costs; i += 8) {
+                vmin = _mm512_min_pd(vmin, _mm512_loadu_pd(costs + i));
+            }
+            min_cost = _mm512_reduce_min_pd(vmin);
+        }
+#elif defined(__AVX2__)
+        if (num_costs >= 4) {
+            __m256d vmin = _mm256_loadu_pd(costs);
+            for (i = 4; i + 4 <= num_costs; i += 4) {
+                vmin = _mm256_min_pd(vmin, _mm256_loadu_pd(costs + i));
+            }
+            double lanes[4];
+            _mm256_storeu_pd(lanes, vmin);
+            min_cost = lanes[0];
+            for (int lane = 1; lane < 4; ++lane) { if (lanes[lane] < min_cost) { min_cost = lanes[lane]; } }
+        }
+#endif
+        for (; i < num_costs; ++i) {
+            if (costs[i] < min_cost) { min_cost = costs[i]; }
+        }
+        return min_cost;
+    }
+
+    /**
+     * @return the logsum of the costs, -1/dispersion * log(sum of exp(-dispersion*cost)).
+     *         There must be at least one cost.  *weights* is scratch space for num_costs doubles.
+     */
+    inline double logitLogsum(const double* costs, size_t num_costs, double dispersion, double* weights)
+    {
+        double min_cost = logitMinCost(costs, num_costs);
+        double sum      = logitWeights(costs, num_costs, dispersion, min_cost, weights);
+        return min_cost - log(sum)/dispersion;
+    }
+
+    /**
+     * Sets probabilities[i] = exp(-dispersion*costs[i]) / sum of exp(-dispersion*cost).
+     * There must be at least one cost.
+     */
+    inline void logitProbabilities(const double* costs, size_t num_costs, double dispersion, double* probabilities)
+    {
+        double min_cost = logitMinCost(costs, num_costs);
+        double sum      = logitWeights(costs, num_costs, dispersion, min_cost, probabilities);
+        double inv_sum  = 1.0/sum;
+        for (size_t i = 0; i < num_costs; ++i) {
+            probabilities[i] *= inv_sum;
+        }
+    }
+
+    /**
+     * A contiguous buffer of doubles for the kernels, kept on the stack for the usual small
+     * number of stop states so it doesn't cost an allocation.
+     */
+    class LogitBuffer
+    {
+    private:
+        static const size_t INLINE_SIZE = 64;
+        double              inline_[INLINE_SIZE];
+        std::vector<double> heap_;
+        double*             data_;
+        size_t              size_;
+
+        // not copyable: data_ may point into inline_
+        LogitBuffer(const LogitBuffer&);
+        LogitBuffer& operator=(const LogitBuffer&);
+
+    public:
+        LogitBuffer() : data_(inline_), size_(0) {}
+
+        /// Sets the size, without keeping the contents
+        void resize(size_t size) {
+            if (size > INLINE_SIZE) {
+                heap_.resize(size);
+                data_ = &heap_[0];
+            } else {
+                data_ = inline_;
+            }
+            size_ = size;
+        }
+
+        void push_back(double value) {
+            if (size_ == INLINE_SIZE && data_ == inline_) {
+                heap_.assign(inline_, inline_ + INLINE_SIZE);
+            }
+            if (size_ >= INLINE_SIZE) {
+                heap_.resize(size_ + 1);
+                heap_[size_] = value;
+                data_ = &heap_[0];
+            } else {
+                inline_[size_] = value;
+            }
+            size_ += 1;
+        }
+
+        double*       data()                      { return data_; }
+        const double* data()                const { return data_; }
+        size_t        size()                const { return size_; }
+        double&       operator[](size_t i)        { return data_[i]; }
+        double        operator[](size_t i)  const { return data_[i]; }
+    };
+
+}
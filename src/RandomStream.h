@@ -0,0 +1,40 @@
+/**
+ * \file RandomStream.h
+ *
+ * A small random number generator for path choice, used in place of the C library rand() so that
+ * threads can draw independently.
+ */
+
+#include <stdlib.h>
+
+namespace fasttrips {
+
+    /**
+     * A splitmix64 random number stream.  Each (seed, substream) pair gives an independent stream, so
+     * the draws for a path ID are reproducible however they're split across threads.
+     */
+    class RandomStream
+    {
+    private:
+        unsigned long long state_;
+
+        static unsigned long long mix(unsigned long long z) {
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            return z ^ (z >> 31);
+        }
+
+    public:
+        RandomStream(int seed, int substream) {
+            state_ = mix(static_cast<unsigned long long>(static_cast<unsigned int>(seed)) + 0x9E3779B97F4A7C15ULL);
+            state_ = mix(state_ ^ (static_cast<unsigned long long>(static_cast<unsigned int>(substream)) * 0x9E3779B97F4A7C15ULL));
+        }
+
+        /// @return the next random number in [0, RAND_MAX], like rand()
+        int next() {
+            state_ += 0x9E3779B97F4A7C15ULL;
+            return static_cast<int>((mix(state_) >> 1) % (static_cast<unsigned long long>(RAND_MAX) + 1));
+        }
+    };
+
+}
@@ -0,0 +1,270 @@
+/**
+ * \file Schedule.h
+ *
+ * The transit vehicle schedules (stop times) for PathFinder, kept once by trip with an index by stop.
+ */
+
+#include <algorithm>
+#include <vector>
+
+namespace fasttrips {
+
+    /// A trip's stop at a stop, for Schedule's index by stop
+    typedef struct {
+        int     trip_id_;
+        int     seq_;           // start at 1
+    } StopVisit;
+
+    /// Where a trip's stop times are in Schedule
+    typedef struct {
+        int     start_;         ///< Slot of sequence 1, or -1 if the trip has no stop times
+        int     count_;         ///< Number of slots (sequences)
+        int     base_seconds_;  ///< For the compact layout, seconds after midnight the offsets are from
+        int     in_order_;      ///< 1 if the trip's times never go back, as they do past midnight
+    } TripSlots;
+
+    /**
+     * Transit vehicle schedules.  Each trip has a slot per stop sequence, in trip id order, so the
+     * sequence is implicit in the position; a stop's visits (trip and sequence) are kept in one array
+     * by stop id, in the order the stop times were given.
+     *
+     * The times are kept in one of two layouts:
+     * - exact: arrival and departure as doubles, in minutes after midnight as given.
+     * - compact: whole seconds as an arrival offset from the trip's first arrival plus a dwell, 16 bits
+     *   each.  Minutes are made from these as fasttrips.Trip does from a time of day, so schedules read
+     *   from GTFS come back exactly.  This is about a quarter of the memory per stop time.
+     *
+     * Read it through the accessors; slots for sequences a trip skips have stop id -1.
+     */
+    class Schedule
+    {
+    private:
+        std::vector<TripSlots>      trips_;             ///< Per trip id
+        std::vector<int>            stop_id_;           ///< Per slot
+        bool                        compact_;
+
+        /** @name Exact layout, per slot */
+        ///@{
+        std::vector<double>         arrive_time_;
+        std::vector<double>         depart_time_;
+        ///@}
+
+        /** @name Compact layout, per slot */
+        ///@{
+        std::vector<unsigned short> arrive_offset_;     ///< Seconds after TripSlots::base_seconds_
+        std::vector<unsigned short> dwell_;             ///< Departure minus arrival, seconds
+        ///@}
+
+        /** @name Index by stop: stop id's visits are stop_visits_[stop_visit_start_[stop id]] up to the next stop id's */
+        ///@{
+        std::vector<int>            stop_visit_start_;
+        std::vector<StopVisit>      stop_visits_;
+        ///@}
+
+        int slot(int trip_id, int seq) const { return trips_[trip_id].start_ + seq - 1; }
+
+        /// Minutes after midnight for seconds after midnight, computed as fasttrips.Trip does
+        static double minutes(int seconds) { return (seconds/60) + (seconds%60)/60.0; }
+
+        /// Fills in the compact layout, if every time is whole seconds and fits; @return false otherwise
+        bool compactTimes() {
+            arrive_offset_.assign(stop_id_.size(), 0);
+            dwell_.assign(stop_id_.size(), 0);
+            for (size_t trip_id = 0; trip_id < trips_.size(); ++trip_id) {
+                TripSlots& trip = trips_[trip_id];
+                if (trip.start_ < 0) { continue; }
+                trip.base_seconds_ = -1;
+                for (int st = trip.start_; st < trip.start_ + trip.count_; ++st) {
+                    if (stop_id_[st] < 0) { continue; }
+                    int arrive = static_cast<int>(arrive_time_[st]*60.0 + 0.5);
+                    int depart = static_cast<int>(depart_time_[st]*60.0 + 0.5);
+                    if ((arrive < 0) || (minutes(arrive) != arrive_time_[st]) || (minutes(depart) != depart_time_[st])) { return false; }
+                    if (trip.base_seconds_ < 0) { trip.base_seconds_ = arrive; }
+                    if ((arrive - trip.base_seconds_ < 0) || (arrive - trip.base_seconds_ > 0xFFFF)) { return false; }
+                    if ((depart - arrive < 0) || (depart - arrive > 0xFFFF)) { return false; }
+                    arrive_offset_[st] = static_cast<unsigned short>(arrive - trip.base_seconds_);
+                    dwell_[st]         = static_cast<unsigned short>(depart - arrive);
+                }
+            }
+            return true;
+        }
+
+    public:
+        Schedule() : compact_(false) {}
+
+        /// Empties the schedule and releases its memory
+        void clear() {
+            std::vector<TripSlots>().swap(trips_);
+            std::vector<int>().swap(stop_id_);
+            std::vector<double>().swap(arrive_time_);
+            std::vector<double>().swap(depart_time_);
+            std::vector<unsigned short>().swap(arrive_offset_);
+            std::vector<unsigned short>().swap(dwell_);
+            std::vector<int>().swap(stop_visit_start_);
+            std::vector<StopVisit>().swap(stop_visits_);
+            compact_ = false;
+        }
+
+        /**
+         * Builds the schedule from the stop times given to PathFinder::initializeSupply.  Negative trip
+         * and stop ids and sequences below 1 are skipped.
+         *
+         * @param compact   Use the compact layout if the times allow it
+         * @return false if compact was asked for but the times aren't all whole seconds, or a trip's times
+         *         are out of order or span more than 18 hours; the exact layout is used then.
+         */
+        bool build(const int* stoptime_index, const double* stoptime_times, int num_stoptimes, bool compact) {
+            clear();
+            int max_trip_id = -1, max_stop_id = -1;
+            for (int i=0; i<num_stoptimes; ++i) {
+                max_trip_id = std::max(max_trip_id, stoptime_index[3*i]);
+                max_stop_id = std::max(max_stop_id, stoptime_index[3*i+2]);
+            }
+            TripSlots no_slots = { -1, 0, 0, 0 };
+            trips_.assign(max_trip_id+1, no_slots);
+            stop_visit_start_.assign(max_stop_id+2, 0);
+            for (int i=0; i<num_stoptimes; ++i) {
+                int trip_id = stoptime_index[3*i], seq = stoptime_index[3*i+1], stop_id = stoptime_index[3*i+2];
+                if ((trip_id < 0) || (stop_id < 0) || (seq < 1)) { continue; }
+                trips_[trip_id].count_ = std::max(trips_[trip_id].count_, seq);
+                stop_visit_start_[stop_id+1] += 1;
+            }
+
+            // slots in trip id order
+            int num_slots = 0;
+            for (size_t trip_id = 0; trip_id < trips_.size(); ++trip_id) {
+                if (trips_[trip_id].count_ == 0) { continue; }
+                trips_[trip_id].start_ = num_slots;
+                num_slots += trips_[trip_id].count_;
+            }
+            stop_id_.assign(num_slots, -1);
+            arrive_time_.assign(num_slots, 0.0);
+            depart_time_.assign(num_slots, 0.0);
+
+            for (size_t stop_id = 1; stop_id < stop_visit_start_.size(); ++stop_id) {
+                stop_visit_start_[stop_id] += stop_visit_start_[stop_id-1];
+            }
+            stop_visits_.resize(stop_visit_start_.back());
+            std::vector<int> next_visit(stop_visit_start_.begin(), stop_visit_start_.end()-1);
+
+            for (int i=0; i<num_stoptimes; ++i) {
+                int trip_id = stoptime_index[3*i], seq = stoptime_index[3*i+1], stop_id = stoptime_index[3*i+2];
+                if ((trip_id < 0) || (stop_id < 0) || (seq < 1)) { continue; }
+                int st = slot(trip_id, seq);
+                stop_id_[st]     = stop_id;
+                arrive_time_[st] = stoptime_times[2*i];
+                depart_time_[st] = stoptime_times[2*i+1];
+                StopVisit visit = { trip_id, seq };
+                stop_visits_[next_visit[stop_id]++] = visit;
+            }
+
+            for (size_t trip_id = 0; trip_id < trips_.size(); ++trip_id) {
+                TripSlots& trip = trips_[trip_id];
+                if (trip.start_ < 0) { continue; }
+                trip.in_order_ = 1;
+                double last_time = -1e300;
+                for (int st = trip.start_; st < trip.start_ + trip.count_; ++st) {
+                    if (stop_id_[st] < 0) { continue; }
+                    if ((arrive_time_[st] < last_time) || (depart_time_[st] < arrive_time_[st])) { trip.in_order_ = 0; }
+                    last_time = depart_time_[st];
+                }
+            }
+
+            bool compacted = compact && compactTimes();
+            if (compacted) {
+                compact_ = true;
+                std::vector<double>().swap(arrive_time_);
+                std::vector<double>().swap(depart_time_);
+            } else {
+                std::vector<unsigned short>().swap(arrive_offset_);
+                std::vector<unsigned short>().swap(dwell_);
+            }
+            return compacted || !compact;
+        }
+
+        /// Is this the compact layout
+        bool compact() const { return compact_; }
+
+        /// @return the number of slots, for tables by PathFinder::stopTimeIndex
+        int numSlots() const { return static_cast<int>(stop_id_.size()); }
+
+        /// @return the slot for the trip and sequence, or -1 if there isn't one
+        int stopTimeIndex(int trip_id, int seq) const {
+            if ((trip_id < 0) || (trip_id >= static_cast<int>(trips_.size()))) { return -1; }
+            if ((trips_[trip_id].start_ < 0) || (seq < 1) || (seq > trips_[trip_id].count_)) { return -1; }
+            return slot(trip_id, seq);
+        }
+
+        /// @return the highest trip id with stop times plus one
+        int numTrips() const { return static_cast<int>(trips_.size()); }
+
+        /// @return the highest stop id with visits plus one
+        int stopIdLimit() const { return std::max(0, static_cast<int>(stop_visit_start_.size()) - 1); }
+
+        /** @name Trip accessors
+         *  For a trip id that has stop times and a sequence from 1 to numStops(); these don't check.
+         */
+        ///@{
+        bool   hasTrip(int trip_id) const { return (trip_id >= 0) && (trip_id < static_cast<int>(trips_.size())) && (trips_[trip_id].start_ >= 0); }
+        int    numStops(int trip_id)               const { return trips_[trip_id].count_; }
+        bool   inOrder(int trip_id)                const { return trips_[trip_id].in_order_ != 0; }
+        int    stopId(int trip_id, int seq)        const { return stop_id_[slot(trip_id, seq)]; }
+        double arriveTime(int trip_id, int seq) const {
+            if (!compact_) { return arrive_time_[slot(trip_id, seq)]; }
+            return minutes(trips_[trip_id].base_seconds_ + arrive_offset_[slot(trip_id, seq)]);
+        }
+        double departTime(int trip_id, int seq) const {
+            if (!compact_) { return depart_time_[slot(trip_id, seq)]; }
+            int st = slot(trip_id, seq);
+            return minutes(trips_[trip_id].base_seconds_ + arrive_offset_[st] + dwell_[st]);
+        }
+        ///@}
+
+        /** @name Stop accessors
+         *  The visits to a stop are [firstVisit(stop id), endVisit(stop id)); these are empty for stops without any.
+         */
+        ///@{
+        int firstVisit(int stop_id) const {
+            return ((stop_id >= 0) && (stop_id < stopIdLimit())) ? stop_visit_start_[stop_id]   : 0;
+        }
+        int endVisit(int stop_id) const {
+            return ((stop_id >= 0) && (stop_id < stopIdLimit())) ? stop_visit_start_[stop_id+1] : 0;
+        }
+        const StopVisit& visit(int visit_index) const { return stop_visits_[visit_index]; }
+        ///@}
+
+        /// Writes the schedule with the given writeValue overloads (see Snapshot.h)
+        template <typename Writer>
+        void write(Writer& writer) const {
+            writeValue(writer, static_cast<int>(compact_));
+            writeValue(writer, trips_);
+            writeValue(writer, stop_id_);
+            writeValue(writer, arrive_time_);
+            writeValue(writer, depart_time_);
+            writeValue(writer, arrive_offset_);
+            writeValue(writer, dwell_);
+            writeValue(writer, stop_visit_start_);
+            writeValue(writer, stop_visits_);
+        }
+
+        /// Reads the schedule written by Schedule::write; @return false if what was read doesn't hang together
+        template <typename Reader>
+        bool read(Reader& reader) {
+            int compact = 0;
+            readValue(reader, compact);
+            readValue(reader, trips_);
+            readValue(reader, stop_id_);
+            readValue(reader, arrive_time_);
+            readValue(reader, depart_time_);
+            readValue(reader, arrive_offset_);
+            readValue(reader, dwell_);
+            readValue(reader, stop_visit_start_);
+            readValue(reader, stop_visits_);
+            compact_ = (compact != 0);
+            size_t num_times = compact_ ? arrive_offset_.size() : arrive_time_.size();
+            return (num_times == stop_id_.size()) &&
+                   (stop_visit_start_.empty() || (stop_visit_start_.back() == static_cast<int>(stop_visits_.size())));
+        }
+    };
+
+}
@@ -0,0 +1,178 @@
+/**
+ * \file Snapshot.h
+ *
+ * Binary reading and writing for PathFinder::saveSnapshot and PathFinder::loadSnapshot, and the
+ * checksum used to tell whether a snapshot is stale.
+ */
+
+#include <string.h>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace fasttrips {
+
+    /// 64-bit FNV-1a hash
+    class Fnv1aHash
+    {
+    private:
+        unsigned long long hash_;
+
+    public:
+        Fnv1aHash() : hash_(0xCBF29CE484222325ULL) {}
+
+        void add(const void* data, size_t num_bytes) {
+            const unsigned char* bytes = static_cast<const unsigned char*>(data);
+            for (size_t ind = 0; ind < num_bytes; ++ind) {
+                hash_ ^= bytes[ind];
+                hash_ *= 0x100000001B3ULL;
+            }
+        }
+
+        template <typename T>
+        void addValue(const T& value) { add(&value, sizeof(T)); }
+
+        /// Adds the contents of the file, and its length so that a missing file differs from an empty one
+        void addFile(const std::string& filename) {
+            std::ifstream file(filename.c_str(), std::ios_base::in | std::ios_base::binary);
+            long long file_bytes = file.is_open() ? 0 : -1;
+            char buffer[64*1024];
+            while (file.good()) {
+                file.read(buffer, sizeof(buffer));
+                add(buffer, static_cast<size_t>(file.gcount()));
+                file_bytes += file.gcount();
+            }
+            addValue(file_bytes);
+        }
+
+        unsigned long long value() const { return hash_; }
+    };
+
+    /**
+     * Writes a snapshot file.  Values are written in the machine's own layout, so a snapshot is only
+     * read back on the same kind of machine (the header says which, see PathFinder::saveSnapshot).
+     * There are no pointers in it, only counts, so it doesn't matter where it's loaded.
+     */
+    class SnapshotWriter
+    {
+    private:
+        std::ofstream file_;
+
+    public:
+        SnapshotWriter(const std::string& filename) :
+            file_(filename.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc) {}
+
+        bool good() const { return file_.good(); }
+        void close()      { file_.close(); }
+
+        void writeBytes(const void* data, size_t num_bytes) {
+            if (num_bytes > 0) { file_.write(static_cast<const char*>(data), num_bytes); }
+        }
+
+        template <typename T>
+        void write(const T& value) { writeBytes(&value, sizeof(T)); }
+    };
+
+    /**
+     * Reads a snapshot file written by fasttrips::SnapshotWriter.  The whole file is read at once;
+     * reading past its end (e.g. a truncated file) makes the reader not good() rather than failing.
+     */
+    class SnapshotReader
+    {
+    private:
+        std::vector<char> data_;
+        size_t            pos_;
+        bool              good_;
+
+    public:
+        SnapshotReader(const std::string& filename) : pos_(0), good_(false) {
+            std::ifstream file(filename.c_str(), std::ios_base::in | std::ios_base::binary);
+            if (!file.is_open()) { return; }
+            file.seekg(0, std::ios_base::end);
+            std::streamoff num_bytes = file.tellg();
+            if (num_bytes <= 0) { return; }
+            file.seekg(0, std::ios_base::beg);
+            data_.resize(static_cast<size_t>(num_bytes));
+            file.read(&data_[0], num_bytes);
+            good_ = (file.gcount() == num_bytes);
+        }
+
+        bool good()  const { return good_; }
+        bool atEnd() const { return pos_ == data_.size(); }
+
+        /// @return true if there are num_bytes left to read; otherwise the reader is no longer good()
+        bool hasBytes(unsigned long long num_bytes) {
+            if (good_ && (num_bytes > data_.size() - pos_)) { good_ = false; }
+            return good_;
+        }
+
+        void readBytes(void* data, size_t num_bytes) {
+            if (!hasBytes(num_bytes) || (num_bytes == 0)) { return; }
+            memcpy(data, &data_[pos_], num_bytes);
+            pos_ += num_bytes;
+        }
+
+        template <typename T>
+        void read(T& value) { readBytes(&value, sizeof(T)); }
+    };
+
+    /** @name Snapshot values
+     *  writeValue/readValue overloads for the types of the PathFinder supply.  Vectors are written as a
+     *  count and then their elements' bytes, so they're only for plain data; maps are a count and then
+     *  each key and value.
+     */
+    ///@{
+    inline void writeValue(SnapshotWriter& writer, int value)                       { writer.write(value); }
+    inline void writeValue(SnapshotWriter& writer, double value)                    { writer.write(value); }
+    inline void writeValue(SnapshotWriter& writer, const std::string& value) {
+        writer.write(static_cast<unsigned long long>(value.size()));
+        writer.writeBytes(value.data(), value.size());
+    }
+    template <typename T>
+    void writeValue(SnapshotWriter& writer, const std::vector<T>& values) {
+        writer.write(static_cast<unsigned long long>(values.size()));
+        if (!values.empty()) { writer.writeBytes(&values[0], sizeof(T)*values.size()); }
+    }
+    template <typename K, typename V, typename C>
+    void writeValue(SnapshotWriter& writer, const std::map<K,V,C>& values) {
+        writer.write(static_cast<unsigned long long>(values.size()));
+        for (typename std::map<K,V,C>::const_iterator iter = values.begin(); iter != values.end(); ++iter) {
+            writeValue(writer, iter->first);
+            writeValue(writer, iter->second);
+        }
+    }
+
+    inline void readValue(SnapshotReader& reader, int& value)                       { reader.read(value); }
+    inline void readValue(SnapshotReader& reader, double& value)                    { reader.read(value); }
+    inline void readValue(SnapshotReader& reader, std::string& value) {
+        unsigned long long num_chars = 0;
+        reader.read(num_chars);
+        if (!reader.hasBytes(num_chars)) { return; }
+        value.resize(static_cast<size_t>(num_chars));
+        if (num_chars > 0) { reader.readBytes(&value[0], static_cast<size_t>(num_chars)); }
+    }
+    template <typename T>
+    void readValue(SnapshotReader& reader, std::vector<T>& values) {
+        unsigned long long num_values = 0;
+        reader.read(num_values);
+        // checking the count first so the byte count can't overflow
+        if (!reader.hasBytes(num_values) || !reader.hasBytes(num_values*sizeof(T))) { return; }
+        values.resize(static_cast<size_t>(num_values));
+        if (num_values > 0) { reader.readBytes(&values[0], static_cast<size_t>(num_values*sizeof(T))); }
+    }
+    template <typename K, typename V, typename C>
+    void readValue(SnapshotReader& reader, std::map<K,V,C>& values) {
+        values.clear();
+        unsigned long long num_values = 0;
+        reader.read(num_values);
+        // they were written in order, so each goes at the end
+        for (unsigned long long ind = 0; (ind < num_values) && reader.good(); ++ind) {
+            K key = K();
+            readValue(reader, key);
+            typename std::map<K,V,C>::iterator iter = values.insert(values.end(), std::make_pair(key, V()));
+            readValue(reader, iter->second);
+        }
+    }
+    ///@}
+}
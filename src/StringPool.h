@@ -0,0 +1,70 @@
+/**
+ * \file StringPool.h
+ *
+ * ID strings by ID number, kept in one block of characters.
+ */
+
+#include <string>
+#include <vector>
+
+namespace fasttrips {
+
+    /**
+     * Strings by number, for the ID numbers fast-trips assigns (which are small and dense).  The
+     * strings are kept nul-terminated in one character buffer with an offset per number, rather
+     * than with an allocation and a tree node each as in a std::map<int, std::string>.
+     */
+    class StringPool
+    {
+    private:
+        std::vector<char>   chars_;
+        std::vector<int>    offsets_;       ///< Per number, the offset of its string in chars_, or -1 for none
+        int                 count_;         ///< Number of numbers with strings
+
+    public:
+        StringPool() : count_(0) {}
+
+        /// Empties the pool and releases its memory
+        void clear() {
+            std::vector<char>().swap(chars_);
+            std::vector<int>().swap(offsets_);
+            count_ = 0;
+        }
+
+        /// Sets the string for the number.  Negative numbers are ignored.
+        void set(int num, const char* str, size_t length) {
+            if (num < 0) { return; }
+            if (num >= static_cast<int>(offsets_.size())) { offsets_.resize(num+1, -1); }
+            if (offsets_[num] < 0) { count_ += 1; }
+            offsets_[num] = static_cast<int>(chars_.size());
+            chars_.insert(chars_.end(), str, str + length);
+            chars_.push_back('\0');
+        }
+
+        void set(int num, const std::string& str) { set(num, str.data(), str.size()); }
+
+        /// Releases the memory reserved for more strings, once they're all set
+        void compact() {
+            std::vector<char>(chars_).swap(chars_);
+            std::vector<int>(offsets_).swap(offsets_);
+        }
+
+        /// @return the number of numbers with strings
+        int size() const { return count_; }
+
+        /// @return the string for the number, or an empty string if there isn't one
+        const char* get(int num) const {
+            if ((num < 0) || (num >= static_cast<int>(offsets_.size())) || (offsets_[num] < 0)) { return ""; }
+            return &chars_[offsets_[num]];
+        }
+
+        /// @return the lowest number with the given string, or -1 if there isn't one.  This looks at every string.
+        int find(const std::string& str) const {
+            for (int num = 0; num < static_cast<int>(offsets_.size()); ++num) {
+                if ((offsets_[num] >= 0) && (str == &chars_[offsets_[num]])) { return num; }
+            }
+            return -1;
+        }
+    };
+
+}
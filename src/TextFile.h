@@ -0,0 +1,205 @@
+/**
+ * \file TextFile.h
+ *
+ * Reading of the whitespace-separated ft_intermediate text files: the whole file is mapped into
+ * memory and its rows are parsed in place, without a std::string per field.  PathFinder splits big
+ * files into chunks of lines and parses them on several threads.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fasttrips {
+
+    /// A read-only view of a whole file, memory mapped if possible and otherwise read into memory
+    class MappedFile
+    {
+    private:
+        std::string         filename_;
+        const char*         data_;
+        size_t              size_;
+        bool                open_;
+        std::vector<char>   buffer_;        ///< The contents, if they couldn't be mapped
+#ifdef _WIN32
+        HANDLE              file_;
+        HANDLE              mapping_;
+#endif
+
+        // not copyable
+        MappedFile(const MappedFile&);
+        MappedFile& operator=(const MappedFile&);
+
+        /// Reads the file into buffer_ instead
+        void readFile() {
+            std::ifstream file(filename_.c_str(), std::ios_base::in | std::ios_base::binary);
+            if (!file.is_open()) { return; }
+            open_ = true;
+            char block[64*1024];
+            while (file.good()) {
+                file.read(block, sizeof(block));
+                buffer_.insert(buffer_.end(), block, block + file.gcount());
+            }
+            data_ = buffer_.empty() ? NULL : &buffer_[0];
+            size_ = buffer_.size();
+        }
+
+    public:
+        MappedFile(const std::string& filename) : filename_(filename), data_(NULL), size_(0), open_(false)
+#ifdef _WIN32
+            , file_(INVALID_HANDLE_VALUE), mapping_(NULL)
+#endif
+        {
+#ifdef _WIN32
+            file_ = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+            if (file_ == INVALID_HANDLE_VALUE) { return; }
+            open_ = true;
+            LARGE_INTEGER file_size;
+            if (!GetFileSizeEx(file_, &file_size) || (file_size.QuadPart == 0)) { return; }
+            mapping_ = CreateFileMapping(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mapping_ != NULL) {
+                data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+            }
+            if (data_ != NULL) { size_ = static_cast<size_t>(file_size.QuadPart); return; }
+#else
+            int fd = open(filename.c_str(), O_RDONLY);
+            if (fd < 0) { return; }
+            open_ = true;
+            struct stat file_stat;
+            if ((fstat(fd, &file_stat) != 0) || (file_stat.st_size == 0)) { close(fd); return; }
+            void* mapped = mmap(NULL, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (mapped != MAP_FAILED) {
+                data_ = static_cast<const char*>(mapped);
+                size_ = static_cast<size_t>(file_stat.st_size);
+                return;
+            }
+#endif
+            readFile();
+        }
+
+        ~MappedFile() {
+            if ((data_ != NULL) && buffer_.empty()) {
+#ifdef _WIN32
+                UnmapViewOfFile(data_);
+#else
+                munmap(const_cast<char*>(data_), size_);
+#endif
+            }
+#ifdef _WIN32
+            if (mapping_ != NULL)               { CloseHandle(mapping_); }
+            if (file_ != INVALID_HANDLE_VALUE)  { CloseHandle(file_);    }
+#endif
+        }
+
+        const std::string& filename() const { return filename_; }
+        bool        isOpen()    const { return open_; }
+        const char* begin()     const { return data_; }
+        const char* end()       const { return data_ + size_; }
+        size_t      size()      const { return size_; }
+    };
+
+    /// A whitespace-separated word in a fasttrips::MappedFile
+    typedef struct {
+        const char* start_;
+        int         length_;
+    } TextToken;
+
+    inline std::string tokenString(const TextToken& token) { return std::string(token.start_, token.length_); }
+
+    inline bool tokenEquals(const TextToken& token, const char* str) {
+        return (strncmp(token.start_, str, token.length_) == 0) && (str[token.length_] == '\0');
+    }
+
+    /// Fields of one row of a file parsed by fasttrips::parseTextRows
+    typedef struct {
+        int         ints_[4];       ///< The 'i' fields, in order
+        TextToken   words_[4];      ///< The 's' fields, in order
+        double      value_;         ///< The 'd' field
+    } TextRow;
+
+    inline bool isTextSpace(char c) { return (c == ' ') || (c == '\t') || (c == '\n') || (c == '\r') || (c == '\v') || (c == '\f'); }
+
+    /// Finds the next word from pos; @return false if there isn't one before end
+    inline bool nextTextToken(const char*& pos, const char* end, TextToken& token) {
+        while ((pos < end) && isTextSpace(*pos)) { ++pos; }
+        if (pos == end) { return false; }
+        token.start_ = pos;
+        while ((pos < end) && !isTextSpace(*pos)) { ++pos; }
+        token.length_ = static_cast<int>(pos - token.start_);
+        return true;
+    }
+
+    /// Parses a whole word as a decimal int; @return false if it isn't one
+    inline bool parseTextInt(const TextToken& token, int& value) {
+        const char* pos = token.start_;
+        const char* end = token.start_ + token.length_;
+        bool negative = false;
+        if ((pos < end) && ((*pos == '-') || (*pos == '+'))) { negative = (*pos == '-'); ++pos; }
+        if ((pos == end) || (end - pos > 10)) { return false; }
+        long long number = 0;
+        for (; pos < end; ++pos) {
+            if ((*pos < '0') || (*pos > '9')) { return false; }
+            number = number*10 + (*pos - '0');
+        }
+        if (negative) { number = -number; }
+        if ((number < -2147483647LL - 1) || (number > 2147483647LL)) { return false; }
+        value = static_cast<int>(number);
+        return true;
+    }
+
+    /// Parses a whole word as a double, as strtod does; @return false if it isn't a number
+    inline bool parseTextDouble(const TextToken& token, double& value) {
+        // strtod needs a terminated string, and accepts words like nan that operator>> doesn't
+        char number[64];
+        if ((token.length_ == 0) || (token.length_ >= static_cast<int>(sizeof(number)))) { return false; }
+        char first = (token.start_[0] == '-' || token.start_[0] == '+') && (token.length_ > 1) ? token.start_[1] : token.start_[0];
+        if (((first < '0') || (first > '9')) && (first != '.')) { return false; }
+        memcpy(number, token.start_, token.length_);
+        number[token.length_] = '\0';
+        char* number_end = NULL;
+        value = strtod(number, &number_end);
+        return (number_end == number + token.length_);
+    }
+
+    /**
+     * Parses rows of whitespace-separated fields from [begin, end) into rows, until the end or a row
+     * that doesn't parse.  The format has a character per field: 'i' for an int, 's' for a word and
+     * 'd' for a double, with at most four ints, four words and one double.
+     *
+     * @return true if everything up to end parsed
+     */
+    inline bool parseTextRows(const char* begin, const char* end, const char* format, std::vector<TextRow>& rows) {
+        const char* pos = begin;
+        TextToken token;
+        while (true) {
+            TextRow row;
+            int num_ints = 0, num_words = 0;
+            for (const char* field = format; *field != '\0'; ++field) {
+                if (!nextTextToken(pos, end, token)) {
+                    // the end is only fine between rows
+                    return (field == format);
+                }
+                if      (*field == 'i') { if (!parseTextInt(token, row.ints_[num_ints++])) { return false; } }
+                else if (*field == 'd') { if (!parseTextDouble(token, row.value_))         { return false; } }
+                else                    { row.words_[num_words++] = token; }
+            }
+            rows.push_back(row);
+        }
+    }
+
+}
@@ -0,0 +1,253 @@
+/**
+ * \file Threading.h
+ *
+ * Minimal portable threads and locks (pthreads or Win32) for splitting work within the extension.
+ */
+
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+namespace fasttrips {
+
+    /// A mutual exclusion lock
+    class Mutex
+    {
+    private:
+#ifdef _WIN32
+        CRITICAL_SECTION    mutex_;
+#else
+        pthread_mutex_t     mutex_;
+#endif
+        // not copyable
+        Mutex(const Mutex&);
+        Mutex& operator=(const Mutex&);
+
+    public:
+#ifdef _WIN32
+        Mutex()         { InitializeCriticalSection(&mutex_); }
+        ~Mutex()        { DeleteCriticalSection(&mutex_);     }
+        void lock()     { EnterCriticalSection(&mutex_);      }
+        void unlock()   { LeaveCriticalSection(&mutex_);      }
+#else
+        Mutex()         { pthread_mutex_init(&mutex_, NULL);  }
+        ~Mutex()        { pthread_mutex_destroy(&mutex_);     }
+        void lock()     { pthread_mutex_lock(&mutex_);        }
+        void unlock()   { pthread_mutex_unlock(&mutex_);      }
+#endif
+    };
+
+    /// Holds a fasttrips::Mutex for its scope
+    class ScopedLock
+    {
+    private:
+        Mutex& mutex_;
+
+        // not copyable
+        ScopedLock(const ScopedLock&);
+        ScopedLock& operator=(const ScopedLock&);
+
+    public:
+        ScopedLock(Mutex& mutex) : mutex_(mutex) { mutex_.lock();   }
+        ~ScopedLock()                            { mutex_.unlock(); }
+    };
+
+    /**
+     * A flag threads can wait for.  set() wakes every thread waiting and it stays set until reset(),
+     * so a waiter checks what it's waiting for under its own lock, resets the event there if it has
+     * to wait, and then waits; a set() after that check isn't missed.
+     */
+    class Event
+    {
+    private:
+#ifdef _WIN32
+        HANDLE              event_;
+#else
+        pthread_mutex_t     mutex_;
+        pthread_cond_t      cond_;
+        bool                set_;
+#endif
+        // not copyable
+        Event(const Event&);
+        Event& operator=(const Event&);
+
+    public:
+#ifdef _WIN32
+        Event()         { event_ = CreateEvent(NULL, TRUE, FALSE, NULL); }
+        ~Event()        { CloseHandle(event_);                           }
+        void set()      { SetEvent(event_);                              }
+        void reset()    { ResetEvent(event_);                            }
+        void wait()     { WaitForSingleObject(event_, INFINITE);         }
+#else
+        Event() : set_(false) {
+            pthread_mutex_init(&mutex_, NULL);
+            pthread_cond_init(&cond_, NULL);
+        }
+        ~Event() {
+            pthread_cond_destroy(&cond_);
+            pthread_mutex_destroy(&mutex_);
+        }
+        void set() {
+            pthread_mutex_lock(&mutex_);
+            set_ = true;
+            pthread_cond_broadcast(&cond_);
+            pthread_mutex_unlock(&mutex_);
+        }
+        void reset() {
+            pthread_mutex_lock(&mutex_);
+            set_ = false;
+            pthread_mutex_unlock(&mutex_);
+        }
+        void wait() {
+            pthread_mutex_lock(&mutex_);
+            while (!set_) { pthread_cond_wait(&cond_, &mutex_); }
+            pthread_mutex_unlock(&mutex_);
+        }
+#endif
+    };
+
+    /// Keeps the compiler and processor from moving memory reads and writes across it
+    inline void memoryBarrier()
+    {
+#ifdef _WIN32
+        MemoryBarrier();
+#else
+        __sync_synchronize();
+#endif
+    }
+
+    /// @return the number of processors (at least 1)
+    inline int numberOfProcessors()
+    {
+#ifdef _WIN32
+        SYSTEM_INFO system_info;
+        GetSystemInfo(&system_info);
+        return (system_info.dwNumberOfProcessors > 0) ? static_cast<int>(system_info.dwNumberOfProcessors) : 1;
+#else
+        long num_processors = sysconf(_SC_NPROCESSORS_ONLN);
+        return (num_processors > 0) ? static_cast<int>(num_processors) : 1;
+#endif
+    }
+
+    /// A function to run on a thread
+    typedef void (*ThreadFunction)(void* arg);
+
+    /// What a started thread should run
+    typedef struct {
+        ThreadFunction  func_;
+        void*           arg_;
+    } ThreadStart;
+
+#ifdef _WIN32
+    inline DWORD WINAPI threadStart(LPVOID start)
+    {
+        ThreadStart* ts = static_cast<ThreadStart*>(start);
+        ts->func_(ts->arg_);
+        return 0;
+    }
+#else
+    extern "C" inline void* threadStart(void* start)
+    {
+        ThreadStart* ts = static_cast<ThreadStart*>(start);
+        ts->func_(ts->arg_);
+        return NULL;
+    }
+#endif
+
+    /**
+     * A thread running func(arg) in the background until join(), which the destructor does if it
+     * hasn't been.  If the thread can't be started, func(arg) runs in the constructor instead.
+     */
+    class Thread
+    {
+    private:
+        ThreadStart         start_;
+        bool                running_;
+#ifdef _WIN32
+        HANDLE              thread_;
+#else
+        pthread_t           thread_;
+#endif
+        // not copyable
+        Thread(const Thread&);
+        Thread& operator=(const Thread&);
+
+    public:
+        Thread(ThreadFunction func, void* arg) : running_(false) {
+            start_.func_ = func;
+            start_.arg_  = arg;
+#ifdef _WIN32
+            thread_  = CreateThread(NULL, 0, threadStart, &start_, 0, NULL);
+            running_ = (thread_ != NULL);
+#else
+            running_ = (pthread_create(&thread_, NULL, threadStart, &start_) == 0);
+#endif
+            if (!running_) { func(arg); }
+        }
+
+        ~Thread() { join(); }
+
+        /// Waits for func(arg) to return
+        void join() {
+            if (!running_) { return; }
+#ifdef _WIN32
+            WaitForSingleObject(thread_, INFINITE);
+            CloseHandle(thread_);
+#else
+            pthread_join(thread_, NULL);
+#endif
+            running_ = false;
+        }
+    };
+
+    /**
+     * Runs func(args[i]) for each of the args, each on its own thread, and returns when they're all done.
+     * The first runs on the calling thread.  If a thread can't be started, its work runs on the calling
+     * thread instead.
+     */
+    inline void runThreads(ThreadFunction func, const std::vector<void*>& args)
+    {
+        if (args.size() == 0) { return; }
+
+        std::vector<ThreadStart> starts(args.size());
+#ifdef _WIN32
+        std::vector<HANDLE>      threads(args.size(), (HANDLE)NULL);
+#else
+        std::vector<pthread_t>   threads(args.size());
+        std::vector<bool>        started(args.size(), false);
+#endif
+        for (size_t ind = 1; ind < args.size(); ++ind) {
+            starts[ind].func_ = func;
+            starts[ind].arg_  = args[ind];
+#ifdef _WIN32
+            threads[ind] = CreateThread(NULL, 0, threadStart, &starts[ind], 0, NULL);
+            if (threads[ind] == NULL) { func(args[ind]); }
+#else
+            started[ind] = (pthread_create(&threads[ind], NULL, threadStart, &starts[ind]) == 0);
+            if (!started[ind]) { func(args[ind]); }
+#endif
+        }
+
+        func(args[0]);
+
+        for (size_t ind = 1; ind < args.size(); ++ind) {
+#ifdef _WIN32
+            if (threads[ind] == NULL) { continue; }
+            WaitForSingleObject(threads[ind], INFINITE);
+            CloseHandle(threads[ind]);
+#else
+            if (!started[ind]) { continue; }
+            pthread_join(threads[ind], NULL);
+#endif
+        }
+    }
+
+}
@@ -4,13 +4,145 @@
 #include <numpy/arrayobject.h>
 
 #include "pathfinder.h"
+#include "simulation.h"
+#include "Threading.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <map>
 #include <string>
 #include <queue>
 
 static PyObject *pyError;
 
-// global variable
+// global variables
 fasttrips::PathFinder pathfinder;
+fasttrips::CapacitySimulation simulation;
+
+/// A chunk of a PathJob's paths, found by one call to PathFinder::findPaths
+struct PathChunk {
+    int                                         first_;             ///< Index of its first path specification in the job
+    std::vector<fasttrips::PathSpecification>   path_specs_;
+    std::vector<double>                         cost_estimates_;    ///< Empty if there are none
+    std::vector<fasttrips::Path>                paths_;
+    std::vector<fasttrips::PathInfo>            path_infos_;
+    std::vector<fasttrips::PerformanceInfo>     perf_infos_;
+};
+
+/**
+ * Paths given to submit_paths, found a chunk at a time, in order, on a background thread (which
+ * splits each chunk over its own threads as find_paths does).  The chunks found are handed to Python
+ * by poll_paths and wait_paths while the rest are being found.
+ */
+struct PathJob {
+    std::vector<PathChunk>  chunks_;
+    bool                    group_by_locality_;
+    int                     num_threads_;
+    fasttrips::Thread*      thread_;
+
+    fasttrips::Mutex        mutex_;         ///< Guards the members below
+    fasttrips::Event        chunk_found_;   ///< Set when a chunk is found, and when the thread is done
+    size_t                  num_found_;     ///< The chunks before this one are found
+    size_t                  num_fetched_;   ///< The chunks before this one have been handed to Python
+    bool                    cancelled_;     ///< Stop after the chunk being found
+    bool                    done_;          ///< The thread has nothing more to do
+    bool                    waiting_;       ///< A Python thread is in wait_paths for it, without the GIL
+};
+
+// submitted path jobs by handle; only used with the GIL held
+std::map<int, PathJob*> path_jobs;
+int next_path_job = 1;
+
+/**
+ * Performance info of the paths found by find_path and by submitted path jobs since the last
+ * fetch_performance, kept in flat arrays laid out as it returns them, so Python gets them as numpy
+ * arrays once rather than a record per path.  (find_paths returns the performance info with its paths
+ * instead.)
+ */
+struct PerformanceRecords {
+    fasttrips::Mutex        mutex_;         ///< Path job threads add to them too
+    std::vector<int>        iteration_;
+    std::vector<int>        path_id_;
+    std::vector<int>        traced_;
+    std::vector<npy_int64>  counts_;        ///< 13 per path, in the order find_paths returns them
+    std::vector<double>     milliseconds_;  ///< Labeling and enumerating, per path
+};
+
+PerformanceRecords performance_records;
+
+/// Puts the counts of the performance info in the order find_paths returns them
+static void
+performanceCounts(const fasttrips::PerformanceInfo& perf_info, npy_int64 counts[13])
+{
+    npy_int64 perf_ints[13] = { perf_info.label_iterations_, perf_info.max_process_count_,
+                                perf_info.queue_pushes_, perf_info.queue_pops_, perf_info.queue_stale_pops_,
+                                perf_info.trips_within_time_, perf_info.stop_relaxations_,
+                                perf_info.states_added_, perf_info.states_updated_, perf_info.states_rejected_,
+                                perf_info.states_pruned_, perf_info.paths_drawn_, perf_info.distinct_paths_ };
+    std::copy(perf_ints, perf_ints + 13, counts);
+}
+
+/// Adds the performance info of the paths to performance_records
+static void
+recordPerformance(const fasttrips::PathSpecification* path_specs, const fasttrips::PerformanceInfo* perf_infos, size_t num_paths)
+{
+    fasttrips::ScopedLock lock(performance_records.mutex_);
+    for (size_t ind = 0; ind < num_paths; ++ind) {
+        performance_records.iteration_.push_back(path_specs[ind].iteration_);
+        performance_records.path_id_.push_back(path_specs[ind].path_id_);
+        performance_records.traced_.push_back(path_specs[ind].trace_ ? 1 : 0);
+        npy_int64 counts[13];
+        performanceCounts(perf_infos[ind], counts);
+        performance_records.counts_.insert(performance_records.counts_.end(), counts, counts + 13);
+        performance_records.milliseconds_.push_back(perf_infos[ind].milliseconds_labeling_);
+        performance_records.milliseconds_.push_back(perf_infos[ind].milliseconds_enumerating_);
+    }
+}
+
+/// @return false (with the Python error set) if there are path jobs using the supply
+static bool
+checkNoPathJobs()
+{
+    if (path_jobs.empty()) { return true; }
+    PyErr_Format(pyError, "Paths are being found for %d submitted path jobs; finish or cancel them first",
+                 static_cast<int>(path_jobs.size()));
+    return false;
+}
+
+/// @return a new 1-dimensional numpy int32 array with the contents of the given vector
+static PyArrayObject* newIntArray(const std::vector<int>& values)
+{
+    npy_intp dims[1];
+    dims[0] = values.size();
+    PyArrayObject *array = (PyArrayObject *)PyArray_SimpleNew(1, dims, NPY_INT32);
+    for (npy_intp ind = 0; ind < dims[0]; ++ind) {
+        *(npy_int32*)PyArray_GETPTR1(array, ind) = values[ind];
+    }
+    return array;
+}
+
+/**
+ * @return false (with the Python error set) if a traced query would run alongside path jobs, since
+ * they'd all write to the same trace and label files
+ */
+static bool
+checkTraceWithPathJobs(bool trace)
+{
+    if (!trace || path_jobs.empty()) { return true; }
+    PyErr_Format(pyError, "Can't trace paths while paths are being found for %d submitted path jobs",
+                 static_cast<int>(path_jobs.size()));
+    return false;
+}
+
+/// @return true if any of the path specifications are traced
+static bool
+anyTraced(const std::vector<fasttrips::PathSpecification>& path_specs)
+{
+    for (size_t ind = 0; ind < path_specs.size(); ++ind) {
+        if (path_specs[ind].trace_) { return true; }
+    }
+    return false;
+}
 
 static PyObject *
 _fasttrips_initialize_parameters(PyObject *self, PyObject *args)
@@ -18,12 +150,31 @@ _fasttrips_initialize_parameters(PyObject *self, PyObject *args)
     double     time_window;
     double     bump_buffer;
     int        stoch_pathset_size;
+    int        stoch_pathset_threads;
     double     stoch_dispersion;
     int        stoch_max_stop_process_count;
-    if (!PyArg_ParseTuple(args, "ddidi", &time_window, &bump_buffer, &stoch_pathset_size, &stoch_dispersion, &stoch_max_stop_process_count)) {
+    const char* goal_direction_str;
+    int        goal_direction_landmarks;
+    int        capture_path_specs;
+    int        compact_schedule;
+    if (!PyArg_ParseTuple(args, "ddiidisiii", &time_window, &bump_buffer, &stoch_pathset_size, &stoch_pathset_threads, &stoch_dispersion, &stoch_max_stop_process_count,
+                          &goal_direction_str, &goal_direction_landmarks, &capture_path_specs, &compact_schedule)) {
+        return NULL;
+    }
+    if (!checkNoPathJobs()) {
+        return NULL;
+    }
+    fasttrips::GoalDirectionType goal_direction;
+    std::string goal_direction_s(goal_direction_str);
+    if      (goal_direction_s == "none"     ) { goal_direction = fasttrips::GOAL_DIRECTION_NONE;      }
+    else if (goal_direction_s == "taz"      ) { goal_direction = fasttrips::GOAL_DIRECTION_TAZ;       }
+    else if (goal_direction_s == "landmarks") { goal_direction = fasttrips::GOAL_DIRECTION_LANDMARKS; }
+    else {
+        PyErr_SetString(pyError, "goal_direction must be one of none, taz, landmarks");
         return NULL;
     }
-    pathfinder.initializeParameters(time_window, bump_buffer, stoch_pathset_size, stoch_dispersion, stoch_max_stop_process_count);
+    pathfinder.initializeParameters(time_window, bump_buffer, stoch_pathset_size, stoch_pathset_threads, stoch_dispersion, stoch_max_stop_process_count,
+                                    goal_direction, goal_direction_landmarks, (capture_path_specs != 0), (compact_schedule != 0));
     Py_RETURN_NONE;
 
 }
@@ -39,6 +190,9 @@ _fasttrips_initialize_supply(PyObject *self, PyObject *args)
                           &input3, &input4)) {
         return NULL;
     }
+    if (!checkNoPathJobs()) {
+        return NULL;
+    }
 
     // trip stop times index: trip id, sequence, stop id
     pyo                 = (PyArrayObject*)PyArray_ContiguousFromObject(input3, NPY_INT32, 2, 2);
@@ -67,6 +221,53 @@ _fasttrips_initialize_supply(PyObject *self, PyObject *args)
     Py_RETURN_NONE;
 }
 
+static PyObject *
+_fasttrips_save_snapshot(PyObject *self, PyObject *args)
+{
+    const char* snapshot_file;
+    if (!PyArg_ParseTuple(args, "s", &snapshot_file)) {
+        return NULL;
+    }
+    if (!pathfinder.saveSnapshot(snapshot_file)) {
+        PyErr_Format(pyError, "Couldn't write supply snapshot %s", snapshot_file);
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+_fasttrips_load_snapshot(PyObject *self, PyObject *args)
+{
+    const char* snapshot_file;
+    const char* output_dir;
+    int proc_num;
+    PyObject *input4, *input5;
+    if (!PyArg_ParseTuple(args, "ssiOO", &snapshot_file, &output_dir, &proc_num,
+                          &input4, &input5)) {
+        return NULL;
+    }
+    if (!checkNoPathJobs()) {
+        return NULL;
+    }
+
+    // trip stop times index and data, as for initialize_supply; the snapshot has to be built from these
+    PyArrayObject *pyo_index = (PyArrayObject*)PyArray_ContiguousFromObject(input4, NPY_INT32, 2, 2);
+    if (pyo_index == NULL) return NULL;
+    PyArrayObject *pyo_times = (PyArrayObject*)PyArray_ContiguousFromObject(input5, NPY_DOUBLE, 2, 2);
+    if (pyo_times == NULL) { Py_DECREF(pyo_index); return NULL; }
+    assert(3 == PyArray_DIMS(pyo_index)[1]);
+    assert(2 == PyArray_DIMS(pyo_times)[1]);
+    assert(PyArray_DIMS(pyo_index)[0] == PyArray_DIMS(pyo_times)[0]);
+
+    bool loaded = pathfinder.loadSnapshot(snapshot_file, output_dir, proc_num,
+                                          (int*)PyArray_DATA(pyo_index), (double*)PyArray_DATA(pyo_times),
+                                          static_cast<int>(PyArray_DIMS(pyo_index)[0]));
+    Py_DECREF(pyo_index);
+    Py_DECREF(pyo_times);
+    if (loaded) { Py_RETURN_TRUE; }
+    Py_RETURN_FALSE;
+}
+
 static PyObject *
 _fasttrips_set_bump_wait(PyObject* self, PyObject *args)
 {
@@ -74,6 +275,9 @@ _fasttrips_set_bump_wait(PyObject* self, PyObject *args)
     if (!PyArg_ParseTuple(args, "OO", &input1, &input2)) {
         return NULL;
     }
+    if (!checkNoPathJobs()) {
+        return NULL;
+    }
     PyArrayObject *pyo;
 
     // bump wait index: trip id, stop sequence, stop id
@@ -94,6 +298,34 @@ _fasttrips_set_bump_wait(PyObject* self, PyObject *args)
     Py_RETURN_NONE;
 }
 
+static PyObject *
+_fasttrips_clear_bump_wait(PyObject* self, PyObject *args)
+{
+    PyObject *input1;
+    if (!PyArg_ParseTuple(args, "O", &input1)) {
+        return NULL;
+    }
+    if (!checkNoPathJobs()) {
+        return NULL;
+    }
+    // None clears them all
+    if (input1 == Py_None) {
+        pathfinder.clearBumpWait(NULL, 0);
+        Py_RETURN_NONE;
+    }
+
+    // bump wait index: trip id, stop sequence, stop id
+    PyArrayObject *pyo = (PyArrayObject*)PyArray_ContiguousFromObject(input1, NPY_INT32, 2, 2);
+    if (pyo == NULL) return NULL;
+    int* bw_index = (int*)PyArray_DATA(pyo);
+    int num_bw    = PyArray_DIMS(pyo)[0];
+    assert(3 == PyArray_DIMS(pyo)[1]);
+
+    pathfinder.clearBumpWait(bw_index, num_bw);
+    Py_DECREF(pyo);
+    Py_RETURN_NONE;
+}
+
 static PyObject *
 _fasttrips_find_path(PyObject *self, PyObject *args)
 {
@@ -110,6 +342,9 @@ _fasttrips_find_path(PyObject *self, PyObject *args)
     path_spec.hyperpath_  = (hyperpath_i != 0);
     path_spec.outbound_   = (outbound_i  != 0);
     path_spec.trace_      = (trace_i     != 0);
+    if (!checkTraceWithPathJobs(path_spec.trace_)) {
+        return NULL;
+    }
     path_spec.user_class_  = user_class;
     path_spec.access_mode_ = access_mode;
     path_spec.transit_mode_= transit_mode;
@@ -117,8 +352,9 @@ _fasttrips_find_path(PyObject *self, PyObject *args)
 
     fasttrips::Path path;
     fasttrips::PathInfo path_info = {0, 0, false, 0, 0};
-    fasttrips::PerformanceInfo perf_info = { 0, 0, 0, 0};
+    fasttrips::PerformanceInfo perf_info = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
     pathfinder.findPath(path_spec, path, path_info, perf_info);
+    recordPerformance(&path_spec, &perf_info, 1);
 
     // package for returning.  We'll separate ints and doubles.
     npy_intp dims_int[2];
@@ -146,17 +382,596 @@ _fasttrips_find_path(PyObject *self, PyObject *args)
         *(npy_double*)PyArray_GETPTR2(ret_double, ind, 4) = path[ind].second.arrdep_time_;
     }
 
-    PyObject *returnobj = Py_BuildValue("(OOdiill)",ret_int,ret_double,path_info.cost_,
+    PyObject *returnobj = Py_BuildValue("(OOdiiddlllllllllll)",ret_int,ret_double,path_info.cost_,
                                         perf_info.label_iterations_, perf_info.max_process_count_,
-                                        perf_info.milliseconds_labeling_, perf_info.milliseconds_enumerating_);
+                                        perf_info.milliseconds_labeling_, perf_info.milliseconds_enumerating_,
+                                        perf_info.queue_pushes_, perf_info.queue_pops_, perf_info.queue_stale_pops_,
+                                        perf_info.trips_within_time_, perf_info.stop_relaxations_,
+                                        perf_info.states_added_, perf_info.states_updated_, perf_info.states_rejected_,
+                                        perf_info.states_pruned_, perf_info.paths_drawn_, perf_info.distinct_paths_);
+    return returnobj;
+}
+
+/// Reads the strings in the given list into the vector; returns false (with the Python error set) if it's not a list of strings
+static bool
+readStringList(PyObject* list, std::vector<std::string>& strings)
+{
+    if (!PyList_Check(list)) {
+        PyErr_SetString(PyExc_TypeError, "Expected a list of strings");
+        return false;
+    }
+    strings.clear();
+    for (Py_ssize_t ind = 0; ind < PyList_Size(list); ++ind) {
+        char* str = PyString_AsString(PyList_GetItem(list, ind));
+        if (str == NULL) { return false; }
+        strings.push_back(str);
+    }
+    return true;
+}
+
+/**
+ * Reads the path specifications as find_paths and submit_paths take them into path_specs, and the cost
+ * estimates into cost_estimates (left empty for None).  Returns false (with the Python error set) if
+ * they can't be read.
+ */
+static bool
+readPathSpecs(int iteration, int hyperpath_i, PyObject* input_specs, PyObject* input_times, PyObject* input_costs,
+              PyObject* input_user_classes, PyObject* input_access_modes, PyObject* input_transit_modes,
+              PyObject* input_egress_modes, std::vector<fasttrips::PathSpecification>& path_specs,
+              std::vector<double>& cost_estimates)
+{
+    // the modes are codes into these lists
+    std::vector<std::string> user_classes, access_modes, transit_modes, egress_modes;
+    if (!readStringList(input_user_classes,  user_classes ) || !readStringList(input_access_modes, access_modes) ||
+        !readStringList(input_transit_modes, transit_modes) || !readStringList(input_egress_modes, egress_modes)) {
+        return false;
+    }
+
+    // path specifications: passenger id, path id, user class, access mode, transit mode, egress mode,
+    // origin taz id, destination taz id, outbound, trace
+    PyArrayObject *pyo_specs = (PyArrayObject*)PyArray_ContiguousFromObject(input_specs, NPY_INT32, 2, 2);
+    if (pyo_specs == NULL) return false;
+    int num_specs       = PyArray_DIMS(pyo_specs)[0];
+    assert(10 == PyArray_DIMS(pyo_specs)[1]);
+
+    // preferred times, minutes after midnight
+    PyArrayObject *pyo_times = (PyArrayObject*)PyArray_ContiguousFromObject(input_times, NPY_DOUBLE, 1, 1);
+    if (pyo_times == NULL) { Py_DECREF(pyo_specs); return false; }
+    assert(num_specs == PyArray_DIMS(pyo_times)[0]);
+
+    const int*    spec_ints  = (const int*)PyArray_DATA(pyo_specs);
+    const double* spec_times = (const double*)PyArray_DATA(pyo_times);
+    path_specs.resize(num_specs);
+    for (int ind = 0; ind < num_specs; ++ind) {
+        const int* row = &spec_ints[10*ind];
+        if ((row[2] < 0) || (row[2] >= (int)user_classes.size())  || (row[3] < 0) || (row[3] >= (int)access_modes.size()) ||
+            (row[4] < 0) || (row[4] >= (int)transit_modes.size()) || (row[5] < 0) || (row[5] >= (int)egress_modes.size())) {
+            PyErr_Format(pyError, "Path specification %d has a mode code out of range", ind);
+            Py_DECREF(pyo_specs);
+            Py_DECREF(pyo_times);
+            return false;
+        }
+        fasttrips::PathSpecification& path_spec = path_specs[ind];
+        path_spec.iteration_            = iteration;
+        path_spec.passenger_id_         = row[0];
+        path_spec.path_id_              = row[1];
+        path_spec.hyperpath_            = (hyperpath_i != 0);
+        path_spec.user_class_           = user_classes[row[2]];
+        path_spec.access_mode_          = access_modes[row[3]];
+        path_spec.transit_mode_         = transit_modes[row[4]];
+        path_spec.egress_mode_          = egress_modes[row[5]];
+        path_spec.origin_taz_id_        = row[6];
+        path_spec.destination_taz_id_   = row[7];
+        path_spec.outbound_             = (row[8] != 0);
+        path_spec.trace_                = (row[9] != 0);
+        path_spec.preferred_time_       = spec_times[ind];
+    }
+    Py_DECREF(pyo_specs);
+    Py_DECREF(pyo_times);
+
+    // how expensive each is expected to be (negative if unknown), or None
+    cost_estimates.clear();
+    if (input_costs != Py_None) {
+        PyArrayObject *pyo_costs = (PyArrayObject*)PyArray_ContiguousFromObject(input_costs, NPY_DOUBLE, 1, 1);
+        if (pyo_costs == NULL) return false;
+        assert(num_specs == PyArray_DIMS(pyo_costs)[0]);
+        const double* costs = (const double*)PyArray_DATA(pyo_costs);
+        cost_estimates.assign(costs, costs + num_specs);
+        Py_DECREF(pyo_costs);
+    }
+    return true;
+}
+
+/**
+ * Packages the results of PathFinder::findPaths for returning: (path start, state ints, state doubles,
+ * path costs, performance ints, performance milliseconds), with the first state of each path at
+ * path_start[path].
+ */
+static PyObject *
+pathResults(const std::vector<fasttrips::Path>& paths, const std::vector<fasttrips::PathInfo>& path_infos,
+            const std::vector<fasttrips::PerformanceInfo>& perf_infos)
+{
+    int num_specs = static_cast<int>(paths.size());
+    npy_intp dims_start[1] = { num_specs + 1 };
+    PyArrayObject *ret_start = (PyArrayObject *)PyArray_SimpleNew(1, dims_start, NPY_INT32);
+    npy_intp num_states = 0;
+    for (int ind = 0; ind < num_specs; ++ind) {
+        *(npy_int32*)PyArray_GETPTR1(ret_start, ind) = (npy_int32)num_states;
+        num_states += paths[ind].size();
+    }
+    *(npy_int32*)PyArray_GETPTR1(ret_start, num_specs) = (npy_int32)num_states;
+
+    npy_intp dims_int[2]    = { num_states, 6 }; // stop_id, deparr_mode_, trip_id_, stop_succpred_, seq_, seq_succpred_
+    npy_intp dims_double[2] = { num_states, 5 }; // label_, deparr_time_, link_time_, cost_, arrdep_time_
+    PyArrayObject *ret_int    = (PyArrayObject *)PyArray_SimpleNew(2, dims_int,    NPY_INT32);
+    PyArrayObject *ret_double = (PyArrayObject *)PyArray_SimpleNew(2, dims_double, NPY_DOUBLE);
+    npy_intp state = 0;
+    for (int ind = 0; ind < num_specs; ++ind) {
+        const fasttrips::Path& path = paths[ind];
+        for (size_t path_ind = 0; path_ind < path.size(); ++path_ind, ++state) {
+            *(npy_int32*)PyArray_GETPTR2(ret_int, state, 0) = path[path_ind].first;
+            *(npy_int32*)PyArray_GETPTR2(ret_int, state, 1) = path[path_ind].second.deparr_mode_;
+            *(npy_int32*)PyArray_GETPTR2(ret_int, state, 2) = path[path_ind].second.trip_id_;
+            *(npy_int32*)PyArray_GETPTR2(ret_int, state, 3) = path[path_ind].second.stop_succpred_;
+            *(npy_int32*)PyArray_GETPTR2(ret_int, state, 4) = path[path_ind].second.seq_;
+            *(npy_int32*)PyArray_GETPTR2(ret_int, state, 5) = path[path_ind].second.seq_succpred_;
+
+            *(npy_double*)PyArray_GETPTR2(ret_double, state, 0) = 0.0; // the chosen path doesn't keep its labels
+            *(npy_double*)PyArray_GETPTR2(ret_double, state, 1) = path[path_ind].second.deparr_time_;
+            *(npy_double*)PyArray_GETPTR2(ret_double, state, 2) = path[path_ind].second.link_time_;
+            *(npy_double*)PyArray_GETPTR2(ret_double, state, 3) = path[path_ind].second.cost_;
+            *(npy_double*)PyArray_GETPTR2(ret_double, state, 4) = path[path_ind].second.arrdep_time_;
+        }
+    }
+
+    // per path: cost, then the performance info as for find_path
+    npy_intp dims_cost[1]      = { num_specs };
+    npy_intp dims_perf_int[2]  = { num_specs, 13 };
+    npy_intp dims_perf_ms[2]   = { num_specs, 2 };
+    PyArrayObject *ret_cost     = (PyArrayObject *)PyArray_SimpleNew(1, dims_cost,     NPY_DOUBLE);
+    PyArrayObject *ret_perf_int = (PyArrayObject *)PyArray_SimpleNew(2, dims_perf_int, NPY_INT64);
+    PyArrayObject *ret_perf_ms  = (PyArrayObject *)PyArray_SimpleNew(2, dims_perf_ms,  NPY_DOUBLE);
+    for (int ind = 0; ind < num_specs; ++ind) {
+        const fasttrips::PerformanceInfo& perf_info = perf_infos[ind];
+        *(npy_double*)PyArray_GETPTR1(ret_cost, ind) = path_infos[ind].cost_;
+        npy_int64 perf_ints[13];
+        performanceCounts(perf_info, perf_ints);
+        for (int col = 0; col < 13; ++col) {
+            *(npy_int64*)PyArray_GETPTR2(ret_perf_int, ind, col) = perf_ints[col];
+        }
+        *(npy_double*)PyArray_GETPTR2(ret_perf_ms, ind, 0) = perf_info.milliseconds_labeling_;
+        *(npy_double*)PyArray_GETPTR2(ret_perf_ms, ind, 1) = perf_info.milliseconds_enumerating_;
+    }
+
+    PyObject *returnobj = Py_BuildValue("(NNNNNN)", ret_start, ret_int, ret_double, ret_cost, ret_perf_int, ret_perf_ms);
+    return returnobj;
+}
+
+static PyObject *
+_fasttrips_find_paths(PyObject *self, PyObject *args)
+{
+    PyObject *input1, *input2, *input3, *input4, *input5, *input6, *input7;
+    int iteration, hyperpath_i, num_threads, group_by_locality;
+    if (!PyArg_ParseTuple(args, "iiOOOOOOOii", &iteration, &hyperpath_i, &input1, &input2, &input7,
+                          &input3, &input4, &input5, &input6, &num_threads, &group_by_locality)) {
+        return NULL;
+    }
+
+    std::vector<fasttrips::PathSpecification> path_specs;
+    std::vector<double> cost_estimates;
+    if (!readPathSpecs(iteration, hyperpath_i, input1, input2, input7, input3, input4, input5, input6,
+                       path_specs, cost_estimates)) {
+        return NULL;
+    }
+    if (!checkTraceWithPathJobs(anyTraced(path_specs))) {
+        return NULL;
+    }
+
+    std::vector<fasttrips::Path>            paths;
+    std::vector<fasttrips::PathInfo>        path_infos;
+    std::vector<fasttrips::PerformanceInfo> perf_infos;
+    Py_BEGIN_ALLOW_THREADS
+    pathfinder.findPaths(path_specs, (input7 != Py_None) ? &cost_estimates : NULL, group_by_locality != 0, num_threads,
+                         paths, path_infos, perf_infos);
+    Py_END_ALLOW_THREADS
+
+    return pathResults(paths, path_infos, perf_infos);
+}
+
+static void
+findPathJobThread(void* arg)
+{
+    PathJob* job = static_cast<PathJob*>(arg);
+    for (size_t ind = 0; ind < job->chunks_.size(); ++ind) {
+        {
+            fasttrips::ScopedLock lock(job->mutex_);
+            if (job->cancelled_) { break; }
+        }
+        PathChunk& chunk = job->chunks_[ind];
+        pathfinder.findPaths(chunk.path_specs_, chunk.cost_estimates_.empty() ? NULL : &chunk.cost_estimates_,
+                             job->group_by_locality_, job->num_threads_,
+                             chunk.paths_, chunk.path_infos_, chunk.perf_infos_);
+        if (!chunk.perf_infos_.empty()) {
+            recordPerformance(&chunk.path_specs_[0], &chunk.perf_infos_[0], chunk.perf_infos_.size());
+        }
+        {
+            fasttrips::ScopedLock lock(job->mutex_);
+            job->num_found_ = ind + 1;
+        }
+        job->chunk_found_.set();
+    }
+    {
+        fasttrips::ScopedLock lock(job->mutex_);
+        job->done_ = true;
+    }
+    job->chunk_found_.set();
+}
+
+/// Waits for the job's thread and deletes the job
+static void
+deletePathJob(int handle)
+{
+    PathJob* job = path_jobs[handle];
+    path_jobs.erase(handle);
+    Py_BEGIN_ALLOW_THREADS
+    job->thread_->join();
+    Py_END_ALLOW_THREADS
+    delete job->thread_;
+    delete job;
+}
+
+/// @return the job for the handle, or NULL (with the Python error set) if there isn't one or it's in wait_paths
+static PathJob *
+findPathJob(int handle)
+{
+    std::map<int, PathJob*>::iterator job_iter = path_jobs.find(handle);
+    if (job_iter == path_jobs.end()) {
+        PyErr_Format(pyError, "There's no path job %d; it's finished or was cancelled", handle);
+        return NULL;
+    }
+    if (job_iter->second->waiting_) {
+        PyErr_Format(pyError, "Path job %d is being waited for by another thread", handle);
+        return NULL;
+    }
+    return job_iter->second;
+}
+
+static PyObject *
+_fasttrips_submit_paths(PyObject *self, PyObject *args)
+{
+    PyObject *input1, *input2, *input3, *input4, *input5, *input6, *input7;
+    int iteration, hyperpath_i, num_threads, group_by_locality, chunk_size;
+    if (!PyArg_ParseTuple(args, "iiOOOOOOOiii", &iteration, &hyperpath_i, &input1, &input2, &input7,
+                          &input3, &input4, &input5, &input6, &num_threads, &group_by_locality, &chunk_size)) {
+        return NULL;
+    }
+
+    std::vector<fasttrips::PathSpecification> path_specs;
+    std::vector<double> cost_estimates;
+    if (!readPathSpecs(iteration, hyperpath_i, input1, input2, input7, input3, input4, input5, input6,
+                       path_specs, cost_estimates)) {
+        return NULL;
+    }
+    if (!checkTraceWithPathJobs(anyTraced(path_specs))) {
+        return NULL;
+    }
+
+    // chunk_size less than 1 is one chunk
+    int num_specs = static_cast<int>(path_specs.size());
+    if ((chunk_size < 1) || (chunk_size > num_specs)) { chunk_size = std::max(num_specs, 1); }
+
+    PathJob* job = new PathJob();
+    job->group_by_locality_ = (group_by_locality != 0);
+    job->num_threads_       = num_threads;
+    job->num_found_         = 0;
+    job->num_fetched_       = 0;
+    job->cancelled_         = false;
+    job->done_              = false;
+    job->waiting_           = false;
+    job->chunks_.resize((num_specs + chunk_size - 1) / chunk_size);
+    for (size_t ind = 0; ind < job->chunks_.size(); ++ind) {
+        PathChunk& chunk = job->chunks_[ind];
+        chunk.first_ = static_cast<int>(ind) * chunk_size;
+        int end      = std::min(chunk.first_ + chunk_size, num_specs);
+        chunk.path_specs_.assign(path_specs.begin() + chunk.first_, path_specs.begin() + end);
+        if (!cost_estimates.empty()) {
+            chunk.cost_estimates_.assign(cost_estimates.begin() + chunk.first_, cost_estimates.begin() + end);
+        }
+    }
+
+    int handle = next_path_job++;
+    path_jobs[handle] = job;
+    job->thread_ = new fasttrips::Thread(findPathJobThread, job);
+    return Py_BuildValue("i", handle);
+}
+
+/**
+ * Hands the job's chunks found since the last call to Python, waiting for one first if wait is true
+ * and there aren't any.  Returns (done, [(first index, find_paths results), ...]); when done, that was
+ * the last of them and the handle is no longer valid.
+ */
+static PyObject *
+fetchPathChunks(int handle, bool wait)
+{
+    PathJob* job = findPathJob(handle);
+    if (job == NULL) { return NULL; }
+
+    if (wait) {
+        job->waiting_ = true;
+        Py_BEGIN_ALLOW_THREADS
+        while (true) {
+            {
+                fasttrips::ScopedLock lock(job->mutex_);
+                if ((job->num_found_ > job->num_fetched_) || job->done_) { break; }
+                job->chunk_found_.reset();
+            }
+            job->chunk_found_.wait();
+        }
+        Py_END_ALLOW_THREADS
+        job->waiting_ = false;
+    }
+
+    size_t num_found;
+    {
+        fasttrips::ScopedLock lock(job->mutex_);
+        num_found = job->num_found_;
+    }
+    PyObject *chunk_list = PyList_New(0);
+    for (size_t ind = job->num_fetched_; ind < num_found; ++ind) {
+        PathChunk& chunk = job->chunks_[ind];
+        PyObject *chunk_tuple = Py_BuildValue("(iN)", chunk.first_, pathResults(chunk.paths_, chunk.path_infos_, chunk.perf_infos_));
+        PyList_Append(chunk_list, chunk_tuple);
+        Py_DECREF(chunk_tuple);
+        // they're Python's now
+        std::vector<fasttrips::PathSpecification>().swap(chunk.path_specs_);
+        std::vector<double>().swap(chunk.cost_estimates_);
+        std::vector<fasttrips::Path>().swap(chunk.paths_);
+        std::vector<fasttrips::PathInfo>().swap(chunk.path_infos_);
+        std::vector<fasttrips::PerformanceInfo>().swap(chunk.perf_infos_);
+    }
+    job->num_fetched_ = num_found;
+
+    bool done = (job->num_fetched_ == job->chunks_.size());
+    if (done) { deletePathJob(handle); }
+    return Py_BuildValue("(NN)", PyBool_FromLong(done ? 1 : 0), chunk_list);
+}
+
+static PyObject *
+_fasttrips_poll_paths(PyObject *self, PyObject *args)
+{
+    int handle;
+    if (!PyArg_ParseTuple(args, "i", &handle)) {
+        return NULL;
+    }
+    return fetchPathChunks(handle, false);
+}
+
+static PyObject *
+_fasttrips_wait_paths(PyObject *self, PyObject *args)
+{
+    int handle;
+    if (!PyArg_ParseTuple(args, "i", &handle)) {
+        return NULL;
+    }
+    return fetchPathChunks(handle, true);
+}
+
+static PyObject *
+_fasttrips_cancel_paths(PyObject *self, PyObject *args)
+{
+    int handle;
+    if (!PyArg_ParseTuple(args, "i", &handle)) {
+        return NULL;
+    }
+    PathJob* job = findPathJob(handle);
+    if (job == NULL) { return NULL; }
+    {
+        fasttrips::ScopedLock lock(job->mutex_);
+        job->cancelled_ = true;
+    }
+    // the chunk being found is finished first
+    deletePathJob(handle);
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+_fasttrips_find_skims(PyObject *self, PyObject *args)
+{
+    PyObject *input1, *input2;
+    fasttrips::PathSpecification skim_spec;
+    char *user_class, *access_mode, *transit_mode, *egress_mode;
+    int num_threads;
+    if (!PyArg_ParseTuple(args, "ssssdOOi", &user_class, &access_mode, &transit_mode, &egress_mode,
+                          &skim_spec.preferred_time_, &input1, &input2, &num_threads)) {
+        return NULL;
+    }
+    skim_spec.iteration_            = 0;
+    skim_spec.passenger_id_         = -1;
+    skim_spec.path_id_              = -1;
+    skim_spec.hyperpath_            = false;
+    skim_spec.origin_taz_id_        = -1;
+    skim_spec.destination_taz_id_   = -1;
+    skim_spec.outbound_             = false;
+    skim_spec.trace_                = false;
+    skim_spec.user_class_           = user_class;
+    skim_spec.access_mode_          = access_mode;
+    skim_spec.transit_mode_         = transit_mode;
+    skim_spec.egress_mode_          = egress_mode;
+
+    // origin and destination TAZ ids
+    PyArrayObject *pyo_origins = (PyArrayObject*)PyArray_ContiguousFromObject(input1, NPY_INT32, 1, 1);
+    if (pyo_origins == NULL) return NULL;
+    PyArrayObject *pyo_destinations = (PyArrayObject*)PyArray_ContiguousFromObject(input2, NPY_INT32, 1, 1);
+    if (pyo_destinations == NULL) { Py_DECREF(pyo_origins); return NULL; }
+    const int* origins      = (const int*)PyArray_DATA(pyo_origins);
+    const int* destinations = (const int*)PyArray_DATA(pyo_destinations);
+    std::vector<int> origin_taz_ids(origins, origins + PyArray_DIMS(pyo_origins)[0]);
+    std::vector<int> destination_taz_ids(destinations, destinations + PyArray_DIMS(pyo_destinations)[0]);
+    Py_DECREF(pyo_origins);
+    Py_DECREF(pyo_destinations);
+
+    std::vector<fasttrips::SkimInfo> skims;
+    Py_BEGIN_ALLOW_THREADS
+    pathfinder.findSkims(skim_spec, origin_taz_ids, destination_taz_ids, num_threads, skims);
+    Py_END_ALLOW_THREADS
+
+    // package for returning: origin by destination matrices of cost, in-vehicle time, wait time (nan if there's no path)
+    // and transfers (-1 if there's no path)
+    npy_intp dims[2] = { (npy_intp)origin_taz_ids.size(), (npy_intp)destination_taz_ids.size() };
+    PyArrayObject *ret_cost      = (PyArrayObject *)PyArray_SimpleNew(2, dims, NPY_DOUBLE);
+    PyArrayObject *ret_ivt       = (PyArrayObject *)PyArray_SimpleNew(2, dims, NPY_DOUBLE);
+    PyArrayObject *ret_wait      = (PyArrayObject *)PyArray_SimpleNew(2, dims, NPY_DOUBLE);
+    PyArrayObject *ret_transfers = (PyArrayObject *)PyArray_SimpleNew(2, dims, NPY_INT32);
+    const double no_path = std::numeric_limits<double>::quiet_NaN();
+    for (npy_intp orig = 0; orig < dims[0]; ++orig) {
+        for (npy_intp dest = 0; dest < dims[1]; ++dest) {
+            const fasttrips::SkimInfo& skim = skims[orig*dims[1] + dest];
+            bool found = (skim.transfers_ >= 0);
+            *(npy_double*)PyArray_GETPTR2(ret_cost,      orig, dest) = found ? skim.cost_            : no_path;
+            *(npy_double*)PyArray_GETPTR2(ret_ivt,       orig, dest) = found ? skim.in_vehicle_time_ : no_path;
+            *(npy_double*)PyArray_GETPTR2(ret_wait,      orig, dest) = found ? skim.wait_time_       : no_path;
+            *(npy_int32* )PyArray_GETPTR2(ret_transfers, orig, dest) = skim.transfers_;
+        }
+    }
+
+    PyObject *returnobj = Py_BuildValue("(NNNN)", ret_cost, ret_ivt, ret_wait, ret_transfers);
+    return returnobj;
+}
+
+static PyObject *
+_fasttrips_initialize_simulation(PyObject *self, PyObject *args)
+{
+    PyObject *input1, *input2, *input3;
+    if (!PyArg_ParseTuple(args, "OOO", &input1, &input2, &input3)) {
+        return NULL;
+    }
+
+    // trip stop times index: trip id, sequence, stop id
+    PyArrayObject *pyo_index = (PyArrayObject*)PyArray_ContiguousFromObject(input1, NPY_INT32, 2, 2);
+    if (pyo_index == NULL) return NULL;
+    int num_stop_ind    = PyArray_DIMS(pyo_index)[0];
+    assert(3 == PyArray_DIMS(pyo_index)[1]);
+
+    // trip stop times data: arrival time, departure time
+    PyArrayObject *pyo_times = (PyArrayObject*)PyArray_ContiguousFromObject(input2, NPY_DOUBLE, 2, 2);
+    if (pyo_times == NULL) { Py_DECREF(pyo_index); return NULL; }
+    assert(num_stop_ind == PyArray_DIMS(pyo_times)[0]);
+    assert(2 == PyArray_DIMS(pyo_times)[1]);
+
+    // vehicle capacity for each stop time, or None
+    PyArrayObject *pyo_capacity = NULL;
+    if (input3 != Py_None) {
+        pyo_capacity = (PyArrayObject*)PyArray_ContiguousFromObject(input3, NPY_INT32, 1, 1);
+        if (pyo_capacity == NULL) { Py_DECREF(pyo_index); Py_DECREF(pyo_times); return NULL; }
+        assert(num_stop_ind == PyArray_DIMS(pyo_capacity)[0]);
+    }
+
+    bool ok = true;
+    try {
+        simulation.initializeStopTimes((int*)PyArray_DATA(pyo_index), (double*)PyArray_DATA(pyo_times),
+                                       pyo_capacity ? (int*)PyArray_DATA(pyo_capacity) : NULL, num_stop_ind);
+    } catch (const fasttrips::SimulationError& e) {
+        PyErr_SetString(pyError, e.what());
+        ok = false;
+    }
+    Py_DECREF(pyo_index);
+    Py_DECREF(pyo_times);
+    Py_XDECREF(pyo_capacity);
+    if (!ok) { return NULL; }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+_fasttrips_simulate(PyObject *self, PyObject *args)
+{
+    PyObject *input1, *input2;
+    int capacity_constraint, bump_one_at_a_time;
+    if (!PyArg_ParseTuple(args, "OOii", &input1, &input2, &capacity_constraint, &bump_one_at_a_time)) {
+        return NULL;
+    }
+
+    // passenger legs: trip list id, trip id, board sequence, alight sequence
+    PyArrayObject *pyo_legs  = (PyArrayObject*)PyArray_ContiguousFromObject(input1, NPY_INT32, 2, 2);
+    if (pyo_legs == NULL) return NULL;
+    int num_legs        = PyArray_DIMS(pyo_legs)[0];
+    assert(4 == PyArray_DIMS(pyo_legs)[1]);
+
+    // passenger arrival time at the boarding stop
+    PyArrayObject *pyo_times = (PyArrayObject*)PyArray_ContiguousFromObject(input2, NPY_DOUBLE, 1, 1);
+    if (pyo_times == NULL) { Py_DECREF(pyo_legs); return NULL; }
+    assert(num_legs == PyArray_DIMS(pyo_times)[0]);
+
+    fasttrips::SimulationResult result;
+    bool ok = true;
+    try {
+        simulation.simulate((int*)PyArray_DATA(pyo_legs), (double*)PyArray_DATA(pyo_times), num_legs,
+                            (capacity_constraint != 0), (bump_one_at_a_time != 0), result);
+    } catch (const fasttrips::SimulationError& e) {
+        PyErr_SetString(pyError, e.what());
+        ok = false;
+    }
+    Py_DECREF(pyo_legs);
+    Py_DECREF(pyo_times);
+    if (!ok) { return NULL; }
+
+    // boards, alights, onboard per stop time; legs of the bumped passengers; legs setting the bump waits
+    PyObject *returnobj = Py_BuildValue("(NNNNNi)", newIntArray(result.boards_), newIntArray(result.alights_),
+                                        newIntArray(result.onboard_), newIntArray(result.bumped_legs_),
+                                        newIntArray(result.bump_wait_legs_), result.bump_iterations_);
+    return returnobj;
+}
+
+static PyObject *
+_fasttrips_fetch_performance(PyObject *self, PyObject *args)
+{
+    if (!PyArg_ParseTuple(args, "")) {
+        return NULL;
+    }
+    std::vector<int>        iteration, path_id, traced;
+    std::vector<npy_int64>  counts;
+    std::vector<double>     milliseconds;
+    {
+        fasttrips::ScopedLock lock(performance_records.mutex_);
+        iteration.swap(performance_records.iteration_);
+        path_id.swap(performance_records.path_id_);
+        traced.swap(performance_records.traced_);
+        counts.swap(performance_records.counts_);
+        milliseconds.swap(performance_records.milliseconds_);
+    }
+
+    // per path: counts and milliseconds as find_paths returns them
+    npy_intp num_paths = static_cast<npy_intp>(iteration.size());
+    npy_intp dims_counts[2]       = { num_paths, 13 };
+    npy_intp dims_milliseconds[2] = { num_paths, 2 };
+    PyArrayObject *ret_counts       = (PyArrayObject *)PyArray_SimpleNew(2, dims_counts,       NPY_INT64);
+    PyArrayObject *ret_milliseconds = (PyArrayObject *)PyArray_SimpleNew(2, dims_milliseconds, NPY_DOUBLE);
+    if (num_paths > 0) {
+        memcpy(PyArray_DATA(ret_counts),       &counts[0],       counts.size()*sizeof(npy_int64));
+        memcpy(PyArray_DATA(ret_milliseconds), &milliseconds[0], milliseconds.size()*sizeof(double));
+    }
+
+    PyObject *returnobj = Py_BuildValue("(NNNNN)", newIntArray(iteration), newIntArray(path_id), newIntArray(traced),
+                                        ret_counts, ret_milliseconds);
     return returnobj;
 }
 
 static PyMethodDef fasttripsMethods[] = {
     {"initialize_parameters",   _fasttrips_initialize_parameters, METH_VARARGS, "Initialize path finding parameters" },
     {"initialize_supply",       _fasttrips_initialize_supply,     METH_VARARGS, "Initialize network supply" },
+    {"save_snapshot",           _fasttrips_save_snapshot,         METH_VARARGS, "Write the network supply to a snapshot file" },
+    {"load_snapshot",           _fasttrips_load_snapshot,         METH_VARARGS, "Read the network supply from a snapshot file, if it's up to date" },
     {"set_bump_wait",           _fasttrips_set_bump_wait,         METH_VARARGS, "Update bump wait"          },
+    {"clear_bump_wait",         _fasttrips_clear_bump_wait,       METH_VARARGS, "Clear bump wait"           },
     {"find_path",               _fasttrips_find_path,             METH_VARARGS, "Find trip-based path"      },
+    {"find_paths",              _fasttrips_find_paths,            METH_VARARGS, "Find trip-based paths for a batch of path specifications" },
+    {"submit_paths",            _fasttrips_submit_paths,          METH_VARARGS, "Start finding trip-based paths for a batch of path specifications on a background thread" },
+    {"poll_paths",              _fasttrips_poll_paths,            METH_VARARGS, "Get the chunks of submitted paths found so far" },
+    {"wait_paths",              _fasttrips_wait_paths,            METH_VARARGS, "Wait for a chunk of submitted paths and get the chunks found so far" },
+    {"cancel_paths",            _fasttrips_cancel_paths,          METH_VARARGS, "Stop finding submitted paths" },
+    {"fetch_performance",       _fasttrips_fetch_performance,     METH_VARARGS, "Get the performance info recorded for find_path and submitted paths since the last fetch" },
+    {"find_skims",              _fasttrips_find_skims,            METH_VARARGS, "Find TAZ to TAZ skims of the deterministic paths from each origin" },
+    {"initialize_simulation",   _fasttrips_initialize_simulation, METH_VARARGS, "Initialize vehicle stop times and capacities for simulation" },
+    {"simulate",                _fasttrips_simulate,              METH_VARARGS, "Put passengers on vehicles and bump for capacity" },
     {NULL, NULL, 0, NULL}        /* Sentinel */
 };
 
@@ -1,4 +1,8 @@
 #include "pathfinder.h"
+#include "LogitKernels.h"
+#include "Threading.h"
+#include "TextFile.h"
+#include "Snapshot.h"
 
 #ifdef _WIN32
 #define NOMINMAX
@@ -8,14 +12,17 @@
 #endif
 
 #include <assert.h>
+#include <stdio.h>
 #include <sstream>
 #include <ios>
 #include <iostream>
 #include <iomanip>
-#include <stack>
 #include <string>
 #include <math.h>
 #include <algorithm>
+#include <deque>
+#include <limits>
+#include <functional>
 
 
 const char kPathSeparator =
@@ -29,6 +36,12 @@ const char kPathSeparator =
 
 static std::ofstream label_file;
 static std::ofstream stopids_file;
+static std::ofstream capture_file;
+/// For queries running concurrently
+static fasttrips::Mutex pathset_file_mutex;
+static fasttrips::Mutex capture_file_mutex;
+/// For PathFinder::loadNames
+static fasttrips::Mutex names_mutex;
 
 namespace fasttrips {
 
@@ -38,283 +51,253 @@ namespace fasttrips {
     /**
      * This doesn't really do anything.
      */
-    PathFinder::PathFinder() : process_num_(-1), TIME_WINDOW_(-1), BUMP_BUFFER_(-1), STOCH_PATHSET_SIZE_(-1), STOCH_DISPERSION_(-1)
+    PathFinder::PathFinder() : process_num_(-1), TIME_WINDOW_(-1), BUMP_BUFFER_(-1), STOCH_PATHSET_SIZE_(-1), STOCH_DISPERSION_(-1), STOCH_PATHSET_THREADS_(1),
+        GOAL_DIRECTION_(GOAL_DIRECTION_NONE), GOAL_DIRECTION_LANDMARKS_(0), CAPTURE_PATH_SPECS_(false), COMPACT_SCHEDULE_(false), names_loaded_(false), transfer_supply_mode_(-1), num_bump_waits_(0), goal_num_nodes_(0),
+        supply_checksum_(0)
     {
     }
 
     void PathFinder::initializeParameters(
-        double     time_window,
-        double     bump_buffer,
-        int        stoch_pathset_size,
-        double     stoch_dispersion,
-        int        stoch_max_stop_process_count)
+        double            time_window,
+        double            bump_buffer,
+        int               stoch_pathset_size,
+        int               stoch_pathset_threads,
+        double            stoch_dispersion,
+        int               stoch_max_stop_process_count,
+        GoalDirectionType goal_direction,
+        int               goal_direction_landmarks,
+        bool              capture_path_specs,
+        bool              compact_schedule)
     {
         TIME_WINDOW_                    = time_window;
         BUMP_BUFFER_                    = bump_buffer;
         STOCH_PATHSET_SIZE_             = stoch_pathset_size;
+        STOCH_PATHSET_THREADS_          = stoch_pathset_threads;
         STOCH_DISPERSION_               = stoch_dispersion;
         STOCH_MAX_STOP_PROCESS_COUNT_   = stoch_max_stop_process_count;
+        GOAL_DIRECTION_                 = goal_direction;
+        GOAL_DIRECTION_LANDMARKS_       = goal_direction_landmarks;
+        CAPTURE_PATH_SPECS_             = capture_path_specs;
+        COMPACT_SCHEDULE_               = compact_schedule;
     }
 
     void PathFinder::readIntermediateFiles()
     {
-        readTripIds();
-        readStopIds();
-        readRouteIds();
-        readModeIds();
+        // the supply modes are needed for the transfer mode; the other names are read when needed
+        readIdFile("ft_intermediate_supply_mode_id.txt", mode_names_);
+        transfer_supply_mode_ = mode_names_.find("transfer");
         readAccessLinks();
         readTransferLinks();
         readTripInfo();
         readWeights();
     }
 
-    void PathFinder::readTripIds() {
-        // Trips have been renumbered by fasttrips.  Read string IDs.
-        // Trip num -> id
-        std::ifstream trip_id_file;
-        std::ostringstream ss_trip;
-        ss_trip << output_dir_ << kPathSeparator << "ft_intermediate_trip_id.txt";
-        trip_id_file.open(ss_trip.str().c_str(), std::ios_base::in);
+    /// A part of a text file for parseTextChunkThread
+    typedef struct {
+        const char*             begin_;
+        const char*             end_;
+        const char*             format_;
+        std::vector<TextRow>    rows_;
+        bool                    complete_;      ///< Did it parse to the end
+    } TextChunk;
 
-        std::string string_trip_id_num, string_trip_id;
-        int trip_id_num;
-
-        trip_id_file >> string_trip_id_num >> string_trip_id;
-        if (process_num_ <= 1) { 
-            std::cout << "Reading " << ss_trip.str() << ": ";
-            std::cout << "[" << string_trip_id_num   << "] ";
-            std::cout << "[" << string_trip_id       << "] ";
-        }
-        while (trip_id_file >> trip_id_num >> string_trip_id) {
-            trip_num_to_str_[trip_id_num] = string_trip_id;
-        }
-        if (process_num_ <= 1) {
-            std::cout << " => Read " << trip_num_to_str_.size() << " lines" << std::endl;
-        }
-        trip_id_file.close();
+    static void parseTextChunkThread(void* chunk_arg)
+    {
+        TextChunk* chunk = static_cast<TextChunk*>(chunk_arg);
+        chunk->complete_ = parseTextRows(chunk->begin_, chunk->end_, chunk->format_, chunk->rows_);
     }
 
-    void PathFinder::readStopIds() {
-        // Stops have been renumbered by fasttrips.  Read string IDs.
-        // Stop num -> id
-        std::ifstream stop_id_file;
-        std::ostringstream ss_stop;
-        ss_stop << output_dir_ << kPathSeparator << "ft_intermediate_stop_id.txt";
-        stop_id_file.open(ss_stop.str().c_str(), std::ios_base::in);
-
-        std::string string_stop_id_num, string_stop_id;
-        int stop_id_num;
+    /// Text files are parsed in chunks of at least this many bytes, on a thread each
+    static const size_t TEXT_CHUNK_BYTES = 256*1024;
 
-        stop_id_file >> string_stop_id_num >> string_stop_id;
-        if (process_num_ <= 1) { 
-            std::cout << "Reading " << ss_stop.str() << ": ";
-            std::cout << "[" << string_stop_id_num   << "] ";
-            std::cout << "[" << string_stop_id       << "] ";
-        }
-        while (stop_id_file >> stop_id_num >> string_stop_id) {
-            stop_num_to_str_[stop_id_num] = string_stop_id;
-        }
-        if (process_num_ <= 1) {
-            std::cout << " => Read " << stop_num_to_str_.size() << " lines" << std::endl;
+    /**
+     * Reads an intermediate file as reading it with operator>> did: a header word per field, then rows
+     * in the format (see fasttrips::parseTextRows) up to the end or the first one that doesn't parse.
+     * Big files are split into chunks of lines that are parsed on a thread per processor.
+     */
+    static void readTextRows(const MappedFile& file, const char* format, bool verbose, std::vector<TextRow>& rows)
+    {
+        const char* pos = file.begin();
+        const char* end = file.end();
+        if (verbose) { std::cout << "Reading " << file.filename() << ": "; }
+        for (const char* field = format; *field != '\0'; ++field) {
+            TextToken token;
+            bool has_token = nextTextToken(pos, end, token);
+            if (verbose) { std::cout << "[" << (has_token ? tokenString(token) : std::string()) << "] "; }
+        }
+
+        size_t num_bytes  = static_cast<size_t>(end - pos);
+        size_t num_chunks = std::min(static_cast<size_t>(numberOfProcessors()), 1 + num_bytes/TEXT_CHUNK_BYTES);
+        std::vector<TextChunk> chunks(num_chunks);
+        std::vector<void*>     chunk_args(num_chunks);
+        for (size_t ind = 0; ind < num_chunks; ++ind) {
+            // each chunk ends after a newline
+            const char* chunk_end = (ind + 1 == num_chunks) ? end : pos + (ind + 1)*num_bytes/num_chunks;
+            if (ind > 0) { chunk_end = std::max(chunk_end, chunks[ind-1].end_); }
+            while ((chunk_end < end) && (*(chunk_end-1) != '\n')) { ++chunk_end; }
+            chunks[ind].begin_      = (ind == 0) ? pos : chunks[ind-1].end_;
+            chunks[ind].end_        = chunk_end;
+            chunks[ind].format_     = format;
+            chunks[ind].complete_   = false;
+            chunk_args[ind]         = &chunks[ind];
+        }
+        runThreads(parseTextChunkThread, chunk_args);
+
+        size_t num_rows = 0;
+        for (size_t ind = 0; ind < num_chunks; ++ind) { num_rows += chunks[ind].rows_.size(); }
+        rows.clear();
+        rows.reserve(num_rows);
+        for (size_t ind = 0; ind < num_chunks; ++ind) {
+            rows.insert(rows.end(), chunks[ind].rows_.begin(), chunks[ind].rows_.end());
+            if (!chunks[ind].complete_) { break; }
         }
-        stop_id_file.close();
     }
 
-    void PathFinder::readRouteIds() {
-        // Routes have been renumbered by fasttrips. Read string IDs.
-        // Route num -> id
-        std::ifstream route_id_file;
-        std::ostringstream ss_route;
-        ss_route << output_dir_ << kPathSeparator << "ft_intermediate_route_id.txt";
-        route_id_file.open(ss_route.str().c_str(), std::ios_base::in);
-
-        std::string string_route_id_num, string_route_id;
-        int route_id_num;
-
-        route_id_file >> string_route_id_num >> string_route_id;
-        if (process_num_ <= 1) { 
-            std::cout << "Reading " << ss_route.str() << ": ";
-            std::cout << "[" << string_route_id_num   << "] ";
-            std::cout << "[" << string_route_id       << "] ";
-        }
-        while (route_id_file >> route_id_num >> string_route_id) {
-            route_num_to_str_[route_id_num] = string_route_id;
-        }
+    void PathFinder::readIdFile(const char* filename, StringPool& names) const
+    {
+        // These have been renumbered by fasttrips.  Read string IDs.
+        // num -> id
+        std::ostringstream ss_id;
+        ss_id << output_dir_ << kPathSeparator << filename;
+        MappedFile id_file(ss_id.str());
+        std::vector<TextRow> rows;
+        readTextRows(id_file, "is", process_num_ <= 1, rows);
+
+        names.clear();
+        for (size_t ind = 0; ind < rows.size(); ++ind) {
+            names.set(rows[ind].ints_[0], rows[ind].words_[0].start_, rows[ind].words_[0].length_);
+        }
+        names.compact();
         if (process_num_ <= 1) {
-            std::cout << " => Read " << route_num_to_str_.size() << " lines" << std::endl;
+            std::cout << " => Read " << names.size() << " lines" << std::endl;
         }
-        route_id_file.close();
     }
 
-    void PathFinder::readModeIds() {
-        // Supply modes have been renumbered by fasttrips. Read string IDs.
-        // Supply mode num -> id
-        std::ifstream mode_id_file;
-        std::ostringstream ss_mode;
-        ss_mode << output_dir_ << kPathSeparator << "ft_intermediate_supply_mode_id.txt";
-        mode_id_file.open(ss_mode.str().c_str(), std::ios_base::in);
-
-        std::string string_mode_num, string_mode;
-        int mode_num;
-
-        mode_id_file >> string_mode_num >> string_mode;
-        if (process_num_ <= 1) {
-            std::cout << "Reading " << ss_mode.str() << ": ";
-            std::cout << "[" << string_mode_num      << "] ";
-            std::cout << "[" << string_mode          << "] ";
-        }
-        while (mode_id_file >> mode_num >> string_mode) {
-            mode_num_to_str_[mode_num] = string_mode;
-            if (string_mode == "transfer") { transfer_supply_mode_ = mode_num; }
-        }
-        if (process_num_ <= 1) {
-            std::cout << " => Read " << mode_num_to_str_.size() << " lines" << std::endl;
-        }
-        mode_id_file.close();
+    void PathFinder::loadNames() const
+    {
+        // once they're loaded, queries don't need the lock
+        if (names_loaded_) { memoryBarrier(); return; }
+
+        ScopedLock names_lock(names_mutex);
+        if (names_loaded_) { return; }
+        readIdFile("ft_intermediate_trip_id.txt",  trip_names_);
+        readIdFile("ft_intermediate_stop_id.txt",  stop_names_);
+        readIdFile("ft_intermediate_route_id.txt", route_names_);
+        if (mode_names_.size() == 0) { readIdFile("ft_intermediate_supply_mode_id.txt", mode_names_); }
+        // the names have to be seen before the flag is
+        memoryBarrier();
+        names_loaded_ = true;
     }
 
     void PathFinder::readAccessLinks() {
         // Taz Access and Egress links (various supply modes)
-        std::ifstream acceggr_file;
         std::ostringstream ss_accegr;
         ss_accegr << output_dir_ << kPathSeparator << "ft_intermediate_access_egress.txt";
-        acceggr_file.open(ss_accegr.str().c_str(), std::ios_base::in);
-
-
-        std::string string_taz_num, string_supply_mode_num, string_stop_id_num, attr_name, string_attr_value;
-        int taz_num, supply_mode_num, stop_id_num;
-        double attr_value;
-
-        acceggr_file >> string_taz_num >> string_supply_mode_num >> string_stop_id_num >> attr_name >> string_attr_value;
-        if (process_num_ <= 1) {
-            std::cout << "Reading " << ss_accegr.str() << ": ";
-            std::cout << "[" << string_taz_num         << "] ";
-            std::cout << "[" << string_supply_mode_num << "] ";
-            std::cout << "[" << string_stop_id_num     << "] ";
-            std::cout << "[" << attr_name              << "] ";
-            std::cout << "[" << string_attr_value      << "] ";
-        }
-        int attrs_read = 0;
-        while (acceggr_file >> taz_num >> supply_mode_num >> stop_id_num >> attr_name >> attr_value) {
-            taz_access_links_[taz_num][supply_mode_num][stop_id_num][attr_name] = attr_value;
-            attrs_read++;
+        MappedFile acceggr_file(ss_accegr.str());
+        std::vector<TextRow> rows;
+        readTextRows(acceggr_file, "iiisd", process_num_ <= 1, rows);
+
+        // a link's attributes are on consecutive lines, so its map is only looked up once
+        Attributes* link_attr = NULL;
+        std::string attr_name;
+        for (size_t ind = 0; ind < rows.size(); ++ind) {
+            const TextRow& row = rows[ind];
+            if ((link_attr == NULL) || (row.ints_[0] != rows[ind-1].ints_[0]) ||
+                (row.ints_[1] != rows[ind-1].ints_[1]) || (row.ints_[2] != rows[ind-1].ints_[2])) {
+                link_attr = &taz_access_links_[row.ints_[0]][row.ints_[1]][row.ints_[2]];
+            }
+            attr_name.assign(row.words_[0].start_, row.words_[0].length_);
+            (*link_attr)[attr_name] = row.value_;
         }
         if (process_num_ <= 1) {
-            std::cout << " => Read " << attrs_read << " lines" << std::endl;
+            std::cout << " => Read " << rows.size() << " lines" << std::endl;
         }
-        acceggr_file.close();
     }
 
     void PathFinder::readTransferLinks() {
         // Transfer links
-        std::ifstream transfer_file;
         std::ostringstream ss_transfer;
         ss_transfer << output_dir_ << kPathSeparator << "ft_intermediate_transfers.txt";
-        transfer_file.open(ss_transfer.str().c_str(), std::ios_base::in);
-
-        std::string string_from_stop_id_num, string_to_stop_id_num, attr_name, string_attr_value;
-        int from_stop_id_num, to_stop_id_num;
-        double attr_value;
-
-        transfer_file >> string_from_stop_id_num >> string_to_stop_id_num >> attr_name >> string_attr_value;
-        if (process_num_ <= 1) {
-            std::cout << "Reading " << ss_transfer.str() << ": ";
-            std::cout << "[" << string_from_stop_id_num  << "] ";
-            std::cout << "[" << string_to_stop_id_num    << "] ";
-            std::cout << "[" << attr_name                << "] ";
-            std::cout << "[" << string_attr_value        << "] ";
-        }
-        int attrs_read = 0;
-        while (transfer_file >> from_stop_id_num >> to_stop_id_num >> attr_name >> attr_value) {
-            // o -> d -> attrs
-            transfer_links_o_d_[from_stop_id_num][to_stop_id_num][attr_name] = attr_value;
-
-            // d -> o -> attrs
-            transfer_links_d_o_[to_stop_id_num][from_stop_id_num][attr_name] = attr_value;
-            attrs_read++;
+        MappedFile transfer_file(ss_transfer.str());
+        std::vector<TextRow> rows;
+        readTextRows(transfer_file, "iisd", process_num_ <= 1, rows);
+
+        Attributes* o_d_attr = NULL;
+        Attributes* d_o_attr = NULL;
+        std::string attr_name;
+        for (size_t ind = 0; ind < rows.size(); ++ind) {
+            const TextRow& row = rows[ind];
+            if ((o_d_attr == NULL) || (row.ints_[0] != rows[ind-1].ints_[0]) || (row.ints_[1] != rows[ind-1].ints_[1])) {
+                // o -> d -> attrs
+                o_d_attr = &transfer_links_o_d_[row.ints_[0]][row.ints_[1]];
+                // d -> o -> attrs
+                d_o_attr = &transfer_links_d_o_[row.ints_[1]][row.ints_[0]];
+            }
+            attr_name.assign(row.words_[0].start_, row.words_[0].length_);
+            (*o_d_attr)[attr_name] = row.value_;
+            (*d_o_attr)[attr_name] = row.value_;
         }
         if (process_num_ <= 1) {
-            std::cout << " => Read " << attrs_read << " lines" << std::endl;
+            std::cout << " => Read " << rows.size() << " lines" << std::endl;
         }
-        transfer_file.close();
     }
 
     void PathFinder::readTripInfo() {
-        std::ifstream tripinfo_file;
         std::ostringstream ss_tripinfo;
         ss_tripinfo << output_dir_ << kPathSeparator << "ft_intermediate_trip_info.txt";
-        tripinfo_file.open(ss_tripinfo.str().c_str(), std::ios_base::in);
-
-        std::string string_trip_id_num, attr_name, string_attr_value;
-        int trip_id_num;
-        double attr_value;
-
-        tripinfo_file >> string_trip_id_num >> attr_name >> string_attr_value;
-        if (process_num_ <= 1) {
-            std::cout << "Reading " << ss_tripinfo.str() << ": ";
-            std::cout << "[" << string_trip_id_num       << "] ";
-            std::cout << "[" << attr_name                << "] ";
-            std::cout << "[" << string_attr_value        << "] ";
-        }
-        int attrs_read = 0;
-        while (tripinfo_file >> trip_id_num >> attr_name >> attr_value) {
+        MappedFile tripinfo_file(ss_tripinfo.str());
+        std::vector<TextRow> rows;
+        readTextRows(tripinfo_file, "isd", process_num_ <= 1, rows);
+
+        TripInfo* trip_info = NULL;
+        std::string attr_name;
+        for (size_t ind = 0; ind < rows.size(); ++ind) {
+            const TextRow& row = rows[ind];
+            if ((trip_info == NULL) || (row.ints_[0] != rows[ind-1].ints_[0])) {
+                trip_info = &trip_info_[row.ints_[0]];
+            }
 
             // these are special
-            if (attr_name == "mode_num") {
-                trip_info_[trip_id_num].supply_mode_num_ = int(attr_value);
-            } else if (attr_name == "route_id_num") {
-                trip_info_[trip_id_num].route_id_ = int(attr_value);
+            if (tokenEquals(row.words_[0], "mode_num")) {
+                trip_info->supply_mode_num_ = int(row.value_);
+            } else if (tokenEquals(row.words_[0], "route_id_num")) {
+                trip_info->route_id_ = int(row.value_);
             } else {
-                trip_info_[trip_id_num].trip_attr_[attr_name] = attr_value;
+                attr_name.assign(row.words_[0].start_, row.words_[0].length_);
+                trip_info->trip_attr_[attr_name] = row.value_;
             }
-            attrs_read++;
         }
         if (process_num_ <= 1) {
-            std::cout << " => Read " << attrs_read << " lines" << std::endl;
+            std::cout << " => Read " << rows.size() << " lines" << std::endl;
         }
-        tripinfo_file.close();
     }
 
     void PathFinder::readWeights() {
         // Weights
-        std::ifstream weights_file;
         std::ostringstream ss_weights;
         ss_weights << output_dir_ << kPathSeparator << "ft_intermediate_weights.txt";
-        weights_file.open(ss_weights.str().c_str(), std::ios_base::in);
-
-        std::string user_class, demand_mode_type, demand_mode, string_supply_mode_num, weight_name, string_weight_value;
-        int supply_mode_num;
-        double weight_value;
-
-        weights_file >> user_class >> demand_mode_type >> demand_mode >> string_supply_mode_num >> weight_name >> string_weight_value;
-        if (process_num_ <= 1) {
-            std::cout << "Reading " << ss_weights.str() << ": ";
-            std::cout << "[" << user_class              << "] ";
-            std::cout << "[" << demand_mode_type        << "] ";
-            std::cout << "[" << demand_mode             << "] ";
-            std::cout << "[" << string_supply_mode_num  << "] ";
-            std::cout << "[" << weight_name             << "] ";
-            std::cout << "[" << string_weight_value     << "] ";
-        }
-        int weights_read = 0;
-        while (weights_file >> user_class >> demand_mode_type >> demand_mode >> supply_mode_num >> weight_name >> weight_value) {
-            UserClassMode ucm = { user_class, fasttrips::MODE_ACCESS, demand_mode };
-            if      (demand_mode_type == "access"  ) { ucm.demand_mode_type_ = MODE_ACCESS;  }
-            else if (demand_mode_type == "egress"  ) { ucm.demand_mode_type_ = MODE_EGRESS;  }
-            else if (demand_mode_type == "transit" ) { ucm.demand_mode_type_ = MODE_TRANSIT; }
-            else if (demand_mode_type == "transfer") { ucm.demand_mode_type_ = MODE_TRANSFER;}
+        MappedFile weights_file(ss_weights.str());
+        std::vector<TextRow> rows;
+        readTextRows(weights_file, "sssisd", process_num_ <= 1, rows);
+
+        for (size_t ind = 0; ind < rows.size(); ++ind) {
+            const TextRow& row = rows[ind];
+            const TextToken& demand_mode_type = row.words_[1];
+            UserClassMode ucm = { tokenString(row.words_[0]), fasttrips::MODE_ACCESS, tokenString(row.words_[2]) };
+            if      (tokenEquals(demand_mode_type, "access"  )) { ucm.demand_mode_type_ = MODE_ACCESS;  }
+            else if (tokenEquals(demand_mode_type, "egress"  )) { ucm.demand_mode_type_ = MODE_EGRESS;  }
+            else if (tokenEquals(demand_mode_type, "transit" )) { ucm.demand_mode_type_ = MODE_TRANSIT; }
+            else if (tokenEquals(demand_mode_type, "transfer")) { ucm.demand_mode_type_ = MODE_TRANSFER;}
             else {
-                std::cerr << "Do not understand demand_mode_type [" << demand_mode_type << "] in " << ss_weights.str() << std::endl;
+                std::cerr << "Do not understand demand_mode_type [" << tokenString(demand_mode_type) << "] in " << ss_weights.str() << std::endl;
                 exit(2);
             }
 
-            weight_lookup_[ucm][supply_mode_num][weight_name] = weight_value;
-            weights_read++;
+            weight_lookup_[ucm][row.ints_[0]][tokenString(row.words_[3])] = row.value_;
         }
         if (process_num_ <= 1) {
-            std::cout << " => Read " << weights_read << " lines" << std::endl;
+            std::cout << " => Read " << rows.size() << " lines" << std::endl;
         }
-        weights_file.close();
     }
 
     void PathFinder::initializeSupply(
@@ -326,26 +309,522 @@ namespace fasttrips {
     {
         output_dir_  = output_dir;
         process_num_ = process_num;
+        clearSupply();
         readIntermediateFiles();
+        initializeStopTimes(stoptime_index, stoptime_times, num_stoptimes);
+        initializeGoalBounds();
+        supply_checksum_ = supplyChecksum(stoptime_index, stoptime_times, num_stoptimes);
+        startCapture(stoptime_index, stoptime_times, num_stoptimes);
+    }
+
+    void PathFinder::clearSupply()
+    {
+        weight_lookup_.clear();
+        taz_access_links_.clear();
+        transfer_links_o_d_.clear();
+        transfer_links_d_o_.clear();
+        trip_info_.clear();
+        schedule_.clear();
+        trip_names_.clear();
+        stop_names_.clear();
+        route_names_.clear();
+        mode_names_.clear();
+        names_loaded_ = false;
+        transfer_supply_mode_ = -1;
+        bump_wait_.clear();
+        has_bump_wait_.clear();
+        num_bump_waits_ = 0;
+        goal_node_index_.clear();
+        goal_taz_row_.clear();
+        goal_bound_from_.clear();
+        goal_bound_to_.clear();
+        goal_num_nodes_ = 0;
+        supply_checksum_ = 0;
+    }
 
+    void PathFinder::initializeStopTimes(
+        const int*      stoptime_index,
+        const double*   stoptime_times,
+        int             num_stoptimes)
+    {
+        if (!schedule_.build(stoptime_index, stoptime_times, num_stoptimes, COMPACT_SCHEDULE_) && (process_num_ <= 1)) {
+            std::cout << "Not using the compact schedule: the stop times aren't all whole seconds in order within 18 hours of each trip's first" << std::endl;
+        }
+        int num_slots = schedule_.numSlots();
+        bump_wait_.assign(num_slots, 0.0);
+        has_bump_wait_.assign(num_slots, false);
+        num_bump_waits_ = 0;
+    }
+
+    void PathFinder::startCapture(
+        const int*      stoptime_index,
+        const double*   stoptime_times,
+        int             num_stoptimes)
+    {
+        if (CAPTURE_PATH_SPECS_) {
+            if (process_num_ <= 1) { writeCaptureSupply(stoptime_index, stoptime_times, num_stoptimes); }
+
+            std::ostringstream ss;
+            ss << output_dir_ << kPathSeparator << "ft_capture_path_specs";
+            if (process_num_ > 0) {
+                ss << "_worker" << std::setfill('0') << std::setw(2) << process_num_;
+            }
+            ss << ".txt";
+            capture_file.open(ss.str().c_str(), std::ios_base::out);
+            capture_file << "iteration passenger_id path_id hyperpath user_class access_mode transit_mode egress_mode ";
+            capture_file << "origin_taz_id destination_taz_id outbound preferred_time trace" << std::endl;
+        }
+    }
+
+    void PathFinder::writeCaptureSupply(
+        const int*      stoptime_index,
+        const double*   stoptime_times,
+        int             num_stoptimes) const
+    {
+        std::ofstream param_file;
+        std::ostringstream ss_param;
+        ss_param << output_dir_ << kPathSeparator << "ft_capture_parameters.txt";
+        param_file.open(ss_param.str().c_str(), std::ios_base::out);
+        param_file << "parameter value" << std::endl;
+        param_file << std::setprecision(17);
+        param_file << "time_window "                    << TIME_WINDOW_                     << std::endl;
+        param_file << "bump_buffer "                    << BUMP_BUFFER_                     << std::endl;
+        param_file << "stoch_pathset_size "             << STOCH_PATHSET_SIZE_              << std::endl;
+        param_file << "stoch_pathset_threads "          << STOCH_PATHSET_THREADS_           << std::endl;
+        param_file << "stoch_dispersion "               << STOCH_DISPERSION_                << std::endl;
+        param_file << "stoch_max_stop_process_count "   << STOCH_MAX_STOP_PROCESS_COUNT_    << std::endl;
+        param_file << "goal_direction "                 << GOAL_DIRECTION_                  << std::endl;
+        param_file << "goal_direction_landmarks "       << GOAL_DIRECTION_LANDMARKS_        << std::endl;
+        param_file << "compact_schedule "               << (COMPACT_SCHEDULE_ ? 1 : 0)      << std::endl;
+        param_file.close();
+
+        std::ofstream stoptimes_file;
+        std::ostringstream ss_stoptimes;
+        ss_stoptimes << output_dir_ << kPathSeparator << "ft_capture_stop_times.txt";
+        stoptimes_file.open(ss_stoptimes.str().c_str(), std::ios_base::out);
+        stoptimes_file << "trip_id_num sequence stop_id_num arrive_time depart_time" << std::endl;
+        stoptimes_file << std::setprecision(17);
         for (int i=0; i<num_stoptimes; ++i) {
-            TripStopTime stt = {
-                stoptime_index[3*i],    // trip id
-                stoptime_index[3*i+1],  // sequence
-                stoptime_index[3*i+2],  // stop id
-                stoptime_times[2*i],    // arrive time
-                stoptime_times[2*i+1]   // depart time
-            };
-            // verify the sequence number makes sense: sequential, starts with 1
-            assert(stt.sequence_ == trip_stop_times_[stt.trip_id_].size()+1);
+            stoptimes_file << stoptime_index[3*i] << " " << stoptime_index[3*i+1] << " " << stoptime_index[3*i+2] << " ";
+            stoptimes_file << stoptime_times[2*i] << " " << stoptime_times[2*i+1] << std::endl;
+        }
+        stoptimes_file.close();
+    }
+
+    void PathFinder::capturePathSpecification(const PathSpecification& path_spec) const
+    {
+        ScopedLock capture_lock(capture_file_mutex);
+        capture_file << path_spec.iteration_ << " " << path_spec.passenger_id_ << " " << path_spec.path_id_ << " ";
+        capture_file << (path_spec.hyperpath_ ? 1 : 0) << " ";
+        capture_file << path_spec.user_class_ << " " << path_spec.access_mode_ << " ";
+        capture_file << path_spec.transit_mode_ << " " << path_spec.egress_mode_ << " ";
+        capture_file << path_spec.origin_taz_id_ << " " << path_spec.destination_taz_id_ << " ";
+        capture_file << (path_spec.outbound_ ? 1 : 0) << " ";
+        capture_file << std::setprecision(17) << path_spec.preferred_time_ << " ";
+        capture_file << (path_spec.trace_ ? 1 : 0) << std::endl;
+    }
+
+    /// The intermediate files PathFinder::readIntermediateFiles reads, for PathFinder::supplyChecksum
+    static const char* INTERMEDIATE_FILES[] = {
+        "ft_intermediate_trip_id.txt",
+        "ft_intermediate_stop_id.txt",
+        "ft_intermediate_route_id.txt",
+        "ft_intermediate_supply_mode_id.txt",
+        "ft_intermediate_access_egress.txt",
+        "ft_intermediate_transfers.txt",
+        "ft_intermediate_trip_info.txt",
+        "ft_intermediate_weights.txt"
+    };
+
+    /// The start of a supply snapshot: what it is, what kind of machine wrote it, and what it was built from
+    typedef struct {
+        char                magic_[8];      ///< "ftsnap" and the format version
+        int                 byte_order_;    ///< 0x01020304 in the writer's byte order
+        int                 sizes_[4];      ///< sizeof int, double, size_t and fasttrips::TripSlots
+        unsigned long long  checksum_;      ///< PathFinder::supplyChecksum of the sources
+    } SnapshotHeader;
+
+    /// The end of a supply snapshot, so a truncated one isn't used
+    static const unsigned long long SNAPSHOT_END = 0x70616e73746674ULL;
+
+    static SnapshotHeader snapshotHeader(unsigned long long checksum)
+    {
+        SnapshotHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic_, "ftsnap\0\4", 8);
+        header.byte_order_  = 0x01020304;
+        header.sizes_[0]    = sizeof(int);
+        header.sizes_[1]    = sizeof(double);
+        header.sizes_[2]    = sizeof(size_t);
+        header.sizes_[3]    = sizeof(TripSlots);
+        header.checksum_    = checksum;
+        return header;
+    }
+
+    static void writeValue(SnapshotWriter& writer, const UserClassMode& ucm)
+    {
+        writeValue(writer, ucm.user_class_);
+        writeValue(writer, static_cast<int>(ucm.demand_mode_type_));
+        writeValue(writer, ucm.demand_mode_);
+    }
+
+    static void readValue(SnapshotReader& reader, UserClassMode& ucm)
+    {
+        int demand_mode_type = 0;
+        readValue(reader, ucm.user_class_);
+        readValue(reader, demand_mode_type);
+        readValue(reader, ucm.demand_mode_);
+        ucm.demand_mode_type_ = static_cast<DemandModeType>(demand_mode_type);
+    }
+
+    static void writeValue(SnapshotWriter& writer, const TripInfo& trip_info)
+    {
+        writeValue(writer, trip_info.supply_mode_num_);
+        writeValue(writer, trip_info.route_id_);
+        writeValue(writer, trip_info.trip_attr_);
+    }
+
+    static void readValue(SnapshotReader& reader, TripInfo& trip_info)
+    {
+        readValue(reader, trip_info.supply_mode_num_);
+        readValue(reader, trip_info.route_id_);
+        readValue(reader, trip_info.trip_attr_);
+    }
 
-            trip_stop_times_[stt.trip_id_].push_back(stt);
-            stop_trip_times_[stt.stop_id_].push_back(stt);
-            if (false && (process_num <= 1) && ((i<5) || (i>num_stoptimes-5))) {
-                printf("stoptimes[%4d][%4d][%4d]=%f, %f\n", stoptime_index[3*i], stoptime_index[3*i+1], stoptime_index[3*i+2],
-                       stoptime_times[2*i], stoptime_times[2*i+1]);
+    unsigned long long PathFinder::supplyChecksum(
+        const int*      stoptime_index,
+        const double*   stoptime_times,
+        int             num_stoptimes) const
+    {
+        Fnv1aHash hash;
+        for (size_t ind = 0; ind < sizeof(INTERMEDIATE_FILES)/sizeof(INTERMEDIATE_FILES[0]); ++ind) {
+            std::ostringstream ss;
+            ss << output_dir_ << kPathSeparator << INTERMEDIATE_FILES[ind];
+            hash.addFile(ss.str());
+        }
+        hash.addValue(num_stoptimes);
+        hash.add(stoptime_index, 3*sizeof(int)*num_stoptimes);
+        hash.add(stoptime_times, 2*sizeof(double)*num_stoptimes);
+        // the goal direction bounds depend on these too
+        hash.addValue(static_cast<int>(GOAL_DIRECTION_));
+        hash.addValue(GOAL_DIRECTION_LANDMARKS_);
+        // and the schedule layout
+        hash.addValue(static_cast<int>(COMPACT_SCHEDULE_));
+        return hash.value();
+    }
+
+    bool PathFinder::saveSnapshot(const char* snapshot_file) const
+    {
+        // written to the side and then moved into place, so other processes never read half of one
+        std::ostringstream ss_temp;
+        ss_temp << snapshot_file << "." << process_num_ << ".tmp";
+        SnapshotWriter writer(ss_temp.str());
+
+        SnapshotHeader header = snapshotHeader(supply_checksum_);
+        writer.write(header);
+        writeValue(writer, weight_lookup_);
+        writeValue(writer, taz_access_links_);
+        writeValue(writer, transfer_links_o_d_);
+        writeValue(writer, transfer_links_d_o_);
+        writeValue(writer, trip_info_);
+        schedule_.write(writer);
+        writeValue(writer, transfer_supply_mode_);
+        writeValue(writer, goal_num_nodes_);
+        writeValue(writer, std::map<int, int>(goal_node_index_.begin(), goal_node_index_.end()));
+        writeValue(writer, std::map<int, int>(goal_taz_row_.begin(), goal_taz_row_.end()));
+        writeValue(writer, goal_bound_from_);
+        writeValue(writer, goal_bound_to_);
+        writer.write(SNAPSHOT_END);
+
+        bool success = writer.good();
+        writer.close();
+        if (success) {
+            remove(snapshot_file);
+            success = (rename(ss_temp.str().c_str(), snapshot_file) == 0);
+        }
+        if (!success) {
+            remove(ss_temp.str().c_str());
+            return false;
+        }
+        if (process_num_ <= 1) {
+            std::cout << "Wrote supply snapshot " << snapshot_file << std::endl;
+        }
+        return true;
+    }
+
+    bool PathFinder::loadSnapshot(
+        const char* snapshot_file,
+        const char* output_dir,
+        int         process_num,
+        int*        stoptime_index,
+        double*     stoptime_times,
+        int         num_stoptimes)
+    {
+        output_dir_  = output_dir;
+        process_num_ = process_num;
+        clearSupply();
+
+        unsigned long long checksum = supplyChecksum(stoptime_index, stoptime_times, num_stoptimes);
+        SnapshotHeader expected     = snapshotHeader(checksum);
+        SnapshotHeader header;
+        SnapshotReader reader(snapshot_file);
+        reader.read(header);
+
+        std::string problem;
+        if (!reader.good()) {
+            problem = "can't read it";
+        } else if ((memcmp(header.magic_, expected.magic_, sizeof(header.magic_)) != 0) ||
+                   (header.byte_order_ != expected.byte_order_) ||
+                   (memcmp(header.sizes_, expected.sizes_, sizeof(header.sizes_)) != 0)) {
+            problem = "it's from another version or kind of machine";
+        } else if (header.checksum_ != checksum) {
+            problem = "the network supply has changed";
+        } else {
+            std::map<int, int> goal_node_index, goal_taz_row;
+            unsigned long long end = 0;
+            readValue(reader, weight_lookup_);
+            readValue(reader, taz_access_links_);
+            readValue(reader, transfer_links_o_d_);
+            readValue(reader, transfer_links_d_o_);
+            readValue(reader, trip_info_);
+            bool schedule_ok = schedule_.read(reader);
+            readValue(reader, transfer_supply_mode_);
+            readValue(reader, goal_num_nodes_);
+            readValue(reader, goal_node_index);
+            readValue(reader, goal_taz_row);
+            readValue(reader, goal_bound_from_);
+            readValue(reader, goal_bound_to_);
+            reader.read(end);
+            if (!reader.good() || (end != SNAPSHOT_END) || !reader.atEnd() || !schedule_ok) {
+                problem = "it's incomplete";
             }
+            goal_node_index_.insert(goal_node_index.begin(), goal_node_index.end());
+            goal_taz_row_.insert(goal_taz_row.begin(), goal_taz_row.end());
         }
+
+        if (!problem.empty()) {
+            clearSupply();
+            if (process_num_ <= 1) {
+                std::cout << "Not using supply snapshot " << snapshot_file << ": " << problem << std::endl;
+            }
+            return false;
+        }
+
+        bump_wait_.assign(schedule_.numSlots(), 0.0);
+        has_bump_wait_.assign(schedule_.numSlots(), false);
+        num_bump_waits_  = 0;
+        supply_checksum_ = checksum;
+
+        if (process_num_ <= 1) {
+            std::cout << "Read supply snapshot " << snapshot_file << std::endl;
+        }
+        startCapture(stoptime_index, stoptime_times, num_stoptimes);
+        return true;
+    }
+
+    void PathFinder::initializeGoalBounds()
+    {
+        goal_node_index_.clear();
+        goal_taz_row_.clear();
+        goal_bound_from_.clear();
+        goal_bound_to_.clear();
+        goal_num_nodes_ = 0;
+        if (GOAL_DIRECTION_ == GOAL_DIRECTION_NONE) { return; }
+
+        // number the nodes: stops first, then TAZs
+        std::vector<bool> is_taz;
+        for (int stop_id = 0; stop_id < schedule_.stopIdLimit(); ++stop_id) {
+            if (schedule_.firstVisit(stop_id) == schedule_.endVisit(stop_id)) { continue; }
+            goal_node_index_[stop_id] = goal_num_nodes_++;
+            is_taz.push_back(false);
+        }
+        for (StopStopToAttr::const_iterator xi = transfer_links_o_d_.begin(); xi != transfer_links_o_d_.end(); ++xi) {
+            for (StopToAttr::const_iterator xj = xi->second.begin(); xj != xi->second.end(); ++xj) {
+                if (goal_node_index_.find(xi->first) == goal_node_index_.end()) { goal_node_index_[xi->first] = goal_num_nodes_++; is_taz.push_back(false); }
+                if (goal_node_index_.find(xj->first) == goal_node_index_.end()) { goal_node_index_[xj->first] = goal_num_nodes_++; is_taz.push_back(false); }
+            }
+        }
+        for (TAZSupplyStopToAttr::const_iterator ti = taz_access_links_.begin(); ti != taz_access_links_.end(); ++ti) {
+            for (SupplyStopToAttr::const_iterator si = ti->second.begin(); si != ti->second.end(); ++si) {
+                for (StopToAttr::const_iterator li = si->second.begin(); li != si->second.end(); ++li) {
+                    if (goal_node_index_.find(li->first) == goal_node_index_.end()) { goal_node_index_[li->first] = goal_num_nodes_++; is_taz.push_back(false); }
+                }
+            }
+        }
+        for (TAZSupplyStopToAttr::const_iterator ti = taz_access_links_.begin(); ti != taz_access_links_.end(); ++ti) {
+            int row = (int)goal_taz_row_.size();
+            goal_taz_row_[ti->first]    = row;
+            goal_node_index_[ti->first] = goal_num_nodes_++;
+            is_taz.push_back(true);
+        }
+
+        // relaxed network edges, keeping the fastest time for each (from node, to node)
+        std::map<std::pair<int,int>, float> edges;
+        std::map<std::pair<int,int>, float>::iterator edge_iter;
+        for (int trip_id = 0; trip_id < schedule_.numTrips(); ++trip_id) {
+            if (!schedule_.hasTrip(trip_id)) { continue; }
+            int prev_seq = -1;
+            for (int seq = 1; seq <= schedule_.numStops(trip_id); ++seq) {
+                if (schedule_.stopId(trip_id, seq) < 0) { continue; }
+                if (prev_seq > 0) {
+                    std::pair<int,int> od(goal_node_index_[schedule_.stopId(trip_id, prev_seq)], goal_node_index_[schedule_.stopId(trip_id, seq)]);
+                    float hop_time = (float)std::max(0.0, schedule_.arriveTime(trip_id, seq) - schedule_.departTime(trip_id, prev_seq));
+                    edge_iter = edges.find(od);
+                    if (edge_iter == edges.end()) { edges[od] = hop_time; }
+                    else { edge_iter->second = std::min(edge_iter->second, hop_time); }
+                }
+                prev_seq = seq;
+            }
+        }
+        for (StopStopToAttr::const_iterator xi = transfer_links_o_d_.begin(); xi != transfer_links_o_d_.end(); ++xi) {
+            for (StopToAttr::const_iterator xj = xi->second.begin(); xj != xi->second.end(); ++xj) {
+                std::pair<int,int> od(goal_node_index_[xi->first], goal_node_index_[xj->first]);
+                float transfer_time = (float)xj->second.find("time_min")->second;
+                edge_iter = edges.find(od);
+                if (edge_iter == edges.end()) { edges[od] = transfer_time; }
+                else { edge_iter->second = std::min(edge_iter->second, transfer_time); }
+            }
+        }
+        for (TAZSupplyStopToAttr::const_iterator ti = taz_access_links_.begin(); ti != taz_access_links_.end(); ++ti) {
+            for (SupplyStopToAttr::const_iterator si = ti->second.begin(); si != ti->second.end(); ++si) {
+                for (StopToAttr::const_iterator li = si->second.begin(); li != si->second.end(); ++li) {
+                    float access_time = (float)li->second.find("time_min")->second;
+                    // access and egress both
+                    for (int dir = 0; dir < 2; ++dir) {
+                        std::pair<int,int> od(goal_node_index_[ti->first], goal_node_index_[li->first]);
+                        if (dir == 1) { std::swap(od.first, od.second); }
+                        edge_iter = edges.find(od);
+                        if (edge_iter == edges.end()) { edges[od] = access_time; }
+                        else { edge_iter->second = std::min(edge_iter->second, access_time); }
+                    }
+                }
+            }
+        }
+        std::vector< std::vector< std::pair<int, float> > > adjacency(goal_num_nodes_), reverse_adjacency(goal_num_nodes_);
+        for (edge_iter = edges.begin(); edge_iter != edges.end(); ++edge_iter) {
+            if (edge_iter->first.first == edge_iter->first.second) { continue; }
+            adjacency        [edge_iter->first.first ].push_back(std::make_pair(edge_iter->first.second, edge_iter->second));
+            reverse_adjacency[edge_iter->first.second].push_back(std::make_pair(edge_iter->first.first,  edge_iter->second));
+        }
+
+        if (GOAL_DIRECTION_ == GOAL_DIRECTION_TAZ) {
+            // a row per TAZ; paths only access/egress at their own TAZs so TAZs aren't passed through
+            size_t num_rows = goal_taz_row_.size();
+            goal_bound_from_.resize(num_rows*goal_num_nodes_);
+            goal_bound_to_.resize  (num_rows*goal_num_nodes_);
+            for (std::tr1::unordered_map<int, int>::const_iterator tri = goal_taz_row_.begin(); tri != goal_taz_row_.end(); ++tri) {
+                int taz_node = goal_node_index_[tri->first];
+                goalBoundShortestTimes(adjacency,         is_taz, taz_node, false, &goal_bound_from_[tri->second*goal_num_nodes_]);
+                goalBoundShortestTimes(reverse_adjacency, is_taz, taz_node, false, &goal_bound_to_  [tri->second*goal_num_nodes_]);
+            }
+        }
+        else {
+            // landmarks need the triangle inequality so the shortest times may pass through TAZs.
+            // Pick them farthest-first: each new landmark is the stop farthest from those picked so far.
+            int num_stops = 0;
+            for (int node = 0; node < goal_num_nodes_; ++node) { if (!is_taz[node]) { num_stops++; } }
+            int num_rows  = std::min(GOAL_DIRECTION_LANDMARKS_, num_stops);
+            goal_bound_from_.resize(num_rows*goal_num_nodes_);
+            goal_bound_to_.resize  (num_rows*goal_num_nodes_);
+
+            std::vector<float> nearest_landmark(goal_num_nodes_, std::numeric_limits<float>::infinity());
+            int landmark = 0;
+            for (int row = 0; row < num_rows; ++row) {
+                if (row > 0) {
+                    float farthest = -1.0;
+                    for (int node = 0; node < goal_num_nodes_; ++node) {
+                        if (is_taz[node] || (nearest_landmark[node] == 0.0)) { continue; }
+                        if (nearest_landmark[node] > farthest) { farthest = nearest_landmark[node]; landmark = node; }
+                    }
+                }
+                float* from_landmark = &goal_bound_from_[row*goal_num_nodes_];
+                goalBoundShortestTimes(adjacency,         is_taz, landmark, true, from_landmark);
+                goalBoundShortestTimes(reverse_adjacency, is_taz, landmark, true, &goal_bound_to_[row*goal_num_nodes_]);
+                nearest_landmark[landmark] = 0.0;
+                for (int node = 0; node < goal_num_nodes_; ++node) {
+                    nearest_landmark[node] = std::min(nearest_landmark[node], from_landmark[node]);
+                }
+            }
+        }
+
+        if (process_num_ <= 1) {
+            std::cout << "Goal direction bounds: " << goal_num_nodes_ << " nodes x ";
+            std::cout << (goal_num_nodes_ > 0 ? goal_bound_from_.size()/goal_num_nodes_ : 0);
+            std::cout << (GOAL_DIRECTION_ == GOAL_DIRECTION_TAZ ? " TAZs" : " landmarks") << " => ";
+            std::cout << (2*goal_bound_from_.size()*sizeof(float))/(1024*1024) << " MB" << std::endl;
+        }
+    }
+
+    void PathFinder::goalBoundShortestTimes(
+        const std::vector< std::vector< std::pair<int, float> > >& adjacency,
+        const std::vector<bool>& is_taz,
+        int source,
+        bool through_taz,
+        float* dist) const
+    {
+        std::fill(dist, dist + goal_num_nodes_, std::numeric_limits<float>::infinity());
+        // (time, node), smallest time on top
+        std::priority_queue< std::pair<float,int>, std::vector< std::pair<float,int> >, std::greater< std::pair<float,int> > > node_queue;
+        dist[source] = 0.0;
+        node_queue.push(std::make_pair(0.0f, source));
+        while (!node_queue.empty()) {
+            std::pair<float,int> time_node = node_queue.top();
+            node_queue.pop();
+            int node = time_node.second;
+            if (time_node.first > dist[node]) { continue; }
+            if (is_taz[node] && !through_taz && (node != source)) { continue; }
+
+            for (std::vector< std::pair<int, float> >::const_iterator ai  = adjacency[node].begin();
+                                                                      ai != adjacency[node].end(); ++ai) {
+                float time = dist[node] + ai->second;
+                if (time < dist[ai->first]) {
+                    dist[ai->first] = time;
+                    node_queue.push(std::make_pair(time, ai->first));
+                }
+            }
+        }
+    }
+
+    double PathFinder::goalLowerBound(
+        const PathSpecification& path_spec,
+        int stop_id) const
+    {
+        if (GOAL_DIRECTION_ == GOAL_DIRECTION_NONE) { return 0.0; }
+
+        int end_taz_id = path_spec.outbound_ ? path_spec.origin_taz_id_ : path_spec.destination_taz_id_;
+        std::tr1::unordered_map<int, int>::const_iterator stop_iter = goal_node_index_.find(stop_id);
+        std::tr1::unordered_map<int, int>::const_iterator taz_iter  = goal_node_index_.find(end_taz_id);
+        if ((stop_iter == goal_node_index_.end()) || (taz_iter == goal_node_index_.end())) { return 0.0; }
+
+        const float infinity = std::numeric_limits<float>::infinity();
+        double bound = 0.0;
+
+        if (GOAL_DIRECTION_ == GOAL_DIRECTION_TAZ) {
+            // outbound: from the origin to the stop; inbound: from the stop to the destination
+            int   row  = goal_taz_row_.find(end_taz_id)->second;
+            float time = path_spec.outbound_ ? goal_bound_from_[row*goal_num_nodes_ + stop_iter->second] :
+                                               goal_bound_to_  [row*goal_num_nodes_ + stop_iter->second];
+            if (time != infinity) { bound = time; }
+        }
+        else {
+            // outbound: bound the time from the origin (a) to the stop (b); inbound: from the stop (a) to the destination (b)
+            // by the triangle inequality with each landmark L: d(a,b) >= d(L,b) - d(L,a) and d(a,b) >= d(a,L) - d(b,L)
+            int a = path_spec.outbound_ ? taz_iter->second  : stop_iter->second;
+            int b = path_spec.outbound_ ? stop_iter->second : taz_iter->second;
+            size_t num_rows = goal_bound_from_.size()/goal_num_nodes_;
+            for (size_t row = 0; row < num_rows; ++row) {
+                const float* from_landmark = &goal_bound_from_[row*goal_num_nodes_];
+                const float* to_landmark   = &goal_bound_to_  [row*goal_num_nodes_];
+                if ((from_landmark[a] != infinity) && (from_landmark[b] != infinity)) {
+                    bound = std::max(bound, (double)from_landmark[b] - (double)from_landmark[a]);
+                }
+                if ((to_landmark[a] != infinity) && (to_landmark[b] != infinity)) {
+                    bound = std::max(bound, (double)to_landmark[a] - (double)to_landmark[b]);
+                }
+            }
+        }
+        // the tables are single precision; back off a little so rounding can't overestimate
+        return std::max(0.0, bound - 0.001);
     }
 
     void PathFinder::setBumpWait(int*       bw_index,
@@ -353,12 +832,29 @@ namespace fasttrips {
                                  int        num_bw)
     {
         for (int i=0; i<num_bw; ++i) {
-            TripStop ts = { bw_index[3*i], bw_index[3*i+1], bw_index[3*i+2] };
-            bump_wait_[ts] = bw_data[i];
-            if (true && (process_num_ <= 1) && ((i<5) || (i>num_bw-5))) {
-                printf("bump_wait[%6d %6d %6d] = %f\n",
-                       bw_index[3*i], bw_index[3*i+1], bw_index[3*i+2], bw_data[i] );
+            int st = stopTimeIndex(bw_index[3*i], bw_index[3*i+1]);
+            if (st < 0) { continue; }
+            if (!has_bump_wait_[st]) {
+                has_bump_wait_[st] = true;
+                num_bump_waits_   += 1;
             }
+            bump_wait_[st] = bw_data[i];
+        }
+    }
+
+    void PathFinder::clearBumpWait(int*     bw_index,
+                                   int      num_bw)
+    {
+        if (bw_index == NULL) {
+            has_bump_wait_.assign(has_bump_wait_.size(), false);
+            num_bump_waits_ = 0;
+            return;
+        }
+        for (int i=0; i<num_bw; ++i) {
+            int st = stopTimeIndex(bw_index[3*i], bw_index[3*i+1]);
+            if ((st < 0) || !has_bump_wait_[st]) { continue; }
+            has_bump_wait_[st] = false;
+            num_bump_waits_   -= 1;
         }
     }
 
@@ -377,6 +873,11 @@ namespace fasttrips {
         // for now we'll just trace
         // if (!path_spec.trace_) { return; }
 
+        if (CAPTURE_PATH_SPECS_) { capturePathSpecification(path_spec); }
+
+        // IDs are written out by name for these
+        if (path_spec.trace_ || path_spec.hyperpath_) { loadNames(); }
+
         std::ofstream trace_file;
         if (path_spec.trace_) {
             std::ostringstream ss;
@@ -409,6 +910,339 @@ namespace fasttrips {
             stopids_file << "stop_id,stop_id_label_iter" << std::endl;
         }
 
+        // compile the search for these flags
+        if (path_spec.trace_) {
+            if (path_spec.hyperpath_) {
+                if (path_spec.outbound_) { searchPath<true,  true,  true >(path_spec, trace_file, path, path_info, performance_info); }
+                else                     { searchPath<true,  true,  false>(path_spec, trace_file, path, path_info, performance_info); }
+            } else {
+                if (path_spec.outbound_) { searchPath<true,  false, true >(path_spec, trace_file, path, path_info, performance_info); }
+                else                     { searchPath<true,  false, false>(path_spec, trace_file, path, path_info, performance_info); }
+            }
+        } else {
+            if (path_spec.hyperpath_) {
+                if (path_spec.outbound_) { searchPath<false, true,  true >(path_spec, trace_file, path, path_info, performance_info); }
+                else                     { searchPath<false, true,  false>(path_spec, trace_file, path, path_info, performance_info); }
+            } else {
+                if (path_spec.outbound_) { searchPath<false, false, true >(path_spec, trace_file, path, path_info, performance_info); }
+                else                     { searchPath<false, false, false>(path_spec, trace_file, path, path_info, performance_info); }
+            }
+        }
+
+        if (path_spec.trace_) {
+
+            trace_file << "        label iterations: " << performance_info.label_iterations_    << std::endl;
+            trace_file << "       max process count: " << performance_info.max_process_count_   << std::endl;
+            trace_file << "   milliseconds labeling: " << performance_info.milliseconds_labeling_    << std::endl;
+            trace_file << "milliseconds enumerating: " << performance_info.milliseconds_enumerating_ << std::endl;
+            trace_file << "            queue pushes: " << performance_info.queue_pushes_        << std::endl;
+            trace_file << "              queue pops: " << performance_info.queue_pops_          << std::endl;
+            trace_file << "        queue stale pops: " << performance_info.queue_stale_pops_    << std::endl;
+            trace_file << "       trips within time: " << performance_info.trips_within_time_   << std::endl;
+            trace_file << "        stop relaxations: " << performance_info.stop_relaxations_    << std::endl;
+            trace_file << "       stop states added: " << performance_info.states_added_        << std::endl;
+            trace_file << "     stop states updated: " << performance_info.states_updated_      << std::endl;
+            trace_file << "    stop states rejected: " << performance_info.states_rejected_     << std::endl;
+            trace_file << "      stop states pruned: " << performance_info.states_pruned_       << std::endl;
+            trace_file << "             paths drawn: " << performance_info.paths_drawn_         << std::endl;
+            trace_file << "          distinct paths: " << performance_info.distinct_paths_      << std::endl;
+            trace_file.close();
+            label_file.close();
+            stopids_file.close();
+        }
+    }
+
+    /// Path specifications that one thread finds one after another: order_[begin_] up to order_[end_]
+    typedef struct {
+        size_t  begin_;
+        size_t  end_;
+        double  cost_;              ///< The estimated cost of them all
+    } PathBatchUnit;
+
+    /// A batch of path specifications shared by the threads of PathFinder::findPaths
+    typedef struct {
+        const PathFinder*                       pathfinder_;
+        const std::vector<PathSpecification>*   path_specs_;
+        std::vector<Path>*                      paths_;
+        std::vector<PathInfo>*                  path_infos_;
+        std::vector<PerformanceInfo>*           performance_infos_;
+        const std::vector<size_t>*              order_;         ///< Path specification indices, grouped into units
+        const std::vector<PathBatchUnit>*       units_;
+        std::vector<std::deque<size_t> >*       queues_;        ///< Per thread, unit indices, most expensive first
+        Mutex*                                  mutexes_;       ///< Per thread, guards its queue
+    } PathBatch;
+
+    /// A thread's view of a fasttrips::PathBatch
+    typedef struct {
+        PathBatch*  batch_;
+        size_t      thread_num_;
+    } PathBatchThread;
+
+    /// Takes the most expensive unit from the given thread's queue; returns false if it's empty
+    static bool takePathBatchUnit(PathBatch* pb, size_t thread_num, size_t& unit)
+    {
+        ScopedLock lock(pb->mutexes_[thread_num]);
+        std::deque<size_t>& queue = (*pb->queues_)[thread_num];
+        if (queue.empty()) { return false; }
+        unit = queue.front();
+        queue.pop_front();
+        return true;
+    }
+
+    static void findPathsThread(void* thread)
+    {
+        PathBatchThread* pbt = static_cast<PathBatchThread*>(thread);
+        PathBatch*       pb  = pbt->batch_;
+        size_t num_threads   = pb->queues_->size();
+        while (true) {
+            size_t unit;
+            // my own queue, then steal
+            bool found = takePathBatchUnit(pb, pbt->thread_num_, unit);
+            for (size_t other = 1; !found && (other < num_threads); ++other) {
+                found = takePathBatchUnit(pb, (pbt->thread_num_ + other) % num_threads, unit);
+            }
+            if (!found) { return; }
+            for (size_t pos = (*pb->units_)[unit].begin_; pos < (*pb->units_)[unit].end_; ++pos) {
+                size_t ind = (*pb->order_)[pos];
+                pb->pathfinder_->findPath((*pb->path_specs_)[ind], (*pb->paths_)[ind], (*pb->path_infos_)[ind], (*pb->performance_infos_)[ind]);
+            }
+        }
+    }
+
+    /// Orders units by estimated cost, most expensive first
+    struct PathBatchUnitCompare {
+        const std::vector<PathBatchUnit>* units_;
+
+        bool operator()(size_t unit1, size_t unit2) const {
+            if ((*units_)[unit1].cost_ != (*units_)[unit2].cost_) { return (*units_)[unit1].cost_ > (*units_)[unit2].cost_; }
+            return unit1 < unit2;
+        }
+    };
+
+    /**
+     * Orders path specification indices so that queries touching the same part of the network are
+     * together: by the TAZ the labeling starts from, direction, preferred time bin and user class.
+     */
+    struct PathLocalityCompare {
+        const std::vector<PathSpecification>*   path_specs_;
+        double                                  time_bin_;      ///< minutes
+
+        int anchorTaz(const PathSpecification& ps) const { return ps.outbound_ ? ps.destination_taz_id_ : ps.origin_taz_id_; }
+        int timeBin(const PathSpecification& ps)   const { return static_cast<int>(floor(ps.preferred_time_/time_bin_)); }
+
+        bool sameGroup(size_t ind1, size_t ind2) const {
+            const PathSpecification& ps1 = (*path_specs_)[ind1];
+            const PathSpecification& ps2 = (*path_specs_)[ind2];
+            return (anchorTaz(ps1) == anchorTaz(ps2)) && (ps1.outbound_ == ps2.outbound_) &&
+                   (timeBin(ps1) == timeBin(ps2)) && (ps1.user_class_ == ps2.user_class_);
+        }
+
+        bool operator()(size_t ind1, size_t ind2) const {
+            const PathSpecification& ps1 = (*path_specs_)[ind1];
+            const PathSpecification& ps2 = (*path_specs_)[ind2];
+            if (anchorTaz(ps1)      != anchorTaz(ps2)     ) { return anchorTaz(ps1)      < anchorTaz(ps2);      }
+            if (ps1.outbound_       != ps2.outbound_      ) { return ps1.outbound_       < ps2.outbound_;       }
+            if (timeBin(ps1)        != timeBin(ps2)       ) { return timeBin(ps1)        < timeBin(ps2);        }
+            if (ps1.user_class_     != ps2.user_class_    ) { return ps1.user_class_     < ps2.user_class_;     }
+            if (ps1.preferred_time_ != ps2.preferred_time_) { return ps1.preferred_time_ < ps2.preferred_time_; }
+            return ind1 < ind2;
+        }
+    };
+
+    double PathFinder::estimatePathCost(const PathSpecification& path_spec) const
+    {
+        double cost = 1.0;
+        int taz_ids[2] = { path_spec.origin_taz_id_, path_spec.destination_taz_id_ };
+        for (int taz = 0; taz < 2; ++taz) {
+            TAZSupplyStopToAttr::const_iterator taz_iter = taz_access_links_.find(taz_ids[taz]);
+            if (taz_iter == taz_access_links_.end()) { continue; }
+            for (SupplyStopToAttr::const_iterator supply_iter = taz_iter->second.begin();
+                 supply_iter != taz_iter->second.end(); ++supply_iter) {
+                cost += supply_iter->second.size();
+            }
+        }
+        return cost;
+    }
+
+    void PathFinder::findPaths(const std::vector<PathSpecification>&    path_specs,
+                               const std::vector<double>*               cost_estimates,
+                               bool                                     group_by_locality,
+                               int                                      num_threads,
+                               std::vector<Path>&                       paths,
+                               std::vector<PathInfo>&                   path_infos,
+                               std::vector<PerformanceInfo>&            performance_infos) const
+    {
+        PathInfo        empty_path_info        = { 0, 0, false, 0, 0 };
+        PerformanceInfo empty_performance_info = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+        paths.assign(path_specs.size(), Path());
+        path_infos.assign(path_specs.size(), empty_path_info);
+        performance_infos.assign(path_specs.size(), empty_performance_info);
+
+        std::vector<size_t> order;
+        for (size_t ind = 0; ind < path_specs.size(); ++ind) {
+            if (path_specs[ind].trace_) { findPath(path_specs[ind], paths[ind], path_infos[ind], performance_infos[ind]); }
+            else                        { order.push_back(ind); }
+        }
+        if (order.size() == 0) { return; }
+
+        // the estimates, with the unknown ones from the TAZ links scaled to the known ones
+        std::vector<double> cost(path_specs.size(), -1.0);
+        double known_sum = 0, known_link_sum = 0;
+        if (cost_estimates) {
+            for (size_t ind = 0; ind < order.size(); ++ind) {
+                if ((*cost_estimates)[order[ind]] < 0) { continue; }
+                cost[order[ind]] = (*cost_estimates)[order[ind]];
+                known_sum       += cost[order[ind]];
+                known_link_sum  += estimatePathCost(path_specs[order[ind]]);
+            }
+        }
+        double scale = (known_sum > 0) ? known_sum/known_link_sum : 1.0;
+        for (size_t ind = 0; ind < order.size(); ++ind) {
+            if (cost[order[ind]] < 0) { cost[order[ind]] = scale*estimatePathCost(path_specs[order[ind]]); }
+        }
+
+        if (num_threads < 1) { num_threads = 1; }
+        if (static_cast<size_t>(num_threads) > order.size()) { num_threads = static_cast<int>(order.size()); }
+
+        // Units of work: each path specification on its own, or with locality, the path specifications of a
+        // group in preferred time order -- but small enough that the threads can still balance the load.
+        std::vector<PathBatchUnit> units;
+        PathLocalityCompare locality = { &path_specs, TIME_WINDOW_ > 0 ? TIME_WINDOW_ : 30.0 };
+        if (group_by_locality) { std::sort(order.begin(), order.end(), locality); }
+        size_t max_unit_size = group_by_locality ? std::max(static_cast<size_t>(1), order.size()/(8*num_threads)) : 1;
+        for (size_t pos = 0; pos < order.size(); ++pos) {
+            if ((units.size() == 0) || (pos - units.back().begin_ >= max_unit_size) || !locality.sameGroup(order[pos-1], order[pos])) {
+                PathBatchUnit unit = { pos, pos, 0.0 };
+                units.push_back(unit);
+            }
+            units.back().end_   = pos + 1;
+            units.back().cost_ += cost[order[pos]];
+        }
+        std::vector<size_t> unit_order(units.size());
+        for (size_t unit = 0; unit < units.size(); ++unit) { unit_order[unit] = unit; }
+        PathBatchUnitCompare compare = { &units };
+        std::sort(unit_order.begin(), unit_order.end(), compare);
+
+        // deal them out so each thread starts with a share of the expensive ones
+        std::vector<std::deque<size_t> > queues(num_threads);
+        for (size_t ind = 0; ind < unit_order.size(); ++ind) {
+            queues[ind % num_threads].push_back(unit_order[ind]);
+        }
+        Mutex* mutexes = new Mutex[num_threads];
+        PathBatch batch = { this, &path_specs, &paths, &path_infos, &performance_infos, &order, &units, &queues, mutexes };
+        std::vector<PathBatchThread> threads(num_threads);
+        std::vector<void*>           thread_args(num_threads);
+        for (int thread_num = 0; thread_num < num_threads; ++thread_num) {
+            threads[thread_num].batch_      = &batch;
+            threads[thread_num].thread_num_ = thread_num;
+            thread_args[thread_num]         = &threads[thread_num];
+        }
+        runThreads(findPathsThread, thread_args);
+        delete [] mutexes;
+    }
+
+    /// The origins of PathFinder::findSkims, shared by its threads
+    typedef struct {
+        const PathFinder*                       pathfinder_;
+        const PathSpecification*                skim_spec_;
+        const std::vector<int>*                 origin_taz_ids_;
+        const std::vector<int>*                 destination_taz_ids_;
+        std::vector<SkimInfo>*                  skims_;
+        size_t                                  next_origin_;   ///< The next origin to skim, guarded by mutex_
+        Mutex*                                  mutex_;
+    } SkimBatch;
+
+    void PathFinder::findSkimsThread(void* batch)
+    {
+        SkimBatch* sb = static_cast<SkimBatch*>(batch);
+        size_t num_destinations = sb->destination_taz_ids_->size();
+        while (true) {
+            size_t origin;
+            {
+                ScopedLock lock(*sb->mutex_);
+                if (sb->next_origin_ >= sb->origin_taz_ids_->size()) { return; }
+                origin = sb->next_origin_++;
+            }
+            sb->pathfinder_->findOriginSkims(*sb->skim_spec_, (*sb->origin_taz_ids_)[origin], *sb->destination_taz_ids_,
+                                             &(*sb->skims_)[origin*num_destinations]);
+        }
+    }
+
+    void PathFinder::findSkims(const PathSpecification&     skim_spec,
+                               const std::vector<int>&      origin_taz_ids,
+                               const std::vector<int>&      destination_taz_ids,
+                               int                          num_threads,
+                               std::vector<SkimInfo>&       skims) const
+    {
+        SkimInfo no_path = { PathFinder::MAX_COST, 0, 0, -1 };
+        skims.assign(origin_taz_ids.size()*destination_taz_ids.size(), no_path);
+        if (skims.size() == 0) { return; }
+
+        if (num_threads < 1) { num_threads = 1; }
+        if (static_cast<size_t>(num_threads) > origin_taz_ids.size()) { num_threads = static_cast<int>(origin_taz_ids.size()); }
+
+        Mutex mutex;
+        SkimBatch batch = { this, &skim_spec, &origin_taz_ids, &destination_taz_ids, &skims, 0, &mutex };
+        std::vector<void*> thread_args(num_threads, &batch);
+        runThreads(findSkimsThread, thread_args);
+    }
+
+    void PathFinder::findOriginSkims(const PathSpecification&   skim_spec,
+                                     int                        origin_taz_id,
+                                     const std::vector<int>&    destination_taz_ids,
+                                     SkimInfo*                  skims) const
+    {
+        // label everything from the origin: with no destination yet there's no end TAZ to stop at or direct toward
+        PathSpecification path_spec     = skim_spec;
+        path_spec.hyperpath_            = false;
+        path_spec.outbound_             = false;
+        path_spec.trace_                = false;
+        path_spec.origin_taz_id_        = origin_taz_id;
+        path_spec.destination_taz_id_   = -1;
+
+        std::ofstream        trace_file;
+        StopStates           stop_states;
+        LabelStopQueue       label_stop_queue;
+        HyperpathStopStates  hyperpath_ss;
+        PerformanceInfo      performance_info = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+        if (!initializeStopStates<false, false, false>(path_spec, trace_file, stop_states, label_stop_queue, hyperpath_ss, performance_info)) { return; }
+        int label_iterations = labelStops<false, false, false>(path_spec, trace_file, stop_states, label_stop_queue, hyperpath_ss, performance_info);
+
+        for (size_t dest = 0; dest < destination_taz_ids.size(); ++dest) {
+            path_spec.destination_taz_id_ = destination_taz_ids[dest];
+            if (path_spec.destination_taz_id_ == origin_taz_id) { continue; }
+
+            Path     path;
+            PathInfo path_info = { 0, 0, false, 0, 0 };
+            bool found = finalizeTazState<false, false, false>(path_spec, trace_file, stop_states, label_stop_queue, label_iterations, hyperpath_ss, performance_info) &&
+                         getFoundPath<false, false, false>(path_spec, trace_file, stop_states, hyperpath_ss, path, path_info, performance_info);
+            // the destination's state is only for this path
+            stop_states.erase(path_spec.destination_taz_id_);
+            if (!found) { continue; }
+
+            // as PathFinder::calculatePathCost splits trip link times
+            SkimInfo& skim = skims[dest];
+            skim.cost_      = path_info.cost_;
+            skim.transfers_ = -1;
+            for (size_t path_ind = 0; path_ind < path.size(); ++path_ind) {
+                const StopState& ss = path[path_ind].second;
+                if (!isTrip(ss.deparr_mode_)) { continue; }
+                double trip_ivt_min    = ss.deparr_time_ - ss.arrdep_time_;
+                skim.in_vehicle_time_ += trip_ivt_min;
+                skim.wait_time_       += ss.link_time_ - trip_ivt_min;
+                skim.transfers_       += 1;
+            }
+        }
+    }
+
+    template <bool TRACE, bool HYPERPATH, bool OUTBOUND>
+    void PathFinder::searchPath(const PathSpecification& path_spec,
+                                std::ofstream&           trace_file,
+                                Path&                    path,
+                                PathInfo&                path_info,
+                                PerformanceInfo&         performance_info) const
+    {
         StopStates           stop_states;
         LabelStopQueue       label_stop_queue;
         HyperpathStopStates  hyperpath_ss;
@@ -427,12 +1261,16 @@ namespace fasttrips {
 #endif
 
         // todo: handle failure
-        bool success = initializeStopStates(path_spec, trace_file, stop_states, label_stop_queue, hyperpath_ss);
+        initializeStopStates<TRACE, HYPERPATH, OUTBOUND>(path_spec, trace_file, stop_states, label_stop_queue, hyperpath_ss, performance_info);
 
-        performance_info.label_iterations_ = labelStops(path_spec, trace_file, stop_states, label_stop_queue, hyperpath_ss, performance_info.max_process_count_);
+        performance_info.label_iterations_ = labelStops<TRACE, HYPERPATH, OUTBOUND>(path_spec, trace_file, stop_states, label_stop_queue, hyperpath_ss, performance_info);
 
         std::vector<StopState> taz_state;
-        finalizeTazState(path_spec, trace_file, stop_states, label_stop_queue, performance_info.label_iterations_, hyperpath_ss);
+        finalizeTazState<TRACE, HYPERPATH, OUTBOUND>(path_spec, trace_file, stop_states, label_stop_queue, performance_info.label_iterations_, hyperpath_ss, performance_info);
+
+        performance_info.queue_pushes_      = label_stop_queue.push_count();
+        performance_info.queue_pops_        = label_stop_queue.pop_count();
+        performance_info.queue_stale_pops_  = label_stop_queue.stale_pop_count();
 
 #ifdef _WIN32
         QueryPerformanceCounter(&labeling_end_time);
@@ -440,7 +1278,7 @@ namespace fasttrips {
         gettimeofday(&labeling_end_time, NULL);
 #endif
 
-        getFoundPath(path_spec, trace_file, stop_states, hyperpath_ss, path, path_info);
+        getFoundPath<TRACE, HYPERPATH, OUTBOUND>(path_spec, trace_file, stop_states, hyperpath_ss, path, path_info, performance_info);
 
 #ifdef _WIN32
         QueryPerformanceCounter(&pathfind_end_time);
@@ -451,15 +1289,8 @@ namespace fasttrips {
         // We now have the elapsed number of ticks, along with the
         // number of ticks-per-second. We use these values
         // to convert to the number of elapsed milliseconds.
-        // To guard against loss-of-precision, we convert
-        // to microseconds *before* dividing by ticks-per-second.
-        label_elapsed.QuadPart    *= 1000;
-        label_elapsed.QuadPart    /= frequency.QuadPart;
-        pathfind_elapsed.QuadPart *= 1000;
-        pathfind_elapsed.QuadPart /= frequency.QuadPart;
-
-        performance_info.milliseconds_labeling_    = (long)label_elapsed.QuadPart;
-        performance_info.milliseconds_enumerating_ = (long)pathfind_elapsed.QuadPart;
+        performance_info.milliseconds_labeling_    = 1000.0*label_elapsed.QuadPart/frequency.QuadPart;
+        performance_info.milliseconds_enumerating_ = 1000.0*pathfind_elapsed.QuadPart/frequency.QuadPart;
 #else
         gettimeofday(&pathfind_end_time, NULL);
 
@@ -472,17 +1303,6 @@ namespace fasttrips {
                (labeling_end_time.tv_usec   + 1000000*labeling_end_time.tv_sec);
         performance_info.milliseconds_enumerating_ = 0.001*diff;
 #endif
-
-        if (path_spec.trace_) {
-
-            trace_file << "        label iterations: " << performance_info.label_iterations_    << std::endl;
-            trace_file << "       max process count: " << performance_info.max_process_count_   << std::endl;
-            trace_file << "   milliseconds labeling: " << performance_info.milliseconds_labeling_    << std::endl;
-            trace_file << "milliseconds enumerating: " << performance_info.milliseconds_enumerating_ << std::endl;
-            trace_file.close();
-            label_file.close();
-            stopids_file.close();
-        }
     }
 
     double PathFinder::tallyLinkCost(
@@ -495,7 +1315,7 @@ namespace fasttrips {
         // iterate through the weights
         double cost = 0;
         if (true && path_spec.trace_) {
-            trace_file << "Link cost for " << std::setw(15) << std::setfill(' ') << std::left << mode_num_to_str_.find(supply_mode_num)->second;
+            trace_file << "Link cost for " << std::setw(15) << std::setfill(' ') << std::left << mode_names_.get(supply_mode_num);
             trace_file << std::setw(15) << std::setfill(' ') << std::right << "weight" << " x attribute" <<std::endl;
         }
 
@@ -528,6 +1348,7 @@ namespace fasttrips {
         return cost;
     }
 
+    template <bool TRACE, bool HYPERPATH, bool OUTBOUND>
     void PathFinder::addStopState(
         const PathSpecification& path_spec,
         std::ofstream& trace_file,
@@ -535,7 +1356,8 @@ namespace fasttrips {
         const StopState& ss,
         StopStates& stop_states,
         LabelStopQueue& label_stop_queue,
-        HyperpathStopStates& hyperpath_ss) const
+        HyperpathStopStates& hyperpath_ss,
+        PerformanceInfo&     performance_info) const
     {
         // do we even want to incorporate this link to our stop state?
         bool rejected = false;
@@ -543,8 +1365,9 @@ namespace fasttrips {
         std::string trace_suffix;
 
         // for deterministic, this is simple
-        if (!path_spec.hyperpath_) {
-            LabelStop ls = { ss.cost_, stop_id };
+        if (!HYPERPATH) {
+            // order by cost plus a lower bound on the remaining cost, if we're goal directed
+            LabelStop ls = { ss.cost_ + goalLowerBound(path_spec, stop_id), stop_id };
 
             trace_suffix = " (rejected)";
             rejected     = true;
@@ -558,6 +1381,7 @@ namespace fasttrips {
 
                 trace_suffix = " (new)";
                 rejected     = false;
+                performance_info.states_added_ += 1;
             }
             // if the stop state exists already, check if this cost is lower
             else if (ss.cost_ < stop_states[stop_id][0].cost_) {
@@ -568,6 +1392,10 @@ namespace fasttrips {
 
                 trace_suffix = " (update)";
                 rejected     = false;
+                performance_info.states_updated_ += 1;
+            }
+            else {
+                performance_info.states_rejected_ += 1;
             }
         }
 
@@ -577,13 +1405,14 @@ namespace fasttrips {
             // Just set if it's new
             // However, if it's bigger than MAX_COST, that's problematic 
             if (hyperpath_ss.find(stop_id) == hyperpath_ss.end()) {
-                HyperpathState hss =  { ss.deparr_time_, ss.trip_id_, ss.cost_, 0 };
+                HyperpathState hss =  { ss.deparr_time_, ss.trip_id_, ss.cost_, 0, ss.deparr_time_, ss.cost_, 1.0 };
                 hyperpath_ss[stop_id] = hss;
 
                 stop_states[stop_id].push_back(ss);
                 label_stop_queue.push( ls );
 
                 trace_suffix = " (new)";
+                performance_info.states_added_ += 1;
             }
 
             else
@@ -597,15 +1426,16 @@ namespace fasttrips {
                 HyperpathState& hss = hyperpath_ss[stop_id];
 
                 // is it too early (outbound) or too late (inbound)?
-                if (( path_spec.outbound_ && (ss.deparr_time_ < hss.latest_dep_earliest_arr_ - TIME_WINDOW_)) ||
-                    (!path_spec.outbound_ && (ss.deparr_time_ > hss.latest_dep_earliest_arr_ + TIME_WINDOW_))) {
+                if (( OUTBOUND && (ss.deparr_time_ < hss.latest_dep_earliest_arr_ - TIME_WINDOW_)) ||
+                    (!OUTBOUND && (ss.deparr_time_ > hss.latest_dep_earliest_arr_ + TIME_WINDOW_))) {
                     rejected = true;
                     trace_suffix = " (rejected)";
+                    performance_info.states_rejected_ += 1;
                 }
 
                 // update latest departure time or earliest arrival time window
-                if (( path_spec.outbound_ && (ss.deparr_time_ > hss.latest_dep_earliest_arr_)) ||
-                    (!path_spec.outbound_ && (ss.deparr_time_ < hss.latest_dep_earliest_arr_))) {
+                if (( OUTBOUND && (ss.deparr_time_ > hss.latest_dep_earliest_arr_)) ||
+                    (!OUTBOUND && (ss.deparr_time_ < hss.latest_dep_earliest_arr_))) {
                     hss.latest_dep_earliest_arr_ = ss.deparr_time_;
                     hss.lder_trip_id_            = ss.trip_id_;
                     update_state                 = true;
@@ -615,23 +1445,21 @@ namespace fasttrips {
 
                 // update stop cost if it's affected
                 if (!rejected) {
+                    std::vector<StopState>& stop_state = stop_states[stop_id];
 
-                    // see if it's there already and add it if not, and recalculate hyperpath cost
+                    // see if it's there already and replace it if so, swapping its cost in the running logsum
                     bool stop_state_found = false;
-                    double hyperpath_cost = 0.0;
-                    std::stack<int> prune_indices;
+                    bool logsum_ok        = true;
+                    for (size_t ss_index = 0; ss_index < stop_state.size(); ++ss_index) {
 
-                    for (int ss_index=0; ss_index < stop_states[stop_id].size(); ++ss_index) {
-
-                        // see if it's there already
-                        StopState& ss_check = stop_states[stop_id][ss_index];
+                        StopState& ss_check = stop_state[ss_index];
                         if ((ss_check.deparr_mode_   == ss.deparr_mode_  ) &&
                             (ss_check.trip_id_       == ss.trip_id_      ) &&
                             (ss_check.stop_succpred_ == ss.stop_succpred_) &&
                             (ss_check.seq_succpred_  == ss.seq_succpred_ )) {
                             // log it
                             trace_suffix += " (sub)";
-                            if (false && path_spec.trace_) {
+                            if (false && TRACE) {
                                 trace_file << "Updating stop state:" << std::endl;
                                 trace_file << "        ";
                                 printStopState(trace_file, stop_id, ss_check, path_spec);
@@ -640,46 +1468,58 @@ namespace fasttrips {
                                 printStopState(trace_file, stop_id, ss, path_spec);
                                 trace_file << " (new)" << std::endl;
                             }
+                            logsum_ok = removeHyperpathLogsumCost(hss, ss_check.cost_);
                             // replace it with updated version
-                            stop_states[stop_id][ss_index] = ss;
+                            ss_check = ss;
                             stop_state_found = true;
-                        }
-
-                        // TODO: window-pruning?  prune stop states outside the window??
-                        if (( path_spec.outbound_ && (stop_states[stop_id][ss_index].deparr_time_ < hss.latest_dep_earliest_arr_ - TIME_WINDOW_)) ||
-                            (!path_spec.outbound_ && (stop_states[stop_id][ss_index].deparr_time_ > hss.latest_dep_earliest_arr_ + TIME_WINDOW_))) {
-                            prune_indices.push(ss_index);
-                        }
-                        // otherwise tally the cost
-                        else {
-                            hyperpath_cost += exp(-1.0*STOCH_DISPERSION_*stop_states[stop_id][ss_index].cost_);
+                            break;
                         }
                     }
 
-                    // window-pruning
-                    while (!prune_indices.empty()) {
-                        int prune_index = prune_indices.top();
-
-                        if (path_spec.trace_) {
-                            trace_file << "  + del ";
-                            printStopState(trace_file, stop_id, stop_states[stop_id][prune_index], path_spec);
-                            trace_file << " (prune-window)" << std::endl;
-                        }
-
-                        stop_states[stop_id].erase( stop_states[stop_id].begin() + prune_index );
-                        prune_indices.pop();
-                    }
-
                     if (!stop_state_found) {
                         // add it to stop_states
-                        stop_states[stop_id].push_back(ss);
-                        hyperpath_cost += exp(-1.0*STOCH_DISPERSION_*ss.cost_);
+                        stop_state.push_back(ss);
+                        performance_info.states_added_ += 1;
+                    } else {
+                        performance_info.states_updated_ += 1;
+                    }
+                    if (logsum_ok) {
+                        addHyperpathLogsumCost(hss, ss.cost_);
+                    } else {
+                        resetHyperpathLogsum(hss, stop_state, OUTBOUND);
+                    }
+                    if (( OUTBOUND && (ss.deparr_time_ < hss.earliest_dep_latest_arr_)) ||
+                        (!OUTBOUND && (ss.deparr_time_ > hss.earliest_dep_latest_arr_))) {
+                        hss.earliest_dep_latest_arr_ = ss.deparr_time_;
+                    }
+
+                    // window-pruning: only if some stop state may be outside the window.  Compact in one pass, keeping the order.
+                    if (( OUTBOUND && (hss.earliest_dep_latest_arr_ < hss.latest_dep_earliest_arr_ - TIME_WINDOW_)) ||
+                        (!OUTBOUND && (hss.earliest_dep_latest_arr_ > hss.latest_dep_earliest_arr_ + TIME_WINDOW_))) {
+                        size_t keep_index = 0;
+                        for (size_t ss_index = 0; ss_index < stop_state.size(); ++ss_index) {
+                            if (( OUTBOUND && (stop_state[ss_index].deparr_time_ < hss.latest_dep_earliest_arr_ - TIME_WINDOW_)) ||
+                                (!OUTBOUND && (stop_state[ss_index].deparr_time_ > hss.latest_dep_earliest_arr_ + TIME_WINDOW_))) {
+                                if (TRACE) {
+                                    trace_file << "  + del ";
+                                    printStopState(trace_file, stop_id, stop_state[ss_index], path_spec);
+                                    trace_file << " (prune-window)" << std::endl;
+                                }
+                                continue;
+                            }
+                            if (keep_index != ss_index) { stop_state[keep_index] = stop_state[ss_index]; }
+                            keep_index++;
+                        }
+                        performance_info.states_pruned_ += static_cast<long>(stop_state.size() - keep_index);
+                        stop_state.resize(keep_index);
+                        // pruned states are typically the oldest and cheapest so just recalculate
+                        resetHyperpathLogsum(hss, stop_state, OUTBOUND);
                     }
 
                     // update the hyperpath cost if it's changed
-                    hyperpath_cost = (-1.0/STOCH_DISPERSION_)*log(hyperpath_cost);
-                    if (abs(hyperpath_cost - hss.hyperpath_cost_) > 0.0001) {
-                        if (path_spec.trace_) {
+                    double hyperpath_cost = hyperpathLogsumCost(hss);
+                    if (fabs(hyperpath_cost - hss.hyperpath_cost_) > 0.0001) {
+                        if (TRACE) {
                             std::ostringstream oss;
                             oss << " (hp cost " << std::setprecision(4) << std::fixed << hss.hyperpath_cost_ << "->" << hyperpath_cost << ")";
                             trace_suffix += oss.str();
@@ -698,7 +1538,7 @@ namespace fasttrips {
         }
 
         // the rest is for debugging
-        if (!path_spec.trace_) {
+        if (!TRACE) {
             return;
         }
 
@@ -728,8 +1568,8 @@ namespace fasttrips {
             label_file << ss.iteration_ << ",";
             label_file << link_num      << ",";
 
-            if (o_d == 0) { label_file << stop_num_to_str_.find(stop_id)->second << ","; }
-            else          { label_file << stop_num_to_str_.find(ss.stop_succpred_)->second << ","; }
+            if (o_d == 0) { label_file << stop_names_.get(stop_id) << ","; }
+            else          { label_file << stop_names_.get(ss.stop_succpred_) << ","; }
 
             if (o_d == 0) { label_file << ss.deparr_time_ << ","; }
             else          { label_file << ss.arrdep_time_ << ","; }
@@ -740,29 +1580,73 @@ namespace fasttrips {
 
             // trip id
             if (ss.deparr_mode_ == MODE_TRANSIT) {
-                label_file << trip_num_to_str_.find(ss.trip_id_)->second << ",";
+                label_file << trip_names_.get(ss.trip_id_) << ",";
             } else {
-                label_file << mode_num_to_str_.find(ss.trip_id_)->second << ",";
+                label_file << mode_names_.get(ss.trip_id_) << ",";
             }
             label_file << ss.link_time_ << ",";
             label_file << ss.link_cost_ << ",";
             label_file << std::fixed << ss.cost_ << ",";
-            if      ( path_spec.outbound_ && o_d == 0) { label_file << "A" << std::endl; }
-            else if (!path_spec.outbound_ && o_d == 1) { label_file << "A" << std::endl; }
+            if      ( OUTBOUND && o_d == 0) { label_file << "A" << std::endl; }
+            else if (!OUTBOUND && o_d == 1) { label_file << "A" << std::endl; }
             else                                       { label_file << "B" << std::endl; }
         }
         ++link_num;
     }
 
+    void PathFinder::addHyperpathLogsumCost(HyperpathState& hss, double cost) const
+    {
+        if (cost < hss.logsum_ref_cost_) {
+            // rebase on the new smaller cost so every term stays at most 1
+            hss.logsum_sum_      = hss.logsum_sum_*exp(-1.0*STOCH_DISPERSION_*(hss.logsum_ref_cost_ - cost)) + 1.0;
+            hss.logsum_ref_cost_ = cost;
+        } else {
+            hss.logsum_sum_     += exp(-1.0*STOCH_DISPERSION_*(cost - hss.logsum_ref_cost_));
+        }
+    }
+
+    bool PathFinder::removeHyperpathLogsumCost(HyperpathState& hss, double cost) const
+    {
+        double prev_sum  = hss.logsum_sum_;
+        hss.logsum_sum_ -= exp(-1.0*STOCH_DISPERSION_*(cost - hss.logsum_ref_cost_));
+        // if the removed term was nearly everything, the difference is mostly rounding error
+        return (hss.logsum_sum_ > 1.0e-6*prev_sum);
+    }
+
+    void PathFinder::resetHyperpathLogsum(HyperpathState& hss, const std::vector<StopState>& stop_state, bool outbound) const
+    {
+        hss.logsum_sum_ = 0.0;
+        if (stop_state.size() == 0) { return; }
+
+        LogitBuffer costs, weights;
+        hss.earliest_dep_latest_arr_ = stop_state[0].deparr_time_;
+        for (std::vector<StopState>::const_iterator ssi = stop_state.begin(); ssi != stop_state.end(); ++ssi) {
+            costs.push_back(ssi->cost_);
+            hss.earliest_dep_latest_arr_ = outbound ? std::min(hss.earliest_dep_latest_arr_, ssi->deparr_time_) :
+                                                      std::max(hss.earliest_dep_latest_arr_, ssi->deparr_time_);
+        }
+        // relative to the logsum itself (which is at most the smallest cost), the sum is 1
+        weights.resize(costs.size());
+        hss.logsum_ref_cost_ = logitLogsum(costs.data(), costs.size(), STOCH_DISPERSION_, weights.data());
+        hss.logsum_sum_      = 1.0;
+    }
+
+    double PathFinder::hyperpathLogsumCost(const HyperpathState& hss) const
+    {
+        return hss.logsum_ref_cost_ - log(hss.logsum_sum_)/STOCH_DISPERSION_;
+    }
+
+    template <bool TRACE, bool HYPERPATH, bool OUTBOUND>
     bool PathFinder::initializeStopStates(
         const PathSpecification& path_spec,
         std::ofstream& trace_file,
         StopStates& stop_states,
         LabelStopQueue& label_stop_queue,
-        HyperpathStopStates& hyperpath_ss) const
+        HyperpathStopStates& hyperpath_ss,
+        PerformanceInfo&     performance_info) const
     {
-        int     start_taz_id = path_spec.outbound_ ? path_spec.destination_taz_id_ : path_spec.origin_taz_id_;
-        double  dir_factor   = path_spec.outbound_ ? 1.0 : -1.0;
+        int     start_taz_id = OUTBOUND ? path_spec.destination_taz_id_ : path_spec.origin_taz_id_;
+        double  dir_factor   = OUTBOUND ? 1.0 : -1.0;
 
         // are there any egress/access links for this TAZ?
         TAZSupplyStopToAttr::const_iterator iter_tss2a = taz_access_links_.find(start_taz_id);
@@ -772,19 +1656,19 @@ namespace fasttrips {
 
         // Are there any supply modes for this demand mode?
         UserClassMode ucm = { path_spec.user_class_,
-                              path_spec.outbound_ ? MODE_EGRESS: MODE_ACCESS,
-                              path_spec.outbound_ ? path_spec.egress_mode_ : path_spec.access_mode_
+                              OUTBOUND ? MODE_EGRESS: MODE_ACCESS,
+                              OUTBOUND ? path_spec.egress_mode_ : path_spec.access_mode_
                             };
         WeightLookup::const_iterator iter_weights = weight_lookup_.find(ucm);
         if (iter_weights == weight_lookup_.end()) {
             std::cerr << "Couldn't find any weights configured for user class [" << path_spec.user_class_ << "], ";
-            std::cerr << (path_spec.outbound_ ? "egress mode [" : "access mode [");
-            std::cerr << (path_spec.outbound_ ? path_spec.egress_mode_ : path_spec.access_mode_) << "]" << std::endl;
+            std::cerr << (OUTBOUND ? "egress mode [" : "access mode [");
+            std::cerr << (OUTBOUND ? path_spec.egress_mode_ : path_spec.access_mode_) << "]" << std::endl;
             return false;
         }
 
-        if (path_spec.trace_) {
-            stopids_file << stop_num_to_str_.find(start_taz_id)->second << ",0" << std::endl;
+        if (TRACE) {
+            stopids_file << stop_names_.get(start_taz_id) << ",0" << std::endl;
         }
 
         // Iterate through valid supply modes
@@ -793,15 +1677,15 @@ namespace fasttrips {
              iter_s2w != iter_weights->second.end(); ++iter_s2w) {
             int supply_mode_num = iter_s2w->first;
 
-            if (path_spec.trace_) {
+            if (TRACE) {
                 trace_file << "Weights exist for supply mode " << supply_mode_num << " => ";
-                trace_file << mode_num_to_str_.find(supply_mode_num)->second << std::endl;
+                trace_file << mode_names_.get(supply_mode_num) << std::endl;
             }
 
             // Are there any egress/access links for the supply mode?
             SupplyStopToAttr::const_iterator iter_ss2a = iter_tss2a->second.find(supply_mode_num);
             if (iter_ss2a == iter_tss2a->second.end()) {
-                if (path_spec.trace_) {
+                if (TRACE) {
                     trace_file << "No links for this supply mode" << std::endl;
                 }
                 continue;
@@ -823,7 +1707,7 @@ namespace fasttrips {
                 link_attr["preferred_delay_min"] = 0.0;
 
                 double cost;
-                if (path_spec.hyperpath_) {
+                if (HYPERPATH) {
                     cost = tallyLinkCost(supply_mode_num, path_spec, trace_file, iter_s2w->second, link_attr);
                 } else {
                     cost = attr_time;
@@ -831,7 +1715,7 @@ namespace fasttrips {
 
                 StopState ss = {
                     deparr_time,                                                                // departure/arrival time
-                    path_spec.outbound_ ? MODE_EGRESS : MODE_ACCESS,                            // departure/arrival mode
+                    OUTBOUND ? MODE_EGRESS : MODE_ACCESS,                            // departure/arrival mode
                     supply_mode_num,                                                            // trip id
                     start_taz_id,                                                               // successor/predecessor
                     -1,                                                                         // sequence
@@ -841,7 +1725,7 @@ namespace fasttrips {
                     cost,                                                                       // cost
                     0,                                                                          // iteration
                     path_spec.preferred_time_ };                                                 // arrival/departure time
-                addStopState(path_spec, trace_file, stop_id, ss, stop_states, label_stop_queue, hyperpath_ss);
+                addStopState<TRACE, HYPERPATH, OUTBOUND>(path_spec, trace_file, stop_id, ss, stop_states, label_stop_queue, hyperpath_ss, performance_info);
 
             } // end iteration through links for the given supply mode
         } // end iteration through valid supply modes
@@ -856,6 +1740,7 @@ namespace fasttrips {
      * *label_stop_queue*, this method will iterate through transfers to (for outbound) or
      * from (for inbound) the current stop and update the next stop given the current stop state.
      **/
+    template <bool TRACE, bool HYPERPATH, bool OUTBOUND>
     void PathFinder::updateStopStatesForTransfers(
         const PathSpecification& path_spec,
         std::ofstream& trace_file,
@@ -863,9 +1748,10 @@ namespace fasttrips {
         LabelStopQueue& label_stop_queue,
         HyperpathStopStates& hyperpath_ss,
         int label_iteration,
-        const LabelStop& current_label_stop) const
+        const LabelStop& current_label_stop,
+        PerformanceInfo& performance_info) const
     {
-        double dir_factor = path_spec.outbound_ ? 1.0 : -1.0;
+        double dir_factor = OUTBOUND ? 1.0 : -1.0;
 
         // current_stop_state is a vector
         std::vector<StopState>& current_stop_state = stop_states[current_label_stop.stop_id_];
@@ -877,14 +1763,14 @@ namespace fasttrips {
         if (current_mode == MODE_EGRESS) return;
         if (current_mode == MODE_ACCESS) return;
         // if not hyperpath, transfer not ok
-        if (!path_spec.hyperpath_ && current_mode == MODE_TRANSFER) return;
+        if (!HYPERPATH && current_mode == MODE_TRANSFER) return;
 
 
         double nonwalk_label = 0;
-        if (path_spec.hyperpath_) {
+        if (HYPERPATH) {
             latest_dep_earliest_arr = hyperpath_ss[current_label_stop.stop_id_].latest_dep_earliest_arr_;
             nonwalk_label = calculateNonwalkLabel(current_stop_state);
-            if (path_spec.trace_) { trace_file << "  nonwalk label:    " << nonwalk_label << std::endl; }
+            if (TRACE) { trace_file << "  nonwalk label:    " << nonwalk_label << std::endl; }
 
             // if nonwalk label == MAX_COST then the only way to reach this stop is via transfer so we don't want to transfer again
             if (nonwalk_label == PathFinder::MAX_COST) return;
@@ -892,7 +1778,7 @@ namespace fasttrips {
         // are there relevant transfers?
         StopStopToAttr::const_iterator transfer_map_it;
         bool found_transfers = false;
-        if (path_spec.outbound_) {
+        if (OUTBOUND) {
             // if outbound, going backwards, so transfer TO this current stop
             transfer_map_it = transfer_links_d_o_.find(current_label_stop.stop_id_);
             found_transfers = (transfer_map_it != transfer_links_d_o_.end());
@@ -915,6 +1801,7 @@ namespace fasttrips {
              transfer_it != transfer_map_it->second.end(); ++transfer_it)
         {
             int     xfer_stop_id    = transfer_it->first;
+            performance_info.stop_relaxations_ += 1;
             double  transfer_time   = transfer_it->second.find("time_min")->second;
             // outbound: departure time = latest departure - transfer
             //  inbound: arrival time   = earliest arrival + transfer
@@ -922,7 +1809,7 @@ namespace fasttrips {
             double  link_cost, cost;
 
             // stochastic/hyperpath: cost update
-            if (path_spec.hyperpath_)
+            if (HYPERPATH)
             {
                 Attributes link_attr            = transfer_it->second;
                 link_attr["transfer_penalty"]   = 1.0;
@@ -934,19 +1821,17 @@ namespace fasttrips {
             else
             {
                 link_cost           = transfer_time;
-                cost                = current_label_stop.label_ + link_cost;
+                cost                = current_stop_state[0].cost_ + link_cost;
 
                 // check (departure mode, stop) if someone's waiting already
                 // curious... this only applies to OUTBOUND
                 // TODO: capacity stuff
-                if (path_spec.outbound_)
+                if (OUTBOUND)
                 {
-                    TripStop ts = { current_trip, current_stop_state[0].seq_, current_label_stop.stop_id_ };
-                    std::map<TripStop, double, struct TripStopCompare>::const_iterator bwi = bump_wait_.find(ts);
-                    if (bwi != bump_wait_.end())
+                    double latest_time;
+                    if (getBumpWait(current_trip, current_stop_state[0].seq_, latest_time))
                     {
                         // time a bumped passenger started waiting
-                        double latest_time = bwi->second;
                         // we can't come in time
                         if (deparr_time - TIME_WINDOW_ > latest_time) { continue; }
                         // leave earlier -- to get in line 5 minutes before bump wait time
@@ -971,10 +1856,11 @@ namespace fasttrips {
                 label_iteration,                // label iteration
                 latest_dep_earliest_arr         // arrival/departure time
             };
-            addStopState(path_spec, trace_file, xfer_stop_id, ss, stop_states, label_stop_queue, hyperpath_ss);
+            addStopState<TRACE, HYPERPATH, OUTBOUND>(path_spec, trace_file, xfer_stop_id, ss, stop_states, label_stop_queue, hyperpath_ss, performance_info);
         }
     }
 
+    template <bool TRACE, bool HYPERPATH, bool OUTBOUND>
     void PathFinder::updateStopStatesForTrips(
         const PathSpecification& path_spec,
         std::ofstream& trace_file,
@@ -983,9 +1869,10 @@ namespace fasttrips {
         HyperpathStopStates& hyperpath_ss,
         int label_iteration,
         const LabelStop& current_label_stop,
-        std::tr1::unordered_set<int>& trips_done) const
+        TripsReached& trips_reached,
+        PerformanceInfo&              performance_info) const
     {
-        double dir_factor = path_spec.outbound_ ? 1.0 : -1.0;
+        double dir_factor = OUTBOUND ? 1.0 : -1.0;
 
         // for weight lookup
         UserClassMode ucm = { path_spec.user_class_, MODE_TRANSIT, path_spec.transit_mode_};
@@ -999,18 +1886,19 @@ namespace fasttrips {
         int current_mode = current_stop_state[0].deparr_mode_;      // why index 0 for hyperpath?-- should this be the latest_dep_earliest_arrival mode?
         int current_trip_id = current_stop_state[0].trip_id_;
         double latest_dep_earliest_arr = current_stop_state[0].deparr_time_;
-        if (path_spec.hyperpath_) {
+        if (HYPERPATH) {
             latest_dep_earliest_arr = hyperpath_ss[current_label_stop.stop_id_].latest_dep_earliest_arr_;
         }
 
         // Update by trips
         std::vector<TripStopTime> relevant_trips;
-        getTripsWithinTime(current_label_stop.stop_id_, path_spec.outbound_, latest_dep_earliest_arr, relevant_trips);
+        getTripsWithinTime(current_label_stop.stop_id_, OUTBOUND, latest_dep_earliest_arr, relevant_trips);
+        performance_info.trips_within_time_ += static_cast<long>(relevant_trips.size());
         for (std::vector<TripStopTime>::const_iterator it=relevant_trips.begin(); it != relevant_trips.end(); ++it) {
 
             // don't include the trip that's determining the time boundary -- we don't want to just use that again
             // otherwise it is likely to end up the best one and then we'll end up having no other option but to choose two links in a row from the same trip
-            if (path_spec.hyperpath_ && hyperpath_ss[current_label_stop.stop_id_].lder_trip_id_ == it->trip_id_) { continue; }
+            if (HYPERPATH && hyperpath_ss[current_label_stop.stop_id_].lder_trip_id_ == it->trip_id_) { continue; }
 
             // the trip info for this trip
             const TripInfo& trip_info = trip_info_.find(it->trip_id_)->second;
@@ -1023,28 +1911,25 @@ namespace fasttrips {
             }
             const NamedWeights& named_weights = iter_sm2nw->second;
 
-            if (true && path_spec.trace_) {
-                trace_file << "valid trips: " << trip_num_to_str_.find(it->trip_id_)->second << " " << it->seq_ << " ";
-                printTime(trace_file, path_spec.outbound_ ? it->arrive_time_ : it->depart_time_);
+            if (true && TRACE) {
+                trace_file << "valid trips: " << trip_names_.get(it->trip_id_) << " " << it->seq_ << " ";
+                printTime(trace_file, OUTBOUND ? it->arrive_time_ : it->depart_time_);
                 trace_file << std::endl;
             }
 
-            // trip is already processed
-            // if (trips_done.find(it->trip_id_) != trips_done.end()) continue;
-
             // trip arrival time (outbound) / trip departure time (inbound)
-            double arrdep_time = path_spec.outbound_ ? it->arrive_time_ : it->depart_time_;
+            double arrdep_time = OUTBOUND ? it->arrive_time_ : it->depart_time_;
             double wait_time = (latest_dep_earliest_arr - arrdep_time)*dir_factor;
             double arrive_time;
             if (wait_time < 0) {
                 printf("wait_time < 0 -- this shouldn't happen!\n");
-                if (path_spec.trace_) { trace_file << "wait_time < 0 -- this shouldn't happen!" << std::endl; }
+                if (TRACE) { trace_file << "wait_time < 0 -- this shouldn't happen!" << std::endl; }
             }
 
             // deterministic path-finding: check capacities
-            if (!path_spec.hyperpath_) {
+            if (!HYPERPATH) {
                 TripStop check_for_bump_wait;
-                if (path_spec.outbound_) {
+                if (OUTBOUND) {
                     // if outbound, this trip loop is possible trips *before* the current trip
                     // checking that we get here in time for the current trip
                     check_for_bump_wait.trip_id_ = current_stop_state[0].trip_id_;
@@ -1061,11 +1946,11 @@ namespace fasttrips {
                     // arrive for this trip
                     arrive_time = current_stop_state[0].deparr_time_;
                 }
-                std::map<TripStop, double, struct TripStopCompare>::const_iterator bwi = bump_wait_.find(check_for_bump_wait);
-                if (bwi != bump_wait_.end()) {
+                double bump_wait_time;
+                if (getBumpWait(check_for_bump_wait.trip_id_, check_for_bump_wait.seq_, bump_wait_time)) {
                     // time a bumped passenger started waiting
-                    float latest_time = bwi->second;
-                    if (path_spec.trace_) {
+                    float latest_time = bump_wait_time;
+                    if (TRACE) {
                         trace_file << "checking latest_time ";
                         printTime(trace_file, latest_time);
                         trace_file << " vs arrive_time ";
@@ -1074,44 +1959,59 @@ namespace fasttrips {
                     }
                     if ((arrive_time + 0.01 >= latest_time) &&
                         (current_stop_state[0].trip_id_ != it->trip_id_)) {
-                        if (path_spec.trace_) { trace_file << "Continuing" << std::endl; }
+                        if (TRACE) { trace_file << "Continuing" << std::endl; }
                         continue;
                     }
                 }
             }
 
-            // get the TripStopTimes for this trip
-            std::map<int, std::vector<TripStopTime> >::const_iterator tstiter = trip_stop_times_.find(it->trip_id_);
-            assert(tstiter != trip_stop_times_.end());
-            const std::vector<TripStopTime>& possible_stops = tstiter->second;
-
             // these are the relevant potential trips/stops; iterate through them
-            unsigned int start_seq = path_spec.outbound_ ? 1 : it->seq_+1;
-            unsigned int end_seq   = path_spec.outbound_ ? it->seq_-1 : possible_stops.size();
-            for (unsigned int seq_num = start_seq; seq_num <= end_seq; ++seq_num) {
+            assert(schedule_.hasTrip(it->trip_id_));
+            int start_seq = OUTBOUND ? 1 : it->seq_+1;
+            int end_seq   = OUTBOUND ? it->seq_-1 : schedule_.numStops(it->trip_id_);
+
+            // deterministic: skip the part of the trip already labeled with a key that's no lower.
+            // Past midnight the labels along the trip aren't just key less time, so those trips are always scanned.
+            if (!HYPERPATH && schedule_.inOrder(it->trip_id_)) {
+                double trip_key = current_stop_state[0].cost_ + latest_dep_earliest_arr*dir_factor;
+                TripsReached::iterator reached = trips_reached.find(it->trip_id_);
+                if ((reached != trips_reached.end()) && (trip_key >= reached->second.key_)) {
+                    if (OUTBOUND) { start_seq = std::max(start_seq, reached->second.seq_); }
+                    else          { end_seq   = std::min(end_seq,   reached->second.seq_); }
+                    if (TRACE) {
+                        trace_file << "trip " << trip_names_.get(it->trip_id_) << " already labeled ";
+                        trace_file << (OUTBOUND ? "before" : "after") << " sequence " << reached->second.seq_ << std::endl;
+                    }
+                    if (start_seq > end_seq) { continue; }
+                }
+                TripReached trip_reached = { trip_key, it->seq_ };
+                trips_reached[it->trip_id_] = trip_reached;
+            }
+            for (int seq_num = start_seq; seq_num <= end_seq; ++seq_num) {
                 // possible board for outbound / alight for inbound
-                const TripStopTime& possible_board_alight = possible_stops.at(seq_num-1);
+                int board_alight_stop = schedule_.stopId(it->trip_id_, seq_num);
+                if (board_alight_stop < 0) { continue; }
+                performance_info.stop_relaxations_ += 1;
 
                 // new label = length of trip so far if the passenger boards/alights at this stop
-                int board_alight_stop = possible_board_alight.stop_id_;
                 StopStates::const_iterator possible_stop_state_iter = stop_states.find(board_alight_stop);
 
                 // hyperpath: potential successor/predessor can't be access or egress
-                if (path_spec.hyperpath_) {
+                if (HYPERPATH) {
                     if (possible_stop_state_iter != stop_states.end() && possible_stop_state_iter->second.size()>0) {
                         int possible_mode = possible_stop_state_iter->second.front().deparr_mode_; // first mode; why 0 index?
                         if ((possible_mode == MODE_ACCESS) || (possible_mode == MODE_EGRESS)) { continue; }
                     }
                 }
 
-                double  deparr_time     = path_spec.outbound_ ? possible_board_alight.depart_time_ : possible_board_alight.arrive_time_;
+                double  deparr_time     = OUTBOUND ? schedule_.departTime(it->trip_id_, seq_num) : schedule_.arriveTime(it->trip_id_, seq_num);
                 // the schedule crossed midnight
-                if (path_spec.outbound_ && arrdep_time < deparr_time) {
+                if (OUTBOUND && arrdep_time < deparr_time) {
                     deparr_time -= 24*60;
-                    if (path_spec.trace_) { trace_file << "trip crossed midnight; adjusting deparr_time" << std::endl; }
-                } else if (!path_spec.outbound_ && deparr_time < arrdep_time) {
+                    if (TRACE) { trace_file << "trip crossed midnight; adjusting deparr_time" << std::endl; }
+                } else if (!OUTBOUND && deparr_time < arrdep_time) {
                     deparr_time += 24*60;
-                    if (path_spec.trace_) { trace_file << "trip crossed midnight; adjusting deparr_time" << std::endl; }
+                    if (TRACE) { trace_file << "trip crossed midnight; adjusting deparr_time" << std::endl; }
                 }
                 double  in_vehicle_time = (arrdep_time - deparr_time)*dir_factor;
                 double  cost      = 0;
@@ -1119,11 +2019,11 @@ namespace fasttrips {
 
                 if (in_vehicle_time < 0) {
                     printf("in_vehicle_time < 0 -- this shouldn't happen\n");
-                    if (path_spec.trace_) { trace_file << "in_vehicle_time < 0 -- this shouldn't happen!" << std::endl; }
+                    if (TRACE) { trace_file << "in_vehicle_time < 0 -- this shouldn't happen!" << std::endl; }
                 }
 
                 // stochastic/hyperpath: cost update
-                if (path_spec.hyperpath_) {
+                if (HYPERPATH) {
 
                     // start with trip info attributes
                     Attributes link_attr = trip_info.trip_attr_;
@@ -1134,8 +2034,8 @@ namespace fasttrips {
                     // If outbound, and the current link is egress, then it's as late as possible and the wait time isn't accurate.
                     // It should be a preferred delay time instead
                     // ditto for inbound and access
-                    if (( path_spec.outbound_ && current_mode == MODE_EGRESS) ||
-                        (!path_spec.outbound_ && current_mode == MODE_ACCESS)) {
+                    if (( OUTBOUND && current_mode == MODE_EGRESS) ||
+                        (!OUTBOUND && current_mode == MODE_ACCESS)) {
                         link_attr["wait_time_min"      ] = 0;
 
 
@@ -1144,8 +2044,8 @@ namespace fasttrips {
                         delay_attr["time_min"           ] = 0;
                         delay_attr["preferred_delay_min"] = wait_time;
                         UserClassMode delay_ucm = { path_spec.user_class_,
-                                                    path_spec.outbound_ ? MODE_EGRESS: MODE_ACCESS,
-                                                    path_spec.outbound_ ? path_spec.egress_mode_ : path_spec.access_mode_
+                                                    OUTBOUND ? MODE_EGRESS: MODE_ACCESS,
+                                                    OUTBOUND ? path_spec.egress_mode_ : path_spec.access_mode_
                                                   };
                         WeightLookup::const_iterator delay_iter_weights = weight_lookup_.find(delay_ucm);
                         if (delay_iter_weights != weight_lookup_.end()) {
@@ -1213,9 +2113,9 @@ namespace fasttrips {
                 StopState ss = {
                     deparr_time,                    // departure/arrival time
                     MODE_TRANSIT,                   // departure/arrival mode
-                    possible_board_alight.trip_id_, // trip id
+                    it->trip_id_,                   // trip id
                     current_label_stop.stop_id_,    // successor/predecessor
-                    possible_board_alight.seq_,     // sequence
+                    seq_num,                        // sequence
                     it->seq_,                       // sequence succ/pred
                     in_vehicle_time+wait_time,      // link time
                     link_cost,                      // link cost
@@ -1223,25 +2123,73 @@ namespace fasttrips {
                     label_iteration,                // label iteration
                     arrdep_time                     // arrival/departure time
                 };
-                addStopState(path_spec, trace_file, board_alight_stop, ss, stop_states, label_stop_queue, hyperpath_ss);
+                addStopState<TRACE, HYPERPATH, OUTBOUND>(path_spec, trace_file, board_alight_stop, ss, stop_states, label_stop_queue, hyperpath_ss, performance_info);
+
+            }
+        }
+    }
+
+    bool PathFinder::getEndTazTargets(
+        const PathSpecification& path_spec,
+        std::map<int, double>& target_access_time) const
+    {
+        int end_taz_id = path_spec.outbound_ ? path_spec.origin_taz_id_ : path_spec.destination_taz_id_;
+
+        // are there any egress/access links?
+        TAZSupplyStopToAttr::const_iterator iter_tss2a = taz_access_links_.find(end_taz_id);
+        if (iter_tss2a == taz_access_links_.end()) {
+            return false;
+        }
+
+        // Are there any supply modes for this demand mode?  Same lookup as PathFinder::finalizeTazState
+        UserClassMode ucm = { path_spec.user_class_,
+                              path_spec.outbound_ ? MODE_ACCESS: MODE_EGRESS,
+                              path_spec.outbound_ ? path_spec.access_mode_ : path_spec.egress_mode_
+                            };
+        WeightLookup::const_iterator iter_weights = weight_lookup_.find(ucm);
+        if (iter_weights == weight_lookup_.end()) {
+            return false;
+        }
+
+        for (SupplyModeToNamedWeights::const_iterator iter_s2w  = iter_weights->second.begin();
+                                                      iter_s2w != iter_weights->second.end(); ++iter_s2w) {
+            SupplyStopToAttr::const_iterator iter_ss2a = iter_tss2a->second.find(iter_s2w->first);
+            if (iter_ss2a == iter_tss2a->second.end()) { continue; }
 
+            for (StopToAttr::const_iterator link_iter  = iter_ss2a->second.begin();
+                                            link_iter != iter_ss2a->second.end(); ++link_iter) {
+                double access_time = link_iter->second.find("time_min")->second;
+                std::map<int, double>::iterator tat_iter = target_access_time.find(link_iter->first);
+                if (tat_iter == target_access_time.end()) {
+                    target_access_time[link_iter->first] = access_time;
+                } else {
+                    tat_iter->second = std::min(tat_iter->second, access_time);
+                }
             }
-            trips_done.insert(it->trip_id_);
         }
+        return (target_access_time.size() > 0);
     }
 
+    template <bool TRACE, bool HYPERPATH, bool OUTBOUND>
     int PathFinder::labelStops(const PathSpecification& path_spec,
                                           std::ofstream& trace_file,
                                           StopStates& stop_states,
                                           LabelStopQueue& label_stop_queue,
                                           HyperpathStopStates& hyperpath_ss,
-                                          int& max_process_count) const
+                                          PerformanceInfo& performance_info) const
     {
         int label_iterations = 1;
         std::tr1::unordered_set<int> stop_done;
-        std::tr1::unordered_set<int> trips_done;
-        double dir_factor = path_spec.outbound_ ? 1.0 : -1.0;
-        LabelStop last_label_stop;
+        TripsReached trips_reached;
+        double dir_factor = OUTBOUND ? 1.0 : -1.0;
+        LabelStop last_label_stop = { 0.0, -1 };  // nothing processed yet
+
+        // deterministic only: stops linked to the end TAZ, and the best end TAZ cost found through them
+        std::map<int, double> target_access_time;
+        double best_end_taz_cost = PathFinder::MAX_COST;
+        if (!HYPERPATH) {
+            getEndTazTargets(path_spec, target_access_time);
+        }
 
         while (!label_stop_queue.empty()) {
             /***************************************************************************************
@@ -1256,24 +2204,33 @@ namespace fasttrips {
             *                     from stop *predecessor*
             *                     and the total cost from the origin TAZ to the *stop_id* is *label*
             **************************************************************************************/
-            LabelStop current_label_stop = label_stop_queue.pop_top(stop_num_to_str_, path_spec.trace_, trace_file);
+            LabelStop current_label_stop = label_stop_queue.pop_top(stop_names_, TRACE, trace_file);
 
             // if we just processed this one, then skip since it'll be a no-op
             if (current_label_stop.stop_id_ == last_label_stop.stop_id_) { continue; }
 
+            // deterministic: labels (cost plus any goal lower bound) only grow from here so nothing left can beat the end TAZ cost
+            if (!HYPERPATH && (current_label_stop.label_ > best_end_taz_cost)) {
+                if (TRACE) {
+                    trace_file << "Pulling from label_stop_queue but label " << current_label_stop.label_;
+                    trace_file << " exceeds best end TAZ cost " << best_end_taz_cost << " so done labeling." << std::endl;
+                }
+                break;
+            }
+
             // hyperpath only
-            if (path_spec.hyperpath_) {
+            if (HYPERPATH) {
                 // have we hit the configured limit?
                 if ((STOCH_MAX_STOP_PROCESS_COUNT_ > 0) && (hyperpath_ss[current_label_stop.stop_id_].process_count_ == STOCH_MAX_STOP_PROCESS_COUNT_)) {
-                    if (path_spec.trace_) {
-                        trace_file << "Pulling from label_stop_queue but stop " << stop_num_to_str_.find(current_label_stop.stop_id_)->second;
+                    if (TRACE) {
+                        trace_file << "Pulling from label_stop_queue but stop " << stop_names_.get(current_label_stop.stop_id_);
                         trace_file << " has been processed the limit " << STOCH_MAX_STOP_PROCESS_COUNT_ << " times so skipping." << std::endl;
                     }
                     continue;
                 }
                 // stop is processing
                 hyperpath_ss[current_label_stop.stop_id_].process_count_ += 1;
-                max_process_count = std::max(max_process_count, hyperpath_ss[current_label_stop.stop_id_].process_count_);
+                performance_info.max_process_count_ = std::max(performance_info.max_process_count_, hyperpath_ss[current_label_stop.stop_id_].process_count_);
             }
 
             // no transfers to the stop
@@ -1282,24 +2239,36 @@ namespace fasttrips {
             // current_stop_state is a vector
             std::vector<StopState>& current_stop_state = stop_states[current_label_stop.stop_id_];
 
-            if (path_spec.trace_) {
+            // deterministic: if this is a target stop reached by a trip, it settles a candidate end TAZ cost.
+            // Skip those with a bump wait since PathFinder::finalizeTazState will adjust their cost.
+            if (!HYPERPATH && (current_stop_state.front().deparr_mode_ == MODE_TRANSIT)) {
+                std::map<int, double>::const_iterator tat_iter = target_access_time.find(current_label_stop.stop_id_);
+                if (tat_iter != target_access_time.end()) {
+                    double latest_time;
+                    if (!OUTBOUND || !getBumpWait(current_stop_state[0].trip_id_, current_stop_state[0].seq_, latest_time)) {
+                        best_end_taz_cost = std::min(best_end_taz_cost, current_stop_state.front().cost_ + tat_iter->second);
+                    }
+                }
+            }
+
+            if (TRACE) {
                 trace_file << "Pulling from label_stop_queue (iteration " << std::setw( 6) << std::setfill(' ') << label_iterations;
-                trace_file << ", stop " << stop_num_to_str_.find(current_label_stop.stop_id_)->second;
-                if (path_spec.hyperpath_) {
+                trace_file << ", stop " << stop_names_.get(current_label_stop.stop_id_);
+                if (HYPERPATH) {
                     trace_file << ", count " << hyperpath_ss[current_label_stop.stop_id_].process_count_;
                     trace_file << ", label ";
                     trace_file << std::setprecision(6) << current_label_stop.label_;
                 }
                 trace_file << ", cost ";
-                if (path_spec.hyperpath_) {
+                if (HYPERPATH) {
                     trace_file << std::setprecision(6) << hyperpath_ss[current_label_stop.stop_id_].hyperpath_cost_;
                 }
                 else {
                     printTimeDuration(trace_file, current_stop_state[0].cost_);
                 }
                 trace_file << ", len "  << current_stop_state.size();
-                if (path_spec.hyperpath_) {
-                    trace_file << (path_spec.outbound_ ? ", latest_dep " : ", earliest_arr ");
+                if (HYPERPATH) {
+                    trace_file << (OUTBOUND ? ", latest_dep " : ", earliest_arr ");
                     printTime(trace_file, hyperpath_ss[current_label_stop.stop_id_].latest_dep_earliest_arr_);
                 }
                 trace_file << ") :======" << std::endl;
@@ -1314,25 +2283,27 @@ namespace fasttrips {
                 }
                 trace_file << "==============================" << std::endl;
 
-                stopids_file << stop_num_to_str_.find(current_label_stop.stop_id_)->second << "," << label_iterations << std::endl;
+                stopids_file << stop_names_.get(current_label_stop.stop_id_) << "," << label_iterations << std::endl;
             }
 
-            updateStopStatesForTransfers(path_spec,
+            updateStopStatesForTransfers<TRACE, HYPERPATH, OUTBOUND>(path_spec,
                                          trace_file,
                                          stop_states,
                                          label_stop_queue,
                                          hyperpath_ss,
                                          label_iterations,
-                                         current_label_stop);
+                                         current_label_stop,
+                                         performance_info);
 
-            updateStopStatesForTrips(path_spec,
+            updateStopStatesForTrips<TRACE, HYPERPATH, OUTBOUND>(path_spec,
                                      trace_file,
                                      stop_states,
                                      label_stop_queue,
                                      hyperpath_ss,
                                      label_iterations,
                                      current_label_stop,
-                                     trips_done);
+                                     trips_reached,
+                                     performance_info);
 
             //  Done with this label iteration!
             label_iterations += 1;
@@ -1343,16 +2314,18 @@ namespace fasttrips {
     }
 
 
+    template <bool TRACE, bool HYPERPATH, bool OUTBOUND>
     bool PathFinder::finalizeTazState(
         const PathSpecification& path_spec,
         std::ofstream& trace_file,
         StopStates& stop_states,
         LabelStopQueue& label_stop_queue,
         int label_iteration,
-        HyperpathStopStates& hyperpath_ss) const
+        HyperpathStopStates& hyperpath_ss,
+        PerformanceInfo&     performance_info) const
     {
-        int end_taz_id = path_spec.outbound_ ? path_spec.origin_taz_id_ : path_spec.destination_taz_id_;
-        double dir_factor = path_spec.outbound_ ? 1.0 : -1.0;
+        int end_taz_id = OUTBOUND ? path_spec.origin_taz_id_ : path_spec.destination_taz_id_;
+        double dir_factor = OUTBOUND ? 1.0 : -1.0;
 
         // instantiate this
         std::vector<StopState>& taz_state = stop_states[end_taz_id];
@@ -1365,19 +2338,19 @@ namespace fasttrips {
 
         // Are there any supply modes for this demand mode?
         UserClassMode ucm = { path_spec.user_class_,
-                              path_spec.outbound_ ? MODE_ACCESS: MODE_EGRESS,
-                              path_spec.outbound_ ? path_spec.access_mode_ : path_spec.egress_mode_
+                              OUTBOUND ? MODE_ACCESS: MODE_EGRESS,
+                              OUTBOUND ? path_spec.access_mode_ : path_spec.egress_mode_
                             };
         WeightLookup::const_iterator iter_weights = weight_lookup_.find(ucm);
         if (iter_weights == weight_lookup_.end()) {
             std::cerr << "Couldn't find any weights configured for user class [" << path_spec.user_class_ << "], ";
-            std::cerr << (path_spec.outbound_ ? "egress mode [" : "access mode [");
-            std::cerr << (path_spec.outbound_ ? path_spec.egress_mode_ : path_spec.access_mode_) << "]" << std::endl;
+            std::cerr << (OUTBOUND ? "egress mode [" : "access mode [");
+            std::cerr << (OUTBOUND ? path_spec.egress_mode_ : path_spec.access_mode_) << "]" << std::endl;
             return false;
         }
 
-        if (path_spec.trace_) {
-            stopids_file << stop_num_to_str_.find(end_taz_id)->second << "," << label_iteration << std::endl;
+        if (TRACE) {
+            stopids_file << stop_names_.get(end_taz_id) << "," << label_iteration << std::endl;
         }
 
         // Iterate through valid supply modes
@@ -1386,15 +2359,15 @@ namespace fasttrips {
              iter_s2w != iter_weights->second.end(); ++iter_s2w) {
             int supply_mode_num = iter_s2w->first;
 
-            if (path_spec.trace_) {
+            if (TRACE) {
                 trace_file << "Weights exist for supply mode " << supply_mode_num << " => ";
-                trace_file << mode_num_to_str_.find(supply_mode_num)->second << std::endl;
+                trace_file << mode_names_.get(supply_mode_num) << std::endl;
             }
 
             // Are there any egress/access links for the supply mode?
             SupplyStopToAttr::const_iterator iter_ss2a = iter_tss2a->second.find(supply_mode_num);
             if (iter_ss2a == iter_tss2a->second.end()) {
-                if (path_spec.trace_) {
+                if (TRACE) {
                     trace_file << "No links for this supply mode" << std::endl;
                 }
                 continue;
@@ -1424,12 +2397,12 @@ namespace fasttrips {
                 const std::vector<StopState>& current_stop_state = stop_states_iter->second;
                 earliest_dep_latest_arr = current_stop_state[0].deparr_time_;
 
-                if (path_spec.hyperpath_)
+                if (HYPERPATH)
                 {
                     for (std::vector<StopState>::const_iterator ssi  = current_stop_state.begin();
                                                                 ssi != current_stop_state.end(); ++ssi)
                     {
-                        if (path_spec.outbound_) {
+                        if (OUTBOUND) {
                             earliest_dep_latest_arr = std::min(earliest_dep_latest_arr, ssi->deparr_time_);
                         } else {
                             earliest_dep_latest_arr = std::max(earliest_dep_latest_arr, ssi->deparr_time_);
@@ -1458,13 +2431,12 @@ namespace fasttrips {
                     cost      = current_stop_state.front().cost_ + link_cost;
 
                     // capacity check
-                    if (path_spec.outbound_)
+                    if (OUTBOUND)
                     {
-                        TripStop ts = { current_stop_state[0].deparr_mode_, current_stop_state[0].seq_, stop_id };
-                        std::map<TripStop, double, struct TripStopCompare>::const_iterator bwi = bump_wait_.find(ts);
-                        if (bwi != bump_wait_.end()) {
+                        double bump_wait_time;
+                        if (getBumpWait(current_stop_state[0].trip_id_, current_stop_state[0].seq_, bump_wait_time)) {
                             // time a bumped passenger started waiting
-                            float latest_time = bwi->second;
+                            float latest_time = bump_wait_time;
                             // we can't come in time
                             if (deparr_time - TIME_WINDOW_ > latest_time) { continue; }
                             // leave earlier -- to get in line 5 minutes before bump wait time
@@ -1477,7 +2449,7 @@ namespace fasttrips {
 
                 StopState ts = {
                     deparr_time,                                                                // departure/arrival time
-                    path_spec.outbound_ ? MODE_ACCESS : MODE_EGRESS,                            // departure/arrival mode
+                    OUTBOUND ? MODE_ACCESS : MODE_EGRESS,                            // departure/arrival mode
                     supply_mode_num,                                                            // trip id
                     stop_id,                                                                    // successor/predecessor
                     -1,                                                                         // sequence
@@ -1488,58 +2460,80 @@ namespace fasttrips {
                     label_iteration,                                                            // label iteration
                     earliest_dep_latest_arr                                                     // arrival/departure time
                 };
-                addStopState(path_spec, trace_file, end_taz_id, ts, stop_states, label_stop_queue, hyperpath_ss);
+                addStopState<TRACE, HYPERPATH, OUTBOUND>(path_spec, trace_file, end_taz_id, ts, stop_states, label_stop_queue, hyperpath_ss, performance_info);
 
             } // end iteration through links for the given supply mode
         } // end iteration through valid supply modes
+        return true;
     }
 
 
+    template <bool TRACE, bool HYPERPATH, bool OUTBOUND>
     bool PathFinder::hyperpathGeneratePath(
         const PathSpecification& path_spec,
         std::ofstream& trace_file,
         const StopStates& stop_states,
         const HyperpathStopStates& hyperpath_ss,
+        HyperpathChoiceCache& choice_cache,
+        RandomStream& random_stream,
         Path& path) const
     {
-        int    start_state_id   = path_spec.outbound_ ? path_spec.origin_taz_id_ : path_spec.destination_taz_id_;
-        double dir_factor       = path_spec.outbound_ ? 1 : -1;
+        int    start_state_id   = OUTBOUND ? path_spec.origin_taz_id_ : path_spec.destination_taz_id_;
+        double dir_factor       = OUTBOUND ? 1 : -1;
         
         const std::vector<StopState>& taz_state = stop_states.find(start_state_id)->second;
-        double taz_label        = hyperpath_ss.find(start_state_id)->second.hyperpath_cost_;
-        int    cost_cutoff      = 1;
 
-        // setup access/egress probabilities
-        std::vector<ProbabilityStop> access_cum_prob; // access/egress cumulative probabilities
-        for (size_t state_index = 0; state_index < taz_state.size(); ++state_index)
+        HyperpathChoiceKey access_key = { start_state_id, 0, 0, 0.0 };
+        HyperpathChoiceCache::iterator access_choice_iter = choice_cache.find(access_key);
+        if (access_choice_iter == choice_cache.end())
         {
-            double probability = exp(-1.0*STOCH_DISPERSION_*taz_state[state_index].cost_) /
-                                 exp(-1.0*STOCH_DISPERSION_*taz_label);
-            // why?  :p
-            int prob_i = static_cast<int>(RAND_MAX*probability);
-            // too small to consider
-            if (prob_i < cost_cutoff) { continue; }
-            if (access_cum_prob.size() == 0) {
-                ProbabilityStop pb = { probability, prob_i, taz_state[state_index].stop_succpred_, state_index };
-                access_cum_prob.push_back( pb );
-            } else {
-                ProbabilityStop pb = { probability, access_cum_prob.back().prob_i_ + prob_i, taz_state[state_index].stop_succpred_, state_index };
-                access_cum_prob.push_back( pb );
+            double taz_label        = hyperpath_ss.find(start_state_id)->second.hyperpath_cost_;
+            int    cost_cutoff      = 1;
+
+            // setup access/egress probabilities: exp(-dispersion*cost)/exp(-dispersion*taz_label)
+            LogitBuffer access_costs, access_probs;
+            for (size_t state_index = 0; state_index < taz_state.size(); ++state_index) {
+                access_costs.push_back(taz_state[state_index].cost_);
             }
-            if (path_spec.trace_) {
-                printStopState(trace_file, start_state_id, taz_state[state_index], path_spec);
-                trace_file << " : prob ";
-                trace_file << std::setw(10) << probability << " cum_prob ";
-                trace_file << std::setw( 6) << access_cum_prob.back().prob_i_;
-                trace_file << "; index " << access_cum_prob.back().index_ << std::endl;
+            access_probs.resize(access_costs.size());
+            logitWeights(access_costs.data(), access_costs.size(), STOCH_DISPERSION_, taz_label, access_probs.data());
+
+            access_choice_iter = choice_cache.insert(std::make_pair(access_key, HyperpathChoice())).first;
+            std::vector<ProbabilityStop>& access_cum_prob = access_choice_iter->second.prob_stops_; // access/egress cumulative probabilities
+            for (size_t state_index = 0; state_index < taz_state.size(); ++state_index)
+            {
+                double probability = access_probs[state_index];
+                // why?  :p
+                int prob_i = static_cast<int>(RAND_MAX*probability);
+                // too small to consider
+                if (prob_i < cost_cutoff) { continue; }
+                if (access_cum_prob.size() == 0) {
+                    ProbabilityStop pb = { probability, prob_i, taz_state[state_index].stop_succpred_, state_index };
+                    access_cum_prob.push_back( pb );
+                } else {
+                    ProbabilityStop pb = { probability, access_cum_prob.back().prob_i_ + prob_i, taz_state[state_index].stop_succpred_, state_index };
+                    access_cum_prob.push_back( pb );
+                }
+                if (TRACE) {
+                    printStopState(trace_file, start_state_id, taz_state[state_index], path_spec);
+                    trace_file << " : prob ";
+                    trace_file << std::setw(10) << probability << " cum_prob ";
+                    trace_file << std::setw( 6) << access_cum_prob.back().prob_i_;
+                    trace_file << "; index " << access_cum_prob.back().index_ << std::endl;
+                }
             }
+            buildAliasTable(access_choice_iter->second);
         }
+        else if (TRACE) {
+            trace_file << "Using memoized access/egress probabilities" << std::endl;
+        }
+        if (access_choice_iter->second.prob_stops_.size() == 0) { return false; }
 
-        size_t chosen_index = chooseState(path_spec, trace_file, access_cum_prob);
+        size_t chosen_index = chooseState(path_spec, trace_file, access_choice_iter->second, random_stream);
         StopState ss = taz_state[chosen_index];
         path.push_back( std::make_pair(start_state_id, ss) );
 
-        if (path_spec.trace_)
+        if (TRACE)
         {
             trace_file << " -> Chose access/egress ";
             printStopState(trace_file, start_state_id, ss, path_spec);
@@ -1555,9 +2549,9 @@ namespace fasttrips {
         while (true)
         {
             // setup probabilities
-            if (path_spec.trace_) {
-                trace_file << "current_stop=" << stop_num_to_str_.find(current_stop_id)->second;
-                trace_file << (path_spec.outbound_ ? "; arrival_time=" : "; departure_time=");
+            if (TRACE) {
+                trace_file << "current_stop=" << stop_names_.get(current_stop_id);
+                trace_file << (OUTBOUND ? "; arrival_time=" : "; departure_time=");
                 printTime(trace_file, arrdep_time);
                 trace_file << "; prev_mode=";
                 printMode(trace_file, prev_mode, prev_trip_id);
@@ -1566,79 +2560,92 @@ namespace fasttrips {
                 printStopStateHeader(trace_file, path_spec);
                 trace_file << std::endl;
             }
-            std::vector<ProbabilityStop> stop_cum_prob;
-            double sum_exp = 0;
             StopStates::const_iterator ssi = stop_states.find(current_stop_id);
-            for (size_t stop_state_index = 0; stop_state_index < ssi->second.size(); ++stop_state_index)
+            HyperpathChoiceKey stop_key = { current_stop_id, prev_mode, prev_trip_id, arrdep_time };
+            HyperpathChoiceCache::iterator stop_choice_iter = choice_cache.find(stop_key);
+            if (stop_choice_iter == choice_cache.end())
             {
-                const StopState& state = ssi->second[stop_state_index];
-
-                // no repeat of access/egress
-                if ( path_spec.outbound_ && state.deparr_mode_ == MODE_ACCESS) { continue; }
-                if (!path_spec.outbound_ && state.deparr_mode_ == MODE_EGRESS) { continue; }
-                // no double walk
-                if (path_spec.outbound_ &&
-                    ((state.deparr_mode_ == MODE_EGRESS) || (state.deparr_mode_ == MODE_TRANSFER)) &&
-                    ((         prev_mode == MODE_ACCESS) || (         prev_mode == MODE_TRANSFER))) { continue; }
-                if (!path_spec.outbound_ &&
-                    ((state.deparr_mode_ == MODE_ACCESS) || (state.deparr_mode_ == MODE_TRANSFER)) &&
-                    ((         prev_mode == MODE_EGRESS) || (         prev_mode == MODE_TRANSFER))) { continue; }
-                // don't double on the same trip ID - that's already covered by a single trip
-                if (state.deparr_mode_ == MODE_TRANSIT && state.trip_id_ == prev_trip_id) { continue; }
-
-                // outbound: we cannot depart before we arrive
-                if (path_spec.outbound_ && state.deparr_time_ < arrdep_time) { continue; }
-                // inbound: we cannot arrive after we depart
-                if (!path_spec.outbound_ && state.deparr_time_ > arrdep_time) { continue; }
-
-                // calculating denominator
-                sum_exp += exp(-1.0*STOCH_DISPERSION_*state.cost_);
-                // probabilities will be filled in later - use cost for now
-                ProbabilityStop pb = { state.cost_, 0, state.stop_succpred_, stop_state_index };
-                stop_cum_prob.push_back(pb);
-
-                if (path_spec.trace_) {
-                    trace_file << "            ";
-                    printStopState(trace_file, current_stop_id, state, path_spec);
-                    trace_file << "  sum_exp = " << std::scientific << sum_exp << std::endl;
+                stop_choice_iter = choice_cache.insert(std::make_pair(stop_key, HyperpathChoice())).first;
+                std::vector<ProbabilityStop>& stop_cum_prob = stop_choice_iter->second.prob_stops_;
+                LogitBuffer stop_costs, stop_probs;
+                for (size_t stop_state_index = 0; stop_state_index < ssi->second.size(); ++stop_state_index)
+                {
+                    const StopState& state = ssi->second[stop_state_index];
+
+                    // no repeat of access/egress
+                    if ( OUTBOUND && state.deparr_mode_ == MODE_ACCESS) { continue; }
+                    if (!OUTBOUND && state.deparr_mode_ == MODE_EGRESS) { continue; }
+                    // no double walk
+                    if (OUTBOUND &&
+                        ((state.deparr_mode_ == MODE_EGRESS) || (state.deparr_mode_ == MODE_TRANSFER)) &&
+                        ((         prev_mode == MODE_ACCESS) || (         prev_mode == MODE_TRANSFER))) { continue; }
+                    if (!OUTBOUND &&
+                        ((state.deparr_mode_ == MODE_ACCESS) || (state.deparr_mode_ == MODE_TRANSFER)) &&
+                        ((         prev_mode == MODE_EGRESS) || (         prev_mode == MODE_TRANSFER))) { continue; }
+                    // don't double on the same trip ID - that's already covered by a single trip
+                    if (state.deparr_mode_ == MODE_TRANSIT && state.trip_id_ == prev_trip_id) { continue; }
+
+                    // outbound: we cannot depart before we arrive
+                    if (OUTBOUND && state.deparr_time_ < arrdep_time) { continue; }
+                    // inbound: we cannot arrive after we depart
+                    if (!OUTBOUND && state.deparr_time_ > arrdep_time) { continue; }
+
+                    // probabilities will be filled in later - use cost for now
+                    ProbabilityStop pb = { state.cost_, 0, state.stop_succpred_, stop_state_index };
+                    stop_cum_prob.push_back(pb);
+                    stop_costs.push_back(state.cost_);
+
+                    if (TRACE) {
+                        trace_file << "            ";
+                        printStopState(trace_file, current_stop_id, state, path_spec);
+                        trace_file << std::endl;
+                    }
                 }
-            }
 
-            // dead end
-            if (stop_cum_prob.size() == 0) {
-                return false;
-            }
-            if (sum_exp == 0) {
-                return false;
-            }
+                // dead end
+                if (stop_cum_prob.size() == 0) {
+                    return false;
+                }
 
-            // denom found - cum prob time
-            for (size_t idx = 0; idx < stop_cum_prob.size(); ++idx) {
-                double probability = exp(-1.0*STOCH_DISPERSION_*stop_cum_prob[idx].probability_) / sum_exp;
+                // cum prob time
+                stop_probs.resize(stop_costs.size());
+                logitProbabilities(stop_costs.data(), stop_costs.size(), STOCH_DISPERSION_, stop_probs.data());
+                for (size_t idx = 0; idx < stop_cum_prob.size(); ++idx) {
+                    double probability = stop_probs[idx];
 
-                // why?  :p
-                int prob_i = static_cast<int>(RAND_MAX*probability);
+                    // why?  :p
+                    int prob_i = static_cast<int>(RAND_MAX*probability);
 
-                stop_cum_prob[idx].probability_ = probability;
-                if (idx == 0) {
-                    stop_cum_prob[idx].prob_i_ = prob_i;
-                } else {
-                    stop_cum_prob[idx].prob_i_ = prob_i + stop_cum_prob[idx-1].prob_i_;
-                }
-                if (path_spec.trace_) {
-                    printStopState(trace_file, current_stop_id, ssi->second[stop_cum_prob[idx].index_], path_spec);
-                    trace_file << std::setw( 6) << std::setfill(' ') << std::fixed << stop_cum_prob[idx].stop_id_ << " ";
-                    trace_file << ": prob ";
-                    trace_file << std::setw(10) << probability << " cum_prob ";
-                    trace_file << std::setw( 6) << stop_cum_prob[idx].prob_i_ << std::endl;
+                    stop_cum_prob[idx].probability_ = probability;
+                    if (idx == 0) {
+                        stop_cum_prob[idx].prob_i_ = prob_i;
+                    } else {
+                        stop_cum_prob[idx].prob_i_ = prob_i + stop_cum_prob[idx-1].prob_i_;
+                    }
+                    if (TRACE) {
+                        printStopState(trace_file, current_stop_id, ssi->second[stop_cum_prob[idx].index_], path_spec);
+                        trace_file << std::setw( 6) << std::setfill(' ') << std::fixed << stop_cum_prob[idx].stop_id_ << " ";
+                        trace_file << ": prob ";
+                        trace_file << std::setw(10) << probability << " cum_prob ";
+                        trace_file << std::setw( 6) << stop_cum_prob[idx].prob_i_ << std::endl;
+                    }
                 }
+                buildAliasTable(stop_choice_iter->second);
+            }
+            else if (TRACE) {
+                trace_file << "Using memoized probabilities" << std::endl;
+            }
+
+            // dead end
+            if (stop_choice_iter->second.prob_stops_.size() == 0) {
+                return false;
             }
 
             // choose!
-            size_t chosen_index = chooseState(path_spec, trace_file, stop_cum_prob);
+            size_t chosen_index = chooseState(path_spec, trace_file, stop_choice_iter->second, random_stream);
             StopState next_ss   = ssi->second[chosen_index];
 
-            if (path_spec.trace_) {
+            if (TRACE) {
                 trace_file << " -> Chose stop link ";
                 printStopState(trace_file, current_stop_id, next_ss, path_spec);
                 trace_file << std::endl;
@@ -1649,7 +2656,7 @@ namespace fasttrips {
             // concrete path states.
 
             // OUTBOUND: We are choosing links in chronological order.
-            if (path_spec.outbound_)
+            if (OUTBOUND)
             {
                 // Leave origin as late as possible
                 if (prev_mode == MODE_ACCESS) {
@@ -1732,15 +2739,15 @@ namespace fasttrips {
             // update arrival / departure time
             arrdep_time = next_ss.arrdep_time_;
 
-            if (path_spec.trace_) {
+            if (TRACE) {
                 trace_file << " ->    Updated link ";
                 printStopState(trace_file, path.back().first, path.back().second, path_spec);
                 trace_file << std::endl;
             }
 
             // are we done?
-            if (( path_spec.outbound_ && next_ss.deparr_mode_ == MODE_EGRESS) ||
-                (!path_spec.outbound_ && next_ss.deparr_mode_ == MODE_ACCESS)) {
+            if (( OUTBOUND && next_ss.deparr_mode_ == MODE_EGRESS) ||
+                (!OUTBOUND && next_ss.deparr_mode_ == MODE_ACCESS)) {
                 break;
             }
 
@@ -1748,12 +2755,59 @@ namespace fasttrips {
         return true;
     }
 
+    template <bool TRACE, bool HYPERPATH, bool OUTBOUND>
+    void PathFinder::hyperpathGeneratePaths(HyperpathDraws& draws) const
+    {
+        const PathSpecification& path_spec  = *draws.path_spec_;
+        std::ofstream&           trace_file = *draws.trace_file_;
+
+        // memoized choice probabilities, shared by the draws
+        HyperpathChoiceCache choice_cache;
+        for (int attempts = draws.first_attempt_; attempts <= draws.last_attempt_; attempts += draws.attempt_step_)
+        {
+            RandomStream random_stream(path_spec.path_id_, attempts);
+            Path new_path;
+            bool path_found = hyperpathGeneratePath<TRACE, HYPERPATH, OUTBOUND>(path_spec, trace_file, *draws.stop_states_, *draws.hyperpath_ss_, choice_cache, random_stream, new_path);
+
+            if (path_found) {
+                if (TRACE) {
+                    trace_file << "----> Found path " << attempts << " ";
+                    printPathCompat(trace_file, path_spec, new_path);
+                    trace_file << std::endl;
+                    printPath(trace_file, path_spec, new_path);
+                    trace_file << std::endl;
+                }
+                // do we already have this?  if so, increment
+                PathSet::iterator paths_iter = draws.paths_.find(new_path);
+                if (paths_iter != draws.paths_.end()) {
+                    paths_iter->second.count_ += 1;
+                } else {
+                    PathInfo pi = { 1, 0, false, 0, 0 };  // count is 1
+                    draws.paths_[new_path] = pi;
+                }
+                if (TRACE) { trace_file << "paths size = " << draws.paths_.size() << std::endl; }
+            } else {
+                if (TRACE) {
+                    trace_file << "----> No path found" << std::endl;
+                }
+            }
+        }
+    }
+
+    template <bool TRACE, bool HYPERPATH, bool OUTBOUND>
+    void PathFinder::hyperpathGeneratePathsThread(void* draws)
+    {
+        HyperpathDraws* hd = static_cast<HyperpathDraws*>(draws);
+        hd->pathfinder_->hyperpathGeneratePaths<TRACE, HYPERPATH, OUTBOUND>(*hd);
+    }
+
     Path PathFinder::choosePath(const PathSpecification& path_spec,
         std::ofstream& trace_file,
         PathSet& paths,
-        int max_prob_i) const
+        int max_prob_i,
+        RandomStream& random_stream) const
     {
-        int random_num = rand();
+        int random_num = random_stream.next();
         if (path_spec.trace_) { trace_file << "random_num " << random_num << " -> "; }
 
         // mod it by max prob
@@ -1769,25 +2823,55 @@ namespace fasttrips {
         printf("PathFinder::choosePath() This should never happen!\n");
     }
 
+    void PathFinder::buildAliasTable(HyperpathChoice& choice) const
+    {
+        size_t num_choices = choice.prob_stops_.size();
+        choice.threshold_.assign(num_choices, 0.0);
+        choice.alias_.assign(num_choices, 0);
+        choice.total_ = (num_choices > 0 ? choice.prob_stops_.back().prob_i_ : 0);
+
+        // scaled weights: each column holds total_ worth, so a choice's weight times the number of columns.
+        // These are integers well under 2^53 so the arithmetic is exact.
+        std::vector<double> scaled(num_choices);
+        std::vector<size_t> small, large;
+        for (size_t ind = 0; ind < num_choices; ++ind) {
+            int prob_i  = choice.prob_stops_[ind].prob_i_ - (ind > 0 ? choice.prob_stops_[ind-1].prob_i_ : 0);
+            scaled[ind] = static_cast<double>(prob_i)*num_choices;
+            if (scaled[ind] < choice.total_) { small.push_back(ind); }
+            else                             { large.push_back(ind); }
+        }
+        // pair each under-full column with an over-full choice that tops it up
+        while (!small.empty() && !large.empty()) {
+            size_t small_ind = small.back(); small.pop_back();
+            size_t large_ind = large.back(); large.pop_back();
+            choice.threshold_[small_ind] = scaled[small_ind];
+            choice.alias_    [small_ind] = large_ind;
+            scaled[large_ind] = scaled[large_ind] + scaled[small_ind] - choice.total_;
+            if (scaled[large_ind] < choice.total_) { small.push_back(large_ind); }
+            else                                   { large.push_back(large_ind); }
+        }
+        // the rest are full
+        for (size_t ind = 0; ind < large.size(); ++ind) { choice.threshold_[large[ind]] = choice.total_; choice.alias_[large[ind]] = large[ind]; }
+        for (size_t ind = 0; ind < small.size(); ++ind) { choice.threshold_[small[ind]] = choice.total_; choice.alias_[small[ind]] = small[ind]; }
+    }
+
     size_t PathFinder::chooseState(
         const PathSpecification& path_spec,
         std::ofstream& trace_file,
-        const std::vector<ProbabilityStop>& prob_stops) const
+        const HyperpathChoice& choice,
+        RandomStream& random_stream) const
     {
-        int random_num = rand();
-        if (path_spec.trace_) { trace_file << "random_num " << random_num << " -> "; }
+        // column, then a coin for the column or its alias
+        int random_num  = random_stream.next();
+        int random_coin = random_stream.next();
+        if (path_spec.trace_) { trace_file << "random_num " << random_num << ", " << random_coin << " -> "; }
 
-        // mod it by max prob
-        random_num = random_num % (prob_stops.back().prob_i_);
-        if (path_spec.trace_) { trace_file << random_num << std::endl; }
+        size_t column = random_num % choice.prob_stops_.size();
+        int    coin   = (choice.total_ > 0 ? random_coin % choice.total_ : 0);
+        size_t chosen = (coin < choice.threshold_[column] ? column : choice.alias_[column]);
+        if (path_spec.trace_) { trace_file << column << ", " << coin << " -> " << chosen << std::endl; }
 
-        for (size_t ind = 0; ind < prob_stops.size(); ++ind)
-        {
-            if (prob_stops[ind].prob_i_==0) { continue; }
-            if (random_num <= prob_stops[ind].prob_i_) { return prob_stops[ind].index_; }
-        }
-        // shouldn't get here
-        printf("PathFinder::chooseState() This should never happen!\n");
+        return choice.prob_stops_[chosen].index_;
     }
 
     /**
@@ -1944,57 +3028,64 @@ namespace fasttrips {
     }
 
     // Return success
+    template <bool TRACE, bool HYPERPATH, bool OUTBOUND>
     bool PathFinder::getFoundPath(
         const PathSpecification& path_spec,
         std::ofstream& trace_file,
         const StopStates& stop_states,
         const HyperpathStopStates& hyperpath_ss,
         Path& path,
-        PathInfo& path_info) const
+        PathInfo& path_info,
+        PerformanceInfo& performance_info) const
     {
-        int end_taz_id = path_spec.outbound_ ? path_spec.origin_taz_id_ : path_spec.destination_taz_id_;
+        int end_taz_id = OUTBOUND ? path_spec.origin_taz_id_ : path_spec.destination_taz_id_;
 
         // no taz states -> no path found
         const std::vector<StopState>& taz_state = stop_states.find(end_taz_id)->second;
         if (taz_state.size() == 0) { return false; }
 
-        if (path_spec.hyperpath_)
+        if (HYPERPATH)
         {
             // find a bunch!
             PathSet paths, paths_updated_cost;
-            // random seed
-            srand(path_spec.path_id_);
-            // find a *set of Paths*
-            for (int attempts = 1; attempts <= STOCH_PATHSET_SIZE_; ++attempts)
-            {
-                Path new_path;
-                bool path_found = hyperpathGeneratePath(path_spec, trace_file, stop_states, hyperpath_ss, new_path);
 
-                if (path_found) {
-                    if (path_spec.trace_) {
-                        trace_file << "----> Found path " << attempts << " ";
-                        printPathCompat(trace_file, path_spec, new_path);
-                        trace_file << std::endl;
-                        printPath(trace_file, path_spec, new_path);
-                        trace_file << std::endl;
-                    }
-                    // do we already have this?  if so, increment
-                    PathSet::iterator paths_iter = paths.find(new_path);
-                    if (paths_iter != paths.end()) {
-                        paths_iter->second.count_ += 1;
+            // find a *set of Paths*
+            // split the attempts across threads, but keep tracing in order on this one
+            int num_threads = (TRACE ? 1 : std::max(1, std::min(STOCH_PATHSET_THREADS_, STOCH_PATHSET_SIZE_)));
+            std::vector<HyperpathDraws> draws(num_threads);
+            std::vector<void*>          draw_args(num_threads);
+            for (int thread_num = 0; thread_num < num_threads; ++thread_num) {
+                draws[thread_num].pathfinder_       = this;
+                draws[thread_num].path_spec_        = &path_spec;
+                draws[thread_num].trace_file_       = &trace_file;
+                draws[thread_num].stop_states_      = &stop_states;
+                draws[thread_num].hyperpath_ss_     = &hyperpath_ss;
+                draws[thread_num].first_attempt_    = 1 + thread_num;
+                draws[thread_num].last_attempt_     = STOCH_PATHSET_SIZE_;
+                draws[thread_num].attempt_step_     = num_threads;
+                draw_args[thread_num]               = &draws[thread_num];
+            }
+            runThreads(hyperpathGeneratePathsThread<TRACE, HYPERPATH, OUTBOUND>, draw_args);
+
+            // merge
+            paths.swap(draws[0].paths_);
+            for (int thread_num = 1; thread_num < num_threads; ++thread_num) {
+                for (PathSet::const_iterator paths_iter = draws[thread_num].paths_.begin(); paths_iter != draws[thread_num].paths_.end(); ++paths_iter) {
+                    PathSet::iterator found_iter = paths.find(paths_iter->first);
+                    if (found_iter != paths.end()) {
+                        found_iter->second.count_ += paths_iter->second.count_;
                     } else {
-                        PathInfo pi = { 1, 0, false, 0, 0 };  // count is 1
-                        paths[new_path] = pi;
-                    }
-                    if (path_spec.trace_) { trace_file << "paths size = " << paths.size() << std::endl; }
-                } else {
-                    if (path_spec.trace_) {
-                        trace_file << "----> No path found" << std::endl;
+                        paths[paths_iter->first] = paths_iter->second;
                     }
                 }
             }
+            for (PathSet::const_iterator paths_iter = paths.begin(); paths_iter != paths.end(); ++paths_iter) {
+                performance_info.paths_drawn_ += paths_iter->second.count_;
+            }
+            performance_info.distinct_paths_ = static_cast<long>(paths.size());
+
             // calculate the costs for those paths and the logsum
-            double logsum = 0;
+            LogitBuffer path_costs;
             for (PathSet::iterator paths_iter = paths.begin(); paths_iter != paths.end(); ++paths_iter)
             {
                 // updated cost version
@@ -2005,13 +3096,24 @@ namespace fasttrips {
                 paths_updated_cost[path_updated] = pathinfo_updated;
                 if (pathinfo_updated.cost_ > 0)
                 {
-                    logsum += exp(-1.0*STOCH_DISPERSION_*pathinfo_updated.cost_);
+                    path_costs.push_back(pathinfo_updated.cost_);
                 }
             }
-            if (logsum == 0) { return false; } // fail
+            if (path_costs.size() == 0) { return false; } // fail
+            LogitBuffer path_weights;
+            path_weights.resize(paths_updated_cost.size());
+            double logsum = logitLogsum(path_costs.data(), path_costs.size(), STOCH_DISPERSION_, path_weights.data());
+
+            // probabilities: exp(-dispersion*cost)/exp(-dispersion*logsum)
+            path_costs.resize(0);
+            for (PathSet::iterator paths_iter = paths_updated_cost.begin(); paths_iter != paths_updated_cost.end(); ++paths_iter) {
+                path_costs.push_back(paths_iter->second.cost_);
+            }
+            logitWeights(path_costs.data(), path_costs.size(), STOCH_DISPERSION_, logsum, path_weights.data());
 
             // debug -- print pet set to file
-            std::ofstream pathset_file;
+            // collected here and appended at once so concurrent queries don't interleave
+            std::ostringstream pathset_file;
             std::ostringstream ss;
             ss << output_dir_ << kPathSeparator;
             ss << "ft_pathset";
@@ -2019,16 +3121,15 @@ namespace fasttrips {
                 ss << "_worker" << std::setfill('0') << std::setw(2) <<  process_num_;
             }
             ss << ".txt";
-            // append
-            pathset_file.open(ss.str().c_str(), (std::ios_base::out | std::ios_base::app));
 
             // for integerized probability*1000000
             int cum_prob    = 0;
             int cost_cutoff = 1;
             // calculate the probabilities for those paths
-            for (PathSet::iterator paths_iter = paths_updated_cost.begin(); paths_iter != paths_updated_cost.end(); ++paths_iter)
+            size_t path_index = 0;
+            for (PathSet::iterator paths_iter = paths_updated_cost.begin(); paths_iter != paths_updated_cost.end(); ++paths_iter, ++path_index)
             {
-                paths_iter->second.probability_ = exp(-1.0*STOCH_DISPERSION_*paths_iter->second.cost_)/logsum;
+                paths_iter->second.probability_ = path_weights[path_index];
                 // why?  :p
                 int prob_i = static_cast<int>(RAND_MAX*paths_iter->second.probability_);
                 // too small to consider
@@ -2036,7 +3137,7 @@ namespace fasttrips {
                 cum_prob += prob_i;
                 paths_iter->second.prob_i_ = cum_prob;
 
-                if (path_spec.trace_)
+                if (TRACE)
                 {
                     trace_file << "-> probability " << std::setfill(' ') << std::setw(8) << paths_iter->second.probability_;
                     trace_file << "; prob_i " << std::setw(8) << paths_iter->second.prob_i_;
@@ -2057,19 +3158,26 @@ namespace fasttrips {
                 pathset_file << std::endl;
             }
 
-            pathset_file.close();
+            {
+                ScopedLock pathset_lock(pathset_file_mutex);
+                // append
+                std::ofstream pathset_out(ss.str().c_str(), (std::ios_base::out | std::ios_base::app));
+                pathset_out << pathset_file.str();
+                pathset_out.close();
+            }
 
             if (cum_prob == 0) { return false; } // fail
 
             // choose path
-            path = choosePath(path_spec, trace_file, paths_updated_cost, cum_prob);
+            RandomStream random_stream(path_spec.path_id_, 0);
+            path = choosePath(path_spec, trace_file, paths_updated_cost, cum_prob, random_stream);
             path_info = paths_updated_cost[path];
         }
         else
         {
             // outbound: origin to destination
             // inbound:  destination to origin
-            int final_state_type = path_spec.outbound_ ? MODE_EGRESS : MODE_ACCESS;
+            int final_state_type = OUTBOUND ? MODE_EGRESS : MODE_ACCESS;
 
             StopState ss = taz_state.front(); // there's only one
             path.push_back( std::make_pair(end_taz_id, ss) );
@@ -2084,7 +3192,7 @@ namespace fasttrips {
                 int curr_index = path.size() - 1;
                 int prev_index = curr_index - 1;
 
-                if (path_spec.outbound_)
+                if (OUTBOUND)
                 {
                     // Leave origin as late as possible
                     if (path[prev_index].second.deparr_mode_ == MODE_ACCESS) {
@@ -2144,11 +3252,12 @@ namespace fasttrips {
             }
             calculatePathCost(path_spec, trace_file, path, path_info);
         }
-        if (path_spec.trace_)
+        if (TRACE)
         {
             trace_file << "Final path" << std::endl;
             printPath(trace_file, path_spec, path);
         }
+        return true;
     }
 
     /**
@@ -2157,15 +3266,14 @@ namespace fasttrips {
      */
     double PathFinder::getScheduledDeparture(int trip_id, int stop_id, int sequence) const
     {
-        std::map<int, std::vector<TripStopTime> >::const_iterator tsti = trip_stop_times_.find(trip_id);
-        if (tsti == trip_stop_times_.end()) { return -1; }
+        if (!schedule_.hasTrip(trip_id)) { return -1; }
 
-        for (size_t stt_index = 0; stt_index < tsti->second.size(); ++stt_index)
+        for (int seq = 1; seq <= schedule_.numStops(trip_id); ++seq)
         {
-            if (tsti->second[stt_index].stop_id_ != stop_id) { continue; }
+            if (schedule_.stopId(trip_id, seq) != stop_id) { continue; }
             // trip id matches and stop id matches -- does sequence match or is it unspecified?
-            if ((sequence < 0) || (sequence == tsti->second[stt_index].seq_)) {
-                return tsti->second[stt_index].depart_time_;
+            if ((sequence < 0) || (sequence == seq)) {
+                return schedule_.departTime(trip_id, seq);
             }
         }
         return -1;
@@ -2177,24 +3285,26 @@ namespace fasttrips {
      */
     void PathFinder::getTripsWithinTime(int stop_id, bool outbound, double timepoint, std::vector<TripStopTime>& return_trips) const
     {
-        // are there any trips for this stop?
-        std::map<int, std::vector<TripStopTime> >::const_iterator mapiter = stop_trip_times_.find(stop_id);
-        if (mapiter == stop_trip_times_.end()) {
-            return;
-        }
-        for (std::vector<TripStopTime>::const_iterator it  = mapiter->second.begin();
-                                                       it != mapiter->second.end();   ++it) {
-            if (outbound && (it->arrive_time_ <= timepoint) && (it->arrive_time_ > timepoint-TIME_WINDOW_)) {
-                return_trips.push_back(*it);
-            } else if (!outbound && (it->depart_time_ >= timepoint) && (it->depart_time_ < timepoint+TIME_WINDOW_)) {
-                return_trips.push_back(*it);
+        for (int visit_index = schedule_.firstVisit(stop_id); visit_index < schedule_.endVisit(stop_id); ++visit_index) {
+            const StopVisit& visit = schedule_.visit(visit_index);
+            double time = outbound ? schedule_.arriveTime(visit.trip_id_, visit.seq_) : schedule_.departTime(visit.trip_id_, visit.seq_);
+            if (outbound ? ((time <= timepoint) && (time > timepoint-TIME_WINDOW_)) :
+                           ((time >= timepoint) && (time < timepoint+TIME_WINDOW_))) {
+                TripStopTime stt = {
+                    visit.trip_id_,
+                    visit.seq_,
+                    stop_id,
+                    schedule_.arriveTime(visit.trip_id_, visit.seq_),
+                    schedule_.departTime(visit.trip_id_, visit.seq_)
+                };
+                return_trips.push_back(stt);
             }
         }
     }
 
     double PathFinder::calculateNonwalkLabel(const std::vector<StopState>& current_stop_state) const
     {
-        double nonwalk_label = 0.0;
+        LogitBuffer nonwalk_costs;
         for (std::vector<StopState>::const_iterator it = current_stop_state.begin();
              it != current_stop_state.end(); ++it)
         {
@@ -2202,14 +3312,16 @@ namespace fasttrips {
                 (it->deparr_mode_ != MODE_TRANSFER) &&
                 (it->deparr_mode_ != MODE_ACCESS  ))
             {
-                nonwalk_label += exp(-1.0*STOCH_DISPERSION_*it->cost_);
+                nonwalk_costs.push_back(it->cost_);
             }
         }
 
-        if (nonwalk_label == 0.0) {
+        if (nonwalk_costs.size() == 0) {
             return PathFinder::MAX_COST;
         }
-        return -1.0/STOCH_DISPERSION_*log(nonwalk_label);
+        LogitBuffer weights;
+        weights.resize(nonwalk_costs.size());
+        return logitLogsum(nonwalk_costs.data(), nonwalk_costs.size(), STOCH_DISPERSION_, weights.data());
     }
 
     void PathFinder::printPath(std::ostream& ostr, const PathSpecification& path_spec, const Path& path) const
@@ -2245,9 +3357,9 @@ namespace fasttrips {
             if ( board_stops.length() > 0) {  board_stops += ","; }
             if (       trips.length() > 0) {        trips += ","; }
             if (alight_stops.length() > 0) { alight_stops += ","; }
-            board_stops  += (path_spec.outbound_ ? stop_num_to_str_.find(stop_id)->second : stop_num_to_str_.find(path[index].second.stop_succpred_)->second);
-            trips        += trip_num_to_str_.find(path[index].second.trip_id_)->second;
-            alight_stops += (path_spec.outbound_ ? stop_num_to_str_.find(path[index].second.stop_succpred_)->second : stop_num_to_str_.find(stop_id)->second);
+            board_stops  += (path_spec.outbound_ ? stop_names_.get(stop_id) : stop_names_.get(path[index].second.stop_succpred_));
+            trips        += trip_names_.get(path[index].second.trip_id_);
+            alight_stops += (path_spec.outbound_ ? stop_names_.get(path[index].second.stop_succpred_) : stop_names_.get(stop_id));
         }
         ostr << " " << board_stops << " " << trips << " " << alight_stops;
     }
@@ -2271,20 +3383,20 @@ namespace fasttrips {
 
     void PathFinder::printStopState(std::ostream& ostr, int stop_id, const StopState& ss, const PathSpecification& path_spec) const
     {
-        ostr << std::setw( 8) << std::setfill(' ') << std::right << stop_num_to_str_.find(stop_id)->second << ":   ";
+        ostr << std::setw( 8) << std::setfill(' ') << std::right << stop_names_.get(stop_id) << ":   ";
         printTime(ostr, ss.deparr_time_);
         ostr << "  ";
         printMode(ostr, ss.deparr_mode_, ss.trip_id_);
         ostr << "  ";
         if (ss.deparr_mode_ == MODE_TRANSIT) {
-            ostr << std::setw(20) << std::setfill(' ') << trip_num_to_str_.find(ss.trip_id_)->second;
+            ostr << std::setw(20) << std::setfill(' ') << trip_names_.get(ss.trip_id_);
         } else if (ss.deparr_mode_ == MODE_ACCESS || ss.deparr_mode_ == MODE_EGRESS) {
-            ostr << std::setw(20) << std::setfill(' ') << mode_num_to_str_.find(ss.trip_id_)->second;
+            ostr << std::setw(20) << std::setfill(' ') << mode_names_.get(ss.trip_id_);
         } else {
             ostr << std::setw(20) << std::setfill(' ') << ss.trip_id_;
         }
         ostr << "  ";
-        ostr << std::setw(10) << std::setfill(' ') << stop_num_to_str_.find(ss.stop_succpred_)->second;
+        ostr << std::setw(10) << std::setfill(' ') << stop_names_.get(ss.stop_succpred_);
         ostr << "  ";
         ostr << std::setw(3) << std::setfill(' ') << ss.seq_;
         ostr << "  ";
@@ -2356,7 +3468,7 @@ namespace fasttrips {
         } else if (mode == MODE_TRANSIT) {
             // show the supply mode
             int supply_mode_num = trip_info_.find(trip_id)->second.supply_mode_num_;
-            ostr << std::setw(10) << std::setfill(' ') << mode_num_to_str_.find(supply_mode_num)->second;
+            ostr << std::setw(10) << std::setfill(' ') << mode_names_.get(supply_mode_num);
         } else {
             // trip
             ostr << std::setw(10) << std::setfill(' ') << "???";
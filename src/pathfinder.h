@@ -11,14 +11,20 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include "StringPool.h"
+#include "Schedule.h"
 #include "LabelStopQueue.h"
+#include "RandomStream.h"
 
 #if __APPLE__
 #include <tr1/unordered_set>
+#include <tr1/unordered_map>
 #elif __linux__
 #include <tr1/unordered_set>
+#include <tr1/unordered_map>
 #else
 #include <unordered_set>
+#include <unordered_map>
 #endif
 
 #if _WIN32
@@ -35,6 +41,13 @@ namespace fasttrips {
         MODE_TRANSIT  = -103,
     };
 
+    /// Lower bounds used to direct deterministic labeling toward the end TAZ.  See PathFinder::goalLowerBound
+    enum GoalDirectionType {
+        GOAL_DIRECTION_NONE      = 0,   ///< no goal direction; queue by cost alone
+        GOAL_DIRECTION_TAZ       = 1,   ///< exact relaxed-network times to/from every TAZ
+        GOAL_DIRECTION_LANDMARKS = 2,   ///< times to/from a few landmark stops (ALT); memory bounded
+    };
+
     /// Weight lookup
     typedef struct {
         std::string     user_class_;
@@ -107,14 +120,6 @@ namespace fasttrips {
         int     stop_id_;
     } TripStop;
 
-    /// Comparator for the PathFinder::bump_wait_ std::map
-    struct TripStopCompare {
-        bool operator()(const TripStop &ts1, const TripStop &ts2) const {
-            return ((ts1.trip_id_ < ts2.trip_id_) ||
-                    ((ts1.trip_id_ == ts2.trip_id_) && (ts1.seq_ < ts2.seq_)));
-        }
-    };
-
     /**
      * The definition of the path we're trying to find.
      */
@@ -168,6 +173,21 @@ namespace fasttrips {
         double  arrdep_time_;           ///< Arrival time for outbound, departure time for inbound
     } StopState;
 
+    /**
+     * For deterministic path finding, how much of a trip PathFinder::updateStopStatesForTrips has already
+     * labeled.  Along a trip, the label at each stop is the trip's key less the vehicle time there (times -1
+     * for inbound), so once the stops up to (outbound) or after (inbound) seq_ have been labeled with a key,
+     * labeling them again with a key that's no lower can't improve anything; as with the reached index of
+     * Trip-Based routing, only the rest of the trip is scanned.
+     */
+    typedef struct {
+        double  key_;                   ///< Label at the stop plus its latest departure (outbound) or less its earliest arrival (inbound)
+        int     seq_;                   ///< Where the trip was reached; stops before it (outbound) or after it (inbound) are labeled
+    } TripReached;
+
+    /// Trip ID -> fasttrips::TripReached, for one query
+    typedef std::tr1::unordered_map<int, TripReached> TripsReached;
+
 
     /// Structure used in PathFinder::hyperpathChoosePath
     typedef struct {
@@ -177,6 +197,43 @@ namespace fasttrips {
         size_t  index_;                 ///< Index into StopState vector (or taz state vector)
     } ProbabilityStop;
 
+    /**
+     * The choice of the next link at a stop in PathFinder::hyperpathGeneratePath, as an alias table (Vose's method)
+     * so that a draw takes constant time.  The choices only depend on the stop, the previous mode and trip,
+     * and the arrival (outbound) or departure (inbound) time, so they're memoized for the path enumeration
+     * of a query in a fasttrips::HyperpathChoiceCache.
+     */
+    typedef struct {
+        std::vector<ProbabilityStop> prob_stops_;   ///< The choices, with cumulative integerized probabilities
+        std::vector<double>          threshold_;    ///< Per column: keep the column's choice if the coin draw is below this (out of total_)
+        std::vector<size_t>          alias_;        ///< Per column: otherwise take this choice
+        int                          total_;        ///< Sum of the integerized probabilities
+    } HyperpathChoice;
+
+    /// Key for a memoized fasttrips::HyperpathChoice.  The access/egress choice uses the start TAZ with zeros for the rest.
+    typedef struct {
+        int     stop_id_;               ///< Current stop ID
+        int     prev_mode_;             ///< Mode of the previously chosen link
+        int     prev_trip_id_;          ///< Trip of the previously chosen link
+        double  arrdep_time_;           ///< Arrival time for outbound, departure time for inbound
+    } HyperpathChoiceKey;
+
+    /// Comparator for the fasttrips::HyperpathChoiceCache
+    struct HyperpathChoiceKeyCompare {
+        bool operator()(const HyperpathChoiceKey &key1, const HyperpathChoiceKey &key2) const {
+            if (key1.stop_id_      < key2.stop_id_     ) { return true;  }
+            if (key1.stop_id_      > key2.stop_id_     ) { return false; }
+            if (key1.prev_mode_    < key2.prev_mode_   ) { return true;  }
+            if (key1.prev_mode_    > key2.prev_mode_   ) { return false; }
+            if (key1.prev_trip_id_ < key2.prev_trip_id_) { return true;  }
+            if (key1.prev_trip_id_ > key2.prev_trip_id_) { return false; }
+            return (key1.arrdep_time_ < key2.arrdep_time_);
+        }
+    };
+
+    /// Memoized hyperpath choices for one query.
+    typedef std::map<HyperpathChoiceKey, HyperpathChoice, struct HyperpathChoiceKeyCompare> HyperpathChoiceCache;
+
     /**
      * The path finding algorithm stores StopState data in this structure.
      * For the stochastic algorithm, a stop ID maps to a vector of StopState instances.
@@ -192,6 +249,9 @@ namespace fasttrips {
       int    lder_trip_id_;            ///< trip for the latest departure/earliest arrival
       double hyperpath_cost_;          ///< hyperpath cost for this stop state
       int    process_count_;           ///< increment this every time the stop is processed
+      double earliest_dep_latest_arr_; ///< bound on the earliest departure (outbound) / latest arrival (inbound) of the stop states, for window pruning
+      double logsum_ref_cost_;         ///< reference cost subtracted in logsum_sum_ so exp() stays in range; at most the smallest cost summed
+      double logsum_sum_;              ///< running sum over the stop states of exp(-dispersion*(cost - logsum_ref_cost_))
     } HyperpathState;
 
     /**
@@ -223,10 +283,29 @@ namespace fasttrips {
     typedef struct {
         int     label_iterations_;              ///< Number of label iterations performed
         int     max_process_count_;             ///< Maximum number of times a stop was processed
-        long    milliseconds_labeling_;         ///< Number of seconds spent in labeling
-        long    milliseconds_enumerating_;      ///< Number of seconds spent in enumerating
+        double  milliseconds_labeling_;         ///< Number of milliseconds spent in labeling
+        double  milliseconds_enumerating_;      ///< Number of milliseconds spent in enumerating
+        long    queue_pushes_;                  ///< Number of labels pushed onto the fasttrips::LabelStopQueue
+        long    queue_pops_;                    ///< Number of labels popped from the fasttrips::LabelStopQueue
+        long    queue_stale_pops_;              ///< Number of superseded labels skipped in the fasttrips::LabelStopQueue
+        long    trips_within_time_;             ///< Number of trips returned by PathFinder::getTripsWithinTime
+        long    stop_relaxations_;              ///< Number of transfer links and trip stops considered from a labeled stop
+        long    states_added_;                  ///< Number of stop states added by PathFinder::addStopState
+        long    states_updated_;                ///< Number of stop states replaced by PathFinder::addStopState
+        long    states_rejected_;               ///< Number of stop states rejected by PathFinder::addStopState
+        long    states_pruned_;                 ///< Number of hyperpath stop states pruned for falling outside the time window
+        long    paths_drawn_;                   ///< Number of paths generated (for stochastic)
+        long    distinct_paths_;                ///< Number of distinct paths generated (for stochastic)
     } PerformanceInfo;
 
+    /** Skims for one origin and destination TAZ, from PathFinder::findSkims. */
+    typedef struct {
+        double  cost_;                          ///< Cost of the deterministic path, as for fasttrips::PathInfo
+        double  in_vehicle_time_;               ///< Minutes on transit vehicles
+        double  wait_time_;                     ///< Minutes waiting for transit vehicles, after the first boarding
+        int     transfers_;                     ///< Number of transfers, or -1 if there's no path
+    } SkimInfo;
+
     /// Comparator to for Path instances so we can put them in a map as keys.
     /// TODO: doc more?
     struct PathCompare {
@@ -251,6 +330,24 @@ namespace fasttrips {
      */
     typedef std::map<Path, PathInfo, struct fasttrips::PathCompare> PathSet;
 
+    class PathFinder;
+
+    /**
+     * A share of the stochastic path enumeration for one query, for PathFinder::hyperpathGeneratePathsThread.
+     * The attempts first_attempt_, first_attempt_ + attempt_step_, ... up to last_attempt_ are drawn into paths_.
+     */
+    typedef struct {
+        const PathFinder*           pathfinder_;
+        const PathSpecification*    path_spec_;
+        std::ofstream*              trace_file_;
+        const StopStates*           stop_states_;
+        const HyperpathStopStates*  hyperpath_ss_;
+        int                         first_attempt_;
+        int                         last_attempt_;
+        int                         attempt_step_;
+        PathSet                     paths_;
+    } HyperpathDraws;
+
     /**
     * This is the class that does all the work.  Setup the network supply first.
     */
@@ -271,8 +368,23 @@ namespace fasttrips {
         /// See <a href="_generated/fasttrips.Assignment.html#fasttrips.Assignment.STOCH_DISPERSION">fasttrips.Assignment.STOCH_DISPERSION</a>
         double STOCH_DISPERSION_;
 
+        /// See <a href="_generated/fasttrips.Assignment.html#fasttrips.Assignment.STOCH_PATHSET_THREADS">fasttrips.Assignment.STOCH_PATHSET_THREADS</a>
+        int STOCH_PATHSET_THREADS_;
+
         /// See <a href="_generated/fasttrips.Assignment.html#fasttrips.Assignment.STOCH_MAX_STOP_PROCESS_COUNT">fasttrips.Assignment.STOCH_MAX_STOP_PROCESS_COUNT</a>
         int STOCH_MAX_STOP_PROCESS_COUNT_;
+
+        /// See <a href="_generated/fasttrips.Assignment.html#fasttrips.Assignment.GOAL_DIRECTION">fasttrips.Assignment.GOAL_DIRECTION</a>
+        GoalDirectionType GOAL_DIRECTION_;
+
+        /// See <a href="_generated/fasttrips.Assignment.html#fasttrips.Assignment.GOAL_DIRECTION_LANDMARKS">fasttrips.Assignment.GOAL_DIRECTION_LANDMARKS</a>
+        int GOAL_DIRECTION_LANDMARKS_;
+
+        /// See <a href="_generated/fasttrips.Assignment.html#fasttrips.Assignment.CAPTURE_PATH_SPECIFICATIONS">fasttrips.Assignment.CAPTURE_PATH_SPECIFICATIONS</a>
+        bool CAPTURE_PATH_SPECS_;
+
+        /// See <a href="_generated/fasttrips.Assignment.html#fasttrips.Assignment.COMPACT_SCHEDULE">fasttrips.Assignment.COMPACT_SCHEDULE</a>
+        bool COMPACT_SCHEDULE_;
         ///@}
 
         /// directory in which to write trace files
@@ -293,16 +405,20 @@ namespace fasttrips {
         StopStopToAttr transfer_links_d_o_;
         /// Trip information: trip id -> Trip Info
         std::map<int, TripInfo> trip_info_;
-        /// Trip information: trip id -> vector of [trip id, sequence, stop id, arrival time, departure time]
-        std::map<int, std::vector<TripStopTime> > trip_stop_times_;
-        /// Stop information: stop id -> vector of [trip id, sequence, stop id, arrival time, departure time]
-        std::map<int, std::vector<TripStopTime> > stop_trip_times_;
+        /// Transit vehicle schedules, by trip and by stop
+        Schedule schedule_;
 
         // ================ ID numbers to ID strings ===============
-        std::map<int, std::string> trip_num_to_str_;
-        std::map<int, std::string> stop_num_to_str_;
-        std::map<int, std::string> route_num_to_str_;
-        std::map<int, std::string> mode_num_to_str_; // supply modes
+        /**
+         * These are only for tracing and the pathset file, so the trip, stop and route names aren't
+         * read until PathFinder::loadNames is called for a path that needs them.
+         */
+        mutable StringPool trip_names_;
+        mutable StringPool stop_names_;
+        mutable StringPool route_names_;
+        mutable StringPool mode_names_; // supply modes
+        /// Have the names been read by PathFinder::loadNames
+        mutable volatile bool names_loaded_;
         int transfer_supply_mode_;
 
         /**
@@ -310,25 +426,117 @@ namespace fasttrips {
          * board a vehicle, this is the time the bumped passengers arrive at a stop and wait for a
          * vehicle they cannot board.
          *
-         * This structure maps the fasttrips::TripStop to the arrival time of the first waiting
-         * would-be passenger.
+         * This is the arrival time of the first waiting would-be passenger for each stop time (see
+         * PathFinder::stopTimeIndex), if PathFinder::has_bump_wait_ is set for it.
+         */
+        std::vector<double> bump_wait_;
+        /// Per stop time, is there a PathFinder::bump_wait_ time
+        std::vector<bool> has_bump_wait_;
+        /// Number of stop times with a bump wait, so the usual uncongested case skips the lookup
+        int num_bump_waits_;
+
+        /// @return the dense stop time index for the trip and sequence (see fasttrips::Schedule), or -1 if there isn't one
+        int stopTimeIndex(int trip_id, int seq) const { return schedule_.stopTimeIndex(trip_id, seq); }
+
+        /**
+         * Looks up the bump wait for a trip at a stop.
+         *
+         * @param latest_time   Set to the time the first bumped passenger started waiting, if there is one
+         * @return true if passengers were bumped from the trip at the stop sequence
+         */
+        bool getBumpWait(int trip_id, int seq, double& latest_time) const {
+            if (num_bump_waits_ == 0) { return false; }
+            int st = stopTimeIndex(trip_id, seq);
+            if ((st < 0) || !has_bump_wait_[st]) { return false; }
+            latest_time = bump_wait_[st];
+            return true;
+        }
+
+        // ================ Goal direction lower bounds ================
+        /// Stop or TAZ id -> node index (column) in the lower bound tables
+        std::tr1::unordered_map<int, int> goal_node_index_;
+        /// For GOAL_DIRECTION_TAZ, TAZ id -> row in the lower bound tables
+        std::tr1::unordered_map<int, int> goal_taz_row_;
+        /// Number of nodes (columns) in the lower bound tables
+        int goal_num_nodes_;
+        /**
+         * Row-major lower bound tables of minimum times over the relaxed network (see
+         * PathFinder::initializeGoalBounds).  Each row is a TAZ for GOAL_DIRECTION_TAZ or a landmark
+         * for GOAL_DIRECTION_LANDMARKS; goal_bound_from_ holds times from the row to each node
+         * and goal_bound_to_ holds times from each node to the row.
          */
-        std::map<TripStop, double, struct TripStopCompare> bump_wait_;
+        std::vector<float> goal_bound_from_;
+        std::vector<float> goal_bound_to_;
+
+        /// PathFinder::supplyChecksum of what the supply was built from, for PathFinder::saveSnapshot
+        unsigned long long supply_checksum_;
+
+        /// Empties the network supply, ID maps and weights, and the tables built from them
+        void clearSupply();
+
+        /// Builds PathFinder::schedule_ and the bump wait tables
+        void initializeStopTimes(const int*     stoptime_index,
+                                 const double*  stoptime_times,
+                                 int            num_stoptimes);
+
+        /// For PathFinder::CAPTURE_PATH_SPECS_, writes the capture supply files and opens the path specification capture file
+        void startCapture(const int*    stoptime_index,
+                          const double* stoptime_times,
+                          int           num_stoptimes);
+
+        /**
+         * A 64-bit FNV-1a checksum of everything the supply is built from: the intermediate files in
+         * PathFinder::output_dir_, the given stop times, and the goal direction parameters.
+         */
+        unsigned long long supplyChecksum(const int*    stoptime_index,
+                                          const double* stoptime_times,
+                                          int           num_stoptimes) const;
 
         /**
          * Read the intermediate files mapping integer IDs to strings
          * for modes, stops, trips, and routes.
          **/
         void readIntermediateFiles();
-        void readTripIds();
-        void readStopIds();
-        void readRouteIds();
-        void readModeIds();
+        /// Reads an intermediate file of ID numbers and ID strings into the given fasttrips::StringPool
+        void readIdFile(const char* filename, StringPool& names) const;
+        /// Reads the ID strings for tracing and the pathset file, if they haven't been read yet.  Thread-safe.
+        void loadNames() const;
         void readAccessLinks();
         void readTransferLinks();
         void readTripInfo();
         void readWeights();
 
+        /**
+         * Builds the lower bound tables for PathFinder::goalLowerBound, if GOAL_DIRECTION_ is configured.
+         *
+         * The relaxed network has an edge between consecutive stops of each trip weighted by the fastest
+         * scheduled hop, transfer links weighted by their walk time, and access/egress links weighted
+         * by their shortest time over supply modes.  Waiting is free and schedules are ignored, so a
+         * shortest time on this network never exceeds the deterministic cost of a real path.
+         */
+        void initializeGoalBounds();
+
+        /**
+         * Dijkstra over a relaxed network adjacency list, filling *dist* with the minimum time from
+         * *source* to each node (or infinity if unreachable).  TAZ nodes are only expanded if they're
+         * the source or if *through_taz* is true.
+         */
+        void goalBoundShortestTimes(const std::vector< std::vector< std::pair<int, float> > >& adjacency,
+                                    const std::vector<bool>& is_taz,
+                                    int source,
+                                    bool through_taz,
+                                    float* dist) const;
+
+        /**
+         * For deterministic path finding, a lower bound on the remaining cost from the given stop to the
+         * end TAZ (origin for outbound, destination for inbound).  The fasttrips::LabelStopQueue is
+         * ordered by cost plus this bound.
+         *
+         * @return the bound, or 0 if there's no goal direction or no information for the stop.
+         */
+        double goalLowerBound(const PathSpecification& path_spec,
+                              int stop_id) const;
+
         /**
          * Tally the link cost, which is the sum of the weighted attributes.
          * @return the cost.
@@ -339,13 +547,43 @@ namespace fasttrips {
                              const NamedWeights& weights,
                              const Attributes& attributes) const;
 
+        /**
+         * Labels and chooses a path for PathFinder::findPath.  This and the search methods it calls are
+         * templated on path_spec.trace_, path_spec.hyperpath_ and path_spec.outbound_, so that those
+         * checks are resolved at compile time; PathFinder::findPath picks the instantiation.
+         */
+        template <bool TRACE, bool HYPERPATH, bool OUTBOUND>
+        void searchPath(const PathSpecification& path_spec,
+                        std::ofstream&           trace_file,
+                        Path&                    path,
+                        PathInfo&                path_info,
+                        PerformanceInfo&         performance_info) const;
+
+        template <bool TRACE, bool HYPERPATH, bool OUTBOUND>
         void addStopState(const PathSpecification& path_spec,
                           std::ofstream& trace_file,
                           const int stop_id,
                           const StopState& ss,
                           StopStates& stop_states,
                           LabelStopQueue& label_stop_queue,
-                          HyperpathStopStates& hyperpath_ss) const;
+                          HyperpathStopStates& hyperpath_ss,
+                          PerformanceInfo& performance_info) const;
+
+        /**
+         * Hyperpath running logsum helpers.  Each stop keeps the sum of exp(-dispersion*cost) over its stop states
+         * relative to a reference cost, so that states can be added, replaced and removed without revisiting
+         * the others, and so the sum neither overflows nor underflows for large costs.
+         */
+        ///@{
+        /// Add a stop state cost to the running logsum.
+        void addHyperpathLogsumCost(HyperpathState& hss, double cost) const;
+        /// Remove a stop state cost from the running logsum.  @return false if the removal lost too much precision; use PathFinder::resetHyperpathLogsum.
+        bool removeHyperpathLogsumCost(HyperpathState& hss, double cost) const;
+        /// Recalculate the running logsum and the window bound from scratch.
+        void resetHyperpathLogsum(HyperpathState& hss, const std::vector<StopState>& stop_state, bool outbound) const;
+        /// @return the hyperpath cost, -1/dispersion * log(sum of exp(-dispersion*cost)), for the running logsum.
+        double hyperpathLogsumCost(const HyperpathState& hss) const;
+        ///@}
 
         /**
          * Initialize the stop states from the access (for inbound) or egress (for outbound) links
@@ -353,24 +591,28 @@ namespace fasttrips {
          *
          * @return success.  This method will only fail if there are no access/egress links for the starting TAZ.
          */
+        template <bool TRACE, bool HYPERPATH, bool OUTBOUND>
         bool initializeStopStates(const PathSpecification& path_spec,
                                   std::ofstream& trace_file,
                                   StopStates& stop_states,
                                   LabelStopQueue& cost_stop_queue,
-                                  HyperpathStopStates& hyperpath_ss) const;
+                                  HyperpathStopStates& hyperpath_ss,
+                                  PerformanceInfo&     performance_info) const;
 
         /**
          * Iterate through all the stops that transfer to(outbound)/from(inbound) the
          * *current_label_stop* and update the *stop_states* with information about how
          * accessible those stops are as a transfer to/from the *current_label_stop*.
          */
+        template <bool TRACE, bool HYPERPATH, bool OUTBOUND>
         void updateStopStatesForTransfers(const PathSpecification& path_spec,
                                   std::ofstream& trace_file,
                                   StopStates& stop_states,
                                   LabelStopQueue& label_stop_queue,
                                   HyperpathStopStates& hyperpath_ss,
                                   int label_iteration,
-                                  const LabelStop& current_label_stop) const;
+                                  const LabelStop& current_label_stop,
+                                  PerformanceInfo& performance_info) const;
 
         /**
          * Iterate through all the stops that are accessible by transit vehicle trip
@@ -378,6 +620,7 @@ namespace fasttrips {
          * with information about how accessible those stops are as a transit trip to/from
          * the *current_label_stop*.
          */
+        template <bool TRACE, bool HYPERPATH, bool OUTBOUND>
         void updateStopStatesForTrips(const PathSpecification& path_spec,
                                   std::ofstream& trace_file,
                                   StopStates& stop_states,
@@ -385,7 +628,19 @@ namespace fasttrips {
                                   HyperpathStopStates& hyperpath_ss,
                                   int label_iteration,
                                   const LabelStop& current_label_stop,
-                                  std::tr1::unordered_set<int>& trips_done) const;
+                                  TripsReached& trips_reached,
+                                  PerformanceInfo&              performance_info) const;
+
+        /**
+         * For deterministic path finding, collects the stops linked to the end TAZ (origin for outbound,
+         * destination for inbound) by access/egress links for the path's demand mode, along with the
+         * smallest link time for each.  These are the targets used by PathFinder::labelStops to stop
+         * labeling once the end TAZ is settled.
+         *
+         * @return false if there are no such links.
+         */
+        bool getEndTazTargets(const PathSpecification& path_spec,
+                              std::map<int, double>& target_access_time) const;
 
         /**
          * Label stops by:
@@ -393,13 +648,18 @@ namespace fasttrips {
          *     * pulling the lowest-labeled stop
          *     * adding the stops accessible by transfer (PathFinder::updateStopStatesForTransfers)
          *     * adding the stops accessible by transit trip (PathFinder::updateStopStatesForTrips)
+         *
+         * For deterministic path finding, labeling stops as soon as the lowest label in the
+         * label_stop_queue exceeds the best end TAZ cost found via a labeled target stop
+         * (see PathFinder::getEndTazTargets), since no remaining stop can improve on it.
          */
+        template <bool TRACE, bool HYPERPATH, bool OUTBOUND>
         int labelStops(const PathSpecification& path_spec,
                                   std::ofstream& trace_file,
                                   StopStates& stop_states,
                                   LabelStopQueue& label_stop_queue,
                                   HyperpathStopStates& hyperpath_ss,
-                                  int& max_process_count) const;
+                                  PerformanceInfo& performance_info) const;
 
         /**
          * This is like the reverse of PathFinder::initializeStopStates.
@@ -408,26 +668,51 @@ namespace fasttrips {
          *
          * @return sucess.
          */
+        template <bool TRACE, bool HYPERPATH, bool OUTBOUND>
         bool finalizeTazState(const PathSpecification& path_spec,
                               std::ofstream& trace_file,
                               StopStates& stop_states,
                               LabelStopQueue& label_stop_queue,
                               int label_iteration,
-                              HyperpathStopStates& hyperpath_ss) const;
+                              HyperpathStopStates& hyperpath_ss,
+                              PerformanceInfo&     performance_info) const;
 
         /**
          * Given all the labeled stops and taz, traces back and generates a
          * specific path.  We do this by setting up probabilities for each
-         * option and then choosing via PathFinder::chooseState.
+         * option and then choosing via PathFinder::chooseState.  The probabilities
+         * are memoized in *choice_cache* for the next paths generated.
          *
          * @return success
          */
+        template <bool TRACE, bool HYPERPATH, bool OUTBOUND>
         bool hyperpathGeneratePath(const PathSpecification& path_spec,
                                   std::ofstream& trace_file,
                                   const StopStates& stop_states,
                                   const HyperpathStopStates& hyperpath_ss,
+                                  HyperpathChoiceCache& choice_cache,
+                                  RandomStream& random_stream,
                                   Path& path) const;
 
+        /**
+         * Generates the paths for the given fasttrips::HyperpathDraws, counting repeats.
+         * Each attempt draws from its own fasttrips::RandomStream (seeded by the path ID and the attempt)
+         * so the result doesn't depend on how the attempts are split up.
+         */
+        template <bool TRACE, bool HYPERPATH, bool OUTBOUND>
+        void hyperpathGeneratePaths(HyperpathDraws& draws) const;
+
+        /// Thread function for PathFinder::hyperpathGeneratePaths; *draws* is a fasttrips::HyperpathDraws
+        template <bool TRACE, bool HYPERPATH, bool OUTBOUND>
+        static void hyperpathGeneratePathsThread(void* draws);
+
+        /**
+         * Fills in the alias table for the given choice from its fasttrips::ProbabilityStop instances.
+         * Each is drawn with probability proportional to its integerized probability (the difference
+         * in cumulative fasttrips::ProbabilityStop.prob_i_).
+         */
+        void buildAliasTable(HyperpathChoice& choice) const;
+
         /**
          * Given a set of paths, randomly selects one based on the cumulative
          * probability (fasttrips::PathInfo.prob_i_)
@@ -437,17 +722,18 @@ namespace fasttrips {
         Path choosePath(const PathSpecification& path_spec,
                         std::ofstream& trace_file,
                         PathSet& paths,
-                        int max_prob_i) const;
+                        int max_prob_i,
+                        RandomStream& random_stream) const;
         /**
-         * Given a vector of fasttrips::ProbabilityStop instances,
-         * randomly selects one based on the cumulative probability
-         * (fasttrips::ProbabilityStop.prob_i_)
+         * Given a fasttrips::HyperpathChoice with its alias table (see PathFinder::buildAliasTable),
+         * randomly selects one of its fasttrips::ProbabilityStop instances.
          *
          * @return the index_ from chosen ProbabilityStop.
          */
         size_t chooseState(const PathSpecification& path_spec,
                                   std::ofstream& trace_file,
-                                  const std::vector<ProbabilityStop>& prob_stops) const;
+                                  const HyperpathChoice& choice,
+                                  RandomStream& random_stream) const;
 
         /** Calculates the cost for the entire given path, and checks for capacity issues.
          *  Sets the results into the given fasttrips::PathInfo instance.
@@ -457,12 +743,23 @@ namespace fasttrips {
                                Path& path,
                                PathInfo& path_info) const;
 
+        template <bool TRACE, bool HYPERPATH, bool OUTBOUND>
         bool getFoundPath(const PathSpecification&      path_spec,
                           std::ofstream&                trace_file,
                           const StopStates&             stop_states,
                           const HyperpathStopStates&    hyperpath_ss,
                           Path&                         path,
-                          PathInfo&                     path_info) const;
+                          PathInfo&                     path_info,
+                          PerformanceInfo&              performance_info) const;
+
+        /// Finds the skims from one origin TAZ for PathFinder::findSkims into its row, skims
+        void findOriginSkims(const PathSpecification&   skim_spec,
+                             int                        origin_taz_id,
+                             const std::vector<int>&    destination_taz_ids,
+                             SkimInfo*                  skims) const;
+
+        /// Thread function for PathFinder::findSkims; *batch* is the fasttrips::SkimBatch of origins
+        static void findSkimsThread(void* batch);
 
         double getScheduledDeparture(int trip_id, int stop_id, int sequence) const;
         /**
@@ -487,6 +784,18 @@ namespace fasttrips {
 
         bool isTrip(const int& mode) const;
 
+        /**
+         * For PathFinder::CAPTURE_PATH_SPECS_, writes the parameters and the stop times to ft_capture_parameters.txt
+         * and ft_capture_stop_times.txt in the output directory, which with the intermediate files are what the
+         * ft_replay benchmark (src/replay.cpp) needs to load the network supply.
+         */
+        void writeCaptureSupply(const int*     stoptime_index,
+                                const double*  stoptime_times,
+                                int            num_stoptimes) const;
+
+        /// For PathFinder::CAPTURE_PATH_SPECS_, appends the path specification to ft_capture_path_specs[_workerXX].txt for replay.
+        void capturePathSpecification(const PathSpecification& path_spec) const;
+
     public:
         const static int MAX_DATETIME   = 48*60; // 48 hours in minutes
         const static double MAX_COST;
@@ -496,22 +805,28 @@ namespace fasttrips {
         PathFinder();
 
         /**
-         * Setup the path finding parameters.
+         * Setup the path finding parameters.  This should happen before PathFinder::initializeSupply
+         * since the goal direction bounds are built with the network supply.
          */
-        void initializeParameters(double     time_window,
-                                  double     bump_buffer,
-                                  int        stoch_pathset_size,
-                                  double     stoch_dispersion,
-                                  int        stoch_max_stop_process_count);
+        void initializeParameters(double            time_window,
+                                  double            bump_buffer,
+                                  int               stoch_pathset_size,
+                                  int               stoch_pathset_threads,
+                                  double            stoch_dispersion,
+                                  int               stoch_max_stop_process_count,
+                                  GoalDirectionType goal_direction,
+                                  int               goal_direction_landmarks,
+                                  bool              capture_path_specs,
+                                  bool              compact_schedule);
 
         /**
          * Setup the network supply.  This should happen once, before any pathfinding.
          *
          * @param output_dir        The directory in which to output trace files (if any)
          * @param process_num       The process number for this instance
-         * @param stoptime_index    For populating PathFinder::trip_stop_times_, this array contains
+         * @param stoptime_index    For populating PathFinder::schedule_, this array contains
          *                          trip IDs, sequence numbers and stop IDs
-         * @param stoptime_times    For populating PathFinder::trip_stop_times_, this array contains
+         * @param stoptime_times    For populating PathFinder::schedule_, this array contains
          *                          transit vehicle arrival times and departure times at a stop.
          * @param num_stoptimes     The number of stop times described in the previous two arrays.
          */
@@ -522,11 +837,39 @@ namespace fasttrips {
                               int           num_stoptimes);
 
         /**
-         * Setup the information for bumped passengers.
+         * Writes the network supply as PathFinder::initializeSupply or PathFinder::loadSnapshot left it
+         * (schedules, ID maps, access/egress and transfer links, trip info, weights
+         * and goal direction bounds) to a binary file that PathFinder::loadSnapshot can read back much
+         * faster than the supply can be built.  Bump waits and the path finding parameters aren't included.
+         *
+         * @return false if the file couldn't be written.
+         */
+        bool saveSnapshot(const char* snapshot_file) const;
+
+        /**
+         * Instead of PathFinder::initializeSupply, reads the network supply from a file written by
+         * PathFinder::saveSnapshot.  The arguments are the same as for PathFinder::initializeSupply, since
+         * the snapshot is only used if it was built from the same intermediate files in output_dir,
+         * stop times and goal direction parameters (see PathFinder::supplyChecksum).  Like
+         * PathFinder::initializeSupply, this should come after PathFinder::initializeParameters.
+         *
+         * @return true if the snapshot was read; otherwise the supply is empty and
+         *         PathFinder::initializeSupply is needed.
+         */
+        bool loadSnapshot(const char*   snapshot_file,
+                          const char*   output_dir,
+                          int           process_num,
+                          int*          stoptime_index,
+                          double*       stoptime_times,
+                          int           num_stoptimes);
+
+        /**
+         * Setup the information for bumped passengers.  This sets (or replaces) the bump waits
+         * for the given trip stops and leaves the others as they are.
          *
          * @param bw_index          For populating PathFinder::bump_wait_, this array contains the
          *                          fasttrips::TripStop fields.
-         * @param bw_data           For populating the PathFinder::bum_wait_, this contains the
+         * @param bw_data           For populating the PathFinder::bump_wait_, this contains the
          *                          arrival time of the first would-be waiting passenger
          * @param num_bw            The number of trip stops with bump waits described in the
          *                          previous two arrays.
@@ -535,6 +878,16 @@ namespace fasttrips {
                          double*    bw_data,
                          int        num_bw);
 
+        /**
+         * Clears the bump waits for the given trip stops, or all of them.
+         *
+         * @param bw_index          The fasttrips::TripStop fields of the trip stops to clear,
+         *                          or NULL to clear all of the bump waits.
+         * @param num_bw            The number of trip stops in bw_index.
+         */
+        void clearBumpWait(int*     bw_index,
+                           int      num_bw);
+
         /// Destructor
         ~PathFinder();
 
@@ -552,5 +905,67 @@ namespace fasttrips {
                       Path              &path,
                       PathInfo          &path_info,
                       PerformanceInfo   &performance_info) const;
+
+        /**
+         * A cheap guess at how expensive finding a path will be, for ordering a batch when there's
+         * no history for it: the number of access and egress links at its two TAZs, since those
+         * seed the labeling and bound the enumeration.
+         */
+        double estimatePathCost(const PathSpecification& path_spec) const;
+
+        /**
+         * Finds the paths for a batch of path specifications on num_threads threads.
+         *
+         * The most expensive path specifications go first (longest processing time first), so that
+         * a few long queries don't start last and leave the other threads idle.  They're dealt out
+         * to a queue per thread, and a thread that empties its own queue takes from the front of
+         * the next thread's queue that isn't empty (the most expensive left in that queue, though not
+         * necessarily in the batch).  Traced path specifications are found first, on the calling
+         * thread, since the trace files aren't shared between threads.
+         *
+         * With group_by_locality, path specifications with the same starting TAZ for the labeling, direction,
+         * preferred time bin (PathFinder::TIME_WINDOW_ wide) and user class are found one after another on
+         * the same thread, in preferred time order, so the access links and schedule they use stay in cache.
+         * The groups are split up as needed to keep the load balanced.  The results are in the order of
+         * path_specs either way.
+         *
+         * @param path_specs        The specifications of the paths to find
+         * @param cost_estimates    Per path specification, how expensive it's expected to be (e.g. its
+         *                          milliseconds last iteration), or negative if unknown; or NULL.
+         *                          Unknown ones use PathFinder::estimatePathCost, scaled to the known ones.
+         * @param group_by_locality Find path specifications that touch the same part of the network together
+         * @param num_threads       The number of threads to use
+         * @param paths             Returns the fasttrips::Path for each path specification
+         * @param path_infos        Returns the fasttrips::PathInfo for each path specification
+         * @param performance_infos Returns the fasttrips::PerformanceInfo for each path specification
+         */
+        void findPaths(const std::vector<PathSpecification>&    path_specs,
+                       const std::vector<double>*               cost_estimates,
+                       bool                                     group_by_locality,
+                       int                                      num_threads,
+                       std::vector<Path>&                       paths,
+                       std::vector<PathInfo>&                   path_infos,
+                       std::vector<PerformanceInfo>&            performance_infos) const;
+
+        /**
+         * Finds TAZ to TAZ skims: for each origin TAZ, labels every stop reachable from it once, departing
+         * at the preferred time (as an inbound deterministic path specification does), and then finds the
+         * deterministic path to each destination TAZ from those labels.  The origins are spread over
+         * num_threads threads.
+         *
+         * @param skim_spec             The user class, modes and preferred (departure) time; the TAZs,
+         *                              direction and search type are ignored
+         * @param origin_taz_ids        The origin TAZs
+         * @param destination_taz_ids   The destination TAZs
+         * @param num_threads           The number of threads to use
+         * @param skims                 Returns the fasttrips::SkimInfo for each origin (row) and destination
+         *                              (column), row-major.  There's no path from a TAZ to itself.
+         */
+        void findSkims(const PathSpecification&     skim_spec,
+                       const std::vector<int>&      origin_taz_ids,
+                       const std::vector<int>&      destination_taz_ids,
+                       int                          num_threads,
+                       std::vector<SkimInfo>&       skims) const;
+
     };
 }
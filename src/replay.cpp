@@ -0,0 +1,221 @@
+/**
+ * \file replay.cpp
+ *
+ * ft_replay: benchmarks the C++ path finding without Python by replaying captured path specifications.
+ *
+ * Run fast-trips with capture_path_specifications = True to write the ft_capture_* files next to the
+ * ft_intermediate_* files in the output directory, build with `python setup.py build_replay`, and then
+ *
+ *     ft_replay <output_dir> [path_specs_file [num_threads [group_by_locality [save_snapshot]]]]
+ *
+ * The path specifications file defaults to ft_capture_path_specs.txt in the output directory, and
+ * group_by_locality (0 or 1, see fasttrips::PathFinder::findPaths) defaults to 0.  The supply is read from
+ * ft_supply_snapshot.bin in the output directory when it's up to date (see fasttrips::PathFinder::loadSnapshot,
+ * and the supply_snapshot option of fast-trips), and otherwise built.  With save_snapshot 1 (default 0) a
+ * supply that had to be built is written there for the next replay.  Tracing is
+ * turned off for the replay, bump waits are not replayed, and stochastic queries append to ft_pathset.txt
+ * in the output directory like a fast-trips run does.
+ */
+
+#include "pathfinder.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <algorithm>
+#include <sstream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+
+#ifdef _WIN32
+const char kPathSeparator = '\\';
+#else
+const char kPathSeparator = '/';
+#endif
+
+/// @return the wall clock time in seconds
+static double wallSeconds()
+{
+#ifdef _WIN32
+    LARGE_INTEGER frequency, now;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&now);
+    return static_cast<double>(now.QuadPart)/frequency.QuadPart;
+#else
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return now.tv_sec + 0.000001*now.tv_usec;
+#endif
+}
+
+/// @return the peak resident memory of this process in megabytes
+static double peakMegabytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) { return 0; }
+    return counters.PeakWorkingSetSize/(1024.0*1024.0);
+#elif defined(__APPLE__)
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss/(1024.0*1024.0);   // bytes
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss/1024.0;            // kilobytes
+#endif
+}
+
+/// Prints the p50, p95, p99 and max of the given milliseconds
+static void printPercentiles(const char* name, std::vector<double>& milliseconds)
+{
+    std::sort(milliseconds.begin(), milliseconds.end());
+    double pct[3] = { 0.50, 0.95, 0.99 };
+    printf("%-12s", name);
+    for (int p = 0; p < 3; ++p) {
+        // nearest rank
+        size_t rank = static_cast<size_t>(pct[p]*milliseconds.size() + 0.999999);
+        if (rank < 1) { rank = 1; }
+        printf(" %10.3f", milliseconds[rank-1]);
+    }
+    printf(" %10.3f\n", milliseconds.back());
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s output_dir [path_specs_file [num_threads [group_by_locality [save_snapshot]]]]\n", argv[0]);
+        return 2;
+    }
+    std::string output_dir(argv[1]);
+    std::string path_specs_filename = (argc > 2) ? std::string(argv[2]) : output_dir + kPathSeparator + "ft_capture_path_specs.txt";
+    int         num_threads         = (argc > 3) ? atoi(argv[3]) : 1;
+    if (num_threads < 1) { num_threads = 1; }
+    bool        group_by_locality   = (argc > 4) ? (atoi(argv[4]) != 0) : false;
+    bool        save_snapshot       = (argc > 5) ? (atoi(argv[5]) != 0) : false;
+
+    // parameters
+    std::map<std::string, double> params;
+    std::string param_filename = output_dir + kPathSeparator + "ft_capture_parameters.txt";
+    std::ifstream param_file(param_filename.c_str());
+    if (!param_file.is_open()) {
+        fprintf(stderr, "Couldn't open %s\n", param_filename.c_str());
+        return 1;
+    }
+    std::string param_name, param_value;
+    param_file >> param_name >> param_value; // header
+    double value;
+    while (param_file >> param_name >> value) { params[param_name] = value; }
+    param_file.close();
+
+    fasttrips::PathFinder pathfinder;
+    pathfinder.initializeParameters(params["time_window"],
+                                    params["bump_buffer"],
+                                    static_cast<int>(params["stoch_pathset_size"]),
+                                    static_cast<int>(params["stoch_pathset_threads"]),
+                                    params["stoch_dispersion"],
+                                    static_cast<int>(params["stoch_max_stop_process_count"]),
+                                    static_cast<fasttrips::GoalDirectionType>(static_cast<int>(params["goal_direction"])),
+                                    static_cast<int>(params["goal_direction_landmarks"]),
+                                    false,
+                                    (params["compact_schedule"] != 0));
+
+    // stop times
+    std::vector<int>    stoptime_index;
+    std::vector<double> stoptime_times;
+    std::string stoptimes_filename = output_dir + kPathSeparator + "ft_capture_stop_times.txt";
+    std::ifstream stoptimes_file(stoptimes_filename.c_str());
+    if (!stoptimes_file.is_open()) {
+        fprintf(stderr, "Couldn't open %s\n", stoptimes_filename.c_str());
+        return 1;
+    }
+    std::string header;
+    std::getline(stoptimes_file, header);
+    int    trip_id, seq, stop_id;
+    double arrive_time, depart_time;
+    while (stoptimes_file >> trip_id >> seq >> stop_id >> arrive_time >> depart_time) {
+        stoptime_index.push_back(trip_id);
+        stoptime_index.push_back(seq);
+        stoptime_index.push_back(stop_id);
+        stoptime_times.push_back(arrive_time);
+        stoptime_times.push_back(depart_time);
+    }
+    stoptimes_file.close();
+    if (stoptime_times.size() == 0) {
+        fprintf(stderr, "No stop times in %s\n", stoptimes_filename.c_str());
+        return 1;
+    }
+
+    // from the supply snapshot if it's up to date, otherwise built (and snapshotted for next time if asked)
+    std::string snapshot_filename = output_dir + kPathSeparator + "ft_supply_snapshot.bin";
+    double supply_start = wallSeconds();
+    bool from_snapshot  = pathfinder.loadSnapshot(snapshot_filename.c_str(), output_dir.c_str(), 0, &stoptime_index[0], &stoptime_times[0],
+                                                  static_cast<int>(stoptime_times.size()/2));
+    if (!from_snapshot) {
+        pathfinder.initializeSupply(output_dir.c_str(), 0, &stoptime_index[0], &stoptime_times[0], static_cast<int>(stoptime_times.size()/2));
+    }
+    printf("Initialized supply%s in %.3f seconds; %.1f MB peak memory\n", from_snapshot ? " from snapshot" : "",
+           wallSeconds() - supply_start, peakMegabytes());
+    if (!from_snapshot && save_snapshot) { pathfinder.saveSnapshot(snapshot_filename.c_str()); }
+
+    // path specifications
+    std::vector<fasttrips::PathSpecification> path_specs;
+    std::ifstream path_specs_file(path_specs_filename.c_str());
+    if (!path_specs_file.is_open()) {
+        fprintf(stderr, "Couldn't open %s\n", path_specs_filename.c_str());
+        return 1;
+    }
+    std::getline(path_specs_file, header);
+    fasttrips::PathSpecification path_spec;
+    int hyperpath_i, outbound_i, trace_i;
+    while (path_specs_file >> path_spec.iteration_ >> path_spec.passenger_id_ >> path_spec.path_id_ >> hyperpath_i
+                           >> path_spec.user_class_ >> path_spec.access_mode_ >> path_spec.transit_mode_ >> path_spec.egress_mode_
+                           >> path_spec.origin_taz_id_ >> path_spec.destination_taz_id_ >> outbound_i
+                           >> path_spec.preferred_time_ >> trace_i) {
+        path_spec.hyperpath_ = (hyperpath_i != 0);
+        path_spec.outbound_  = (outbound_i  != 0);
+        path_spec.trace_     = false;
+        path_specs.push_back(path_spec);
+    }
+    path_specs_file.close();
+    if (path_specs.size() == 0) {
+        fprintf(stderr, "No path specifications in %s\n", path_specs_filename.c_str());
+        return 1;
+    }
+
+    // replay
+    std::vector<fasttrips::Path>            paths;
+    std::vector<fasttrips::PathInfo>        path_infos;
+    std::vector<fasttrips::PerformanceInfo> performance;
+    double replay_start   = wallSeconds();
+    pathfinder.findPaths(path_specs, NULL, group_by_locality, num_threads, paths, path_infos, performance);
+    double replay_seconds = wallSeconds() - replay_start;
+
+    // report
+    std::vector<double> labeling_ms, enumerating_ms, total_ms;
+    long label_iterations = 0;
+    for (size_t ind = 0; ind < performance.size(); ++ind) {
+        labeling_ms.push_back(performance[ind].milliseconds_labeling_);
+        enumerating_ms.push_back(performance[ind].milliseconds_enumerating_);
+        total_ms.push_back(performance[ind].milliseconds_labeling_ + performance[ind].milliseconds_enumerating_);
+        label_iterations += performance[ind].label_iterations_;
+    }
+    printf("Replayed %d path specifications from %s on %d thread%s\n", static_cast<int>(path_specs.size()),
+           path_specs_filename.c_str(), num_threads, (num_threads == 1 ? "" : "s"));
+    printf("%.3f seconds; %.1f paths per second; %ld label iterations; %.1f MB peak memory\n", replay_seconds,
+           path_specs.size()/replay_seconds, label_iterations, peakMegabytes());
+    printf("milliseconds        p50        p95        p99        max\n");
+    printPercentiles("labeling",    labeling_ms);
+    printPercentiles("enumerating", enumerating_ms);
+    printPercentiles("total",       total_ms);
+    return 0;
+}
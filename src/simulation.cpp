@@ -0,0 +1,241 @@
+#include "simulation.h"
+
+#include <algorithm>
+#include <queue>
+#include <set>
+#include <sstream>
+
+namespace fasttrips {
+
+    /// Orders bump candidates (leg indices) as fasttrips.Assignment.simulate did
+    struct BumpCandidateCompare {
+        const std::vector<PassengerLeg>*    legs_;
+        const std::vector<double>*          stop_arrive_time_;
+        const std::vector<int>*             trip_id_;
+        const std::vector<int>*             seq_;
+
+        bool operator()(int leg1, int leg2) const {
+            const PassengerLeg& l1 = (*legs_)[leg1];
+            const PassengerLeg& l2 = (*legs_)[leg2];
+            int st1 = l1.board_stoptime_;
+            int st2 = l2.board_stoptime_;
+            // the stop: vehicle arrival time, trip, sequence
+            if ((*stop_arrive_time_)[st1] != (*stop_arrive_time_)[st2]) { return (*stop_arrive_time_)[st1] < (*stop_arrive_time_)[st2]; }
+            if ((*trip_id_)[st1]          != (*trip_id_)[st2]         ) { return (*trip_id_)[st1]          < (*trip_id_)[st2];          }
+            if ((*seq_)[st1]              != (*seq_)[st2]             ) { return (*seq_)[st1]              < (*seq_)[st2];              }
+            // at the stop: later arrivals, then later trip list IDs, get bumped first
+            if (l1.arrive_time_  != l2.arrive_time_ ) { return l1.arrive_time_  > l2.arrive_time_;  }
+            if (l1.trip_list_id_ != l2.trip_list_id_) { return l1.trip_list_id_ > l2.trip_list_id_; }
+            return leg1 < leg2;
+        }
+    };
+
+    /// For the heap of stop times over capacity: orders stop times by vehicle arrival time, trip and sequence, latest on the bottom
+    struct StopTimeLaterCompare {
+        const std::vector<double>*          arrive_time_;
+        const std::vector<int>*             trip_id_;
+        const std::vector<int>*             seq_;
+
+        bool operator()(int st1, int st2) const {
+            if ((*arrive_time_)[st1] != (*arrive_time_)[st2]) { return (*arrive_time_)[st1] > (*arrive_time_)[st2]; }
+            if ((*trip_id_)[st1]     != (*trip_id_)[st2]    ) { return (*trip_id_)[st1]     > (*trip_id_)[st2];     }
+            return (*seq_)[st1] > (*seq_)[st2];
+        }
+    };
+
+    CapacitySimulation::CapacitySimulation()
+    {}
+
+    CapacitySimulation::~CapacitySimulation()
+    {}
+
+    void CapacitySimulation::initializeStopTimes(
+        const int*      stoptime_index,
+        const double*   stoptime_times,
+        const int*      capacity,
+        int             num_stoptimes)
+    {
+        trip_id_.resize(num_stoptimes);
+        seq_.resize(num_stoptimes);
+        stop_id_.resize(num_stoptimes);
+        arrive_time_.resize(num_stoptimes);
+        capacity_.assign(num_stoptimes, -1);
+        trip_stoptimes_.clear();
+
+        for (int i=0; i<num_stoptimes; ++i) {
+            trip_id_[i]     = stoptime_index[3*i];
+            seq_[i]         = stoptime_index[3*i+1];
+            stop_id_[i]     = stoptime_index[3*i+2];
+            arrive_time_[i] = stoptime_times[2*i];
+            if (capacity) { capacity_[i] = capacity[i]; }
+
+            if (seq_[i] < 1) {
+                std::ostringstream ss;
+                ss << "Stop time " << i << " for trip " << trip_id_[i] << " has sequence " << seq_[i] << "; sequences start at 1";
+                throw SimulationError(ss.str());
+            }
+            std::vector<int>& stoptimes = trip_stoptimes_[trip_id_[i]];
+            if (static_cast<int>(stoptimes.size()) < seq_[i]) { stoptimes.resize(seq_[i], -1); }
+            stoptimes[seq_[i]-1] = i;
+        }
+
+        next_stoptime_.assign(num_stoptimes, -1);
+        for (std::map<int, std::vector<int> >::const_iterator trip_iter = trip_stoptimes_.begin();
+             trip_iter != trip_stoptimes_.end(); ++trip_iter) {
+            int prev_st = -1;
+            for (size_t ind=0; ind<trip_iter->second.size(); ++ind) {
+                int st = trip_iter->second[ind];
+                if (st < 0) { continue; }
+                if (prev_st >= 0) { next_stoptime_[prev_st] = st; }
+                prev_st = st;
+            }
+        }
+    }
+
+    int CapacitySimulation::stopTimeIndex(int trip_id, int seq) const
+    {
+        std::map<int, std::vector<int> >::const_iterator trip_iter = trip_stoptimes_.find(trip_id);
+        if ((trip_iter != trip_stoptimes_.end()) && (seq >= 1) && (seq <= static_cast<int>(trip_iter->second.size())) &&
+            (trip_iter->second[seq-1] >= 0)) {
+            return trip_iter->second[seq-1];
+        }
+        std::ostringstream ss;
+        ss << "No stop time for trip " << trip_id << " sequence " << seq;
+        throw SimulationError(ss.str());
+    }
+
+    void CapacitySimulation::simulate(
+        const int*          leg_index,
+        const double*       leg_arrive_times,
+        int                 num_legs,
+        bool                capacity_constraint,
+        bool                bump_one_at_a_time,
+        SimulationResult&   result) const
+    {
+        int num_stoptimes = static_cast<int>(trip_id_.size());
+        std::vector<PassengerLeg>           legs(num_legs);
+        std::map<int, std::vector<int> >    trip_list_legs;
+        std::vector<std::vector<int> >      boarding_legs(num_stoptimes);
+        for (int leg=0; leg<num_legs; ++leg) {
+            legs[leg].trip_list_id_     = leg_index[4*leg];
+            legs[leg].board_stoptime_   = stopTimeIndex(leg_index[4*leg+1], leg_index[4*leg+2]);
+            legs[leg].alight_stoptime_  = stopTimeIndex(leg_index[4*leg+1], leg_index[4*leg+3]);
+            legs[leg].arrive_time_      = leg_arrive_times[leg];
+            if (seq_[legs[leg].alight_stoptime_] <= seq_[legs[leg].board_stoptime_]) {
+                std::ostringstream ss;
+                ss << "Trip list " << legs[leg].trip_list_id_ << " alights trip " << leg_index[4*leg+1]
+                   << " at sequence " << leg_index[4*leg+3] << ", not after boarding at " << leg_index[4*leg+2];
+                throw SimulationError(ss.str());
+            }
+            trip_list_legs[legs[leg].trip_list_id_].push_back(leg);
+            boarding_legs[legs[leg].board_stoptime_].push_back(leg);
+        }
+
+        // Put passenger paths on transit vehicles to get vehicle boards/alights/load
+        LoadLedger ledger(next_stoptime_, capacity_);
+        for (int leg=0; leg<num_legs; ++leg) {
+            ledger.addLeg(legs[leg]);
+        }
+        std::vector<bool> active_legs(num_legs, true);
+
+        result.bumped_legs_.clear();
+        result.bump_wait_legs_.clear();
+        result.bump_iterations_ = 0;
+
+        if (capacity_constraint) {
+            // Stop times over capacity, earliest vehicle arrival on top.  Bumping only removes passengers,
+            // so no stop time goes over capacity after this; entries that no longer are get skipped.
+            std::vector<int> over_capacity;
+            ledger.takeOverCapacity(over_capacity);
+            StopTimeLaterCompare later = { &arrive_time_, &trip_id_, &seq_ };
+            std::priority_queue<int, std::vector<int>, StopTimeLaterCompare> overcap_heap(later, over_capacity);
+
+            while (true) {
+                // the first stop over capacity on each trip (or just the earliest one) gets bumped
+                std::vector<int> bump_stoptimes, still_over;
+                std::set<int>    bump_trips;
+                while (!overcap_heap.empty()) {
+                    int st = overcap_heap.top();
+                    overcap_heap.pop();
+                    if (ledger.overCapacity(st) == 0) { continue; }
+                    if (bump_trips.insert(trip_id_[st]).second) {
+                        bump_stoptimes.push_back(st);
+                        // One stop at a time -- slower but more accurate
+                        if (bump_one_at_a_time) { break; }
+                    } else {
+                        still_over.push_back(st);
+                    }
+                }
+                if (bump_stoptimes.size() == 0) { break; }
+
+                int num_bumped = bumpPassengers(legs, bump_stoptimes, boarding_legs, trip_list_legs, active_legs, ledger, result);
+                if (num_bumped == 0) { break; }
+                result.bump_iterations_ += 1;
+
+                for (size_t ind=0; ind<still_over.size(); ++ind) {
+                    if (ledger.overCapacity(still_over[ind]) > 0) { overcap_heap.push(still_over[ind]); }
+                }
+                for (size_t ind=0; ind<bump_stoptimes.size(); ++ind) {
+                    if (ledger.overCapacity(bump_stoptimes[ind]) > 0) { overcap_heap.push(bump_stoptimes[ind]); }
+                }
+            }
+        }
+
+        result.boards_  = ledger.boards();
+        result.alights_ = ledger.alights();
+        result.onboard_ = ledger.onboard();
+    }
+
+    int CapacitySimulation::bumpPassengers(
+        const std::vector<PassengerLeg>&        legs,
+        const std::vector<int>&                 bump_stoptimes,
+        const std::vector<std::vector<int> >&   boarding_legs,
+        const std::map<int, std::vector<int> >& trip_list_legs,
+        std::vector<bool>&                      active_legs,
+        LoadLedger&                             ledger,
+        SimulationResult&                       result) const
+    {
+        // who boards at those stops, and how many are problematic at each
+        std::map<int, int> overcap;
+        std::vector<int>   candidates;
+        for (size_t ind=0; ind<bump_stoptimes.size(); ++ind) {
+            int st = bump_stoptimes[ind];
+            overcap[st] = ledger.overCapacity(st);
+            for (size_t board_ind=0; board_ind<boarding_legs[st].size(); ++board_ind) {
+                if (active_legs[boarding_legs[st][board_ind]]) { candidates.push_back(boarding_legs[st][board_ind]); }
+            }
+        }
+        BumpCandidateCompare compare = { &legs, &arrive_time_, &trip_id_, &seq_ };
+        std::sort(candidates.begin(), candidates.end(), compare);
+
+        // the first overcap at each stop, once per passenger path
+        std::set<int>       bumped_trip_lists;
+        std::map<int, int>  bump_count;
+        std::vector<int>    bumped_legs;
+        for (size_t ind=0; ind<candidates.size(); ++ind) {
+            const PassengerLeg& leg = legs[candidates[ind]];
+            int& count = bump_count[leg.board_stoptime_];
+            if (count >= overcap[leg.board_stoptime_]) { continue; }
+            count += 1;
+            if (!bumped_trip_lists.insert(leg.trip_list_id_).second) { continue; }
+            bumped_legs.push_back(candidates[ind]);
+        }
+
+        // kick out the bumped passenger paths; the first bumped at each stop is waiting for the vehicle
+        std::set<int> bump_wait_stoptimes;
+        for (size_t ind=0; ind<bumped_legs.size(); ++ind) {
+            const PassengerLeg& leg = legs[bumped_legs[ind]];
+            result.bumped_legs_.push_back(bumped_legs[ind]);
+            if (bump_wait_stoptimes.insert(leg.board_stoptime_).second) {
+                result.bump_wait_legs_.push_back(bumped_legs[ind]);
+            }
+            const std::vector<int>& path_legs = trip_list_legs.find(leg.trip_list_id_)->second;
+            for (size_t path_ind=0; path_ind<path_legs.size(); ++path_ind) {
+                if (!active_legs[path_legs[path_ind]]) { continue; }
+                ledger.removeLeg(legs[path_legs[path_ind]]);
+                active_legs[path_legs[path_ind]] = false;
+            }
+        }
+        return static_cast<int>(bumped_legs.size());
+    }
+}
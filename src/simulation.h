@@ -0,0 +1,177 @@
+/**
+ * \file simulation.h
+ *
+ * Defines the C++ that puts passenger paths onto transit vehicles for fast-trips: vehicle loads
+ * and, with a capacity constraint, which passengers get bumped.
+ */
+
+#include <map>
+#include <vector>
+#include <stdexcept>
+#include <string>
+
+namespace fasttrips {
+
+    class SimulationError : public std::runtime_error {
+    public:
+        SimulationError(const std::string& what_arg): std::runtime_error(what_arg) {}
+        SimulationError(const char* what_arg): std::runtime_error(what_arg) {}
+        virtual ~SimulationError() throw() {}
+    };
+
+    /// A passenger's ride on a transit vehicle trip, boarding and alighting at stop times
+    typedef struct {
+        int     trip_list_id_;          ///< The passenger path (trip list ID number) this leg is a part of
+        int     board_stoptime_;        ///< Index of the stop time where the passenger boards
+        int     alight_stoptime_;       ///< Index of the stop time where the passenger alights
+        double  arrive_time_;           ///< Time the passenger arrives at the boarding stop, minutes after midnight
+    } PassengerLeg;
+
+    /// The results of CapacitySimulation::simulate
+    typedef struct {
+        std::vector<int>    boards_;            ///< Per stop time, number of passengers boarding
+        std::vector<int>    alights_;           ///< Per stop time, number of passengers alighting
+        std::vector<int>    onboard_;           ///< Per stop time, number of passengers on board after departing
+        std::vector<int>    bumped_legs_;       ///< Index of a leg of each bumped passenger path, where it was bumped
+        std::vector<int>    bump_wait_legs_;    ///< Per stop time where passengers were bumped, the leg of the first one bumped
+        int                 bump_iterations_;   ///< Number of times passengers were bumped
+    } SimulationResult;
+
+    /**
+     * Vehicle loads by stop time, kept up to date as passenger legs are added and removed so that
+     * bumping a few passengers costs the length of their legs rather than a pass over every stop time.
+     */
+    class LoadLedger
+    {
+    private:
+        const std::vector<int>& next_stoptime_;     ///< Per stop time, the next stop time on the trip (or -1)
+        const std::vector<int>& capacity_;          ///< Per stop time, the vehicle capacity (negative for none)
+        std::vector<int>        boards_;
+        std::vector<int>        alights_;
+        std::vector<int>        onboard_;
+        std::vector<int>        over_capacity_;     ///< Stop times that went over capacity since the last takeOverCapacity()
+
+    public:
+        LoadLedger(const std::vector<int>& next_stoptime, const std::vector<int>& capacity) :
+            next_stoptime_(next_stoptime), capacity_(capacity),
+            boards_(capacity.size(), 0), alights_(capacity.size(), 0), onboard_(capacity.size(), 0) {}
+
+        /// Puts the leg on its vehicle: +1 boarding, +1 alighting, and +1 on board in between
+        void addLeg(const PassengerLeg& leg) {
+            boards_ [leg.board_stoptime_ ] += 1;
+            alights_[leg.alight_stoptime_] += 1;
+            for (int st = leg.board_stoptime_; (st >= 0) && (st != leg.alight_stoptime_); st = next_stoptime_[st]) {
+                onboard_[st] += 1;
+                if ((capacity_[st] >= 0) && (onboard_[st] == capacity_[st] + 1)) { over_capacity_.push_back(st); }
+            }
+        }
+
+        /// Takes the leg off of its vehicle
+        void removeLeg(const PassengerLeg& leg) {
+            boards_ [leg.board_stoptime_ ] -= 1;
+            alights_[leg.alight_stoptime_] -= 1;
+            for (int st = leg.board_stoptime_; (st >= 0) && (st != leg.alight_stoptime_); st = next_stoptime_[st]) {
+                onboard_[st] -= 1;
+            }
+        }
+
+        /// @return how many passengers over capacity the vehicle is when departing the stop time (0 if not)
+        int overCapacity(int stoptime) const {
+            if ((capacity_[stoptime] < 0) || (onboard_[stoptime] <= capacity_[stoptime])) { return 0; }
+            return onboard_[stoptime] - capacity_[stoptime];
+        }
+
+        /// Moves the stop times that went over capacity since the last call into the given vector
+        void takeOverCapacity(std::vector<int>& stoptimes) {
+            stoptimes.insert(stoptimes.end(), over_capacity_.begin(), over_capacity_.end());
+            over_capacity_.clear();
+        }
+
+        const std::vector<int>& boards()  const { return boards_;  }
+        const std::vector<int>& alights() const { return alights_; }
+        const std::vector<int>& onboard() const { return onboard_; }
+    };
+
+    /**
+     * Puts passenger paths onto transit vehicles.  This replaces the pandas groupby/merge/cumsum
+     * capacity loop in fasttrips.Assignment.simulate.
+     *
+     * The stop times are the same arrays as given to PathFinder::initializeSupply, so the stop
+     * time index here is the row of the stop times (and vehicle trips) dataframe.
+     */
+    class CapacitySimulation
+    {
+    private:
+        /** @name Stop times, indexed by stop time */
+        ///@{
+        std::vector<int>    trip_id_;
+        std::vector<int>    seq_;
+        std::vector<int>    stop_id_;
+        std::vector<double> arrive_time_;
+        std::vector<int>    capacity_;          ///< negative for no capacity
+        std::vector<int>    next_stoptime_;     ///< the next stop time on the trip, or -1 for the last
+        ///@}
+
+        /// Trip id -> stop time indices for the trip, in sequence order
+        std::map<int, std::vector<int> > trip_stoptimes_;
+
+        /**
+         * Bumps the passengers boarding after their vehicle is full at the given stop times, as
+         * fasttrips.Assignment.simulate did: at each stop, the latest arriving (and then the highest
+         * trip list ID) are bumped first.  Their paths are removed from the ledger.
+         *
+         * @return the number of passenger paths bumped.
+         */
+        int bumpPassengers(const std::vector<PassengerLeg>&         legs,
+                           const std::vector<int>&                  bump_stoptimes,
+                           const std::vector<std::vector<int> >&    boarding_legs,
+                           const std::map<int, std::vector<int> >&  trip_list_legs,
+                           std::vector<bool>&                       active_legs,
+                           LoadLedger&                              ledger,
+                           SimulationResult&                        result) const;
+
+    public:
+        /// Constructor
+        CapacitySimulation();
+        /// Destructor
+        ~CapacitySimulation();
+
+        /**
+         * Keeps the stop times and vehicle capacities.
+         *
+         * @param stoptime_index    3*num_stoptimes ints: trip id, sequence, stop id, as for PathFinder::initializeSupply
+         * @param stoptime_times    2*num_stoptimes doubles: arrival time, departure time, as for PathFinder::initializeSupply
+         * @param capacity          num_stoptimes vehicle capacities (negative for none), or NULL for no capacities
+         * @param num_stoptimes     Number of stop times
+         */
+        void initializeStopTimes(const int*     stoptime_index,
+                                 const double*  stoptime_times,
+                                 const int*     capacity,
+                                 int            num_stoptimes);
+
+        /// @return the stop time index for the given trip and stop sequence; throws fasttrips::SimulationError if there isn't one
+        int stopTimeIndex(int trip_id, int seq) const;
+
+        /**
+         * Puts the passenger legs on the vehicles and, if capacity_constraint, bumps passenger paths
+         * until no vehicle is over capacity.
+         *
+         * The loads are kept in a fasttrips::LoadLedger, and the stop times over capacity in a heap
+         * ordered by vehicle arrival time, so each bump iteration only costs the bumped passengers'
+         * legs and the stops over capacity.
+         *
+         * @param leg_index         4*num_legs ints: trip list id, trip id, board sequence, alight sequence
+         * @param leg_arrive_times  num_legs doubles: the passenger's arrival time at the boarding stop
+         * @param num_legs          Number of passenger legs
+         * @param capacity_constraint   Bump passengers so vehicles aren't over capacity
+         * @param bump_one_at_a_time    See <a href="_generated/fasttrips.Assignment.html#fasttrips.Assignment.BUMP_ONE_AT_A_TIME">fasttrips.Assignment.BUMP_ONE_AT_A_TIME</a>
+         * @param result            The loads and bumped passengers
+         */
+        void simulate(const int*        leg_index,
+                      const double*     leg_arrive_times,
+                      int               num_legs,
+                      bool              capacity_constraint,
+                      bool              bump_one_at_a_time,
+                      SimulationResult& result) const;
+    };
+}